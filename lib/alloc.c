@@ -0,0 +1,145 @@
+/* alloc.c --- Memory allocation functions used by the library.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "internal.h"
+
+/* All memory that the library allocates itself goes through the
+   functions below, so that applications can replace the allocator
+   with gss_set_allocator.  Memory allocated by Shishi is released
+   with free, as before.
+
+   The pools that the Kerberos V5 mechanism keeps for the life of the
+   process, of Shishi handles in lib/krb5/thread.c and of handles and
+   service tickets in lib/krb5/handles.c, use malloc and free instead.
+   They are shared by all contexts and threads, so they must stay
+   valid when an allocator that releases its memory in bulk, such as
+   a per-request arena, is installed or reset. */
+
+static void *(*gss_malloc_func) (size_t) = malloc;
+static void *(*gss_realloc_func) (void *, size_t) = realloc;
+static void (*gss_free_func) (void *) = free;
+
+/**
+ * gss_set_allocator:
+ * @minor_status: (integer, modify) Mechanism specific status code.
+ * @malloc_func: (function, read, optional) Replacement for malloc().
+ * @realloc_func: (function, read, optional) Replacement for realloc().
+ * @free_func: (function, read, optional) Replacement for free().
+ *
+ * Make the library use the given functions for all memory it
+ * allocates, including buffers, names, OID sets and other objects
+ * handed out to the application.  gss_release_buffer(),
+ * gss_release_name(), gss_release_oid_set() and the other release
+ * functions then call @free_func.  Either all three functions must
+ * be given, or all must be NULL to restore the C library allocator.
+ *
+ * The functions must be thread safe if the library is used from
+ * several threads.  As memory has to be released with the allocator
+ * it came from, the allocator should only be replaced before any
+ * other GSS function is called, or after all objects from the
+ * previous allocator have been released.  Memory that the library
+ * keeps for its own use across contexts, such as the Kerberos V5
+ * mechanism's pool of credential handles, is always allocated with
+ * the C library allocator.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_FAILURE`: Some, but not all, of the functions were NULL.
+ **/
+OM_uint32
+gss_set_allocator (OM_uint32 * minor_status,
+		   void *(*malloc_func) (size_t),
+		   void *(*realloc_func) (void *, size_t),
+		   void (*free_func) (void *))
+{
+  if (minor_status)
+    *minor_status = 0;
+
+  if (!malloc_func && !realloc_func && !free_func)
+    {
+      malloc_func = malloc;
+      realloc_func = realloc;
+      free_func = free;
+    }
+  else if (!malloc_func || !realloc_func || !free_func)
+    return GSS_S_FAILURE;
+
+  gss_malloc_func = malloc_func;
+  gss_realloc_func = realloc_func;
+  gss_free_func = free_func;
+
+  return GSS_S_COMPLETE;
+}
+
+void *
+_gss_malloc (size_t size)
+{
+  return gss_malloc_func (size);
+}
+
+void *
+_gss_calloc (size_t nmemb, size_t size)
+{
+  void *p;
+
+  if (size && nmemb > (size_t) -1 / size)
+    {
+      errno = ENOMEM;
+      return NULL;
+    }
+
+  p = gss_malloc_func (nmemb * size);
+  if (p)
+    memset (p, 0, nmemb * size);
+
+  return p;
+}
+
+void *
+_gss_realloc (void *ptr, size_t size)
+{
+  return gss_realloc_func (ptr, size);
+}
+
+void
+_gss_free (void *ptr)
+{
+  if (ptr)
+    gss_free_func (ptr);
+}
+
+char *
+_gss_strdup (const char *s)
+{
+  size_t len = strlen (s) + 1;
+  char *p = gss_malloc_func (len);
+
+  if (p)
+    memcpy (p, s, len);
+
+  return p;
+}
@@ -103,28 +103,44 @@ _gss_asn1_get_length_der (const char *der, size_t der_len, size_t * len)
     }
 }
 
-OM_uint32
-_gss_encapsulate_token_prefix (const char *prefix, size_t prefixlen,
-			       const char *in, size_t inlen,
-			       const char *oid, OM_uint32 oidlen,
-			       void **out, size_t * outlen)
+/* Return the length of the RFC 2743 token header, that is the tag,
+   length and mechanism OID, for INLEN bytes of token data and an OID
+   of OIDLEN bytes. */
+size_t
+_gss_encapsulate_token_headroom (size_t inlen, size_t oidlen)
 {
   size_t oidlenlen;
   size_t asn1len, asn1lenlen;
-  unsigned char *p;
-
-  if (prefix == NULL)
-    prefixlen = 0;
 
   _gss_asn1_length_der (oidlen, NULL, &oidlenlen);
-  asn1len = 1 + oidlenlen + oidlen + prefixlen + inlen;
+  asn1len = 1 + oidlenlen + oidlen + inlen;
   _gss_asn1_length_der (asn1len, NULL, &asn1lenlen);
 
-  *outlen = 1 + asn1lenlen + asn1len;
-  p = *out = malloc (*outlen);
-  if (!p)
-    return -1;
+  return 1 + asn1lenlen + 1 + oidlenlen + oidlen;
+}
 
+/* Frame the INLEN bytes of token data at DATA, which are preceded by
+   HEADROOM bytes reserved by the caller, by writing the token header
+   for the OID of OIDLEN bytes at OID immediately in front of them.
+   Returns a pointer to the start of the token, which is at DATA -
+   _gss_encapsulate_token_headroom (INLEN, OIDLEN), or NULL if
+   HEADROOM is too small.  The data is not moved. */
+char *
+_gss_encapsulate_token_inplace (char *data, size_t headroom, size_t inlen,
+				const char *oid, size_t oidlen)
+{
+  size_t hdrlen = _gss_encapsulate_token_headroom (inlen, oidlen);
+  size_t oidlenlen;
+  size_t asn1len, asn1lenlen;
+  unsigned char *p;
+
+  if (headroom < hdrlen)
+    return NULL;
+
+  _gss_asn1_length_der (oidlen, NULL, &oidlenlen);
+  asn1len = 1 + oidlenlen + oidlen + inlen;
+
+  p = (unsigned char *) data - hdrlen;
   *p++ = '\x60';
   _gss_asn1_length_der (asn1len, p, &asn1lenlen);
   p += asn1lenlen;
@@ -132,17 +148,48 @@ _gss_encapsulate_token_prefix (const char *prefix, size_t prefixlen,
   _gss_asn1_length_der (oidlen, p, &oidlenlen);
   p += oidlenlen;
   memcpy (p, oid, oidlen);
-  p += oidlen;
+
+  return data - hdrlen;
+}
+
+OM_uint32
+_gss_encapsulate_token_prefix (const char *prefix, size_t prefixlen,
+			       const char *in, size_t inlen,
+			       const char *oid, OM_uint32 oidlen,
+			       void **out, size_t * outlen)
+{
+  size_t hdrlen;
+  char *p;
+
+  if (prefix == NULL)
+    prefixlen = 0;
+
+  hdrlen = _gss_encapsulate_token_headroom (prefixlen + inlen, oidlen);
+  *outlen = hdrlen + prefixlen + inlen;
+  p = *out = _gss_malloc (*outlen);
+  if (!p)
+    return -1;
+
   if (prefixlen > 0)
-    {
-      memcpy (p, prefix, prefixlen);
-      p += prefixlen;
-    }
-  memcpy (p, in, inlen);
+    memcpy (p + hdrlen, prefix, prefixlen);
+  memcpy (p + hdrlen + prefixlen, in, inlen);
+  _gss_encapsulate_token_inplace (p + hdrlen, hdrlen, prefixlen + inlen,
+				  oid, oidlen);
 
   return 0;
 }
 
+/* Return the length of the token that _gss_encapsulate_token_prefix
+   would produce for PREFIXLEN bytes of prefix, INLEN bytes of data and
+   an OID of OIDLEN bytes. */
+size_t
+_gss_encapsulate_token_length (size_t prefixlen, size_t inlen,
+			       size_t oidlen)
+{
+  return _gss_encapsulate_token_headroom (prefixlen + inlen, oidlen)
+    + prefixlen + inlen;
+}
+
 /**
  * gss_encapsulate_token:
  * @input_token: (buffer, opaque, read) Buffer with GSS-API context token data.
@@ -247,17 +294,20 @@ _gss_decapsulate_token (const char *in, size_t inlen,
 }
 
 /**
- * gss_decapsulate_token:
+ * gss_decapsulate_token_view:
  * @input_token: (buffer, opaque, read) Buffer with GSS-API context token.
  * @token_oid: (Object ID, read) Expected object identifier of token.
  * @output_token: (buffer, opaque, modify) Decapsulated token data;
- *   caller must release with gss_release_buffer().
+ *   points into @input_token and must not be released.
  *
  * Remove the mechanism-independent token header from an initial
- * GSS-API context token.  Unwrap a buffer in the
- * mechanism-independent token format.  This is the reverse of
- * gss_encapsulate_token().  The translation is loss-less, all data is
- * preserved as is.  This function is standardized in RFC 6339.
+ * GSS-API context token, like gss_decapsulate_token(), but without
+ * copying the data.  On success, @output_token describes the token
+ * data inside the @input_token buffer, and is only valid as long as
+ * that buffer is.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
  *
  * Return value:
  *
@@ -266,14 +316,11 @@ _gss_decapsulate_token (const char *in, size_t inlen,
  *
  * `GSS_S_DEFECTIVE_TOKEN`: Means that the token failed consistency
  * checks (e.g., OID mismatch or ASN.1 DER length errors).
- *
- * `GSS_S_FAILURE`: Indicates that decapsulation failed for reasons
- * unspecified at the GSS-API level.
  **/
 OM_uint32
-gss_decapsulate_token (gss_const_buffer_t input_token,
-		       gss_const_OID token_oid,
-		       gss_buffer_t output_token)
+gss_decapsulate_token_view (gss_const_buffer_t input_token,
+			    gss_const_OID token_oid,
+			    gss_buffer_t output_token)
 {
   gss_OID_desc tmpoid;
   char *oid = NULL, *out = NULL;
@@ -298,11 +345,53 @@ gss_decapsulate_token (gss_const_buffer_t input_token,
     return GSS_S_DEFECTIVE_TOKEN;
 
   output_token->length = outlen;
-  output_token->value = malloc (outlen);
+  output_token->value = out;
+
+  return GSS_S_COMPLETE;
+}
+
+/**
+ * gss_decapsulate_token:
+ * @input_token: (buffer, opaque, read) Buffer with GSS-API context token.
+ * @token_oid: (Object ID, read) Expected object identifier of token.
+ * @output_token: (buffer, opaque, modify) Decapsulated token data;
+ *   caller must release with gss_release_buffer().
+ *
+ * Remove the mechanism-independent token header from an initial
+ * GSS-API context token.  Unwrap a buffer in the
+ * mechanism-independent token format.  This is the reverse of
+ * gss_encapsulate_token().  The translation is loss-less, all data is
+ * preserved as is.  This function is standardized in RFC 6339.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Indicates successful completion, and that output
+ * parameters holds correct information.
+ *
+ * `GSS_S_DEFECTIVE_TOKEN`: Means that the token failed consistency
+ * checks (e.g., OID mismatch or ASN.1 DER length errors).
+ *
+ * `GSS_S_FAILURE`: Indicates that decapsulation failed for reasons
+ * unspecified at the GSS-API level.
+ **/
+OM_uint32
+gss_decapsulate_token (gss_const_buffer_t input_token,
+		       gss_const_OID token_oid,
+		       gss_buffer_t output_token)
+{
+  gss_buffer_desc view;
+  OM_uint32 maj_stat;
+
+  maj_stat = gss_decapsulate_token_view (input_token, token_oid, &view);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  output_token->length = view.length;
+  output_token->value = _gss_malloc (view.length);
   if (!output_token->value)
     return GSS_S_FAILURE;
 
-  memcpy (output_token->value, out, outlen);
+  memcpy (output_token->value, view.value, view.length);
 
   return GSS_S_COMPLETE;
 }
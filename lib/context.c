@@ -25,6 +25,109 @@
 /* _gss_find_mech */
 #include "meta.h"
 
+/* Shared by gss_init_sec_context and gss_init_sec_context_async.
+   WAIT_FD is NULL for the former. */
+static OM_uint32
+init_sec_context (OM_uint32 * minor_status,
+		  const gss_cred_id_t initiator_cred_handle,
+		  gss_ctx_id_t * context_handle,
+		  const gss_name_t target_name,
+		  const gss_OID mech_type,
+		  OM_uint32 req_flags,
+		  OM_uint32 time_req,
+		  const gss_channel_bindings_t input_chan_bindings,
+		  const gss_buffer_t input_token,
+		  gss_OID * actual_mech_type,
+		  gss_buffer_t output_token,
+		  OM_uint32 * ret_flags, OM_uint32 * time_rec, int *wait_fd)
+{
+  OM_uint32 maj_stat;
+  _gss_mech_api_t mech;
+  int freecontext = 0;
+
+  if (output_token)
+    {
+      output_token->length = 0;
+      output_token->value = NULL;
+    }
+
+  if (ret_flags)
+    *ret_flags = 0;
+
+  if (wait_fd)
+    *wait_fd = -1;
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT | GSS_S_CALL_INACCESSIBLE_READ;
+    }
+
+  if (output_token == GSS_C_NO_BUFFER)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_FAILURE | GSS_S_CALL_BAD_STRUCTURE;
+    }
+
+  if (*context_handle == GSS_C_NO_CONTEXT)
+    mech = _gss_find_mech (mech_type);
+  else
+    mech = (*context_handle)->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (actual_mech_type)
+    *actual_mech_type = mech->mech;
+
+  if (*context_handle == GSS_C_NO_CONTEXT)
+    {
+      *context_handle = _gss_calloc (sizeof (**context_handle), 1);
+      if (!*context_handle)
+	{
+	  if (minor_status)
+	    *minor_status = ENOMEM;
+	  return GSS_S_FAILURE;
+	}
+      (*context_handle)->mech = mech->mech;
+      (*context_handle)->api = mech;
+      freecontext = 1;
+    }
+
+  if (wait_fd && mech->init_sec_context_async)
+    maj_stat = _GSS_MECH_CALL (mech, init_sec_context_async)
+      (minor_status, initiator_cred_handle, context_handle, target_name,
+       mech_type, req_flags, time_req, input_chan_bindings, input_token,
+       actual_mech_type, output_token, ret_flags, time_rec, wait_fd);
+  else
+    maj_stat = _GSS_MECH_CALL (mech, init_sec_context) (minor_status,
+							initiator_cred_handle,
+							context_handle,
+							target_name,
+							mech_type, req_flags,
+							time_req,
+							input_chan_bindings,
+							input_token,
+							actual_mech_type,
+							output_token,
+							ret_flags, time_rec);
+
+  /* A mechanism that fails the first call releases what it set up in
+     the context, so only the context itself is left to free. */
+  if (GSS_ERROR (maj_stat) && freecontext)
+    {
+      _gss_free (*context_handle);
+      *context_handle = GSS_C_NO_CONTEXT;
+    }
+
+  return maj_stat;
+}
+
 /**
  * gss_init_sec_context:
  * @minor_status: (integer, modify) Mechanism specific status code.
@@ -354,79 +457,84 @@ gss_init_sec_context (OM_uint32 * minor_status,
 		      gss_buffer_t output_token,
 		      OM_uint32 * ret_flags, OM_uint32 * time_rec)
 {
-  OM_uint32 maj_stat;
-  _gss_mech_api_t mech;
-  int freecontext = 0;
-
-  if (output_token)
-    {
-      output_token->length = 0;
-      output_token->value = NULL;
-    }
-
-  if (ret_flags)
-    *ret_flags = 0;
-
-  if (!context_handle)
-    {
-      if (minor_status)
-	*minor_status = 0;
-      return GSS_S_NO_CONTEXT | GSS_S_CALL_INACCESSIBLE_READ;
-    }
-
-  if (output_token == GSS_C_NO_BUFFER)
-    {
-      if (minor_status)
-	*minor_status = 0;
-      return GSS_S_FAILURE | GSS_S_CALL_BAD_STRUCTURE;
-    }
-
-  if (*context_handle == GSS_C_NO_CONTEXT)
-    mech = _gss_find_mech (mech_type);
-  else
-    mech = _gss_find_mech ((*context_handle)->mech);
-  if (mech == NULL)
-    {
-      if (minor_status)
-	*minor_status = 0;
-      return GSS_S_BAD_MECH;
-    }
-
-  if (actual_mech_type)
-    *actual_mech_type = mech->mech;
-
-  if (*context_handle == GSS_C_NO_CONTEXT)
-    {
-      *context_handle = calloc (sizeof (**context_handle), 1);
-      if (!*context_handle)
-	{
-	  if (minor_status)
-	    *minor_status = ENOMEM;
-	  return GSS_S_FAILURE;
-	}
-      (*context_handle)->mech = mech->mech;
-      freecontext = 1;
-    }
-
-  maj_stat = mech->init_sec_context (minor_status,
-				     initiator_cred_handle,
-				     context_handle,
-				     target_name,
-				     mech_type,
-				     req_flags,
-				     time_req,
-				     input_chan_bindings,
-				     input_token,
-				     actual_mech_type,
-				     output_token, ret_flags, time_rec);
-
-  if (GSS_ERROR (maj_stat) && freecontext)
-    {
-      free (*context_handle);
-      *context_handle = GSS_C_NO_CONTEXT;
-    }
+  return init_sec_context (minor_status, initiator_cred_handle,
+			   context_handle, target_name, mech_type, req_flags,
+			   time_req, input_chan_bindings, input_token,
+			   actual_mech_type, output_token, ret_flags, time_rec,
+			   NULL);
+}
 
-  return maj_stat;
+/**
+ * gss_init_sec_context_async:
+ * @minor_status: (integer, modify) Mechanism specific status code.
+ * @initiator_cred_handle: (gss_cred_id_t, read, optional) Handle for
+ *   credentials claimed, as for gss_init_sec_context().
+ * @context_handle: (gss_ctx_id_t, read/modify) Context handle for new
+ *   context, as for gss_init_sec_context().
+ * @target_name: (gss_name_t, read) Name of target.
+ * @mech_type: (OID, read, optional) Object ID of desired mechanism.
+ * @req_flags: (bit-mask, read) Contains various independent flags,
+ *   as for gss_init_sec_context().
+ * @time_req: (Integer, read, optional) Desired number of seconds for
+ *   which context should remain valid.
+ * @input_chan_bindings: (channel bindings, read, optional)
+ *   Application-specified bindings.
+ * @input_token: (buffer, opaque, read, optional) Token received from
+ *   peer application.
+ * @actual_mech_type: (OID, modify, optional) Actual mechanism used.
+ * @output_token: (buffer, opaque, modify) Token to be sent to peer
+ *   application.
+ * @ret_flags: (bit-mask, modify, optional) Contains various
+ *   independent flags, as for gss_init_sec_context().
+ * @time_rec: (Integer, modify, optional) Number of seconds for which
+ *   the context will remain valid.
+ * @wait_fd: (Integer, modify, optional) File descriptor to wait for,
+ *   or -1.  Specify NULL to block as gss_init_sec_context() does.
+ *
+ * Like gss_init_sec_context(), but does not block while the
+ * mechanism talks to other parties than the peer, such as a Kerberos
+ * V5 KDC.  If the call would have to wait for them, it returns
+ * `GSS_S_CONTINUE_NEEDED` with an empty @output_token and stores a
+ * file descriptor in @wait_fd.  Once the descriptor is readable, for
+ * example as reported by poll(), call the function again with the
+ * same arguments and no input token to continue.  The descriptor
+ * belongs to the context, and stays valid until that call; do not
+ * read from or close it.  In all other cases @wait_fd is set to -1,
+ * and the result is as for gss_init_sec_context().
+ *
+ * While a call is pending, the context may only be passed to this
+ * function and to gss_delete_sec_context(), which then waits for the
+ * request to finish.  Mechanisms that do not support asynchronous
+ * operation block as gss_init_sec_context() does.
+ *
+ * The Kerberos V5 mechanism uses it when a service ticket has to be
+ * requested from the KDC, which is then done by a thread of its own.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value: As for gss_init_sec_context().
+ **/
+OM_uint32
+gss_init_sec_context_async (OM_uint32 * minor_status,
+			    const gss_cred_id_t initiator_cred_handle,
+			    gss_ctx_id_t * context_handle,
+			    const gss_name_t target_name,
+			    const gss_OID mech_type,
+			    OM_uint32 req_flags,
+			    OM_uint32 time_req,
+			    const gss_channel_bindings_t input_chan_bindings,
+			    const gss_buffer_t input_token,
+			    gss_OID * actual_mech_type,
+			    gss_buffer_t output_token,
+			    OM_uint32 * ret_flags, OM_uint32 * time_rec,
+			    int *wait_fd)
+{
+  return init_sec_context (minor_status, initiator_cred_handle,
+			   context_handle, target_name, mech_type, req_flags,
+			   time_req, input_chan_bindings, input_token,
+			   actual_mech_type, output_token, ret_flags, time_rec,
+			   wait_fd);
 }
 
 /**
@@ -695,6 +803,7 @@ gss_accept_sec_context (OM_uint32 * minor_status,
 			gss_cred_id_t * delegated_cred_handle)
 {
   _gss_mech_api_t mech;
+  OM_uint32 maj_stat;
 
   if (!context_handle)
     {
@@ -726,7 +835,7 @@ gss_accept_sec_context (OM_uint32 * minor_status,
       mech = _gss_find_mech_no_default (&oidbuf);
     }
   else
-    mech = _gss_find_mech_no_default ((*context_handle)->mech);
+    mech = (*context_handle)->api;
   if (mech == NULL)
     {
       if (minor_status)
@@ -737,16 +846,21 @@ gss_accept_sec_context (OM_uint32 * minor_status,
   if (mech_type)
     *mech_type = mech->mech;
 
-  return mech->accept_sec_context (minor_status,
-				   context_handle,
-				   acceptor_cred_handle,
-				   input_token_buffer,
-				   input_chan_bindings,
-				   src_name,
-				   mech_type,
-				   output_token,
-				   ret_flags,
-				   time_rec, delegated_cred_handle);
+  maj_stat = _GSS_MECH_CALL (mech, accept_sec_context) (minor_status,
+							context_handle,
+							acceptor_cred_handle,
+							input_token_buffer,
+							input_chan_bindings,
+							src_name, mech_type,
+							output_token,
+							ret_flags, time_rec,
+							delegated_cred_handle);
+
+  /* The mechanism allocates the context of an acceptor. */
+  if (*context_handle != GSS_C_NO_CONTEXT)
+    (*context_handle)->api = mech;
+
+  return maj_stat;
 }
 
 /**
@@ -824,7 +938,7 @@ gss_delete_sec_context (OM_uint32 * minor_status,
       output_token->value = NULL;
     }
 
-  mech = _gss_find_mech ((*context_handle)->mech);
+  mech = (*context_handle)->api;
   if (mech == NULL)
     {
       if (minor_status)
@@ -832,9 +946,10 @@ gss_delete_sec_context (OM_uint32 * minor_status,
       return GSS_S_BAD_MECH;
     }
 
-  ret = mech->delete_sec_context (NULL, context_handle, output_token);
+  ret = _GSS_MECH_CALL (mech, delete_sec_context) (NULL, context_handle,
+						   output_token);
 
-  free (*context_handle);
+  _gss_free (*context_handle);
   *context_handle = GSS_C_NO_CONTEXT;
 
   return ret;
@@ -916,7 +1031,7 @@ gss_context_time (OM_uint32 * minor_status,
       return GSS_S_NO_CONTEXT | GSS_S_CALL_BAD_STRUCTURE;
     }
 
-  mech = _gss_find_mech (context_handle->mech);
+  mech = context_handle->api;
   if (mech == NULL)
     {
       if (minor_status)
@@ -924,7 +1039,8 @@ gss_context_time (OM_uint32 * minor_status,
       return GSS_S_BAD_MECH;
     }
 
-  return mech->context_time (minor_status, context_handle, time_rec);
+  return _GSS_MECH_CALL (mech, context_time) (minor_status, context_handle,
+					      time_rec);
 }
 
 /**
@@ -1102,7 +1218,41 @@ gss_wrap_size_limit (OM_uint32 * minor_status,
 		     gss_qop_t qop_req,
 		     OM_uint32 req_output_size, OM_uint32 * max_input_size)
 {
-  return GSS_S_FAILURE;
+  _gss_mech_api_t mech;
+
+  if (context_handle == GSS_C_NO_CONTEXT)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT | GSS_S_CALL_BAD_STRUCTURE;
+    }
+
+  if (max_input_size == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_WRITE;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->wrap_size_limit == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, wrap_size_limit) (minor_status, context_handle,
+						 conf_req_flag, qop_req,
+						 req_output_size,
+						 max_input_size);
 }
 
 /**
@@ -1209,3 +1359,71 @@ gss_import_sec_context (OM_uint32 * minor_status,
 {
   return GSS_S_UNAVAILABLE;
 }
+
+/**
+ * gss_set_replay_window:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Context to configure.
+ * @window: (Integer, read) Number of recently received sequence
+ *   numbers to remember, or 0 for the mechanism default.
+ *
+ * Set how far out of order per-message tokens may arrive on a context
+ * established with `GSS_C_REPLAY_FLAG` or `GSS_C_SEQUENCE_FLAG`.
+ * Tokens that arrive at most @window sequence numbers late are
+ * accepted once and reported with the `GSS_S_UNSEQ_TOKEN`
+ * supplementary status, replays of them with
+ * `GSS_S_DUPLICATE_TOKEN`.  Older tokens are reported with
+ * `GSS_S_OLD_TOKEN`.  The mechanism may round @window up.
+ *
+ * Tokens that were missing when the window is changed are afterwards
+ * reported as duplicates, so this is best called before any tokens
+ * have been received.
+ *
+ * The Kerberos V5 mechanism uses a window of 64 by default, and
+ * supports windows up to 1024.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_FAILURE`: The window is larger than the mechanism supports.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_set_replay_window (OM_uint32 * minor_status,
+		       const gss_ctx_id_t context_handle, OM_uint32 window)
+{
+  _gss_mech_api_t mech;
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->set_replay_window == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, set_replay_window) (minor_status,
+						   context_handle, window);
+}
@@ -155,7 +155,7 @@ gss_acquire_cred (OM_uint32 * minor_status,
       return GSS_S_BAD_MECH;
     }
 
-  *output_cred_handle = calloc (sizeof (**output_cred_handle), 1);
+  *output_cred_handle = _gss_calloc (sizeof (**output_cred_handle), 1);
   if (!*output_cred_handle)
     {
       if (minor_status)
@@ -163,16 +163,16 @@ gss_acquire_cred (OM_uint32 * minor_status,
       return GSS_S_FAILURE;
     }
   (*output_cred_handle)->mech = mech->mech;
+  (*output_cred_handle)->api = mech;
 
-  maj_stat = mech->acquire_cred (minor_status,
-				 desired_name,
-				 time_req,
-				 desired_mechs,
-				 cred_usage,
-				 output_cred_handle, actual_mechs, time_rec);
+  maj_stat = _GSS_MECH_CALL (mech, acquire_cred) (minor_status, desired_name,
+						  time_req, desired_mechs,
+						  cred_usage,
+						  output_cred_handle,
+						  actual_mechs, time_rec);
   if (GSS_ERROR (maj_stat))
     {
-      free (*output_cred_handle);
+      _gss_free (*output_cred_handle);
       *output_cred_handle = GSS_C_NO_CREDENTIAL;
       return maj_stat;
     }
@@ -391,7 +391,7 @@ gss_inquire_cred (OM_uint32 * minor_status,
 	return maj_stat;
     }
 
-  mech = _gss_find_mech (credh->mech);
+  mech = credh->api;
   if (mech == NULL)
     {
       if (minor_status)
@@ -399,8 +399,9 @@ gss_inquire_cred (OM_uint32 * minor_status,
       return GSS_S_BAD_MECH;
     }
 
-  maj_stat = mech->inquire_cred (minor_status, credh, name, lifetime,
-				 cred_usage, mechanisms);
+  maj_stat = _GSS_MECH_CALL (mech, inquire_cred) (minor_status, credh, name,
+						  lifetime, cred_usage,
+						  mechanisms);
 
   if (cred_handle == GSS_C_NO_CREDENTIAL)
     gss_release_cred (NULL, &credh);
@@ -497,9 +498,11 @@ gss_inquire_cred_by_mech (OM_uint32 * minor_status,
 	return maj_stat;
     }
 
-  maj_stat = mech->inquire_cred_by_mech (minor_status, credh, mech_type, name,
-					 initiator_lifetime,
-					 acceptor_lifetime, cred_usage);
+  maj_stat = _GSS_MECH_CALL (mech, inquire_cred_by_mech) (minor_status, credh,
+							  mech_type, name,
+							  initiator_lifetime,
+							  acceptor_lifetime,
+							  cred_usage);
 
   if (cred_handle == GSS_C_NO_CREDENTIAL)
     gss_release_cred (NULL, &credh);
@@ -546,7 +549,7 @@ gss_release_cred (OM_uint32 * minor_status, gss_cred_id_t * cred_handle)
       return GSS_S_COMPLETE;
     }
 
-  mech = _gss_find_mech ((*cred_handle)->mech);
+  mech = (*cred_handle)->api;
   if (mech == NULL)
     {
       if (minor_status)
@@ -554,11 +557,71 @@ gss_release_cred (OM_uint32 * minor_status, gss_cred_id_t * cred_handle)
       return GSS_S_DEFECTIVE_CREDENTIAL;
     }
 
-  maj_stat = mech->release_cred (minor_status, cred_handle);
-  free (*cred_handle);
+  maj_stat = _GSS_MECH_CALL (mech, release_cred) (minor_status, cred_handle);
+  _gss_free (*cred_handle);
   *cred_handle = GSS_C_NO_CREDENTIAL;
   if (GSS_ERROR (maj_stat))
     return maj_stat;
 
   return GSS_S_COMPLETE;
 }
+
+/**
+ * gss_set_cred_refresh:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @mech_type: (Object ID, read, optional) Mechanism to configure.
+ *   Specify GSS_C_NO_OID to use the default mechanism.
+ * @percent: (Integer, read) How much of their lifetime may pass
+ *   before credentials are renewed, in percent, or 0 to not renew
+ *   credentials in advance.
+ *
+ * Have the mechanism renew, in the background, the credentials it
+ * obtained on behalf of the application, such as Kerberos V5 service
+ * tickets, once @percent of their lifetime has passed.  Contexts
+ * established later then find fresh credentials, instead of having
+ * to obtain new ones when the old have expired.  Credentials that
+ * were not used since they were obtained are left to expire.  By
+ * default credentials are not renewed in advance.
+ *
+ * The Kerberos V5 mechanism renews the service tickets used by
+ * initiator contexts while renewal is enabled, from a thread that it
+ * starts on the first call with a non-zero @percent.  Tickets that
+ * expire before they could be renewed are forgotten.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_BAD_MECH`: The requested mechanism is not supported.
+ *
+ * `GSS_S_FAILURE`: @percent is 100 or more, or the background
+ * renewal could not be started.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_set_cred_refresh (OM_uint32 * minor_status,
+		      const gss_OID mech_type, OM_uint32 percent)
+{
+  _gss_mech_api_t mech;
+
+  mech = _gss_find_mech (mech_type);
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->set_cred_refresh == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, set_cred_refresh) (minor_status, percent);
+}
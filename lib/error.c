@@ -231,7 +231,7 @@ gss_display_status (OM_uint32 * minor_status,
 	case GSS_S_DUPLICATE_ELEMENT:
 	case GSS_S_NAME_NOT_MN:
 	  status_string->value =
-	    strdup (_(gss_routine_errors
+	    _gss_strdup (_(gss_routine_errors
 		      [(GSS_ROUTINE_ERROR (status_value) >>
 			GSS_C_ROUTINE_ERROR_OFFSET) - 1].text));
 	  if (!status_string->value)
@@ -266,7 +266,7 @@ gss_display_status (OM_uint32 * minor_status,
 	case GSS_S_CALL_INACCESSIBLE_WRITE:
 	case GSS_S_CALL_BAD_STRUCTURE:
 	  status_string->value =
-	    strdup (_(gss_calling_errors
+	    _gss_strdup (_(gss_calling_errors
 		      [(GSS_CALLING_ERROR (status_value) >>
 			GSS_C_CALLING_ERROR_OFFSET) - 1].text));
 	  if (!status_string->value)
@@ -290,7 +290,7 @@ gss_display_status (OM_uint32 * minor_status,
 	    GSS_SUPPLEMENTARY_INFO (status_value))
 	  {
 	    status_string->value =
-	      strdup (_(gss_supplementary_errors[i].text));
+	      _gss_strdup (_(gss_supplementary_errors[i].text));
 	    if (!status_string->value)
 	      {
 		if (minor_status)
@@ -309,7 +309,7 @@ gss_display_status (OM_uint32 * minor_status,
 
       if (message_context)
 	*message_context = 0;
-      status_string->value = strdup (_("No error"));
+      status_string->value = _gss_strdup (_("No error"));
       if (!status_string->value)
 	{
 	  if (minor_status)
@@ -324,9 +324,11 @@ gss_display_status (OM_uint32 * minor_status,
 	_gss_mech_api_t mech;
 
 	mech = _gss_find_mech (mech_type);
-	return mech->display_status (minor_status, status_value, status_type,
-				     mech_type, message_context,
-				     status_string);
+	return _GSS_MECH_CALL (mech, display_status) (minor_status,
+						      status_value,
+						      status_type, mech_type,
+						      message_context,
+						      status_string);
       }
       break;
 
@@ -39,12 +39,16 @@ AC_DEFUN([libgl_EARLY],
   m4_pattern_allow([^gl_LTLIBOBJS$])dnl a variable
   AC_REQUIRE([gl_PROG_AR_RANLIB])
   # Code from module absolute-header:
+  # Code from module crypto/hmac-sha1:
+  # Code from module crypto/md5:
+  # Code from module crypto/sha1:
   # Code from module extensions:
   AC_REQUIRE([gl_USE_SYSTEM_EXTENSIONS])
   # Code from module extern-inline:
   # Code from module gettext-h:
   # Code from module include_next:
   # Code from module lib-msvc-compat:
+  # Code from module memxor:
   # Code from module snippet/arg-nonnull:
   # Code from module snippet/c++defs:
   # Code from module snippet/warn-on-use:
@@ -67,10 +71,14 @@ AC_DEFUN([libgl_INIT],
   m4_pushdef([libgl_LIBSOURCES_DIR], [])
   gl_COMMON
   gl_source_base='lib/gl'
+  gl_HMAC_SHA1
+  gl_MD5
+  gl_SHA1
   AC_REQUIRE([gl_EXTERN_INLINE])
   AC_SUBST([LIBINTL])
   AC_SUBST([LTLIBINTL])
   gl_LD_OUTPUT_DEF
+  gl_MEMXOR
   gl_STDDEF_H
   gl_HEADER_STRING_H
   gl_FUNC_STRVERSCMP
@@ -220,6 +228,14 @@ AC_DEFUN([libgl_FILE_LIST], [
   build-aux/snippet/warn-on-use.h
   lib/dummy.c
   lib/gettext.h
+  lib/hmac-sha1.c
+  lib/hmac.h
+  lib/md5.c
+  lib/md5.h
+  lib/memxor.c
+  lib/memxor.h
+  lib/sha1.c
+  lib/sha1.h
   lib/stddef.in.h
   lib/string.in.h
   lib/strverscmp.c
@@ -228,8 +244,12 @@ AC_DEFUN([libgl_FILE_LIST], [
   m4/extensions.m4
   m4/extern-inline.m4
   m4/gnulib-common.m4
+  m4/hmac-sha1.m4
   m4/include_next.m4
   m4/ld-output-def.m4
+  m4/md5.m4
+  m4/memxor.m4
+  m4/sha1.m4
   m4/stddef_h.m4
   m4/string_h.m4
   m4/strverscmp.m4
@@ -29,9 +29,184 @@
 /* See version.c. */
 extern const char *gss_check_version (const char *req_version);
 
+/* See alloc.c. */
+extern OM_uint32 gss_set_allocator (OM_uint32 * minor_status,
+				    void *(*malloc_func) (size_t),
+				    void *(*realloc_func) (void *, size_t),
+				    void (*free_func) (void *));
+
+/* See asn1.c. */
+extern OM_uint32 gss_decapsulate_token_view (gss_const_buffer_t input_token,
+					     gss_const_OID token_oid,
+					     gss_buffer_t output_token);
+
 /* See ext.c. */
 extern int gss_userok (const gss_name_t name, const char *username);
 
+/* See msg.c. */
+
+typedef struct gss_iov_buffer_desc_struct
+{
+  OM_uint32 type;
+  gss_buffer_desc buffer;
+} gss_iov_buffer_desc, *gss_iov_buffer_t;
+
+#define GSS_C_NO_IOV_BUFFER ((gss_iov_buffer_t) 0)
+
+#define GSS_IOV_BUFFER_TYPE_EMPTY 0
+#define GSS_IOV_BUFFER_TYPE_DATA 1
+#define GSS_IOV_BUFFER_TYPE_HEADER 2
+#define GSS_IOV_BUFFER_TYPE_TRAILER 7
+#define GSS_IOV_BUFFER_TYPE_PADDING 9
+#define GSS_IOV_BUFFER_TYPE_SIGN_ONLY 11
+
+#define GSS_IOV_BUFFER_FLAG_MASK 0xFFFF0000
+#define GSS_IOV_BUFFER_FLAG_ALLOCATE 0x00010000
+#define GSS_IOV_BUFFER_FLAG_ALLOCATED 0x00020000
+
+#define GSS_IOV_BUFFER_TYPE(type) ((type) & ~GSS_IOV_BUFFER_FLAG_MASK)
+#define GSS_IOV_BUFFER_FLAGS(type) ((type) & GSS_IOV_BUFFER_FLAG_MASK)
+
+extern OM_uint32 gss_wrap_iov (OM_uint32 * minor_status,
+			       gss_ctx_id_t context_handle,
+			       int conf_req_flag,
+			       gss_qop_t qop_req,
+			       int *conf_state,
+			       gss_iov_buffer_desc * iov, int iov_count);
+extern OM_uint32 gss_unwrap_iov (OM_uint32 * minor_status,
+				 gss_ctx_id_t context_handle,
+				 int *conf_state,
+				 gss_qop_t * qop_state,
+				 gss_iov_buffer_desc * iov, int iov_count);
+extern OM_uint32 gss_wrap_iov_length (OM_uint32 * minor_status,
+				      gss_ctx_id_t context_handle,
+				      int conf_req_flag,
+				      gss_qop_t qop_req,
+				      int *conf_state,
+				      gss_iov_buffer_desc * iov,
+				      int iov_count);
+
+typedef struct gss_mic_stream_struct *gss_mic_stream_t;
+
+#define GSS_C_NO_MIC_STREAM ((gss_mic_stream_t) 0)
+
+extern OM_uint32 gss_get_mic_init (OM_uint32 * minor_status,
+				   const gss_ctx_id_t context_handle,
+				   gss_qop_t qop_req,
+				   gss_mic_stream_t * mic_stream);
+extern OM_uint32 gss_verify_mic_init (OM_uint32 * minor_status,
+				      const gss_ctx_id_t context_handle,
+				      gss_mic_stream_t * mic_stream);
+extern OM_uint32 gss_mic_update (OM_uint32 * minor_status,
+				 gss_mic_stream_t mic_stream,
+				 const gss_buffer_t message_buffer);
+extern OM_uint32 gss_get_mic_final (OM_uint32 * minor_status,
+				    gss_mic_stream_t * mic_stream,
+				    gss_buffer_t message_token);
+extern OM_uint32 gss_verify_mic_final (OM_uint32 * minor_status,
+				       gss_mic_stream_t * mic_stream,
+				       const gss_buffer_t token_buffer,
+				       gss_qop_t * qop_state);
+extern OM_uint32 gss_release_mic_stream (OM_uint32 * minor_status,
+					 gss_mic_stream_t * mic_stream);
+
+extern OM_uint32 gss_wrap_into (OM_uint32 * minor_status,
+				const gss_ctx_id_t context_handle,
+				int conf_req_flag,
+				gss_qop_t qop_req,
+				const gss_buffer_t input_message_buffer,
+				int *conf_state,
+				gss_buffer_t output_message_buffer);
+extern OM_uint32 gss_unwrap_into (OM_uint32 * minor_status,
+				  const gss_ctx_id_t context_handle,
+				  const gss_buffer_t input_message_buffer,
+				  gss_buffer_t output_message_buffer,
+				  int *conf_state, gss_qop_t * qop_state);
+extern OM_uint32 gss_get_mic_into (OM_uint32 * minor_status,
+				   const gss_ctx_id_t context_handle,
+				   gss_qop_t qop_req,
+				   const gss_buffer_t message_buffer,
+				   gss_buffer_t message_token);
+extern OM_uint32 gss_unwrap_inplace (OM_uint32 * minor_status,
+				     const gss_ctx_id_t context_handle,
+				     gss_buffer_t message_buffer,
+				     size_t * offset, size_t * length,
+				     int *conf_state, gss_qop_t * qop_state);
+
+typedef struct gss_wrap_stream_struct *gss_wrap_stream_t;
+
+#define GSS_C_NO_WRAP_STREAM ((gss_wrap_stream_t) 0)
+
+extern OM_uint32 gss_wrap_init (OM_uint32 * minor_status,
+				const gss_ctx_id_t context_handle,
+				int conf_req_flag, gss_qop_t qop_req,
+				int *conf_state,
+				gss_wrap_stream_t * wrap_stream);
+extern OM_uint32 gss_unwrap_init (OM_uint32 * minor_status,
+				  const gss_ctx_id_t context_handle,
+				  gss_wrap_stream_t * wrap_stream);
+extern OM_uint32 gss_wrap_update (OM_uint32 * minor_status,
+				  gss_wrap_stream_t wrap_stream,
+				  const gss_buffer_t input_buffer,
+				  gss_buffer_t output_buffer);
+extern OM_uint32 gss_wrap_final (OM_uint32 * minor_status,
+				 gss_wrap_stream_t * wrap_stream,
+				 gss_buffer_t output_buffer);
+extern OM_uint32 gss_unwrap_final (OM_uint32 * minor_status,
+				   gss_wrap_stream_t * wrap_stream,
+				   gss_buffer_t output_buffer,
+				   int *conf_state, gss_qop_t * qop_state);
+extern OM_uint32 gss_release_wrap_stream (OM_uint32 * minor_status,
+					  gss_wrap_stream_t * wrap_stream);
+
+extern OM_uint32 gss_wrap_batch (OM_uint32 * minor_status,
+				 const gss_ctx_id_t context_handle,
+				 int conf_req_flag, gss_qop_t qop_req,
+				 size_t count,
+				 gss_buffer_desc * input_message_buffers,
+				 int *conf_state,
+				 gss_buffer_desc * output_message_buffers,
+				 gss_buffer_t output_arena);
+extern OM_uint32 gss_unwrap_batch (OM_uint32 * minor_status,
+				   const gss_ctx_id_t context_handle,
+				   size_t count,
+				   gss_buffer_desc * input_message_buffers,
+				   gss_buffer_desc * output_message_buffers,
+				   OM_uint32 * message_statuses,
+				   int *conf_states,
+				   gss_buffer_t output_arena);
+
+/* See cred.c. */
+extern OM_uint32 gss_set_cred_refresh (OM_uint32 * minor_status,
+				       const gss_OID mech_type,
+				       OM_uint32 percent);
+
+/* See context.c. */
+extern OM_uint32 gss_init_sec_context_async (OM_uint32 * minor_status,
+					     const gss_cred_id_t
+					     initiator_cred_handle,
+					     gss_ctx_id_t * context_handle,
+					     const gss_name_t target_name,
+					     const gss_OID mech_type,
+					     OM_uint32 req_flags,
+					     OM_uint32 time_req,
+					     const gss_channel_bindings_t
+					     input_chan_bindings,
+					     const gss_buffer_t input_token,
+					     gss_OID * actual_mech_type,
+					     gss_buffer_t output_token,
+					     OM_uint32 * ret_flags,
+					     OM_uint32 * time_rec,
+					     int *wait_fd);
+extern OM_uint32 gss_set_replay_window (OM_uint32 * minor_status,
+					const gss_ctx_id_t context_handle,
+					OM_uint32 window);
+
+/* See misc.c. */
+extern OM_uint32 gss_release_iov_buffer (OM_uint32 * minor_status,
+					 gss_iov_buffer_desc * iov,
+					 int iov_count);
+
 /* Static versions of the public OIDs for use, e.g., in static
    variable initalization.  See oid.c. */
 extern gss_OID_desc GSS_C_NT_USER_NAME_static;
@@ -49,9 +49,17 @@ typedef struct gss_name_struct
   gss_OID type;
 } gss_name_desc;
 
+/* Each handle below records the mechanism table entry it belongs to
+   in API, set when the handle is created, so that calls on it need
+   not look up the mechanism OID again.  DATA holds the state of
+   mechanisms loaded from modules, see meta.h. */
+struct _gss_mech_api_struct;
+
 typedef struct gss_cred_id_struct
 {
   gss_OID mech;
+  struct _gss_mech_api_struct *api;
+  void *data;
 #ifdef USE_KERBEROS5
   struct _gss_krb5_cred_struct *krb5;
 #endif
@@ -60,17 +68,55 @@ typedef struct gss_cred_id_struct
 typedef struct gss_ctx_id_struct
 {
   gss_OID mech;
+  struct _gss_mech_api_struct *api;
+  void *data;
 #ifdef USE_KERBEROS5
   struct _gss_krb5_ctx_struct *krb5;
 #endif
 } gss_ctx_id_desc;
 
+typedef struct gss_mic_stream_struct
+{
+  gss_OID mech;
+  struct _gss_mech_api_struct *api;
+  int verify;
+  void *data;
+#ifdef USE_KERBEROS5
+  struct _gss_krb5_mic_struct *krb5;
+#endif
+} gss_mic_stream_desc;
+
+typedef struct gss_wrap_stream_struct
+{
+  gss_OID mech;
+  struct _gss_mech_api_struct *api;
+  int unwrap;
+  void *data;
+#ifdef USE_KERBEROS5
+  struct _gss_krb5_wrap_struct *krb5;
+#endif
+} gss_wrap_stream_desc;
+
+/* alloc.c */
+extern void *_gss_malloc (size_t size);
+extern void *_gss_calloc (size_t nmemb, size_t size);
+extern void *_gss_realloc (void *ptr, size_t size);
+extern void _gss_free (void *ptr);
+extern char *_gss_strdup (const char *s);
+
 /* asn1.c */
 extern OM_uint32
 _gss_encapsulate_token_prefix (const char *prefix, size_t prefixlen,
 			       const char *in, size_t inlen,
 			       const char *oid, OM_uint32 oidlen,
 			       void **out, size_t * outlen);
+extern size_t
+_gss_encapsulate_token_length (size_t prefixlen, size_t inlen,
+			       size_t oidlen);
+extern size_t _gss_encapsulate_token_headroom (size_t inlen, size_t oidlen);
+extern char *_gss_encapsulate_token_inplace (char *data, size_t headroom,
+					     size_t inlen, const char *oid,
+					     size_t oidlen);
 extern int
 _gss_decapsulate_token (const char *in, size_t inlen,
 			char **oid, size_t * oidlen,
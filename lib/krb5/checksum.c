@@ -55,7 +55,7 @@ hash_cb (OM_uint32 * minor_status,
     + input_chan_bindings->initiator_address.length
     + input_chan_bindings->acceptor_address.length
     + input_chan_bindings->application_data.length;
-  p = buf = malloc (len);
+  p = buf = _gss_malloc (len);
   if (!buf)
     {
       if (minor_status)
@@ -90,7 +90,7 @@ hash_cb (OM_uint32 * minor_status,
 	    input_chan_bindings->application_data.length);
 
   res = shishi_md5 (k5->sh, buf, len, out);
-  free (buf);
+  _gss_free (buf);
   if (res != SHISHI_OK)
     return GSS_S_FAILURE;
 
@@ -108,7 +108,7 @@ _gss_krb5_checksum_pack (OM_uint32 * minor_status,
   char *p;
 
   *datalen = 24;
-  p = *data = malloc (*datalen);
+  p = *data = _gss_malloc (*datalen);
   if (!p)
     {
       if (minor_status)
@@ -166,7 +166,7 @@ _gss_krb5_checksum_pack (OM_uint32 * minor_status,
 		     input_chan_bindings, &md5hash);
       if (res != GSS_S_COMPLETE)
 	{
-	  free (p);
+	  _gss_free (p);
 	  return res;
 	}
 
@@ -246,7 +246,7 @@ _gss_krb5_checksum_parse (OM_uint32 * minor_status,
   if (rc != SHISHI_TOO_SMALL_BUFFER)
     return GSS_S_FAILURE;
 
-  out = malloc (len);
+  out = _gss_malloc (len);
   if (!out)
     {
       if (minor_status)
@@ -257,23 +257,30 @@ _gss_krb5_checksum_parse (OM_uint32 * minor_status,
   rc = shishi_ap_authenticator_cksumdata (k5->ap, out, &len);
   if (rc != SHISHI_OK)
     {
-      free (out);
+      _gss_free (out);
       return GSS_S_FAILURE;
     }
 
-  if (memcmp (out, "\x10\x00\x00\x00", 4) != 0)
+  if (len < 24 || memcmp (out, "\x10\x00\x00\x00", 4) != 0)
     {
-      free (out);
+      _gss_free (out);
       return GSS_S_DEFECTIVE_TOKEN;
     }
 
+  /* Remember the requested per-message services, so that replay and
+     sequence detection is done as the initiator asked for. */
+  k5->flags = (out[20] & 0xFF) | (out[21] & 0xFF) << 8;
+  k5->flags &= GSS_C_MUTUAL_FLAG | GSS_C_REPLAY_FLAG | GSS_C_SEQUENCE_FLAG
+    | GSS_C_CONF_FLAG | GSS_C_INTEG_FLAG;
+  k5->flags |= GSS_C_PROT_READY_FLAG;
+
   if (input_chan_bindings != GSS_C_NO_CHANNEL_BINDINGS)
     {
       rc = hash_cb (minor_status, context_handle,
 		    input_chan_bindings, &md5hash);
       if (rc != GSS_S_COMPLETE)
 	{
-	  free (out);
+	  _gss_free (out);
 	  return GSS_S_DEFECTIVE_TOKEN;
 	}
 
@@ -288,7 +295,7 @@ _gss_krb5_checksum_parse (OM_uint32 * minor_status,
       rc = memcmp (&out[4], zeros, 16);
     }
 
-  free (out);
+  _gss_free (out);
 
   if (rc != 0)
     return GSS_S_DEFECTIVE_TOKEN;
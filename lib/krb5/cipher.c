@@ -0,0 +1,422 @@
+/* krb5/cipher.c --- AES encryption for Krb5 GSS per-message tokens.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* The RFC 4121 Wrap tokens of the AES enctypes are encrypted with
+   AES-CBC and ciphertext stealing.  Shishi re-expands the key and
+   allocates the output on every call, and only offers the variant
+   with ciphertext stealing.  When the CPU has AES instructions the
+   key is expanded once per context and the blocks are encrypted
+   here; otherwise the calls below go to Shishi. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Get specification. */
+#include "cipher.h"
+
+#ifdef HAVE_X86_CRYPTO_INTRINSICS
+
+# include <cpuid.h>
+# include <immintrin.h>
+
+/* Zero until the features have been looked up. */
+static int cpu_features;
+
+int
+_gss_krb5_cpu_features (void)
+{
+  unsigned int eax, ebx, ecx, edx, xcr0 = 0, ecx1;
+  int features = __atomic_load_n (&cpu_features, __ATOMIC_RELAXED);
+
+  if (features)
+    return features;
+
+  features = _GSS_KRB5_CPU_KNOWN;
+  if (__get_cpuid (1, &eax, &ebx, &ecx1, &edx)
+      && (ecx1 & bit_SSSE3) && (ecx1 & bit_SSE4_1))
+    {
+      /* The AVX registers are only usable if the kernel saves them. */
+      if ((ecx1 & bit_OSXSAVE) && (ecx1 & bit_AVX))
+	__asm__ ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
+
+      if (ecx1 & bit_AES)
+	features |= _GSS_KRB5_CPU_AES;
+      if (__get_cpuid_count (7, 0, &eax, &ebx, &ecx, &edx))
+	{
+	  if (ebx & bit_SHA)
+	    features |= _GSS_KRB5_CPU_SHA;
+	  if ((ebx & bit_AVX2) && (xcr0 & 6) == 6)
+	    features |= _GSS_KRB5_CPU_AVX2;
+	}
+    }
+
+  __atomic_store_n (&cpu_features, features, __ATOMIC_RELAXED);
+
+  return features;
+}
+
+# define AESNI __attribute__ ((target ("aes,sse2")))
+
+# define LOAD(p) _mm_loadu_si128 ((const __m128i *) (const void *) (p))
+# define STORE(p, x) _mm_storeu_si128 ((__m128i *) (void *) (p), x)
+
+/* One step of the AES key schedule: the running XOR of the words of
+   K, plus the word of the key generation assist result T that the
+   caller selected into every lane. */
+AESNI static __m128i
+expand_step (__m128i k, __m128i t)
+{
+  k = _mm_xor_si128 (k, _mm_slli_si128 (k, 4));
+  k = _mm_xor_si128 (k, _mm_slli_si128 (k, 4));
+  k = _mm_xor_si128 (k, _mm_slli_si128 (k, 4));
+  return _mm_xor_si128 (k, t);
+}
+
+# define EXPAND(k, prev, rcon, sel)					\
+  expand_step (k, _mm_shuffle_epi32 (_mm_aeskeygenassist_si128 (prev, rcon), \
+				     sel))
+
+AESNI static void
+aesni_expand (_gss_krb5_aes_key * aes, const char *key, size_t keylen)
+{
+  __m128i rk[_GSS_KRB5_AES_MAX_ROUNDS + 1];
+  int i;
+
+  rk[0] = LOAD (key);
+  if (keylen == 16)
+    {
+      rk[1] = EXPAND (rk[0], rk[0], 0x01, 0xff);
+      rk[2] = EXPAND (rk[1], rk[1], 0x02, 0xff);
+      rk[3] = EXPAND (rk[2], rk[2], 0x04, 0xff);
+      rk[4] = EXPAND (rk[3], rk[3], 0x08, 0xff);
+      rk[5] = EXPAND (rk[4], rk[4], 0x10, 0xff);
+      rk[6] = EXPAND (rk[5], rk[5], 0x20, 0xff);
+      rk[7] = EXPAND (rk[6], rk[6], 0x40, 0xff);
+      rk[8] = EXPAND (rk[7], rk[7], 0x80, 0xff);
+      rk[9] = EXPAND (rk[8], rk[8], 0x1b, 0xff);
+      rk[10] = EXPAND (rk[9], rk[9], 0x36, 0xff);
+      aes->rounds = 10;
+    }
+  else
+    {
+      rk[1] = LOAD (key + 16);
+      rk[2] = EXPAND (rk[0], rk[1], 0x01, 0xff);
+      rk[3] = EXPAND (rk[1], rk[2], 0x00, 0xaa);
+      rk[4] = EXPAND (rk[2], rk[3], 0x02, 0xff);
+      rk[5] = EXPAND (rk[3], rk[4], 0x00, 0xaa);
+      rk[6] = EXPAND (rk[4], rk[5], 0x04, 0xff);
+      rk[7] = EXPAND (rk[5], rk[6], 0x00, 0xaa);
+      rk[8] = EXPAND (rk[6], rk[7], 0x08, 0xff);
+      rk[9] = EXPAND (rk[7], rk[8], 0x00, 0xaa);
+      rk[10] = EXPAND (rk[8], rk[9], 0x10, 0xff);
+      rk[11] = EXPAND (rk[9], rk[10], 0x00, 0xaa);
+      rk[12] = EXPAND (rk[10], rk[11], 0x20, 0xff);
+      rk[13] = EXPAND (rk[11], rk[12], 0x00, 0xaa);
+      rk[14] = EXPAND (rk[12], rk[13], 0x40, 0xff);
+      aes->rounds = 14;
+    }
+
+  /* The equivalent inverse cipher, FIPS 197 section 5.3.5, uses the
+     round keys in reverse order, with InvMixColumns applied to all
+     but the first and last. */
+  for (i = 0; i <= aes->rounds; i++)
+    {
+      STORE (aes->enc + 16 * i, rk[i]);
+      if (i == 0 || i == aes->rounds)
+	STORE (aes->dec + 16 * (aes->rounds - i), rk[i]);
+      else
+	STORE (aes->dec + 16 * (aes->rounds - i), _mm_aesimc_si128 (rk[i]));
+    }
+
+  memset (rk, 0, sizeof (rk));
+}
+
+AESNI static __m128i
+aesni_encrypt (const _gss_krb5_aes_key * aes, __m128i b)
+{
+  int i;
+
+  b = _mm_xor_si128 (b, LOAD (aes->enc));
+  for (i = 1; i < aes->rounds; i++)
+    b = _mm_aesenc_si128 (b, LOAD (aes->enc + 16 * i));
+  return _mm_aesenclast_si128 (b, LOAD (aes->enc + 16 * aes->rounds));
+}
+
+AESNI static __m128i
+aesni_decrypt (const _gss_krb5_aes_key * aes, __m128i b)
+{
+  int i;
+
+  b = _mm_xor_si128 (b, LOAD (aes->dec));
+  for (i = 1; i < aes->rounds; i++)
+    b = _mm_aesdec_si128 (b, LOAD (aes->dec + 16 * i));
+  return _mm_aesdeclast_si128 (b, LOAD (aes->dec + 16 * aes->rounds));
+}
+
+/* CBC encryption is sequential, but the blocks can be decrypted
+   independently, so four are kept in flight to hide the latency of
+   the AES instructions. */
+AESNI static void
+aesni_cbc (const _gss_krb5_aes_key * aes, int decryptp, char *iv,
+	   const char *in, char *out, size_t len)
+{
+  __m128i v = LOAD (iv), b0, b1, b2, b3, c0, c1, c2, c3, k;
+  size_t i = 0;
+  int r;
+
+  if (!decryptp)
+    {
+      for (; i < len; i += 16)
+	{
+	  v = aesni_encrypt (aes, _mm_xor_si128 (LOAD (in + i), v));
+	  STORE (out + i, v);
+	}
+      STORE (iv, v);
+      return;
+    }
+
+  for (; i + 64 <= len; i += 64)
+    {
+      c0 = LOAD (in + i);
+      c1 = LOAD (in + i + 16);
+      c2 = LOAD (in + i + 32);
+      c3 = LOAD (in + i + 48);
+      k = LOAD (aes->dec);
+      b0 = _mm_xor_si128 (c0, k);
+      b1 = _mm_xor_si128 (c1, k);
+      b2 = _mm_xor_si128 (c2, k);
+      b3 = _mm_xor_si128 (c3, k);
+      for (r = 1; r < aes->rounds; r++)
+	{
+	  k = LOAD (aes->dec + 16 * r);
+	  b0 = _mm_aesdec_si128 (b0, k);
+	  b1 = _mm_aesdec_si128 (b1, k);
+	  b2 = _mm_aesdec_si128 (b2, k);
+	  b3 = _mm_aesdec_si128 (b3, k);
+	}
+      k = LOAD (aes->dec + 16 * aes->rounds);
+      STORE (out + i, _mm_xor_si128 (_mm_aesdeclast_si128 (b0, k), v));
+      STORE (out + i + 16, _mm_xor_si128 (_mm_aesdeclast_si128 (b1, k), c0));
+      STORE (out + i + 32, _mm_xor_si128 (_mm_aesdeclast_si128 (b2, k), c1));
+      STORE (out + i + 48, _mm_xor_si128 (_mm_aesdeclast_si128 (b3, k), c2));
+      v = c3;
+    }
+
+  for (; i < len; i += 16)
+    {
+      c0 = LOAD (in + i);
+      STORE (out + i, _mm_xor_si128 (aesni_decrypt (aes, c0), v));
+      v = c0;
+    }
+  STORE (iv, v);
+}
+
+/* CBC with ciphertext stealing as in RFC 3962 section 5: the last
+   two blocks of the CBC encryption of the zero-padded input are
+   swapped and the output is truncated to the length of the input. */
+AESNI static void
+aesni_cts (const _gss_krb5_aes_key * aes, int decryptp, const char *iv,
+	   const char *in, char *out, size_t len)
+{
+  char chain[16], last[16], x[16], y[16];
+  size_t head, r;
+  __m128i d;
+
+  memcpy (chain, iv, 16);
+  if (len == 16)
+    {
+      aesni_cbc (aes, decryptp, chain, in, out, 16);
+      return;
+    }
+
+  /* HEAD whole blocks, then one more, and a final one of R bytes. */
+  head = (len - 17) / 16 * 16;
+  r = len - head - 16;
+
+  /* Save the tail before OUT, which may be IN, is written. */
+  memcpy (x, in + head, 16);
+  memset (last, 0, sizeof (last));
+  memcpy (last, in + head + 16, r);
+
+  if (head > 0)
+    aesni_cbc (aes, decryptp, chain, in, out, head);
+
+  if (!decryptp)
+    {
+      d = aesni_encrypt (aes, _mm_xor_si128 (LOAD (x), LOAD (chain)));
+      STORE (y, d);
+      d = aesni_encrypt (aes, _mm_xor_si128 (LOAD (last), d));
+      STORE (out + head, d);
+      memcpy (out + head + 16, y, r);
+    }
+  else
+    {
+      /* X is the final block of the CBC output, LAST the start of the
+         one before it, whose remaining bytes are those of the
+         decryption of X, as the plaintext was padded with zeros. */
+      STORE (y, aesni_decrypt (aes, LOAD (x)));
+      memcpy (last + r, y + r, 16 - r);
+      d = _mm_xor_si128 (aesni_decrypt (aes, LOAD (last)), LOAD (chain));
+      STORE (out + head, d);
+      d = _mm_xor_si128 (LOAD (y), LOAD (last));
+      STORE (x, d);
+      memcpy (out + head + 16, x, r);
+    }
+
+  memset (y, 0, sizeof (y));
+  memset (x, 0, sizeof (x));
+  memset (last, 0, sizeof (last));
+}
+
+#else
+
+int
+_gss_krb5_cpu_features (void)
+{
+  return _GSS_KRB5_CPU_KNOWN;
+}
+
+#endif
+
+/* Name the implementation that _gss_krb5_aes_init picks, for the
+   self tests. */
+const char *
+_gss_krb5_cipher_provider (void)
+{
+  return _gss_krb5_cpu_features () & _GSS_KRB5_CPU_AES ? "aes-ni" : "shishi";
+}
+
+/* Set up AES to encrypt with KEY, which it takes ownership of. */
+void
+_gss_krb5_aes_init (_gss_krb5_aes_key * aes, Shishi_key * key)
+{
+  memset (aes, 0, sizeof (*aes));
+  aes->key = key;
+
+#ifdef HAVE_X86_CRYPTO_INTRINSICS
+  if ((_gss_krb5_cpu_features () & _GSS_KRB5_CPU_AES)
+      && (shishi_key_length (key) == 16 || shishi_key_length (key) == 32))
+    aesni_expand (aes, shishi_key_value (key), shishi_key_length (key));
+#endif
+}
+
+/* Release the key of AES and wipe the expanded key. */
+void
+_gss_krb5_aes_done (_gss_krb5_aes_key * aes)
+{
+  if (aes->key)
+    shishi_key_done (aes->key);
+  memset (aes, 0, sizeof (*aes));
+}
+
+/* Encrypt (DECRYPTP zero) or decrypt the LEN bytes at IN, a non-zero
+   multiple of the block size, with plain AES-CBC, using and updating
+   the chaining value IV, and write the result to OUT, which may be
+   IN.  SH is a handle from _gss_krb5_crypto_get, used when the CPU
+   has no AES instructions.  Returns a Shishi error code. */
+int
+_gss_krb5_aes_cbc (Shishi * sh, const _gss_krb5_aes_key * aes,
+		   int decryptp, char *iv, const char *in, char *out,
+		   size_t len)
+{
+  char next[16], tmpblk[16];
+  char *tmp;
+  int rc;
+
+#ifdef HAVE_X86_CRYPTO_INTRINSICS
+  if (aes->rounds)
+    {
+      aesni_cbc (aes, decryptp, iv, in, out, len);
+      return SHISHI_OK;
+    }
+#endif
+
+  /* Shishi only offers CBC with ciphertext stealing, which for two or
+     more whole blocks is CBC with the last two blocks swapped. */
+  if (out != in)
+    memcpy (out, in, len);
+
+  if (decryptp)
+    memcpy (next, out + len - 16, 16);
+
+  if (decryptp && len > 16)
+    {
+      memcpy (tmpblk, out + len - 32, 16);
+      memcpy (out + len - 32, out + len - 16, 16);
+      memcpy (out + len - 16, tmpblk, 16);
+    }
+
+  rc = shishi_aes_cts (sh, decryptp, shishi_key_value (aes->key),
+		       shishi_key_length (aes->key), iv, NULL, out, len,
+		       &tmp);
+  if (rc != SHISHI_OK)
+    return rc;
+
+  if (!decryptp && len > 16)
+    {
+      memcpy (out, tmp, len - 32);
+      memcpy (out + len - 32, tmp + len - 16, 16);
+      memcpy (out + len - 16, tmp + len - 32, 16);
+    }
+  else
+    memcpy (out, tmp, len);
+  free (tmp);
+
+  if (!decryptp)
+    memcpy (next, out + len - 16, 16);
+  memcpy (iv, next, 16);
+
+  return SHISHI_OK;
+}
+
+/* Encrypt (DECRYPTP zero) or decrypt the LEN bytes at IN, at least
+   one block, with AES-CBC with ciphertext stealing as in RFC 3962,
+   starting from the chaining value IV, and write the result to OUT,
+   which may be IN.  Returns a Shishi error code. */
+int
+_gss_krb5_aes_cts (Shishi * sh, const _gss_krb5_aes_key * aes,
+		   int decryptp, const char *iv, const char *in, char *out,
+		   size_t len)
+{
+  char *tmp;
+  int rc;
+
+#ifdef HAVE_X86_CRYPTO_INTRINSICS
+  if (aes->rounds)
+    {
+      aesni_cts (aes, decryptp, iv, in, out, len);
+      return SHISHI_OK;
+    }
+#endif
+
+  rc = shishi_aes_cts (sh, decryptp, shishi_key_value (aes->key),
+		       shishi_key_length (aes->key), iv, NULL, in, len, &tmp);
+  if (rc != SHISHI_OK)
+    return rc;
+
+  memcpy (out, tmp, len);
+  free (tmp);
+
+  return SHISHI_OK;
+}
@@ -0,0 +1,63 @@
+/* krb5/cipher.h --- AES encryption for Krb5 GSS per-message tokens.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _GSS_KRB5_CIPHER_H
+#define _GSS_KRB5_CIPHER_H
+
+#include <stddef.h>
+
+#include <shishi.h>
+
+#define _GSS_KRB5_AES_BLOCK 16
+#define _GSS_KRB5_AES_MAX_ROUNDS 14
+
+/* Instruction set extensions found by _gss_krb5_cpu_features. */
+#define _GSS_KRB5_CPU_KNOWN 1
+#define _GSS_KRB5_CPU_AES 2
+#define _GSS_KRB5_CPU_SHA 4
+#define _GSS_KRB5_CPU_AVX2 8
+
+/* An AES key.  When the CPU has AES instructions, ROUNDS is non-zero
+   and ENC and DEC hold the expanded key for encryption and
+   decryption; otherwise Shishi does the work with KEY. */
+typedef struct _gss_krb5_aes_struct
+{
+  Shishi_key *key;
+  int rounds;
+  unsigned char enc[(_GSS_KRB5_AES_MAX_ROUNDS + 1) * _GSS_KRB5_AES_BLOCK];
+  unsigned char dec[(_GSS_KRB5_AES_MAX_ROUNDS + 1) * _GSS_KRB5_AES_BLOCK];
+} _gss_krb5_aes_key;
+
+extern int _gss_krb5_cpu_features (void);
+extern const char *_gss_krb5_cipher_provider (void);
+
+extern void _gss_krb5_aes_init (_gss_krb5_aes_key * aes, Shishi_key * key);
+extern void _gss_krb5_aes_done (_gss_krb5_aes_key * aes);
+
+extern int _gss_krb5_aes_cbc (Shishi * sh, const _gss_krb5_aes_key * aes,
+			      int decryptp, char *iv,
+			      const char *in, char *out, size_t len);
+extern int _gss_krb5_aes_cts (Shishi * sh, const _gss_krb5_aes_key * aes,
+			      int decryptp, const char *iv,
+			      const char *in, char *out, size_t len);
+
+#endif /* _GSS_KRB5_CIPHER_H */
@@ -32,7 +32,10 @@
 
 /* Request part of gss_krb5_init_sec_context.  Assumes that
    context_handle is valid, and has krb5 specific structure, and that
-   output_token is valid and cleared. */
+   output_token is valid and cleared.  If WAIT_FD is not NULL and the
+   service ticket has to be requested from the KDC, the request is
+   left running in k5->fetch, and GSS_S_CONTINUE_NEEDED is returned
+   with the descriptor to wait for in WAIT_FD. */
 static OM_uint32
 init_request (OM_uint32 * minor_status,
 	      const gss_cred_id_t initiator_cred_handle,
@@ -45,7 +48,7 @@ init_request (OM_uint32 * minor_status,
 	      const gss_buffer_t input_token,
 	      gss_OID * actual_mech_type,
 	      gss_buffer_t output_token,
-	      OM_uint32 * ret_flags, OM_uint32 * time_rec)
+	      OM_uint32 * ret_flags, OM_uint32 * time_rec, int *wait_fd)
 {
   gss_ctx_id_t ctx = *context_handle;
   _gss_krb5_ctx_t k5 = ctx->krb5;
@@ -54,18 +57,40 @@ init_request (OM_uint32 * minor_status,
   int rc;
   OM_uint32 maj_stat;
   Shishi_tkts_hint hint;
+  uint32_t seqnr;
 
   /* Get service ticket. */
-  maj_stat = gss_krb5_canonicalize_name (minor_status, target_name,
-					 GSS_C_NO_OID, &k5->peerptr);
-  if (GSS_ERROR (maj_stat))
-    return maj_stat;
+  if (k5->peerptr == GSS_C_NO_NAME)
+    {
+      maj_stat = gss_krb5_canonicalize_name (minor_status, target_name,
+					     GSS_C_NO_OID, &k5->peerptr);
+      if (GSS_ERROR (maj_stat))
+	return maj_stat;
+    }
 
   memset (&hint, 0, sizeof (hint));
   hint.server = k5->peerptr->value;
   hint.endtime = time_req;
 
-  k5->tkt = shishi_tkts_get (shishi_tkts_default (k5->sh), &hint);
+  if (wait_fd && !k5->fetch)
+    {
+      k5->tkt = _gss_krb5_handle_tkt_cached (k5->handle, &hint);
+      if (!k5->tkt)
+	k5->fetch = _gss_krb5_fetch_start (k5->handle, &hint);
+    }
+
+  if (k5->fetch)
+    {
+      if (!_gss_krb5_fetch_wait (k5->fetch, wait_fd == NULL, &k5->tkt))
+	{
+	  *wait_fd = _gss_krb5_fetch_fd (k5->fetch);
+	  return GSS_S_CONTINUE_NEEDED;
+	}
+      k5->fetch = NULL;
+    }
+  else if (!k5->tkt)
+    k5->tkt = _gss_krb5_handle_tkt (k5->handle, &hint);
+
   if (!k5->tkt)
     {
       if (minor_status)
@@ -85,15 +110,16 @@ init_request (OM_uint32 * minor_status,
   rc = shishi_ap_tktoptionsraw (k5->sh, &k5->ap, k5->tkt,
 				SHISHI_APOPTIONS_MUTUAL_REQUIRED,
 				0x8003, cksum, cksumlen);
-  free (cksum);
+  _gss_free (cksum);
   if (rc != SHISHI_OK)
     return GSS_S_FAILURE;
 
   rc = shishi_authenticator_seqnumber_get (k5->sh,
 					   shishi_ap_authenticator (k5->ap),
-					   &k5->initseqnr);
+					   &seqnr);
   if (rc != SHISHI_OK)
     return GSS_S_FAILURE;
+  k5->initseqnr = seqnr;
 
   rc = shishi_ap_req_der (k5->ap, &der, &derlen);
   if (rc != SHISHI_OK)
@@ -134,28 +160,22 @@ init_reply (OM_uint32 * minor_status,
 {
   gss_ctx_id_t ctx = *context_handle;
   _gss_krb5_ctx_t k5 = ctx->krb5;
-  OM_uint32 tmp_min_stat;
   gss_buffer_desc data;
+  uint32_t seqnr;
   int rc;
 
-  if (gss_decapsulate_token (input_token, GSS_KRB5, &data) != GSS_S_COMPLETE)
+  if (gss_decapsulate_token_view (input_token, GSS_KRB5, &data)
+      != GSS_S_COMPLETE)
     return GSS_S_DEFECTIVE_TOKEN;
 
   if (data.length < TOK_LEN)
-    {
-      gss_release_buffer (&tmp_min_stat, &data);
-      return GSS_S_DEFECTIVE_TOKEN;
-    }
+    return GSS_S_DEFECTIVE_TOKEN;
 
   if (memcmp (data.value, TOK_AP_REP, TOK_LEN) != 0)
-    {
-      gss_release_buffer (&tmp_min_stat, &data);
-      return GSS_S_DEFECTIVE_TOKEN;
-    }
+    return GSS_S_DEFECTIVE_TOKEN;
 
   rc = shishi_ap_rep_der_set (k5->ap, (char *) data.value + TOK_LEN,
 			      data.length - TOK_LEN);
-  gss_release_buffer (&tmp_min_stat, &data);
   if (rc != SHISHI_OK)
     return GSS_S_DEFECTIVE_TOKEN;
 
@@ -165,38 +185,50 @@ init_reply (OM_uint32 * minor_status,
 
   rc = shishi_encapreppart_seqnumber_get (k5->sh,
 					  shishi_ap_encapreppart (k5->ap),
-					  &k5->acceptseqnr);
+					  &seqnr);
   if (rc != SHISHI_OK)
     {
       /* A strict 1964 implementation would return
          GSS_S_DEFECTIVE_TOKEN here.  gssapi-cfx permit absent
          sequence number, though. */
-      k5->acceptseqnr = 0;
+      seqnr = 0;
     }
+  k5->acceptseqnr = seqnr;
 
   return GSS_S_COMPLETE;
 }
 
-/* Initiates the establishment of a krb5 security context between the
-   application and a remote peer.  Assumes that context_handle and
-   output_token are valid and cleared. */
-OM_uint32
-gss_krb5_init_sec_context (OM_uint32 * minor_status,
-			   const gss_cred_id_t initiator_cred_handle,
-			   gss_ctx_id_t * context_handle,
-			   const gss_name_t target_name,
-			   const gss_OID mech_type,
-			   OM_uint32 req_flags,
-			   OM_uint32 time_req,
-			   const gss_channel_bindings_t input_chan_bindings,
-			   const gss_buffer_t input_token,
-			   gss_OID * actual_mech_type,
-			   gss_buffer_t output_token,
-			   OM_uint32 * ret_flags, OM_uint32 * time_rec)
+/* Release the krb5 part of CTX after the first call to
+   init_sec_context failed, so that the caller only has CTX itself to
+   free. */
+static void
+init_abandon (gss_ctx_id_t ctx)
+{
+  gss_krb5_delete_sec_context (NULL, &ctx, GSS_C_NO_BUFFER);
+  ctx->krb5 = NULL;
+}
+
+/* Shared by gss_krb5_init_sec_context and
+   gss_krb5_init_sec_context_async.  WAIT_FD is NULL for the
+   former. */
+static OM_uint32
+init_sec_context (OM_uint32 * minor_status,
+		  const gss_cred_id_t initiator_cred_handle,
+		  gss_ctx_id_t * context_handle,
+		  const gss_name_t target_name,
+		  const gss_OID mech_type,
+		  OM_uint32 req_flags,
+		  OM_uint32 time_req,
+		  const gss_channel_bindings_t input_chan_bindings,
+		  const gss_buffer_t input_token,
+		  gss_OID * actual_mech_type,
+		  gss_buffer_t output_token,
+		  OM_uint32 * ret_flags, OM_uint32 * time_rec, int *wait_fd)
 {
   gss_ctx_id_t ctx = *context_handle;
   _gss_krb5_ctx_t k5 = ctx->krb5;
   OM_uint32 maj_stat;
+  int first = k5 == NULL;
   int rc;
 
   if (minor_status)
@@ -220,7 +252,7 @@ gss_krb5_init_sec_context (OM_uint32 * minor_status,
 
   if (k5 == NULL)
     {
-      k5 = ctx->krb5 = calloc (sizeof (*k5), 1);
+      k5 = ctx->krb5 = _gss_calloc (sizeof (*k5), 1);
       if (!k5)
 	{
 	  if (minor_status)
@@ -228,9 +260,24 @@ gss_krb5_init_sec_context (OM_uint32 * minor_status,
 	  return GSS_S_FAILURE;
 	}
 
-      rc = shishi_init (&k5->sh);
+      rc = _gss_krb5_lock_init (k5);
+      if (rc != 0)
+	{
+	  _gss_free (k5);
+	  ctx->krb5 = NULL;
+	  if (minor_status)
+	    *minor_status = rc;
+	  return GSS_S_FAILURE;
+	}
+
+      rc = _gss_krb5_handle_get (&k5->handle, &k5->sh);
       if (rc != SHISHI_OK)
-	return GSS_S_FAILURE;
+	{
+	  _gss_krb5_lock_done (k5);
+	  _gss_free (k5);
+	  ctx->krb5 = NULL;
+	  return GSS_S_FAILURE;
+	}
     }
 
   if (!k5->reqdone)
@@ -245,8 +292,16 @@ gss_krb5_init_sec_context (OM_uint32 * minor_status,
 			       input_chan_bindings,
 			       input_token,
 			       actual_mech_type,
-			       output_token, ret_flags, time_rec);
+			       output_token, ret_flags, time_rec, wait_fd);
       if (GSS_ERROR (maj_stat))
+	{
+	  if (first)
+	    init_abandon (ctx);
+	  return maj_stat;
+	}
+
+      /* Still waiting for the service ticket. */
+      if (k5->fetch)
 	return maj_stat;
 
       k5->flags = req_flags & (	/* GSS_C_DELEG_FLAG | */
@@ -261,6 +316,15 @@ gss_krb5_init_sec_context (OM_uint32 * minor_status,
 	*ret_flags = k5->flags;
 
       k5->key = shishi_ap_key (k5->ap);
+      if (_gss_krb5_derive_keys (k5) != SHISHI_OK)
+	{
+	  if (first)
+	    {
+	      gss_release_buffer (NULL, output_token);
+	      init_abandon (ctx);
+	    }
+	  return GSS_S_FAILURE;
+	}
       k5->reqdone = 1;
     }
   else if (k5->reqdone && k5->flags & GSS_C_MUTUAL_FLAG && !k5->repdone)
@@ -293,6 +357,55 @@ gss_krb5_init_sec_context (OM_uint32 * minor_status,
   return maj_stat;
 }
 
+/* Initiates the establishment of a krb5 security context between the
+   application and a remote peer.  Assumes that context_handle and
+   output_token are valid and cleared. */
+OM_uint32
+gss_krb5_init_sec_context (OM_uint32 * minor_status,
+			   const gss_cred_id_t initiator_cred_handle,
+			   gss_ctx_id_t * context_handle,
+			   const gss_name_t target_name,
+			   const gss_OID mech_type,
+			   OM_uint32 req_flags,
+			   OM_uint32 time_req,
+			   const gss_channel_bindings_t input_chan_bindings,
+			   const gss_buffer_t input_token,
+			   gss_OID * actual_mech_type,
+			   gss_buffer_t output_token,
+			   OM_uint32 * ret_flags, OM_uint32 * time_rec)
+{
+  return init_sec_context (minor_status, initiator_cred_handle,
+			   context_handle, target_name, mech_type, req_flags,
+			   time_req, input_chan_bindings, input_token,
+			   actual_mech_type, output_token, ret_flags, time_rec,
+			   NULL);
+}
+
+/* As gss_krb5_init_sec_context, but requests a missing service
+   ticket in the background, see gss_init_sec_context_async. */
+OM_uint32
+gss_krb5_init_sec_context_async (OM_uint32 * minor_status,
+				 const gss_cred_id_t initiator_cred_handle,
+				 gss_ctx_id_t * context_handle,
+				 const gss_name_t target_name,
+				 const gss_OID mech_type,
+				 OM_uint32 req_flags,
+				 OM_uint32 time_req,
+				 const gss_channel_bindings_t
+				 input_chan_bindings,
+				 const gss_buffer_t input_token,
+				 gss_OID * actual_mech_type,
+				 gss_buffer_t output_token,
+				 OM_uint32 * ret_flags,
+				 OM_uint32 * time_rec, int *wait_fd)
+{
+  return init_sec_context (minor_status, initiator_cred_handle,
+			   context_handle, target_name, mech_type, req_flags,
+			   time_req, input_chan_bindings, input_token,
+			   actual_mech_type, output_token, ret_flags, time_rec,
+			   wait_fd);
+}
+
 /* Allows a remotely initiated security context between the
    application and a remote peer to be established, using krb5.
    Assumes context_handle is valid. */
@@ -313,7 +426,7 @@ gss_krb5_accept_sec_context (OM_uint32 * minor_status,
   gss_ctx_id_t cx;
   _gss_krb5_ctx_t cxk5;
   _gss_krb5_cred_t crk5;
-  OM_uint32 tmp_min_stat;
+  uint32_t seqnr;
   int rc;
 
   if (minor_status)
@@ -331,7 +444,7 @@ gss_krb5_accept_sec_context (OM_uint32 * minor_status,
 
   crk5 = acceptor_cred_handle->krb5;
 
-  cx = calloc (sizeof (*cx), 1);
+  cx = _gss_calloc (sizeof (*cx), 1);
   if (!cx)
     {
       if (minor_status)
@@ -339,15 +452,25 @@ gss_krb5_accept_sec_context (OM_uint32 * minor_status,
       return GSS_S_FAILURE;
     }
 
-  cxk5 = calloc (sizeof (*cxk5), 1);
+  cxk5 = _gss_calloc (sizeof (*cxk5), 1);
   if (!cxk5)
     {
-      free (cx);
+      _gss_free (cx);
       if (minor_status)
 	*minor_status = ENOMEM;
       return GSS_S_FAILURE;
     }
 
+  rc = _gss_krb5_lock_init (cxk5);
+  if (rc != 0)
+    {
+      _gss_free (cxk5);
+      _gss_free (cx);
+      if (minor_status)
+	*minor_status = rc;
+      return GSS_S_FAILURE;
+    }
+
   cx->mech = GSS_KRB5;
   cx->krb5 = cxk5;
   /* XXX cx->peer?? */
@@ -361,25 +484,18 @@ gss_krb5_accept_sec_context (OM_uint32 * minor_status,
   if (rc != SHISHI_OK)
     return GSS_S_FAILURE;
 
-  rc = gss_decapsulate_token (input_token_buffer, GSS_KRB5, &in);
+  rc = gss_decapsulate_token_view (input_token_buffer, GSS_KRB5, &in);
   if (rc != GSS_S_COMPLETE)
     return GSS_S_BAD_MIC;
 
   if (in.length < TOK_LEN)
-    {
-      gss_release_buffer (&tmp_min_stat, &in);
-      return GSS_S_BAD_MIC;
-    }
+    return GSS_S_BAD_MIC;
 
   if (memcmp (in.value, TOK_AP_REQ, TOK_LEN) != 0)
-    {
-      gss_release_buffer (&tmp_min_stat, &in);
-      return GSS_S_BAD_MIC;
-    }
+    return GSS_S_BAD_MIC;
 
   rc = shishi_ap_req_der_set (cxk5->ap, (char *) in.value + TOK_LEN,
 			      in.length - TOK_LEN);
-  gss_release_buffer (&tmp_min_stat, &in);
   if (rc != SHISHI_OK)
     return GSS_S_FAILURE;
 
@@ -393,9 +509,10 @@ gss_krb5_accept_sec_context (OM_uint32 * minor_status,
 
   rc = shishi_authenticator_seqnumber_get (cxk5->sh,
 					   shishi_ap_authenticator (cxk5->ap),
-					   &cxk5->initseqnr);
+					   &seqnr);
   if (rc != SHISHI_OK)
     return GSS_S_FAILURE;
+  cxk5->initseqnr = seqnr;
 
   rc = _gss_krb5_checksum_parse (minor_status,
 				 context_handle, input_chan_bindings);
@@ -404,6 +521,8 @@ gss_krb5_accept_sec_context (OM_uint32 * minor_status,
 
   cxk5->tkt = shishi_ap_tkt (cxk5->ap);
   cxk5->key = shishi_ap_key (cxk5->ap);
+  if (_gss_krb5_derive_keys (cxk5) != SHISHI_OK)
+    return GSS_S_FAILURE;
 
   if (shishi_apreq_mutual_required_p (crk5->sh, shishi_ap_req (cxk5->ap)))
     {
@@ -420,14 +539,15 @@ gss_krb5_accept_sec_context (OM_uint32 * minor_status,
 
       rc = shishi_encapreppart_seqnumber_get (cxk5->sh,
 					      shishi_ap_encapreppart
-					      (cxk5->ap), &cxk5->acceptseqnr);
+					      (cxk5->ap), &seqnr);
       if (rc != SHISHI_OK)
 	{
 	  /* A strict 1964 implementation would return
 	     GSS_S_DEFECTIVE_TOKEN here.  gssapi-cfx permit absent
 	     sequence number, though. */
-	  cxk5->acceptseqnr = 0;
+	  seqnr = 0;
 	}
+      cxk5->acceptseqnr = seqnr;
 
       rc = shishi_asn1_to_der (crk5->sh, aprep, &der, &len);
       if (rc != SHISHI_OK)
@@ -457,20 +577,32 @@ gss_krb5_accept_sec_context (OM_uint32 * minor_status,
   if (src_name)
     {
       gss_name_t p;
+      char *client;
+      size_t clientlen;
 
-      p = malloc (sizeof (*p));
-      if (!p)
+      rc = shishi_encticketpart_client (cxk5->sh,
+					shishi_tkt_encticketpart (cxk5->tkt),
+					&client, &clientlen);
+      if (rc != SHISHI_OK)
+	return GSS_S_FAILURE;
+
+      /* The name is released with gss_release_name, so it has to be
+         copied from the memory allocated by Shishi. */
+      p = _gss_malloc (sizeof (*p));
+      if (p)
+	p->value = _gss_malloc (clientlen + 1);
+      if (!p || !p->value)
 	{
+	  _gss_free (p);
+	  free (client);
 	  if (minor_status)
 	    *minor_status = ENOMEM;
 	  return GSS_S_FAILURE;
 	}
-
-      rc = shishi_encticketpart_client (cxk5->sh,
-					shishi_tkt_encticketpart (cxk5->tkt),
-					&p->value, &p->length);
-      if (rc != SHISHI_OK)
-	return GSS_S_FAILURE;
+      memcpy (p->value, client, clientlen);
+      p->value[clientlen] = '\0';
+      p->length = clientlen;
+      free (client);
 
       p->type = GSS_KRB5_NT_PRINCIPAL_NAME;
 
@@ -496,15 +628,22 @@ gss_krb5_delete_sec_context (OM_uint32 * minor_status,
 {
   _gss_krb5_ctx_t k5 = (*context_handle)->krb5;
 
+  /* The handle is in use until a pending ticket request finishes. */
+  if (k5->fetch)
+    _gss_krb5_fetch_wait (k5->fetch, 1, &k5->tkt);
+
   if (k5->peerptr != GSS_C_NO_NAME)
     gss_release_name (NULL, &k5->peerptr);
 
+  _gss_krb5_release_keys (k5);
+
   if (k5->ap)
     shishi_ap_done (k5->ap);
 
   if (!k5->acceptor)
-    shishi_done (k5->sh);
-  free (k5);
+    _gss_krb5_handle_put (k5->handle);
+  _gss_krb5_lock_done (k5);
+  _gss_free (k5);
 
   if (minor_status)
     *minor_status = 0;
@@ -65,7 +65,7 @@ acquire_cred1 (OM_uint32 * minor_status,
   {
     char *p;
 
-    p = malloc (k5->peerptr->length + 1);
+    p = _gss_malloc (k5->peerptr->length + 1);
     if (!p)
       {
 	if (minor_status)
@@ -77,7 +77,7 @@ acquire_cred1 (OM_uint32 * minor_status,
 
     k5->key = shishi_hostkeys_for_serverrealm (k5->sh, p, NULL);
 
-    free (p);
+    _gss_free (p);
   }
 
   if (!k5->key)
@@ -105,7 +105,7 @@ gss_krb5_acquire_cred (OM_uint32 * minor_status,
   OM_uint32 maj_stat;
   gss_cred_id_t p = *output_cred_handle;
 
-  p->krb5 = calloc (sizeof (*p->krb5), 1);
+  p->krb5 = _gss_calloc (sizeof (*p->krb5), 1);
   if (!p->krb5)
     {
       if (minor_status)
@@ -118,14 +118,14 @@ gss_krb5_acquire_cred (OM_uint32 * minor_status,
       maj_stat = gss_create_empty_oid_set (minor_status, actual_mechs);
       if (GSS_ERROR (maj_stat))
 	{
-	  free (p->krb5);
+	  _gss_free (p->krb5);
 	  return maj_stat;
 	}
       maj_stat = gss_add_oid_set_member (minor_status, GSS_KRB5,
 					 actual_mechs);
       if (GSS_ERROR (maj_stat))
 	{
-	  free (p->krb5);
+	  _gss_free (p->krb5);
 	  return maj_stat;
 	}
     }
@@ -137,7 +137,7 @@ gss_krb5_acquire_cred (OM_uint32 * minor_status,
     {
       if (actual_mechs)
 	gss_release_oid_set (NULL, actual_mechs);
-      free (p->krb5);
+      _gss_free (p->krb5);
 
       return maj_stat;
     }
@@ -230,7 +230,7 @@ gss_krb5_release_cred (OM_uint32 * minor_status, gss_cred_id_t * cred_handle)
 
   shishi_key_done (k5->key);
   shishi_done (k5->sh);
-  free (k5);
+  _gss_free (k5);
 
   if (minor_status)
     *minor_status = 0;
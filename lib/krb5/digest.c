@@ -0,0 +1,557 @@
+/* krb5/digest.c --- Incremental MD5, SHA-1 and HMAC-SHA1 for Krb5 GSS.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* Shishi only offers one-shot hash functions, which would force
+   callers to buffer the whole message.  These wrap the incremental
+   gnulib MD5 and SHA-1 so that the per-message code can checksum data
+   as it arrives, and use the CPU's SHA extensions when present. */
+
+#include "config.h"
+
+#include <string.h>
+
+/* Get specification. */
+#include "digest.h"
+
+#include "memxor.h"
+
+#ifdef HAVE_X86_CRYPTO_INTRINSICS
+# include <immintrin.h>
+# include "cipher.h"
+#endif
+
+/* MD5, see RFC 1321. */
+
+void
+_gss_krb5_md5_init (_gss_krb5_md5_ctx * ctx)
+{
+  md5_init_ctx (ctx);
+}
+
+void
+_gss_krb5_md5_update (_gss_krb5_md5_ctx * ctx, const void *data, size_t len)
+{
+  md5_process_bytes (data, len, ctx);
+}
+
+void
+_gss_krb5_md5_final (_gss_krb5_md5_ctx * ctx, char *digest)
+{
+  md5_finish_ctx (ctx, digest);
+}
+
+/* SHA-1, see FIPS 180-4. */
+
+#ifdef HAVE_X86_CRYPTO_INTRINSICS
+
+/* Rounds 4G to 4G+3 with the SHA extensions.  M[G % 4] holds words
+   4G to 4G+3 of the message schedule.  While they are used, the three
+   other registers are turned into the words for the next rounds, and
+   the E value for the next rounds is saved. */
+# define SHA1_ROUNDS(g, f)						\
+  do									\
+    {									\
+      if ((g) == 0)							\
+	e[0] = _mm_add_epi32 (e[0], m[0]);				\
+      else								\
+	e[(g) & 1] = _mm_sha1nexte_epu32 (e[(g) & 1], m[(g) & 3]);	\
+      e[~(g) & 1] = abcd;						\
+      if ((g) >= 3 && (g) <= 18)					\
+	m[((g) + 1) & 3] = _mm_sha1msg2_epu32 (m[((g) + 1) & 3],	\
+					       m[(g) & 3]);		\
+      abcd = _mm_sha1rnds4_epu32 (abcd, e[(g) & 1], f);			\
+      if ((g) >= 1 && (g) <= 16)					\
+	m[((g) - 1) & 3] = _mm_sha1msg1_epu32 (m[((g) - 1) & 3],	\
+					       m[(g) & 3]);		\
+      if ((g) >= 2 && (g) <= 17)					\
+	m[((g) - 2) & 3] = _mm_xor_si128 (m[((g) - 2) & 3], m[(g) & 3]); \
+    }									\
+  while (0)
+
+__attribute__ ((target ("sha,sse4.1"))) static void
+sha1_block_shani (uint32_t * state, const unsigned char *p)
+{
+  const __m128i bswap = _mm_set_epi64x (0x0001020304050607LL,
+					0x08090a0b0c0d0e0fLL);
+  __m128i abcd, abcd_save, e_save, e[2], m[4];
+  int i;
+
+  abcd = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *) state),
+			    0x1b);
+  e[0] = _mm_set_epi32 (state[4], 0, 0, 0);
+  abcd_save = abcd;
+  e_save = e[0];
+
+  for (i = 0; i < 4; i++)
+    m[i] = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (p + 16 * i)),
+			     bswap);
+
+  SHA1_ROUNDS (0, 0);
+  SHA1_ROUNDS (1, 0);
+  SHA1_ROUNDS (2, 0);
+  SHA1_ROUNDS (3, 0);
+  SHA1_ROUNDS (4, 0);
+  SHA1_ROUNDS (5, 1);
+  SHA1_ROUNDS (6, 1);
+  SHA1_ROUNDS (7, 1);
+  SHA1_ROUNDS (8, 1);
+  SHA1_ROUNDS (9, 1);
+  SHA1_ROUNDS (10, 2);
+  SHA1_ROUNDS (11, 2);
+  SHA1_ROUNDS (12, 2);
+  SHA1_ROUNDS (13, 2);
+  SHA1_ROUNDS (14, 2);
+  SHA1_ROUNDS (15, 3);
+  SHA1_ROUNDS (16, 3);
+  SHA1_ROUNDS (17, 3);
+  SHA1_ROUNDS (18, 3);
+  SHA1_ROUNDS (19, 3);
+
+  e[0] = _mm_sha1nexte_epu32 (e[0], e_save);
+  abcd = _mm_add_epi32 (abcd, abcd_save);
+
+  _mm_storeu_si128 ((__m128i *) state, _mm_shuffle_epi32 (abcd, 0x1b));
+  state[4] = _mm_extract_epi32 (e[0], 3);
+}
+
+#endif
+
+#ifdef HAVE_X86_CRYPTO_INTRINSICS
+
+/* Hash the LEN bytes at P, a multiple of the block size, into CTX
+   with the SHA extensions, keeping the byte count the way
+   sha1_process_block does. */
+static void
+sha1_blocks_shani (_gss_krb5_sha1_ctx * ctx, const unsigned char *p,
+		   size_t len)
+{
+  uint32_t state[5] = { ctx->A, ctx->B, ctx->C, ctx->D, ctx->E };
+  uint32_t lolen = len;
+  size_t i;
+
+  for (i = 0; i < len; i += _GSS_KRB5_DIGEST_BLOCK)
+    sha1_block_shani (state, p + i);
+
+  ctx->A = state[0];
+  ctx->B = state[1];
+  ctx->C = state[2];
+  ctx->D = state[3];
+  ctx->E = state[4];
+  ctx->total[0] += lolen;
+  ctx->total[1] += (len >> 31 >> 1) + (ctx->total[0] < lolen);
+}
+
+/* Like sha1_process_bytes, but with whole blocks hashed by
+   sha1_blocks_shani.  The partial block is kept in CTX as gnulib
+   does, so sha1_finish_ctx can complete the digest. */
+static void
+sha1_update_shani (_gss_krb5_sha1_ctx * ctx, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  size_t n;
+
+  if (ctx->buflen > 0)
+    {
+      n = _GSS_KRB5_DIGEST_BLOCK - ctx->buflen;
+      if (n > len)
+	n = len;
+      memcpy ((char *) ctx->buffer + ctx->buflen, p, n);
+      ctx->buflen += n;
+      p += n;
+      len -= n;
+      if (ctx->buflen < _GSS_KRB5_DIGEST_BLOCK)
+	return;
+      sha1_blocks_shani (ctx, (const unsigned char *) ctx->buffer,
+			 _GSS_KRB5_DIGEST_BLOCK);
+      ctx->buflen = 0;
+    }
+
+  n = len - len % _GSS_KRB5_DIGEST_BLOCK;
+  if (n > 0)
+    sha1_blocks_shani (ctx, p, n);
+
+  memcpy (ctx->buffer, p + n, len - n);
+  ctx->buflen = len - n;
+}
+
+#endif
+
+void
+_gss_krb5_sha1_init (_gss_krb5_sha1_ctx * ctx)
+{
+  sha1_init_ctx (ctx);
+}
+
+void
+_gss_krb5_sha1_update (_gss_krb5_sha1_ctx * ctx, const void *data,
+		       size_t len)
+{
+#ifdef HAVE_X86_CRYPTO_INTRINSICS
+  if (_gss_krb5_cpu_features () & _GSS_KRB5_CPU_SHA)
+    {
+      sha1_update_shani (ctx, data, len);
+      return;
+    }
+#endif
+  sha1_process_bytes (data, len, ctx);
+}
+
+void
+_gss_krb5_sha1_final (_gss_krb5_sha1_ctx * ctx, char *digest)
+{
+  sha1_finish_ctx (ctx, digest);
+}
+
+/* HMAC-SHA1, see RFC 2104.  gnulib's hmac_sha1 is one-shot, so the
+   keyed inner and outer states are kept here instead. */
+
+void
+_gss_krb5_hmac_sha1_init (_gss_krb5_hmac_sha1_ctx * ctx,
+			  const char *key, size_t keylen)
+{
+  char pad[_GSS_KRB5_DIGEST_BLOCK];
+  char digest[_GSS_KRB5_SHA1_LEN];
+
+  if (keylen > _GSS_KRB5_DIGEST_BLOCK)
+    {
+      sha1_buffer (key, keylen, digest);
+      key = digest;
+      keylen = _GSS_KRB5_SHA1_LEN;
+    }
+
+  memset (pad, 0x36, sizeof (pad));
+  memxor (pad, key, keylen);
+  _gss_krb5_sha1_init (&ctx->inner);
+  _gss_krb5_sha1_update (&ctx->inner, pad, sizeof (pad));
+
+  memset (pad, 0x5c, sizeof (pad));
+  memxor (pad, key, keylen);
+  _gss_krb5_sha1_init (&ctx->outer);
+  _gss_krb5_sha1_update (&ctx->outer, pad, sizeof (pad));
+
+  memset (pad, 0, sizeof (pad));
+  memset (digest, 0, sizeof (digest));
+}
+
+void
+_gss_krb5_hmac_sha1_update (_gss_krb5_hmac_sha1_ctx * ctx,
+			    const void *data, size_t len)
+{
+  _gss_krb5_sha1_update (&ctx->inner, data, len);
+}
+
+void
+_gss_krb5_hmac_sha1_final (_gss_krb5_hmac_sha1_ctx * ctx, char *digest)
+{
+  char inner[_GSS_KRB5_SHA1_LEN];
+
+  _gss_krb5_sha1_final (&ctx->inner, inner);
+  _gss_krb5_sha1_update (&ctx->outer, inner, sizeof (inner));
+  _gss_krb5_sha1_final (&ctx->outer, digest);
+}
+
+/* Several HMAC-SHA1 computations at once.  SHA-1 is sequential
+   within a message, so short messages leave most of a vector unit
+   idle.  With AVX2, eight independent messages are instead hashed
+   side by side in the 32-bit lanes of the vector registers. */
+
+static void
+hmac_sha1_one (_gss_krb5_hmac_sha1_job * job)
+{
+  _gss_krb5_hmac_sha1_ctx hmac = *job->key;
+
+  _gss_krb5_hmac_sha1_update (&hmac, job->data, job->len);
+  _gss_krb5_hmac_sha1_update (&hmac, job->tail, job->taillen);
+  _gss_krb5_hmac_sha1_final (&hmac, job->digest);
+}
+
+#ifdef HAVE_X86_CRYPTO_INTRINSICS
+
+/* The keyed states set up by _gss_krb5_hmac_sha1_init end on a block
+   boundary, so their chaining value and byte count are all that is
+   needed to carry on hashing them in a vector lane. */
+
+static uint32_t
+sha1_word (const _gss_krb5_sha1_ctx * ctx, int j)
+{
+  const uint32_t words[5] = { ctx->A, ctx->B, ctx->C, ctx->D, ctx->E };
+
+  return words[j];
+}
+
+static uint64_t
+sha1_length (const _gss_krb5_sha1_ctx * ctx)
+{
+  return ((uint64_t) ctx->total[1] << 32 | ctx->total[0]) + ctx->buflen;
+}
+
+/* Number of blocks of the inner hash input of JOB after the key,
+   including the padding. */
+static size_t
+job_blocks (const _gss_krb5_hmac_sha1_job * job)
+{
+  return (job->len + job->taillen + 8) / _GSS_KRB5_DIGEST_BLOCK + 1;
+}
+
+/* Return block B of the inner hash input of JOB after the key, that
+   is of the data, the tail and the padding.  Blocks that lie within
+   the data are returned where they are, others are put together in
+   BUF. */
+static const unsigned char *
+job_block (const _gss_krb5_hmac_sha1_job * job, size_t b, unsigned char *buf)
+{
+  const unsigned char *data = job->data;
+  const unsigned char *tail = job->tail;
+  size_t start = b * _GSS_KRB5_DIGEST_BLOCK;
+  size_t end = start + _GSS_KRB5_DIGEST_BLOCK;
+  size_t n = job->len + job->taillen, from, to;
+  uint64_t bits;
+  int i;
+
+  if (end <= job->len)
+    return data + start;
+
+  memset (buf, 0, _GSS_KRB5_DIGEST_BLOCK);
+  if (start < job->len)
+    memcpy (buf, data + start, job->len - start);
+  from = start > job->len ? start : job->len;
+  to = end < n ? end : n;
+  if (from < to)
+    memcpy (buf + from - start, tail + from - job->len, to - from);
+  if (n >= start && n < end)
+    buf[n - start] = 0x80;
+  if (b == job_blocks (job) - 1)
+    {
+      bits = (sha1_length (&job->key->inner) + n) * 8;
+      for (i = 0; i < 8; i++)
+	buf[56 + i] = (bits >> (56 - 8 * i)) & 0xFF;
+    }
+
+  return buf;
+}
+
+# define AVX2 __attribute__ ((target ("avx2")))
+
+# define ROL32X8(x, n)						\
+  _mm256_or_si256 (_mm256_slli_epi32 (x, n), _mm256_srli_epi32 (x, 32 - (n)))
+
+/* Load the eight big endian words at offset OFF of the blocks at
+   P[0] to P[7] into W, so that W[I] holds word I of every block. */
+AVX2 static void
+load_x8 (__m256i * w, const unsigned char *const *p, size_t off)
+{
+  const __m256i bswap = _mm256_set_epi8 (12, 13, 14, 15, 8, 9, 10, 11,
+					 4, 5, 6, 7, 0, 1, 2, 3,
+					 12, 13, 14, 15, 8, 9, 10, 11,
+					 4, 5, 6, 7, 0, 1, 2, 3);
+  __m256i r[8], t[8], u[8];
+  int i;
+
+  for (i = 0; i < 8; i++)
+    r[i] = _mm256_loadu_si256 ((const __m256i *) (p[i] + off));
+
+  /* Transpose the 8x8 matrix of words. */
+  for (i = 0; i < 8; i += 2)
+    {
+      t[i] = _mm256_unpacklo_epi32 (r[i], r[i + 1]);
+      t[i + 1] = _mm256_unpackhi_epi32 (r[i], r[i + 1]);
+    }
+  for (i = 0; i < 8; i += 4)
+    {
+      u[i] = _mm256_unpacklo_epi64 (t[i], t[i + 2]);
+      u[i + 1] = _mm256_unpackhi_epi64 (t[i], t[i + 2]);
+      u[i + 2] = _mm256_unpacklo_epi64 (t[i + 1], t[i + 3]);
+      u[i + 3] = _mm256_unpackhi_epi64 (t[i + 1], t[i + 3]);
+    }
+  for (i = 0; i < 4; i++)
+    {
+      w[i] = _mm256_shuffle_epi8 (_mm256_permute2x128_si256 (u[i], u[i + 4],
+							     0x20), bswap);
+      w[i + 4] = _mm256_shuffle_epi8 (_mm256_permute2x128_si256 (u[i],
+								 u[i + 4],
+								 0x31),
+				      bswap);
+    }
+}
+
+/* Run the SHA-1 compression function on the blocks at P[0] to P[7],
+   one per lane of STATE, and update the lanes selected by ACTIVE. */
+AVX2 static void
+sha1_block_x8 (__m256i * state, const unsigned char *const *p,
+	       __m256i active)
+{
+  __m256i w[16], a, b, c, d, e, k, t;
+  int i;
+
+  load_x8 (w, p, 0);
+  load_x8 (w + 8, p, 32);
+
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+
+# define SHA1_X8_ROUND(i, f)						\
+  do									\
+    {									\
+      if ((i) >= 16)							\
+	{								\
+	  t = _mm256_xor_si256 (_mm256_xor_si256 (w[((i) - 3) & 15],	\
+						  w[((i) - 8) & 15]),	\
+				_mm256_xor_si256 (w[((i) - 14) & 15],	\
+						  w[(i) & 15]));	\
+	  w[(i) & 15] = ROL32X8 (t, 1);					\
+	}								\
+      t = _mm256_add_epi32 (_mm256_add_epi32 (ROL32X8 (a, 5), f),	\
+			    _mm256_add_epi32 (_mm256_add_epi32 (e, k),	\
+					      w[(i) & 15]));		\
+      e = d;								\
+      d = c;								\
+      c = ROL32X8 (b, 30);						\
+      b = a;								\
+      a = t;								\
+    }									\
+  while (0)
+
+  k = _mm256_set1_epi32 (0x5a827999);
+  for (i = 0; i < 20; i++)
+    SHA1_X8_ROUND (i, _mm256_or_si256 (_mm256_and_si256 (b, c),
+				       _mm256_andnot_si256 (b, d)));
+  k = _mm256_set1_epi32 (0x6ed9eba1);
+  for (; i < 40; i++)
+    SHA1_X8_ROUND (i, _mm256_xor_si256 (_mm256_xor_si256 (b, c), d));
+  k = _mm256_set1_epi32 ((int) 0x8f1bbcdc);
+  for (; i < 60; i++)
+    SHA1_X8_ROUND (i, _mm256_or_si256 (_mm256_and_si256 (b, c),
+				       _mm256_and_si256 (d,
+							 _mm256_or_si256 (b,
+									  c))));
+  k = _mm256_set1_epi32 ((int) 0xca62c1d6);
+  for (; i < 80; i++)
+    SHA1_X8_ROUND (i, _mm256_xor_si256 (_mm256_xor_si256 (b, c), d));
+
+  state[0] = _mm256_blendv_epi8 (state[0], _mm256_add_epi32 (state[0], a),
+				 active);
+  state[1] = _mm256_blendv_epi8 (state[1], _mm256_add_epi32 (state[1], b),
+				 active);
+  state[2] = _mm256_blendv_epi8 (state[2], _mm256_add_epi32 (state[2], c),
+				 active);
+  state[3] = _mm256_blendv_epi8 (state[3], _mm256_add_epi32 (state[3], d),
+				 active);
+  state[4] = _mm256_blendv_epi8 (state[4], _mm256_add_epi32 (state[4], e),
+				 active);
+}
+
+/* Compute the N jobs at JOBS, at most eight, in parallel.  Lanes
+   whose message is shorter are left alone once it has been hashed. */
+AVX2 static void
+hmac_sha1_x8 (_gss_krb5_hmac_sha1_job * jobs, size_t n)
+{
+  static const unsigned char zero[_GSS_KRB5_DIGEST_BLOCK];
+  unsigned char buf[8][_GSS_KRB5_DIGEST_BLOCK];
+  const unsigned char *p[8];
+  uint32_t st[5][8];
+  int32_t mask[8];
+  __m256i state[5];
+  size_t blocks[8], max = 0, b, i;
+  uint64_t bits;
+  int j;
+
+  for (i = 0; i < 8; i++)
+    {
+      const _gss_krb5_hmac_sha1_ctx *key = jobs[i < n ? i : 0].key;
+
+      for (j = 0; j < 5; j++)
+	st[j][i] = sha1_word (&key->inner, j);
+      blocks[i] = i < n ? job_blocks (&jobs[i]) : 0;
+      if (blocks[i] > max)
+	max = blocks[i];
+    }
+  for (j = 0; j < 5; j++)
+    state[j] = _mm256_loadu_si256 ((const __m256i *) st[j]);
+
+  for (b = 0; b < max; b++)
+    {
+      for (i = 0; i < 8; i++)
+	{
+	  p[i] = b < blocks[i] ? job_block (&jobs[i], b, buf[i]) : zero;
+	  mask[i] = b < blocks[i] ? -1 : 0;
+	}
+      sha1_block_x8 (state, p,
+		     _mm256_loadu_si256 ((const __m256i *) mask));
+    }
+
+  /* The outer hash is over the inner digest, in one block. */
+  for (j = 0; j < 5; j++)
+    _mm256_storeu_si256 ((__m256i *) st[j], state[j]);
+  for (i = 0; i < 8; i++)
+    {
+      const _gss_krb5_hmac_sha1_ctx *key = jobs[i < n ? i : 0].key;
+
+      memset (buf[i], 0, _GSS_KRB5_DIGEST_BLOCK);
+      for (j = 0; j < _GSS_KRB5_SHA1_LEN; j++)
+	buf[i][j] = (st[j / 4][i] >> (24 - 8 * (j % 4))) & 0xFF;
+      buf[i][_GSS_KRB5_SHA1_LEN] = 0x80;
+      bits = (sha1_length (&key->outer) + _GSS_KRB5_SHA1_LEN) * 8;
+      for (j = 0; j < 8; j++)
+	buf[i][56 + j] = (bits >> (56 - 8 * j)) & 0xFF;
+      p[i] = buf[i];
+
+      for (j = 0; j < 5; j++)
+	st[j][i] = sha1_word (&key->outer, j);
+    }
+  for (j = 0; j < 5; j++)
+    state[j] = _mm256_loadu_si256 ((const __m256i *) st[j]);
+  sha1_block_x8 (state, p, _mm256_set1_epi32 (-1));
+
+  for (j = 0; j < 5; j++)
+    _mm256_storeu_si256 ((__m256i *) st[j], state[j]);
+  for (i = 0; i < n; i++)
+    for (j = 0; j < _GSS_KRB5_SHA1_LEN; j++)
+      jobs[i].digest[j] = (st[j / 4][i] >> (24 - 8 * (j % 4))) & 0xFF;
+}
+
+#endif
+
+/* Compute the COUNT HMAC-SHA1 jobs at JOBS.  The keys must be set up
+   with _gss_krb5_hmac_sha1_init and not updated since. */
+void
+_gss_krb5_hmac_sha1_multi (_gss_krb5_hmac_sha1_job * jobs, size_t count)
+{
+  size_t i = 0;
+
+#ifdef HAVE_X86_CRYPTO_INTRINSICS
+  size_t n;
+
+  /* A single message is hashed faster on its own. */
+  if (_gss_krb5_cpu_features () & _GSS_KRB5_CPU_AVX2)
+    for (; count - i >= 2; i += n)
+      {
+	n = count - i < 8 ? count - i : 8;
+	hmac_sha1_x8 (jobs + i, n);
+      }
+#endif
+
+  for (; i < count; i++)
+    hmac_sha1_one (&jobs[i]);
+}
@@ -0,0 +1,78 @@
+/* krb5/digest.h --- Incremental MD5, SHA-1 and HMAC-SHA1 for Krb5 GSS.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _GSS_KRB5_DIGEST_H
+#define _GSS_KRB5_DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "md5.h"
+#include "sha1.h"
+
+#define _GSS_KRB5_MD5_LEN MD5_DIGEST_SIZE
+#define _GSS_KRB5_SHA1_LEN SHA1_DIGEST_SIZE
+#define _GSS_KRB5_DIGEST_BLOCK 64
+
+typedef struct md5_ctx _gss_krb5_md5_ctx;
+typedef struct sha1_ctx _gss_krb5_sha1_ctx;
+
+typedef struct _gss_krb5_hmac_sha1_struct
+{
+  _gss_krb5_sha1_ctx inner;
+  _gss_krb5_sha1_ctx outer;
+} _gss_krb5_hmac_sha1_ctx;
+
+extern void _gss_krb5_md5_init (_gss_krb5_md5_ctx * ctx);
+extern void _gss_krb5_md5_update (_gss_krb5_md5_ctx * ctx,
+				  const void *data, size_t len);
+extern void _gss_krb5_md5_final (_gss_krb5_md5_ctx * ctx, char *digest);
+
+extern void _gss_krb5_sha1_init (_gss_krb5_sha1_ctx * ctx);
+extern void _gss_krb5_sha1_update (_gss_krb5_sha1_ctx * ctx,
+				   const void *data, size_t len);
+extern void _gss_krb5_sha1_final (_gss_krb5_sha1_ctx * ctx, char *digest);
+
+extern void _gss_krb5_hmac_sha1_init (_gss_krb5_hmac_sha1_ctx * ctx,
+				      const char *key, size_t keylen);
+extern void _gss_krb5_hmac_sha1_update (_gss_krb5_hmac_sha1_ctx * ctx,
+					const void *data, size_t len);
+extern void _gss_krb5_hmac_sha1_final (_gss_krb5_hmac_sha1_ctx * ctx,
+				       char *digest);
+
+/* One HMAC-SHA1 computation for _gss_krb5_hmac_sha1_multi, with the
+   key set up in KEY, over LEN bytes at DATA followed by TAILLEN bytes
+   at TAIL.  The result is stored in DIGEST. */
+typedef struct _gss_krb5_hmac_sha1_job_struct
+{
+  const _gss_krb5_hmac_sha1_ctx *key;
+  const void *data;
+  size_t len;
+  const void *tail;
+  size_t taillen;
+  char digest[_GSS_KRB5_SHA1_LEN];
+} _gss_krb5_hmac_sha1_job;
+
+extern void _gss_krb5_hmac_sha1_multi (_gss_krb5_hmac_sha1_job * jobs,
+				       size_t count);
+
+#endif /* _GSS_KRB5_DIGEST_H */
@@ -83,7 +83,7 @@ gss_krb5_display_status (OM_uint32 * minor_status,
   switch (status_value)
     {
     case 0:
-      status_string->value = strdup (_("No krb5 error"));
+      status_string->value = _gss_strdup (_("No krb5 error"));
       if (!status_string->value)
 	{
 	  if (minor_status)
@@ -113,7 +113,7 @@ gss_krb5_display_status (OM_uint32 * minor_status,
     case GSS_KRB5_S_KG_BAD_LENGTH:
     case GSS_KRB5_S_KG_CTX_INCOMPLETE:
       status_string->value =
-	strdup (_(gss_krb5_errors[status_value - 1].text));
+	_gss_strdup (_(gss_krb5_errors[status_value - 1].text));
       if (!status_string->value)
 	{
 	  if (minor_status)
@@ -124,7 +124,7 @@ gss_krb5_display_status (OM_uint32 * minor_status,
       break;
 
     default:
-      status_string->value = strdup (_("Unknown krb5 error"));
+      status_string->value = _gss_strdup (_("Unknown krb5 error"));
       if (!status_string->value)
 	{
 	  if (minor_status)
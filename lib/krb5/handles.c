@@ -0,0 +1,1169 @@
+/* krb5/handles.c --- Pool of Shishi handles for initiator contexts.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "k5internal.h"
+
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+/* Shishi itself reads its environment variables with getenv, so the
+   handle key must see them too where secure_getenv is missing. */
+#ifndef HAVE_SECURE_GETENV
+# define secure_getenv getenv
+#endif
+
+/* Setting up a Shishi handle with shishi_init reads the Shishi
+   configuration and the ticket file, which dominates the cost of
+   initiating a short-lived context.  Initiator contexts therefore
+   borrow an initialised handle from the pool below for their
+   lifetime, and give it back when they are deleted.  A handle is
+   only used by one context at a time.
+
+   Handles are kept apart by a key made of the effective user and
+   the environment variables that decide which configuration and
+   tickets Shishi uses.  Before a handle is lent out again, its
+   tickets are read anew if the ticket file was changed since, e.g.,
+   by kinit.  Tickets a context added, such as service tickets, are
+   written to the ticket file when the handle is returned, as
+   shishi_done would have done.  Changes to the configuration files
+   themselves are only seen by handles created later.
+
+   Each handle also indexes the service tickets that its contexts
+   used, by server principal and enctype, so that setting up another
+   context for the same service finds its ticket without searching
+   the ticket set.  Entries are dropped once their ticket has
+   expired, and when the tickets are read anew.
+
+   Tickets that have to be requested from the KDC are fetched once
+   for all handles with the same key: the first context to ask for a
+   ticket sends the request, and contexts that ask for the same
+   ticket meanwhile wait for its result, which is copied into their
+   own handles.  The outcome, including a failure, is remembered for
+   a few seconds, so that a burst of contexts for a service costs a
+   single round trip, and an unknown service is not asked for over
+   and over.
+
+   When enabled with gss_set_cred_refresh, a thread renews the
+   service tickets that contexts used, through whichever handle, once
+   the configured share of their lifetime has passed, so that
+   contexts rarely find their ticket expired.  Only tickets that were
+   used since they were last obtained are renewed, and tickets that
+   expired before they could be renewed are forgotten.  The thread
+   renews through an idle handle, or a new one, and shares the new
+   ticket like the outcome of a request until it expires, so that
+   handles that were lent out meanwhile load it instead of asking the
+   KDC once their own copy expires.
+
+   Contexts set up with gss_init_sec_context_async request a missing
+   ticket from a thread of their own, which wakes the application up
+   through a pipe when it is done.
+
+   The handles, ticket requests and renewals outlive the contexts
+   that use them, and parts of them are allocated by Shishi, so they
+   use malloc and free rather than the allocator of
+   gss_set_allocator, see alloc.c. */
+
+/* Most idle handles kept. */
+#define HANDLE_POOL_MAX 16
+
+/* Hash buckets of the service ticket index, a power of two, and the
+   most tickets indexed per handle. */
+#define TKT_BUCKETS 64
+#define TKT_MAX 256
+
+/* Seconds the outcome of a ticket request is shared. */
+#define TKT_FLIGHT_TTL 5
+
+/* Seconds before a ticket that could not be renewed is tried again,
+   and most seconds the renewal thread sleeps. */
+#define REFRESH_RETRY 30
+#define REFRESH_POLL 60
+
+struct tkt_entry
+{
+  struct tkt_entry *next;
+  Shishi_tkt *tkt;
+  time_t starttime;
+  time_t endtime;
+  int32_t etype;
+  /* Follows the structure. */
+  char *server;
+};
+
+struct _gss_krb5_handle_struct
+{
+  Shishi *sh;
+  char *key;
+  /* The ticket file as it was when the tickets were last read or
+     written, and the number of tickets then. */
+  time_t mtime;
+  off_t size;
+  int ntkts;
+  /* Service ticket index. */
+  struct tkt_entry *tkts[TKT_BUCKETS];
+  size_t ntktentries;
+};
+
+/* A ticket request, in progress or finished.  The ticket is kept in
+   DER form, which unlike a Shishi_tkt is not tied to a handle. */
+struct tkt_flight
+{
+  struct tkt_flight *next;
+  /* Handle key, server, enctype and end time asked for. */
+  char *key;
+  /* The contexts waiting for the flight, plus one while it is in the
+     list of flights. */
+  size_t refs;
+  int done;
+  int failed;
+  time_t expires;
+  char *der[3];
+  size_t derlen[3];
+};
+
+/* A service ticket that contexts used, for the renewal thread.  There
+   is one for each handle key and ticket request. */
+struct tkt_renewal
+{
+  struct tkt_renewal *next;
+  /* Enctype and end time asked for. */
+  int32_t etype;
+  time_t hintend;
+  /* Lifetime of the newest ticket seen. */
+  time_t starttime;
+  time_t endtime;
+  /* Whether the ticket was used since it was obtained, and when to
+     try again after renewing it failed. */
+  int used;
+  time_t retry;
+  /* Follow the structure. */
+  char *key;
+  char *server;
+};
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t handles_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flights_cond = PTHREAD_COND_INITIALIZER;
+# define HANDLES_LOCK() pthread_mutex_lock (&handles_lock)
+# define HANDLES_UNLOCK() pthread_mutex_unlock (&handles_lock)
+# define FLIGHTS_WAIT() pthread_cond_wait (&flights_cond, &handles_lock)
+# define FLIGHTS_DONE() pthread_cond_broadcast (&flights_cond)
+
+/* Signalled when the renewal thread should look again. */
+static pthread_cond_t refresh_cond = PTHREAD_COND_INITIALIZER;
+/* Share of the ticket lifetime after which tickets are renewed, in
+   percent, or 0 if they are not. */
+static OM_uint32 refresh_percent;
+static int refresher_running;
+/* Tickets to renew, only freed by the renewal thread. */
+static struct tkt_renewal *renewals;
+#else
+# define HANDLES_LOCK()
+# define HANDLES_UNLOCK()
+# define FLIGHTS_WAIT()
+# define FLIGHTS_DONE()
+#endif
+
+/* Idle handles, the most recently returned last. */
+static _gss_krb5_handle_t idle[HANDLE_POOL_MAX];
+static size_t idle_len;
+
+/* Ticket requests in progress, the outcome of recent ones, and
+   renewed tickets.  The list is short: it only holds the services
+   asked for in the last TKT_FLIGHT_TTL seconds, and those renewed. */
+static struct tkt_flight *flights;
+
+/* Return the key for handles set up in the current environment, in
+   memory to be released with free, or NULL if memory is short. */
+static char *
+handle_key (void)
+{
+  static const char *const vars[] = {
+    "SHISHI_CONFIG", "SHISHI_HOME", "SHISHI_USER", "SHISHI_TICKETS",
+    "HOME", "USER"
+  };
+  const char *values[sizeof (vars) / sizeof (vars[0])];
+  unsigned long uid = 0;
+  size_t len = 3 * sizeof (uid) + 1;
+  char *key, *p;
+  size_t i;
+
+#ifdef HAVE_GETEUID
+  uid = geteuid ();
+#endif
+  for (i = 0; i < sizeof (vars) / sizeof (vars[0]); i++)
+    {
+      values[i] = secure_getenv (vars[i]);
+      len += strlen (vars[i]) + 2 + (values[i] ? strlen (values[i]) : 0);
+    }
+
+  key = malloc (len);
+  if (!key)
+    return NULL;
+
+  p = key + sprintf (key, "%lu", uid);
+  for (i = 0; i < sizeof (vars) / sizeof (vars[0]); i++)
+    p += sprintf (p, "\n%s=%s", vars[i], values[i] ? values[i] : "");
+
+  return key;
+}
+
+static size_t
+tkt_hash (const char *server)
+{
+  const unsigned char *p = (const unsigned char *) server;
+  size_t h = 2166136261U;
+
+  while (*p)
+    h = (h ^ *p++) * 16777619U;
+
+  return h & (TKT_BUCKETS - 1);
+}
+
+/* Remove the entry at *ENTRYP from the service ticket index of
+   HANDLE.  The ticket itself stays in the ticket set. */
+static void
+tkt_unlink (_gss_krb5_handle_t handle, struct tkt_entry **entryp)
+{
+  struct tkt_entry *e = *entryp;
+
+  *entryp = e->next;
+  free (e);
+  handle->ntktentries--;
+}
+
+static void
+tkt_clear (_gss_krb5_handle_t handle)
+{
+  size_t i;
+
+  for (i = 0; i < TKT_BUCKETS; i++)
+    while (handle->tkts[i])
+      tkt_unlink (handle, &handle->tkts[i]);
+}
+
+/* Make room for one more entry in the index of HANDLE, by dropping
+   the entries of expired tickets, or else the one that expires
+   first. */
+static void
+tkt_evict (_gss_krb5_handle_t handle, time_t now)
+{
+  struct tkt_entry **e, **first = NULL;
+  size_t i;
+
+  for (i = 0; i < TKT_BUCKETS; i++)
+    for (e = &handle->tkts[i]; *e;)
+      if ((*e)->endtime <= now)
+	tkt_unlink (handle, e);
+      else
+	{
+	  if (!first || (*e)->endtime < (*first)->endtime)
+	    first = e;
+	  e = &(*e)->next;
+	}
+
+  if (handle->ntktentries >= TKT_MAX && first)
+    tkt_unlink (handle, first);
+}
+
+static void
+flight_release (struct tkt_flight *f)
+{
+  size_t i;
+
+  if (--f->refs > 0)
+    return;
+
+  for (i = 0; i < 3; i++)
+    free (f->der[i]);
+  free (f->key);
+  free (f);
+}
+
+/* Store the DER encoding of TKT in flight F.  Returns 0 on success,
+   or -1 if some part could not be encoded. */
+static int
+flight_store (Shishi * sh, struct tkt_flight *f, Shishi_tkt * tkt)
+{
+  Shishi_asn1 parts[3];
+  size_t i;
+
+  parts[0] = shishi_tkt_ticket (tkt);
+  parts[1] = shishi_tkt_enckdcreppart (tkt);
+  parts[2] = shishi_tkt_kdcrep (tkt);
+  for (i = 0; i < 3; i++)
+    if (shishi_asn1_to_der (sh, parts[i], &f->der[i], &f->derlen[i])
+	!= SHISHI_OK)
+      return -1;
+
+  return 0;
+}
+
+/* Return a copy in SH of the ticket fetched by flight F, after adding
+   it to the tickets of SH, or NULL on failure. */
+static Shishi_tkt *
+flight_load (Shishi * sh, struct tkt_flight *f)
+{
+  Shishi_asn1 ticket, enckdcreppart, kdcrep;
+  Shishi_tkt *tkt;
+
+  ticket = shishi_der2asn1_ticket (sh, f->der[0], f->derlen[0]);
+  enckdcreppart = shishi_der2asn1_enckdcreppart (sh, f->der[1],
+						 f->derlen[1]);
+  kdcrep = shishi_der2asn1_kdcrep (sh, f->der[2], f->derlen[2]);
+
+  /* The ticket takes over the parts, but only once it exists. */
+  tkt = NULL;
+  if (ticket && enckdcreppart && kdcrep)
+    tkt = shishi_tkt2 (sh, ticket, enckdcreppart, kdcrep);
+  if (!tkt)
+    {
+      if (ticket)
+	shishi_asn1_done (sh, ticket);
+      if (enckdcreppart)
+	shishi_asn1_done (sh, enckdcreppart);
+      if (kdcrep)
+	shishi_asn1_done (sh, kdcrep);
+      return NULL;
+    }
+
+  if (shishi_tkts_add (shishi_tkts_default (sh), tkt) != SHISHI_OK)
+    {
+      shishi_tkt_done (tkt);
+      return NULL;
+    }
+
+  return tkt;
+}
+
+/* Return the key of the flight for HINT through HANDLE, in memory to
+   be released with free, or NULL if memory is short. */
+static char *
+flight_key (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint)
+{
+  char *key;
+
+  key = malloc (strlen (handle->key) + strlen (hint->server)
+		+ 2 * 3 * sizeof (long) + 4);
+  if (key)
+    sprintf (key, "%s\n%s\n%ld\n%ld", handle->key, hint->server,
+	     (long) hint->etype, (long) hint->endtime);
+
+  return key;
+}
+
+/* Request a ticket for HINT from the KDC through HANDLE, unless a
+   request for it is already in progress or was recently made, in
+   which case its outcome is used. */
+static Shishi_tkt *
+tkt_fetch (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint)
+{
+  Shishi_tkts *tkts = shishi_tkts_default (handle->sh);
+  struct tkt_flight **fp, *f;
+  time_t now = time (NULL);
+  Shishi_tkt *tkt;
+  char *key;
+
+  key = flight_key (handle, hint);
+  if (!key)
+    return shishi_tkts_get (tkts, hint);
+
+  HANDLES_LOCK ();
+  for (fp = &flights, f = NULL; *fp;)
+    if ((*fp)->done && (*fp)->expires <= now)
+      {
+	struct tkt_flight *old = *fp;
+
+	*fp = old->next;
+	flight_release (old);
+      }
+    else if (strcmp ((*fp)->key, key) == 0)
+      {
+	f = *fp;
+	break;
+      }
+    else
+      fp = &(*fp)->next;
+
+  if (f)
+    {
+      free (key);
+      f->refs++;
+      while (!f->done)
+	FLIGHTS_WAIT ();
+      HANDLES_UNLOCK ();
+
+      /* F cannot change once done, and is kept by our reference. */
+      if (f->failed)
+	tkt = NULL;
+      else if (!f->der[2] || !(tkt = flight_load (handle->sh, f)))
+	tkt = shishi_tkts_get (tkts, hint);
+
+      HANDLES_LOCK ();
+      flight_release (f);
+      HANDLES_UNLOCK ();
+
+      return tkt;
+    }
+
+  f = calloc (1, sizeof (*f));
+  if (!f)
+    {
+      HANDLES_UNLOCK ();
+      free (key);
+      return shishi_tkts_get (tkts, hint);
+    }
+  f->key = key;
+  f->refs = 2;
+  f->next = flights;
+  flights = f;
+  HANDLES_UNLOCK ();
+
+  tkt = shishi_tkts_get (tkts, hint);
+  now = time (NULL);
+  f->expires = now + TKT_FLIGHT_TTL;
+  if (!tkt)
+    f->failed = 1;
+  else if (flight_store (handle->sh, f, tkt) != 0)
+    f->expires = now;
+  else if (shishi_tkt_endctime (tkt) < f->expires)
+    f->expires = shishi_tkt_endctime (tkt);
+
+  HANDLES_LOCK ();
+  f->done = 1;
+  FLIGHTS_DONE ();
+  flight_release (f);
+  HANDLES_UNLOCK ();
+
+  return tkt;
+}
+
+/* Return the indexed ticket of HANDLE that matches HINT, or NULL. */
+static Shishi_tkt *
+tkt_lookup (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint)
+{
+  size_t bucket = tkt_hash (hint->server);
+  time_t now = time (NULL);
+  struct tkt_entry **e;
+
+  for (e = &handle->tkts[bucket]; *e;)
+    if ((*e)->endtime <= now)
+      tkt_unlink (handle, e);
+    else if (strcmp ((*e)->server, hint->server) == 0
+	     && (hint->etype == 0 || (*e)->etype == hint->etype)
+	     && (hint->endtime == 0 || (*e)->endtime >= hint->endtime))
+      return (*e)->tkt;
+    else
+      e = &(*e)->next;
+
+  return NULL;
+}
+
+/* Add TKT, found for HINT->server, to the index of HANDLE. */
+static void
+tkt_insert (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint,
+	    Shishi_tkt * tkt)
+{
+  size_t bucket = tkt_hash (hint->server);
+  struct tkt_entry *n;
+  size_t len;
+
+  if (handle->ntktentries >= TKT_MAX)
+    tkt_evict (handle, time (NULL));
+
+  len = strlen (hint->server);
+  n = malloc (sizeof (*n) + len + 1);
+  if (!n)
+    return;
+
+  n->tkt = tkt;
+  n->starttime = shishi_tkt_startctime (tkt);
+  n->endtime = shishi_tkt_endctime (tkt);
+  n->etype = shishi_tkt_keytype_fast (tkt);
+  n->server = (char *) (n + 1);
+  memcpy (n->server, hint->server, len + 1);
+  n->next = handle->tkts[bucket];
+  handle->tkts[bucket] = n;
+  handle->ntktentries++;
+}
+
+/* Note that a context uses TKT, found for HINT through HANDLE, so
+   that the renewal thread renews it if it runs. */
+static void
+tkt_used (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint,
+	  Shishi_tkt * tkt)
+{
+#ifdef HAVE_PTHREAD_H
+  time_t endtime = shishi_tkt_endctime (tkt);
+  struct tkt_renewal *r;
+  size_t keylen, len;
+
+  HANDLES_LOCK ();
+  if (refresh_percent == 0)
+    {
+      HANDLES_UNLOCK ();
+      return;
+    }
+
+  for (r = renewals; r; r = r->next)
+    if (r->etype == hint->etype && r->hintend == hint->endtime
+	&& strcmp (r->server, hint->server) == 0
+	&& strcmp (r->key, handle->key) == 0)
+      break;
+
+  if (!r)
+    {
+      keylen = strlen (handle->key);
+      len = strlen (hint->server);
+      r = calloc (1, sizeof (*r) + keylen + len + 2);
+      if (!r)
+	{
+	  HANDLES_UNLOCK ();
+	  return;
+	}
+      r->etype = hint->etype;
+      r->hintend = hint->endtime;
+      r->key = (char *) (r + 1);
+      memcpy (r->key, handle->key, keylen + 1);
+      r->server = r->key + keylen + 1;
+      memcpy (r->server, hint->server, len + 1);
+      r->next = renewals;
+      renewals = r;
+    }
+
+  if (endtime > r->endtime)
+    {
+      r->starttime = shishi_tkt_startctime (tkt);
+      r->endtime = endtime;
+      r->retry = 0;
+      pthread_cond_signal (&refresh_cond);
+    }
+  r->used = 1;
+  HANDLES_UNLOCK ();
+#endif
+}
+
+static Shishi_tkt *
+tkt_cached (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint)
+{
+  Shishi_tkt *tkt;
+
+  tkt = tkt_lookup (handle, hint);
+  if (tkt)
+    return tkt;
+
+  tkt = shishi_tkts_find (shishi_tkts_default (handle->sh), hint);
+  if (tkt)
+    tkt_insert (handle, hint, tkt);
+
+  return tkt;
+}
+
+/* Find a service ticket for HINT->server, of enctype HINT->etype and
+   valid until HINT->endtime unless they are zero, among the tickets
+   HANDLE already has.  Returns NULL if there is none. */
+Shishi_tkt *
+_gss_krb5_handle_tkt_cached (_gss_krb5_handle_t handle,
+			     Shishi_tkts_hint * hint)
+{
+  Shishi_tkt *tkt;
+
+  tkt = tkt_cached (handle, hint);
+  if (tkt)
+    tkt_used (handle, hint, tkt);
+
+  return tkt;
+}
+
+/* As _gss_krb5_handle_tkt_cached, but if HANDLE has no matching
+   ticket, a new one is requested from the KDC by tkt_fetch.  Returns
+   NULL if no ticket could be found. */
+Shishi_tkt *
+_gss_krb5_handle_tkt (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint)
+{
+  Shishi_tkt *tkt;
+
+  tkt = tkt_cached (handle, hint);
+  if (!tkt)
+    {
+      tkt = tkt_fetch (handle, hint);
+      if (tkt)
+	tkt_insert (handle, hint, tkt);
+    }
+  if (tkt)
+    tkt_used (handle, hint, tkt);
+
+  return tkt;
+}
+
+/* Note the state of the ticket file of HANDLE. */
+static void
+handle_stat (_gss_krb5_handle_t handle)
+{
+  const char *file = shishi_tkts_default_file (handle->sh);
+  struct stat st;
+
+  if (file && stat (file, &st) == 0)
+    {
+      handle->mtime = st.st_mtime;
+      handle->size = st.st_size;
+    }
+  else
+    {
+      handle->mtime = 0;
+      handle->size = -1;
+    }
+  handle->ntkts = shishi_tkts_size (shishi_tkts_default (handle->sh));
+}
+
+/* Read the tickets of HANDLE again if the ticket file changed since
+   they were read. */
+static void
+handle_refresh (_gss_krb5_handle_t handle)
+{
+  const char *file = shishi_tkts_default_file (handle->sh);
+  Shishi_tkts *tkts = shishi_tkts_default (handle->sh);
+  time_t mtime = handle->mtime;
+  off_t size = handle->size;
+
+  handle_stat (handle);
+  if (handle->mtime == mtime && handle->size == size)
+    return;
+
+  tkt_clear (handle);
+  while (shishi_tkts_size (tkts) > 0)
+    {
+      shishi_tkt_done (shishi_tkts_nth (tkts, 0));
+      shishi_tkts_remove (tkts, 0);
+    }
+  if (handle->size >= 0)
+    shishi_tkts_from_file (tkts, file);
+  handle->ntkts = shishi_tkts_size (tkts);
+}
+
+static void
+handle_free (_gss_krb5_handle_t handle)
+{
+  tkt_clear (handle);
+  shishi_done (handle->sh);
+  free (handle->key);
+  free (handle);
+}
+
+/* Take the idle handle with KEY that was returned last out of the
+   pool, and return it after reading its tickets again if needed, or
+   return NULL if there is none. */
+static _gss_krb5_handle_t
+handle_take (const char *key)
+{
+  _gss_krb5_handle_t h = NULL;
+  size_t i;
+
+  HANDLES_LOCK ();
+  for (i = idle_len; i > 0; i--)
+    if (strcmp (idle[i - 1]->key, key) == 0)
+      {
+	h = idle[i - 1];
+	memmove (idle + i - 1, idle + i, (idle_len - i) * sizeof (*idle));
+	idle_len--;
+	break;
+      }
+  HANDLES_UNLOCK ();
+
+  if (h)
+    handle_refresh (h);
+
+  return h;
+}
+
+/* Initialise a new handle for KEY, which it takes over, and store it
+   in HANDLE.  Returns SHISHI_OK on success, or a Shishi error code
+   after releasing KEY. */
+static int
+handle_new (_gss_krb5_handle_t * handle, char *key)
+{
+  _gss_krb5_handle_t h;
+  int rc;
+
+  h = calloc (1, sizeof (*h));
+  if (!h)
+    {
+      free (key);
+      return SHISHI_MALLOC_ERROR;
+    }
+
+  rc = shishi_init (&h->sh);
+  if (rc != SHISHI_OK)
+    {
+      free (h);
+      free (key);
+      return rc;
+    }
+  h->key = key;
+  handle_stat (h);
+
+  *handle = h;
+  return SHISHI_OK;
+}
+
+/* Borrow an initialised Shishi handle, and store it in SH and the
+   pool entry to give back in HANDLE.  Returns SHISHI_OK on success,
+   or a Shishi error code. */
+int
+_gss_krb5_handle_get (_gss_krb5_handle_t * handle, Shishi ** sh)
+{
+  _gss_krb5_handle_t h;
+  char *key;
+  int rc;
+
+  key = handle_key ();
+  if (!key)
+    return SHISHI_MALLOC_ERROR;
+
+  h = handle_take (key);
+  if (h)
+    free (key);
+  else
+    {
+      rc = handle_new (&h, key);
+      if (rc != SHISHI_OK)
+	return rc;
+    }
+
+  *handle = h;
+  *sh = h->sh;
+  return SHISHI_OK;
+}
+
+/* Give back HANDLE, which may be NULL, after writing any tickets that
+   were added while it was borrowed. */
+void
+_gss_krb5_handle_put (_gss_krb5_handle_t handle)
+{
+  Shishi_tkts *tkts;
+
+  if (!handle)
+    return;
+
+  tkts = shishi_tkts_default (handle->sh);
+  if (shishi_tkts_size (tkts) != handle->ntkts)
+    {
+      shishi_tkts_to_file (tkts, shishi_tkts_default_file (handle->sh));
+      handle_stat (handle);
+    }
+
+  HANDLES_LOCK ();
+  if (idle_len == HANDLE_POOL_MAX)
+    {
+      /* Replace the handle that has been idle the longest. */
+      _gss_krb5_handle_t oldest = idle[0];
+
+      memmove (idle, idle + 1, (idle_len - 1) * sizeof (*idle));
+      idle[idle_len - 1] = handle;
+      handle = oldest;
+    }
+  else
+    {
+      idle[idle_len++] = handle;
+      handle = NULL;
+    }
+  HANDLES_UNLOCK ();
+
+  /* Its tickets are written once more by shishi_done, so they must
+     not be older than the file. */
+  if (handle)
+    {
+      handle_refresh (handle);
+      handle_free (handle);
+    }
+}
+
+#ifdef HAVE_PTHREAD_H
+
+/* Return when the ticket of R is due for renewal. */
+static time_t
+tkt_renew_time (struct tkt_renewal *r, OM_uint32 percent)
+{
+  time_t t = r->starttime + (r->endtime - r->starttime) * percent / 100;
+
+  return t > r->retry ? t : r->retry;
+}
+
+/* Replace the tickets of HANDLE that match HINT by TKT, in its ticket
+   set and its index. */
+static void
+handle_replace_tkt (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint,
+		    Shishi_tkt * tkt)
+{
+  Shishi_tkts *tkts = shishi_tkts_default (handle->sh);
+  struct tkt_entry **e;
+  Shishi_tkt *old;
+  int n;
+
+  for (e = &handle->tkts[tkt_hash (hint->server)]; *e;)
+    if (strcmp ((*e)->server, hint->server) == 0
+	&& (hint->etype == 0 || (*e)->etype == hint->etype))
+      {
+	old = (*e)->tkt;
+	tkt_unlink (handle, e);
+	for (n = 0; n < shishi_tkts_size (tkts); n++)
+	  if (shishi_tkts_nth (tkts, n) == old)
+	    {
+	      shishi_tkts_remove (tkts, n);
+	      shishi_tkt_done (old);
+	      break;
+	    }
+      }
+    else
+      e = &(*e)->next;
+
+  tkt_insert (handle, hint, tkt);
+}
+
+/* Share TKT, obtained for HINT through HANDLE, with the other handles
+   as the outcome of a finished request, until it expires.  A request
+   in progress for the same ticket is left alone. */
+static void
+flight_share (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint,
+	      Shishi_tkt * tkt)
+{
+  struct tkt_flight **fp, *f, *old;
+
+  f = calloc (1, sizeof (*f));
+  if (!f)
+    return;
+  f->refs = 1;
+  f->done = 1;
+  f->expires = shishi_tkt_endctime (tkt);
+  f->key = flight_key (handle, hint);
+  if (!f->key || flight_store (handle->sh, f, tkt) != 0)
+    {
+      flight_release (f);
+      return;
+    }
+
+  HANDLES_LOCK ();
+  for (fp = &flights; *fp; fp = &(*fp)->next)
+    if (strcmp ((*fp)->key, f->key) == 0)
+      break;
+  if (!*fp)
+    {
+      f->next = flights;
+      flights = f;
+      f = NULL;
+    }
+  else if ((*fp)->done)
+    {
+      old = *fp;
+      f->next = old->next;
+      *fp = f;
+      f = old;
+    }
+  if (f)
+    flight_release (f);
+  HANDLES_UNLOCK ();
+}
+
+/* Renew the ticket of R through an idle handle with its key, or a new
+   one, and share the new ticket with the other handles. */
+static void
+tkt_renew (struct tkt_renewal *r)
+{
+  _gss_krb5_handle_t handle;
+  Shishi_tkts_hint hint;
+  Shishi_tkts *tkts;
+  Shishi_tkt *tkt;
+  time_t endtime;
+  char *key;
+
+  handle = handle_take (r->key);
+  if (!handle)
+    {
+      /* A new handle is set up from the environment of this thread,
+	 which may not be the one R was used in. */
+      key = handle_key ();
+      if (!key)
+	return;
+      if (strcmp (key, r->key) != 0)
+	{
+	  free (key);
+	  return;
+	}
+      if (handle_new (&handle, key) != SHISHI_OK)
+	return;
+    }
+
+  memset (&hint, 0, sizeof (hint));
+  hint.server = r->server;
+  hint.etype = r->etype;
+  hint.endtime = r->hintend;
+  tkts = shishi_tkts_default (handle->sh);
+  tkt = shishi_tkts_get_tgs (tkts, &hint);
+  if (tkt)
+    {
+      endtime = shishi_tkt_endctime (tkt);
+      handle_replace_tkt (handle, &hint, tkt);
+      flight_share (handle, &hint, tkt);
+      shishi_tkts_to_file (tkts, shishi_tkts_default_file (handle->sh));
+      handle_stat (handle);
+
+      HANDLES_LOCK ();
+      if (endtime > r->endtime)
+	{
+	  r->starttime = shishi_tkt_startctime (tkt);
+	  r->endtime = endtime;
+	}
+      r->used = 0;
+      r->retry = 0;
+      HANDLES_UNLOCK ();
+    }
+
+  _gss_krb5_handle_put (handle);
+}
+
+/* The renewal thread, which runs while refresh_percent is non-zero. */
+static void *
+refresher (void *arg)
+{
+  struct tkt_renewal **rp, *r, *due;
+  struct timespec ts;
+  OM_uint32 percent;
+  time_t now, next, t;
+
+  HANDLES_LOCK ();
+  while ((percent = refresh_percent) > 0)
+    {
+      now = time (NULL);
+      next = now + REFRESH_POLL;
+      due = NULL;
+      for (rp = &renewals; *rp;)
+	{
+	  r = *rp;
+	  if (r->endtime <= now)
+	    {
+	      /* Too late to renew it; a new one is requested when it
+		 is used again. */
+	      *rp = r->next;
+	      free (r);
+	      continue;
+	    }
+	  rp = &r->next;
+	  if (!r->used || due)
+	    continue;
+	  t = tkt_renew_time (r, percent);
+	  if (t <= now)
+	    due = r;
+	  else if (t < next)
+	    next = t;
+	}
+
+      if (due)
+	{
+	  /* Only this thread frees DUE. */
+	  due->retry = now + REFRESH_RETRY;
+	  HANDLES_UNLOCK ();
+	  tkt_renew (due);
+	  HANDLES_LOCK ();
+	  continue;
+	}
+
+      ts.tv_sec = next;
+      ts.tv_nsec = 0;
+      pthread_cond_timedwait (&refresh_cond, &handles_lock, &ts);
+    }
+  while (renewals)
+    {
+      r = renewals;
+      renewals = r->next;
+      free (r);
+    }
+  refresher_running = 0;
+  HANDLES_UNLOCK ();
+
+  return NULL;
+}
+
+#endif
+
+OM_uint32
+gss_krb5_set_cred_refresh (OM_uint32 * minor_status, OM_uint32 percent)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_t thread;
+  int rc;
+#endif
+
+  if (minor_status)
+    *minor_status = 0;
+
+  if (percent >= 100)
+    return GSS_S_FAILURE;
+
+#ifdef HAVE_PTHREAD_H
+  HANDLES_LOCK ();
+  refresh_percent = percent;
+  if (percent > 0 && !refresher_running)
+    {
+      rc = pthread_create (&thread, NULL, refresher, NULL);
+      if (rc != 0)
+	{
+	  refresh_percent = 0;
+	  HANDLES_UNLOCK ();
+	  return GSS_S_FAILURE;
+	}
+      pthread_detach (thread);
+      refresher_running = 1;
+    }
+  pthread_cond_signal (&refresh_cond);
+  HANDLES_UNLOCK ();
+
+  return GSS_S_COMPLETE;
+#else
+  return percent > 0 ? GSS_S_UNAVAILABLE : GSS_S_COMPLETE;
+#endif
+}
+
+#if defined HAVE_PTHREAD_H && defined HAVE_PIPE
+
+struct _gss_krb5_fetch_struct
+{
+  _gss_krb5_handle_t handle;
+  Shishi_tkts_hint hint;
+  pthread_t thread;
+  /* The read end is handed to the application. */
+  int fds[2];
+  int done;
+  Shishi_tkt *tkt;
+  /* HINT.server follows the structure. */
+};
+
+static void *
+fetch_thread (void *arg)
+{
+  _gss_krb5_fetch_t fetch = arg;
+  Shishi_tkt *tkt;
+
+  tkt = _gss_krb5_handle_tkt (fetch->handle, &fetch->hint);
+
+  HANDLES_LOCK ();
+  fetch->tkt = tkt;
+  fetch->done = 1;
+  HANDLES_UNLOCK ();
+
+  while (write (fetch->fds[1], "", 1) < 0 && errno == EINTR)
+    ;
+
+  return NULL;
+}
+
+/* Start requesting a ticket for HINT through HANDLE in a new thread.
+   HANDLE must not be used until the request has finished, see
+   _gss_krb5_fetch_wait.  Returns NULL if no thread could be
+   started. */
+_gss_krb5_fetch_t
+_gss_krb5_fetch_start (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint)
+{
+  size_t len = strlen (hint->server);
+  _gss_krb5_fetch_t fetch;
+
+  fetch = _gss_calloc (1, sizeof (*fetch) + len + 1);
+  if (!fetch)
+    return NULL;
+
+  fetch->handle = handle;
+  fetch->hint = *hint;
+  fetch->hint.server = (char *) (fetch + 1);
+  memcpy (fetch->hint.server, hint->server, len + 1);
+
+  if (pipe (fetch->fds) != 0)
+    {
+      _gss_free (fetch);
+      return NULL;
+    }
+
+  if (pthread_create (&fetch->thread, NULL, fetch_thread, fetch) != 0)
+    {
+      close (fetch->fds[0]);
+      close (fetch->fds[1]);
+      _gss_free (fetch);
+      return NULL;
+    }
+
+  return fetch;
+}
+
+/* Return the descriptor that becomes readable when FETCH is done. */
+int
+_gss_krb5_fetch_fd (_gss_krb5_fetch_t fetch)
+{
+  return fetch->fds[0];
+}
+
+/* If FETCH is done, or BLOCK is non-zero, wait for it to finish,
+   store the ticket or NULL in TKT, release FETCH and return 1.
+   Otherwise return 0. */
+int
+_gss_krb5_fetch_wait (_gss_krb5_fetch_t fetch, int block, Shishi_tkt ** tkt)
+{
+  int done;
+
+  HANDLES_LOCK ();
+  done = fetch->done;
+  HANDLES_UNLOCK ();
+  if (!done && !block)
+    return 0;
+
+  pthread_join (fetch->thread, NULL);
+  *tkt = fetch->tkt;
+  close (fetch->fds[0]);
+  close (fetch->fds[1]);
+  _gss_free (fetch);
+
+  return 1;
+}
+
+#else
+
+_gss_krb5_fetch_t
+_gss_krb5_fetch_start (_gss_krb5_handle_t handle, Shishi_tkts_hint * hint)
+{
+  return NULL;
+}
+
+int
+_gss_krb5_fetch_fd (_gss_krb5_fetch_t fetch)
+{
+  return -1;
+}
+
+int
+_gss_krb5_fetch_wait (_gss_krb5_fetch_t fetch, int block, Shishi_tkt ** tkt)
+{
+  *tkt = NULL;
+  return 1;
+}
+
+#endif
@@ -25,6 +25,13 @@
 
 #include <shishi.h>
 
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+
+#include "cipher.h"
+#include "digest.h"
+
 typedef struct _gss_krb5_cred_struct
 {
   Shishi *sh;
@@ -33,19 +40,145 @@ typedef struct _gss_krb5_cred_struct
   Shishi_key *key;
 } _gss_krb5_cred_desc, *_gss_krb5_cred_t;
 
+/* RFC 4121 key usage numbers, see section 2. */
+#define KG_USAGE_ACCEPTOR_SEAL 22
+#define KG_USAGE_ACCEPTOR_SIGN 23
+#define KG_USAGE_INITIATOR_SEAL 24
+#define KG_USAGE_INITIATOR_SIGN 25
+
+/* Keys derived from the context key for the tokens sent in one
+   direction.  The HMAC contexts hold the state after the key has
+   been absorbed, and are copied for each message. */
+typedef struct _gss_krb5_keys_struct
+{
+  /* MIC tokens, and RFC 1964 Wrap tokens for DES3. */
+  _gss_krb5_hmac_sha1_ctx mic;
+  /* RFC 4121 Wrap tokens: Kc for integrity-only tokens, Ke and Ki for
+     confidential tokens. */
+  _gss_krb5_hmac_sha1_ctx kc;
+  _gss_krb5_hmac_sha1_ctx ki;
+  _gss_krb5_aes_key ke;
+} _gss_krb5_keys_desc, *_gss_krb5_keys_t;
+
+/* Replay window for received tokens, in sequence numbers.  The
+   width is a power of two. */
+#define _GSS_KRB5_REPLAY_WINDOW 64
+#define _GSS_KRB5_REPLAY_WINDOW_MAX 1024
+
+/* Bit SEQNR % WIDTH is set for each sequence number inside the window
+   that has not been received yet.  A cleared window treats everything
+   before the first expected token as already received. */
+typedef struct _gss_krb5_replay_struct
+{
+  /* Zero means _GSS_KRB5_REPLAY_WINDOW. */
+  OM_uint32 width;
+  uint64_t missing[_GSS_KRB5_REPLAY_WINDOW_MAX / 64];
+} _gss_krb5_replay_desc;
+
+/* A Shishi handle borrowed from the pool in handles.c. */
+typedef struct _gss_krb5_handle_struct *_gss_krb5_handle_t;
+
+/* A ticket requested in a thread of its own, see handles.c. */
+typedef struct _gss_krb5_fetch_struct *_gss_krb5_fetch_t;
+
 typedef struct _gss_krb5_ctx_struct
 {
   Shishi *sh;
+  /* Initiators only, SH belongs to it. */
+  _gss_krb5_handle_t handle;
+  /* Initiators only, the pending request for TKT. */
+  _gss_krb5_fetch_t fetch;
   Shishi_ap *ap;
   Shishi_tkt *tkt;
   Shishi_key *key;
   gss_name_t peerptr;
   int acceptor;
-  uint32_t acceptseqnr;
-  uint32_t initseqnr;
+  /* RFC 1964 tokens carry the low 32 bits, RFC 4121 tokens all 64. */
+  uint64_t acceptseqnr;
+  uint64_t initseqnr;
   OM_uint32 flags;
+  _gss_krb5_replay_desc replay;
   int reqdone;
   int repdone;
+  /* Set up by _gss_krb5_derive_keys once KEY is known. */
+  _gss_krb5_keys_desc send;
+  _gss_krb5_keys_desc recv;
+#ifdef HAVE_PTHREAD_H
+  /* Protects the sequence numbers and REPLAY, see thread.c. */
+  pthread_mutex_t lock;
+#endif
 } _gss_krb5_ctx_desc, *_gss_krb5_ctx_t;
 
+typedef struct _gss_krb5_mic_struct
+{
+  _gss_krb5_ctx_t k5;
+  int verify;
+  /* DES-MAC-MD5 hashes with MD5, everything else uses HMAC-SHA1 with
+     a derived key. */
+  union
+  {
+    _gss_krb5_md5_ctx md5;
+    _gss_krb5_hmac_sha1_ctx hmac;
+  } u;
+} _gss_krb5_mic_desc, *_gss_krb5_mic_t;
+
+/* State of a RFC 4121 Wrap token that is produced or verified in
+   pieces, see msg.c. */
+typedef struct _gss_krb5_wrap_struct
+{
+  _gss_krb5_ctx_t k5;
+  int unwrap;
+  int sealed;
+  /* The token header, and how many bytes of it have been sent or
+     received. */
+  char header[16];
+  size_t headerlen;
+  size_t ec, rrc;
+  uint64_t seqnr;
+  /* HMAC over the plaintext (sealed) or the message. */
+  _gss_krb5_hmac_sha1_ctx hmac;
+  /* CBC chaining value. */
+  char iv[16];
+  /* Token bytes that cannot be processed yet. */
+  char *pending;
+  size_t pendinglen;
+  /* When unwrapping, the first RRC bytes of the token body, which
+     belong at its end. */
+  char *rotated;
+  size_t rotatedlen;
+  /* When unwrapping a sealed token, decrypted bytes that may turn out
+     to be filler or the header copy, and the number of confounder
+     bytes still to be dropped. */
+  char *plain;
+  size_t plainlen;
+  size_t skip;
+} _gss_krb5_wrap_desc, *_gss_krb5_wrap_t;
+
 OM_uint32 gss_krb5_tktlifetime (Shishi_tkt * tkt);
+
+/* See keys.c. */
+int _gss_krb5_derive_keys (_gss_krb5_ctx_t k5);
+void _gss_krb5_release_keys (_gss_krb5_ctx_t k5);
+
+/* See thread.c. */
+int _gss_krb5_lock_init (_gss_krb5_ctx_t k5);
+void _gss_krb5_lock_done (_gss_krb5_ctx_t k5);
+void _gss_krb5_lock (_gss_krb5_ctx_t k5);
+void _gss_krb5_unlock (_gss_krb5_ctx_t k5);
+uint64_t _gss_krb5_send_seqnr (_gss_krb5_ctx_t k5);
+uint64_t _gss_krb5_send_seqnrs (_gss_krb5_ctx_t k5, size_t count);
+Shishi *_gss_krb5_crypto_get (void);
+void _gss_krb5_crypto_put (Shishi * sh);
+
+/* handles.c */
+int _gss_krb5_handle_get (_gss_krb5_handle_t * handle, Shishi ** sh);
+void _gss_krb5_handle_put (_gss_krb5_handle_t handle);
+Shishi_tkt *_gss_krb5_handle_tkt_cached (_gss_krb5_handle_t handle,
+					 Shishi_tkts_hint * hint);
+Shishi_tkt *_gss_krb5_handle_tkt (_gss_krb5_handle_t handle,
+				  Shishi_tkts_hint * hint);
+_gss_krb5_fetch_t _gss_krb5_fetch_start (_gss_krb5_handle_t handle,
+					 Shishi_tkts_hint * hint);
+int _gss_krb5_fetch_fd (_gss_krb5_fetch_t fetch);
+int _gss_krb5_fetch_wait (_gss_krb5_fetch_t fetch, int block,
+			  Shishi_tkt ** tkt);
@@ -0,0 +1,155 @@
+/* krb5/keys.c --- Derived keys for Krb5 GSS per-message tokens.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "k5internal.h"
+
+/* Derive the RFC 3961 key for USAGE and KIND, which is 0x99 for the
+   checksum key, 0xAA for the encryption key and 0x55 for the
+   integrity key. */
+static int
+derive_key (_gss_krb5_ctx_t k5, int usage, int kind, Shishi_key ** dk)
+{
+  char constant[5];
+  int rc;
+
+  constant[0] = (usage >> 24) & 0xFF;
+  constant[1] = (usage >> 16) & 0xFF;
+  constant[2] = (usage >> 8) & 0xFF;
+  constant[3] = usage & 0xFF;
+  constant[4] = kind;
+
+  rc = shishi_key (k5->sh, dk);
+  if (rc != SHISHI_OK)
+    return rc;
+  shishi_key_copy (*dk, k5->key);
+
+  rc = shishi_dk (k5->sh, k5->key, constant, sizeof (constant), *dk);
+  if (rc != SHISHI_OK)
+    shishi_key_done (*dk);
+
+  return rc;
+}
+
+/* Derive the key for USAGE and KIND and set up HMAC-SHA1 with it. */
+static int
+derive_hmac (_gss_krb5_ctx_t k5, int usage, int kind,
+	     _gss_krb5_hmac_sha1_ctx * hmac)
+{
+  Shishi_key *dk;
+  int rc;
+
+  rc = derive_key (k5, usage, kind, &dk);
+  if (rc != SHISHI_OK)
+    return rc;
+
+  _gss_krb5_hmac_sha1_init (hmac, shishi_key_value (dk),
+			    shishi_key_length (dk));
+  shishi_key_done (dk);
+
+  return SHISHI_OK;
+}
+
+/* Set up KEYS for RFC 4121 tokens with key usages SIGN and SEAL. */
+static int
+derive_cfx_keys (_gss_krb5_ctx_t k5, int sign, int seal,
+		 _gss_krb5_keys_t keys)
+{
+  Shishi_key *ke;
+  int rc;
+
+  rc = derive_hmac (k5, sign, 0x99, &keys->mic);
+  if (rc == SHISHI_OK)
+    rc = derive_hmac (k5, seal, 0x99, &keys->kc);
+  if (rc == SHISHI_OK)
+    rc = derive_hmac (k5, seal, 0x55, &keys->ki);
+  if (rc == SHISHI_OK)
+    rc = derive_key (k5, seal, 0xAA, &ke);
+  if (rc == SHISHI_OK)
+    _gss_krb5_aes_init (&keys->ke, ke);
+
+  return rc;
+}
+
+/* Derive the per-message keys of context K5 from its key, so that
+   the message functions do not have to repeat the key derivation
+   for each token.  Must be called whenever the context key is
+   set. */
+int
+_gss_krb5_derive_keys (_gss_krb5_ctx_t k5)
+{
+  int rc;
+
+  _gss_krb5_release_keys (k5);
+
+  switch (shishi_key_type (k5->key))
+    {
+    case SHISHI_DES3_CBC_HMAC_SHA1_KD:
+      /* RFC 1964 uses the same key usage in both directions. */
+      rc = derive_hmac (k5, SHISHI_KEYUSAGE_GSS_R2, 0x99, &k5->send.mic);
+      if (rc != SHISHI_OK)
+	return rc;
+      k5->recv.mic = k5->send.mic;
+      break;
+
+    case SHISHI_AES128_CTS_HMAC_SHA1_96:
+    case SHISHI_AES256_CTS_HMAC_SHA1_96:
+      if (k5->acceptor)
+	{
+	  rc = derive_cfx_keys (k5, KG_USAGE_ACCEPTOR_SIGN,
+				KG_USAGE_ACCEPTOR_SEAL, &k5->send);
+	  if (rc == SHISHI_OK)
+	    rc = derive_cfx_keys (k5, KG_USAGE_INITIATOR_SIGN,
+				  KG_USAGE_INITIATOR_SEAL, &k5->recv);
+	}
+      else
+	{
+	  rc = derive_cfx_keys (k5, KG_USAGE_INITIATOR_SIGN,
+				KG_USAGE_INITIATOR_SEAL, &k5->send);
+	  if (rc == SHISHI_OK)
+	    rc = derive_cfx_keys (k5, KG_USAGE_ACCEPTOR_SIGN,
+				  KG_USAGE_ACCEPTOR_SEAL, &k5->recv);
+	}
+      if (rc != SHISHI_OK)
+	{
+	  _gss_krb5_release_keys (k5);
+	  return rc;
+	}
+      break;
+
+    default:
+      /* DES-MAC-MD5 uses the context key directly. */
+      break;
+    }
+
+  return SHISHI_OK;
+}
+
+/* Release and wipe the keys set up by _gss_krb5_derive_keys. */
+void
+_gss_krb5_release_keys (_gss_krb5_ctx_t k5)
+{
+  _gss_krb5_aes_done (&k5->send.ke);
+  _gss_krb5_aes_done (&k5->recv.ke);
+
+  memset (&k5->send, 0, sizeof (k5->send));
+  memset (&k5->recv, 0, sizeof (k5->recv));
+}
@@ -24,45 +24,724 @@
 #include "k5internal.h"
 
 #define TOK_LEN 2
+#define TOK_MIC    "\x01\x01"
 #define TOK_WRAP   "\x02\x01"
+#define TOK_MIC_CFX "\x04\x04"
+#define TOK_WRAP_CFX "\x05\x04"
+
+#define C2I(buf) ((uint32_t) (buf[0] & 0xFF) |		\
+		  (uint32_t) (buf[1] & 0xFF) << 8 |	\
+		  (uint32_t) (buf[2] & 0xFF) << 16 |	\
+		  (uint32_t) (buf[3] & 0xFF) << 24)
+
+/* RFC 4121 token header, see section 4.2.6.2. */
+#define CFX_HEADER_LEN 16
+
+#define CFX_FLAG_SENT_BY_ACCEPTOR 0x01
+#define CFX_FLAG_SEALED 0x02
+/* Never set, as no acceptor subkey is negotiated; tokens that carry
+   it are rejected. */
+#define CFX_FLAG_ACCEPTOR_SUBKEY 0x04
+
+/* Confidential tokens are checksummed and encrypted in slices of
+   this many bytes, so that each slice is still in the cache when the
+   second operation reaches it.  A multiple of the cipher block
+   sizes. */
+#define CIPHER_SLICE 4096
+
+/* Store in *A and *B the overlap of [START, START + N) and [OFF, OFF
+   + LEN), and return non-zero if it is not empty. */
+static int
+slice_overlap (size_t start, size_t n, size_t off, size_t len,
+	       size_t * a, size_t * b)
+{
+  *a = start > off ? start : off;
+  *b = start + n < off + len ? start + n : off + len;
+  return *a < *b;
+}
 
-#define C2I(buf) ((buf[0] & 0xFF) |		\
-		  ((buf[1] & 0xFF) << 8) |	\
-		  ((buf[2] & 0xFF) << 16) |	\
-		  ((buf[3] & 0xFF) << 24))
+/* Write the header of a RFC 4121 token TOKID sent on context K5 with
+   sequence number SEQNR into HEADER.  The EC and RRC fields are set
+   to EC and RRC. */
+static void
+cfx_header (_gss_krb5_ctx_t k5, const char *tokid, int flags,
+	    size_t ec, size_t rrc, uint64_t seqnr, char *header)
+{
+  size_t i;
+
+  if (k5->acceptor)
+    flags |= CFX_FLAG_SENT_BY_ACCEPTOR;
+
+  memcpy (header, tokid, TOK_LEN);
+  header[2] = flags;
+  header[3] = '\xFF';
+  header[4] = (ec >> 8) & 0xFF;
+  header[5] = ec & 0xFF;
+  header[6] = (rrc >> 8) & 0xFF;
+  header[7] = rrc & 0xFF;
+  for (i = 0; i < 8; i++)
+    header[8 + i] = (seqnr >> (56 - 8 * i)) & 0xFF;
+}
 
-OM_uint32
-gss_krb5_get_mic (OM_uint32 * minor_status,
-		  const gss_ctx_id_t context_handle,
-		  gss_qop_t qop_req,
-		  const gss_buffer_t message_buffer,
-		  gss_buffer_t message_token)
+static uint64_t
+cfx_seqnr (const char *header)
 {
-  return GSS_S_UNAVAILABLE;
+  uint64_t seqnr = 0;
+  size_t i;
+
+  for (i = 0; i < 8; i++)
+    seqnr = (seqnr << 8) | (header[8 + i] & 0xFF);
+
+  return seqnr;
 }
 
-OM_uint32
-gss_krb5_verify_mic (OM_uint32 * minor_status,
-		     const gss_ctx_id_t context_handle,
-		     const gss_buffer_t message_buffer,
-		     const gss_buffer_t token_buffer, gss_qop_t * qop_state)
+/* Compute the DES MAC of RFC 1964 from the MD5 hash DIGEST, that is
+   the last block of its DES-CBC encryption with KEY and a zero IV,
+   and write it to the 8 bytes at OUT. */
+static int
+des_md5_mac (Shishi * sh, Shishi_key * key, const char *digest, char *out)
 {
-  return GSS_S_UNAVAILABLE;
+  static const char iv[8];
+  char *tmp;
+  int rc;
+
+  rc = shishi_des (sh, 0, shishi_key_value (key), iv, NULL,
+		   digest, _GSS_KRB5_MD5_LEN, &tmp);
+  if (rc != SHISHI_OK)
+    return rc;
+
+  memcpy (out, tmp + _GSS_KRB5_MD5_LEN - 8, 8);
+  free (tmp);
+
+  return SHISHI_OK;
 }
 
-OM_uint32
-gss_krb5_wrap (OM_uint32 * minor_status,
-	       const gss_ctx_id_t context_handle,
-	       int conf_req_flag,
-	       gss_qop_t qop_req,
-	       const gss_buffer_t input_message_buffer,
-	       int *conf_state, gss_buffer_t output_message_buffer)
+/* Encrypt or decrypt the LEN bytes at IN, a multiple of the block
+   size, with DES3-CBC and the context key KEY, using and updating
+   the chaining value IV, and write the result to OUT, which may be
+   IN. */
+static int
+des3_cbc (Shishi * sh, Shishi_key * key, int decryptp, char *iv,
+	  const char *in, char *out, size_t len)
 {
-  _gss_krb5_ctx_t k5 = context_handle->krb5;
-  size_t padlength;
-  gss_buffer_desc data;
+  char *tmp, *ivout;
+  size_t tmplen, ivoutlen;
+  int rc;
+
+  if (decryptp)
+    rc = shishi_decrypt_ivupdate_etype (sh, key, 0, SHISHI_DES3_CBC_NONE,
+					iv, 8, &ivout, &ivoutlen,
+					in, len, &tmp, &tmplen);
+  else
+    rc = shishi_encrypt_ivupdate_etype (sh, key, 0, SHISHI_DES3_CBC_NONE,
+					iv, 8, &ivout, &ivoutlen,
+					in, len, &tmp, &tmplen);
+  if (rc != SHISHI_OK)
+    return rc;
+
+  if (tmplen == len && ivoutlen == 8)
+    {
+      memcpy (out, tmp, len);
+      memcpy (iv, ivout, 8);
+    }
+  else
+    rc = SHISHI_CRYPTO_ERROR;
+  free (tmp);
+  free (ivout);
+
+  return rc;
+}
+
+/* Encrypt the LEN bytes of plaintext at BUF in place with AES-CBC
+   with ciphertext stealing and a zero IV, and compute the HMAC KEY
+   over the plaintext into CKSUM.  The MSGLEN bytes at MSG belong at
+   BUF + OFF, and are copied there slice by slice, so that each part
+   of the message is copied, checksummed and encrypted in one go. */
+static int
+cfx_seal (Shishi * sh, const _gss_krb5_aes_key * ke,
+	  const _gss_krb5_hmac_sha1_ctx * key,
+	  char *buf, size_t len, const char *msg, size_t off, size_t msglen,
+	  char *cksum, size_t cksumlen)
+{
+  _gss_krb5_hmac_sha1_ctx hmac = *key;
+  char digest[_GSS_KRB5_SHA1_LEN];
+  char iv[16];
+  size_t cbclen, i, n, a, b;
+  int rc;
+
+  /* The last two blocks, the final one possibly partial, are left for
+     the ciphertext stealing. */
+  cbclen = len > 32 ? (len - 17) / 16 * 16 : 0;
+  memset (iv, 0, sizeof (iv));
+
+  for (i = 0; i < len; i += n)
+    {
+      n = i < cbclen ? cbclen - i : len - i;
+      if (i < cbclen && n > CIPHER_SLICE)
+	n = CIPHER_SLICE;
+
+      if (slice_overlap (i, n, off, msglen, &a, &b))
+	memcpy (buf + a, msg + a - off, b - a);
+      _gss_krb5_hmac_sha1_update (&hmac, buf + i, n);
+
+      if (i < cbclen)
+	rc = _gss_krb5_aes_cbc (sh, ke, 0, iv, buf + i, buf + i, n);
+      else
+	rc = _gss_krb5_aes_cts (sh, ke, 0, iv, buf + i, buf + i, n);
+      if (rc != SHISHI_OK)
+	return rc;
+    }
+
+  _gss_krb5_hmac_sha1_final (&hmac, digest);
+  memcpy (cksum, digest, cksumlen);
+
+  return SHISHI_OK;
+}
+
+/* Decrypt the LEN bytes of ciphertext at IN, made by cfx_seal, and
+   compute the HMAC KEY over the plaintext into CKSUM.  Of the
+   plaintext, the MSGLEN bytes at offset OFF are written to MSG and
+   the last 16 bytes to TRAILER; nothing else is kept.  MSG may point
+   to IN + OFF. */
+static int
+cfx_unseal (Shishi * sh, const _gss_krb5_aes_key * ke,
+	    const _gss_krb5_hmac_sha1_ctx * key, const char *in, size_t len,
+	    char *msg, size_t off, size_t msglen, char *trailer,
+	    char *cksum, size_t cksumlen)
+{
+  _gss_krb5_hmac_sha1_ctx hmac = *key;
+  char digest[_GSS_KRB5_SHA1_LEN];
+  char slice[CIPHER_SLICE];
+  char iv[16];
+  size_t cbclen, i, n, a, b;
+  int rc;
+
+  cbclen = len > 32 ? (len - 17) / 16 * 16 : 0;
+  memset (iv, 0, sizeof (iv));
+
+  for (i = 0; i < len; i += n)
+    {
+      n = i < cbclen ? cbclen - i : len - i;
+      if (i < cbclen && n > CIPHER_SLICE)
+	n = CIPHER_SLICE;
+
+      /* Work on a copy, as MSG may overlap the ciphertext. */
+      if (i < cbclen)
+	rc = _gss_krb5_aes_cbc (sh, ke, 1, iv, in + i, slice, n);
+      else
+	rc = _gss_krb5_aes_cts (sh, ke, 1, iv, in + i, slice, n);
+      if (rc != SHISHI_OK)
+	return rc;
+
+      _gss_krb5_hmac_sha1_update (&hmac, slice, n);
+      if (slice_overlap (i, n, off, msglen, &a, &b))
+	memcpy (msg + a - off, slice + a - i, b - a);
+      if (slice_overlap (i, n, len - 16, 16, &a, &b))
+	memcpy (trailer + a - (len - 16), slice + a - i, b - a);
+    }
+
+  _gss_krb5_hmac_sha1_final (&hmac, digest);
+  memcpy (cksum, digest, cksumlen);
+
+  return SHISHI_OK;
+}
+
+/* Check the sequence number SEQNR of an authenticated token received
+   on context K5 against the replay window, and record it.  RFC 1964
+   tokens only carry the bits in MASK.  Returns the supplementary
+   status, see RFC 2743 section 1.2.3.  The caller must hold the lock
+   of K5. */
+static OM_uint32
+check_seqnr (_gss_krb5_ctx_t k5, uint64_t seqnr, uint64_t mask)
+{
+  _gss_krb5_replay_desc *w = &k5->replay;
+  uint64_t *next = k5->acceptor ? &k5->initseqnr : &k5->acceptseqnr;
+  uint64_t width = w->width ? w->width : _GSS_KRB5_REPLAY_WINDOW;
+  uint64_t ahead = (seqnr - *next) & mask;
+  uint64_t behind = (*next - seqnr) & mask;
+  int replay = (k5->flags & GSS_C_REPLAY_FLAG) != 0;
+  int sequence = (k5->flags & GSS_C_SEQUENCE_FLAG) != 0;
+  uint64_t i, bit;
+
+  if (ahead <= mask / 2)
+    {
+      /* Slide the window, marking any skipped tokens as missing. */
+      for (i = 0; i < ahead && i < width; i++)
+	{
+	  bit = (*next + i) & (width - 1);
+	  w->missing[bit / 64] |= (uint64_t) 1 << bit % 64;
+	}
+      bit = seqnr & (width - 1);
+      w->missing[bit / 64] &= ~((uint64_t) 1 << bit % 64);
+      *next += ahead + 1;
+
+      return ahead && sequence ? GSS_S_GAP_TOKEN : GSS_S_COMPLETE;
+    }
+
+  if (behind > width)
+    return replay || sequence ? GSS_S_OLD_TOKEN : GSS_S_COMPLETE;
+
+  bit = seqnr & (width - 1);
+  if (!(w->missing[bit / 64] & (uint64_t) 1 << bit % 64))
+    return replay || sequence ? GSS_S_DUPLICATE_TOKEN : GSS_S_COMPLETE;
+  w->missing[bit / 64] &= ~((uint64_t) 1 << bit % 64);
+
+  return sequence ? GSS_S_UNSEQ_TOKEN : GSS_S_COMPLETE;
+}
+
+static OM_uint32
+recv_seqnr (_gss_krb5_ctx_t k5, uint64_t seqnr, uint64_t mask)
+{
+  OM_uint32 maj_stat;
+
+  _gss_krb5_lock (k5);
+  maj_stat = check_seqnr (k5, seqnr, mask);
+  _gss_krb5_unlock (k5);
+
+  return maj_stat;
+}
+
+/* Check the flags of a RFC 4121 token received on context K5.  The
+   token must come from the peer, and must not be protected with an
+   acceptor subkey, as this implementation never asserts one. */
+static OM_uint32
+cfx_check_flags (_gss_krb5_ctx_t k5, int flags)
+{
+  if (((flags & CFX_FLAG_SENT_BY_ACCEPTOR) != 0) == (k5->acceptor != 0))
+    return GSS_S_BAD_MIC;
+  if (flags & CFX_FLAG_ACCEPTOR_SUBKEY)
+    return GSS_S_DEFECTIVE_TOKEN;
+
+  return GSS_S_COMPLETE;
+}
+
+/* Return non-zero if the context key uses RFC 4121 tokens. */
+static int
+cfx_enctype_p (_gss_krb5_ctx_t k5)
+{
+  switch (shishi_key_type (k5->key))
+    {
+    case SHISHI_AES128_CTS_HMAC_SHA1_96:
+    case SHISHI_AES256_CTS_HMAC_SHA1_96:
+      return 1;
+
+    default:
+      return 0;
+    }
+}
+
+/* Compute the size of the header and trailer of a RFC 4121 Wrap token
+   that is split into IOV buffers.  With confidentiality, the header
+   also holds the encrypted confounder and the trailer holds the
+   encrypted header copy followed by the HMAC. */
+static void
+cfx_iov_sizes (_gss_krb5_ctx_t k5, int conf_req_flag,
+	       size_t * hdrlen, size_t * trllen)
+{
+  int32_t etype = shishi_key_type (k5->key);
+  size_t cksumlen =
+    shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+
+  if (conf_req_flag)
+    {
+      *hdrlen = CFX_HEADER_LEN + shishi_cipher_confoundersize (etype);
+      *trllen = CFX_HEADER_LEN + cksumlen;
+    }
+  else
+    {
+      *hdrlen = CFX_HEADER_LEN;
+      *trllen = cksumlen;
+    }
+}
+
+/* Compute the checksum of an integrity-only RFC 4121 Wrap token with
+   header HEADER over LEN bytes at DATA, and write it to OUT.  The
+   checksum covers the data followed by the header, with EC and RRC
+   set to zero, see RFC 4121 section 4.2.4. */
+static void
+cfx_wrap_hmac (const _gss_krb5_hmac_sha1_ctx * key, const char *header,
+	       const char *data, size_t len, char *out, size_t cksumlen)
+{
+  _gss_krb5_hmac_sha1_ctx hmac = *key;
+  char digest[_GSS_KRB5_SHA1_LEN];
+  char tmp[CFX_HEADER_LEN];
+
+  memcpy (tmp, header, CFX_HEADER_LEN);
+  memset (tmp + 4, 0, 4);
+
+  _gss_krb5_hmac_sha1_update (&hmac, data, len);
+  _gss_krb5_hmac_sha1_update (&hmac, tmp, CFX_HEADER_LEN);
+  _gss_krb5_hmac_sha1_final (&hmac, digest);
+  memcpy (out, digest, cksumlen);
+}
+
+/* Report that the caller supplied buffer BUFFER is too small, and
+   that LEN bytes are needed. */
+static OM_uint32
+buffer_too_small (OM_uint32 * minor_status, gss_buffer_t buffer, size_t len)
+{
+  buffer->length = len;
+  if (minor_status)
+    *minor_status = ERANGE;
+  return GSS_S_FAILURE;
+}
+
+/* Produce a RFC 4121 Wrap token with sequence number SEQNR in P,
+   which must have room for the header, message and trailer given by
+   cfx_iov_sizes.  SH is a Shishi handle, which is only needed for
+   confidential tokens.  The token is not wrapped in the RFC 2743
+   framing (see section 4.4 of RFC 4121). */
+static OM_uint32
+wrap_cfx (OM_uint32 * minor_status,
+	  _gss_krb5_ctx_t k5, Shishi * sh, uint64_t seqnr,
+	  int conf_req_flag,
+	  const gss_buffer_t input_message_buffer,
+	  int *conf_state, char *p)
+{
+  int32_t etype = shishi_key_type (k5->key);
+  size_t confsize = shishi_cipher_confoundersize (etype);
+  size_t cksumlen =
+    shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+  size_t len = input_message_buffer->length;
+  char *q;
+  int rc;
+
+  if (conf_req_flag)
+    {
+      /* Header | E(confounder | plaintext | header) | HMAC, with EC
+         and RRC both zero, see RFC 3961 section 5.3. */
+      size_t ptlen = confsize + len + CFX_HEADER_LEN;
+
+      cfx_header (k5, TOK_WRAP_CFX, CFX_FLAG_SEALED, 0, 0, seqnr, p);
+      q = p + CFX_HEADER_LEN;
+      rc = shishi_randomize (sh, 0, q, confsize);
+      if (rc != SHISHI_OK)
+	return GSS_S_FAILURE;
+      memcpy (q + confsize + len, p, CFX_HEADER_LEN);
+
+      rc = cfx_seal (sh, &k5->send.ke, &k5->send.ki, q, ptlen,
+		     input_message_buffer->value, confsize, len,
+		     q + ptlen, cksumlen);
+      if (rc != SHISHI_OK)
+	return GSS_S_FAILURE;
+    }
+  else
+    {
+      /* For integrity-only tokens, EC is the checksum length. */
+      cfx_header (k5, TOK_WRAP_CFX, 0, cksumlen, 0, seqnr, p);
+      q = p + CFX_HEADER_LEN;
+      memcpy (q, input_message_buffer->value, len);
+      cfx_wrap_hmac (&k5->send.kc, p, q, len, q + len, cksumlen);
+    }
+
+  if (conf_state)
+    *conf_state = conf_req_flag;
+
+  return GSS_S_COMPLETE;
+}
+
+/* Check the header of the RFC 4121 Wrap token of TOKLEN bytes at
+   HEADER received on context K5, and compute the length LEN of the
+   message it carries.  FLAGS, EC, RRC and SEQNR are set to the
+   respective header fields. */
+static OM_uint32
+cfx_wrap_parse (_gss_krb5_ctx_t k5, const char *header, size_t toklen,
+		int *flags, size_t * ec, size_t * rrc, uint64_t * seqnr,
+		size_t * len)
+{
+  int32_t etype = shishi_key_type (k5->key);
+  size_t confsize = shishi_cipher_confoundersize (etype);
+  size_t cksumlen =
+    shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+  size_t bodylen;
+  OM_uint32 maj_stat;
+
+  if (toklen < CFX_HEADER_LEN)
+    return GSS_S_DEFECTIVE_TOKEN;
+
+  if (memcmp (header, TOK_WRAP_CFX, TOK_LEN) != 0
+      || (header[3] & 0xFF) != 0xFF)
+    return GSS_S_DEFECTIVE_TOKEN;
+
+  *flags = header[2] & 0xFF;
+  maj_stat = cfx_check_flags (k5, *flags);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  *ec = (header[4] & 0xFF) << 8 | (header[5] & 0xFF);
+  *rrc = (header[6] & 0xFF) << 8 | (header[7] & 0xFF);
+  *seqnr = cfx_seqnr (header);
+  bodylen = toklen - CFX_HEADER_LEN;
+
+  if (*flags & CFX_FLAG_SEALED)
+    {
+      if (bodylen < confsize + *ec + CFX_HEADER_LEN + cksumlen)
+	return GSS_S_DEFECTIVE_TOKEN;
+      *len = bodylen - confsize - *ec - CFX_HEADER_LEN - cksumlen;
+    }
+  else
+    {
+      if (bodylen < *ec || *ec != cksumlen)
+	return GSS_S_DEFECTIVE_TOKEN;
+      *len = bodylen - *ec;
+    }
+
+  return GSS_S_COMPLETE;
+}
+
+/* Reverse the LEN bytes at P. */
+static void
+reverse_bytes (char *p, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len / 2; i++)
+    {
+      char c = p[i];
+      p[i] = p[len - 1 - i];
+      p[len - 1 - i] = c;
+    }
+}
+
+/* Verify (and decrypt) the body of a RFC 4121 Wrap token, with the
+   header HEADER parsed by cfx_wrap_parse.  BODY holds the BODYLEN
+   bytes following the header, with any rotation undone.  The LEN
+   bytes of message are written to OUT, which may point to where the
+   message is in BODY.  No part of the message is left in OUT if
+   the token is bad. */
+static OM_uint32
+cfx_unwrap_body (OM_uint32 * minor_status, _gss_krb5_ctx_t k5,
+		 const char *header, const char *body, size_t bodylen,
+		 int flags, size_t len, char *out)
+{
+  int32_t etype = shishi_key_type (k5->key);
+  size_t confsize = shishi_cipher_confoundersize (etype);
+  size_t cksumlen =
+    shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+  char cksum[_GSS_KRB5_SHA1_LEN];
+  char trailer[CFX_HEADER_LEN];
+  size_t ptlen;
+  Shishi *sh;
+  int rc;
+
+  if (flags & CFX_FLAG_SEALED)
+    {
+      /* Decrypt confounder | plaintext | header and check the HMAC
+         over it, in one pass. */
+      ptlen = bodylen - cksumlen;
+
+      sh = _gss_krb5_crypto_get ();
+      if (!sh)
+	{
+	  if (minor_status)
+	    *minor_status = ENOMEM;
+	  return GSS_S_FAILURE;
+	}
+      rc = cfx_unseal (sh, &k5->recv.ke, &k5->recv.ki, body, ptlen,
+		       out, confsize, len, trailer, cksum, cksumlen);
+      _gss_krb5_crypto_put (sh);
+
+      /* The encrypted header copy must match, except for RRC.  The
+         message is not left behind if the token is bad. */
+      if (rc != SHISHI_OK
+	  || memcmp (cksum, body + ptlen, cksumlen) != 0
+	  || memcmp (trailer, header, 6) != 0
+	  || memcmp (trailer + 8, header + 8, 8) != 0)
+	{
+	  memset (out, 0, len);
+	  return GSS_S_BAD_MIC;
+	}
+    }
+  else
+    {
+      cfx_wrap_hmac (&k5->recv.kc, header, body, len, cksum, cksumlen);
+      if (memcmp (cksum, body + len, cksumlen) != 0)
+	return GSS_S_BAD_MIC;
+
+      if (out != body)
+	memmove (out, body, len);
+    }
+
+  return GSS_S_COMPLETE;
+}
+
+/* Verify (and decrypt) a RFC 4121 Wrap token.  If INTO is non-zero,
+   the message is written to the caller supplied buffer
+   OUTPUT_MESSAGE_BUFFER, whose length is its size; otherwise it is
+   allocated. */
+static OM_uint32
+unwrap_cfx (OM_uint32 * minor_status,
+	    _gss_krb5_ctx_t k5,
+	    const gss_buffer_t input_message_buffer,
+	    gss_buffer_t output_message_buffer,
+	    int *conf_state, gss_qop_t * qop_state, int into)
+{
+  const char *header = input_message_buffer->value;
+  const char *body = header + CFX_HEADER_LEN;
+  char *rotated = NULL;
+  size_t bodylen, ec, rrc;
+  uint64_t seqnr;
   char *p;
+  size_t len;
+  OM_uint32 maj_stat;
+  int flags;
+
+  maj_stat = cfx_wrap_parse (k5, header, input_message_buffer->length,
+			     &flags, &ec, &rrc, &seqnr, &len);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+  bodylen = input_message_buffer->length - CFX_HEADER_LEN;
+
+  /* The message length follows from the header, so a caller supplied
+     buffer can be checked before doing any work. */
+  if (into && output_message_buffer->length < len)
+    return buffer_too_small (minor_status, output_message_buffer, len);
+
+  p = into ? output_message_buffer->value : _gss_malloc (len ? len : 1);
+  if (!p)
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+
+  /* Undo any right rotation applied by the sender. */
+  if (bodylen > 0 && rrc % bodylen != 0)
+    {
+      rrc %= bodylen;
+      rotated = _gss_malloc (bodylen);
+      if (!rotated)
+	{
+	  if (!into)
+	    _gss_free (p);
+	  if (minor_status)
+	    *minor_status = ENOMEM;
+	  return GSS_S_FAILURE;
+	}
+      memcpy (rotated, body + rrc, bodylen - rrc);
+      memcpy (rotated + bodylen - rrc, body, rrc);
+      body = rotated;
+    }
+
+  maj_stat = cfx_unwrap_body (minor_status, k5, header, body, bodylen,
+			      flags, len, p);
+  _gss_free (rotated);
+  if (GSS_ERROR (maj_stat))
+    {
+      if (!into)
+	_gss_free (p);
+      return maj_stat;
+    }
+
+  output_message_buffer->value = p;
+  output_message_buffer->length = len;
+
+  if (conf_state)
+    *conf_state = (flags & CFX_FLAG_SEALED) != 0;
+  if (qop_state)
+    *qop_state = GSS_C_QOP_DEFAULT;
+
+  return recv_seqnr (k5, seqnr, UINT64_MAX);
+}
+
+/* Verify (and decrypt) the RFC 4121 Wrap token in MESSAGE_BUFFER in
+   place, and store the position of the message in it in OFFSET and
+   LENGTH. */
+static OM_uint32
+unwrap_cfx_inplace (OM_uint32 * minor_status,
+		    _gss_krb5_ctx_t k5,
+		    gss_buffer_t message_buffer,
+		    size_t * offset, size_t * length,
+		    int *conf_state, gss_qop_t * qop_state)
+{
+  int32_t etype = shishi_key_type (k5->key);
+  char *header = message_buffer->value;
+  char *body = header + CFX_HEADER_LEN;
+  size_t bodylen, ec, rrc;
+  uint64_t seqnr;
+  size_t len, off;
+  OM_uint32 maj_stat;
+  int flags;
+
+  maj_stat = cfx_wrap_parse (k5, header, message_buffer->length,
+			     &flags, &ec, &rrc, &seqnr, &len);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+  bodylen = message_buffer->length - CFX_HEADER_LEN;
+
+  /* Undo any right rotation by rotating left in place, and record
+     that in the header so that the token stays consistent. */
+  if (bodylen > 0 && rrc % bodylen != 0)
+    {
+      rrc %= bodylen;
+      reverse_bytes (body, rrc);
+      reverse_bytes (body + rrc, bodylen - rrc);
+      reverse_bytes (body, bodylen);
+    }
+  header[6] = header[7] = 0;
+
+  off = CFX_HEADER_LEN;
+  if (flags & CFX_FLAG_SEALED)
+    off += shishi_cipher_confoundersize (etype);
+
+  maj_stat = cfx_unwrap_body (minor_status, k5, header, body, bodylen,
+			      flags, len, header + off);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  *offset = off;
+  *length = len;
+
+  if (conf_state)
+    *conf_state = (flags & CFX_FLAG_SEALED) != 0;
+  if (qop_state)
+    *qop_state = GSS_C_QOP_DEFAULT;
+
+  return recv_seqnr (k5, seqnr, UINT64_MAX);
+}
+
+/* Return the length of the RFC 1964 Wrap token header on context K5,
+   which is followed by the message padded with 1 to 8 bytes, see RFC
+   1964 section 1.2.2.3. */
+static size_t
+rfc1964_wrap_hdrlen (_gss_krb5_ctx_t k5)
+{
+  /* Header, SND_SEQ, checksum and confounder. */
+  if (shishi_key_type (k5->key) == SHISHI_DES_CBC_MD5)
+    return 8 + 8 + 8 + 8;
+  return 8 + 8 + 20 + 8;
+}
+
+/* Return the length of the RFC 1964 Wrap token for LEN bytes of
+   message on context K5, including the RFC 2743 framing. */
+static size_t
+rfc1964_wrap_length (_gss_krb5_ctx_t k5, size_t len)
+{
+  return _gss_encapsulate_token_length (0, rfc1964_wrap_hdrlen (k5)
+					+ len + 8 - len % 8,
+					GSS_KRB5->length);
+}
+
+/* Produce a RFC 1964 Wrap token with the low 32 bits of SEQNR as
+   sequence number in BUF, which must have room for
+   rfc1964_wrap_length bytes, using the Shishi handle SH.  The token
+   is built behind room for the RFC 2743 header, which is then filled
+   in without moving the token.  Confidentiality is only available
+   with DES3. */
+static OM_uint32
+wrap_rfc1964 (OM_uint32 * minor_status,
+	      _gss_krb5_ctx_t k5, Shishi * sh, uint64_t seqnr,
+	      int conf_req_flag,
+	      const gss_buffer_t input_message_buffer,
+	      int *conf_state, char *buf)
+{
+  size_t padlength = 8 - input_message_buffer->length % 8;
+  size_t toklen = rfc1964_wrap_hdrlen (k5)
+    + input_message_buffer->length + padlength;
+  size_t hdrlen = _gss_encapsulate_token_headroom (toklen, GSS_KRB5->length);
+  char *p = buf + hdrlen;
   size_t tmplen;
+  int sealed = 0;
   int rc;
 
   switch (shishi_key_type (k5->key))
@@ -86,16 +765,6 @@ gss_krb5_wrap (OM_uint32 * minor_status,
 	   ;;   DES-MAC-MD5 CKSUM      CONFOUNDER
 	   ;;   PADDED DATA
 	 */
-	padlength = 8 - input_message_buffer->length % 8;
-	data.length = 4 * 8 + input_message_buffer->length + padlength;
-	p = malloc (data.length);
-	if (!p)
-	  {
-	    if (minor_status)
-	      *minor_status = ENOMEM;
-	    return GSS_S_FAILURE;
-	  }
-
 	/* XXX encrypt data iff confidential option chosen */
 
 	/* Setup header and confounder */
@@ -103,7 +772,7 @@ gss_krb5_wrap (OM_uint32 * minor_status,
 	memcpy (header + 2, "\x00\x00", 2);	/* SGN_ALG: DES-MAC-MD5 */
 	memcpy (header + 4, "\xFF\xFF", 2);	/* SEAL_ALG: none */
 	memcpy (header + 6, "\xFF\xFF", 2);	/* filler */
-	rc = shishi_randomize (k5->sh, 0, confounder, 8);
+	rc = shishi_randomize (sh, 0, confounder, 8);
 	if (rc != SHISHI_OK)
 	  return GSS_S_FAILURE;
 
@@ -115,7 +784,7 @@ gss_krb5_wrap (OM_uint32 * minor_status,
 	memset (p + 16 + input_message_buffer->length,
 		(int) padlength, padlength);
 
-	rc = shishi_checksum (k5->sh,
+	rc = shishi_checksum (sh,
 			      k5->key,
 			      0, SHISHI_RSA_MD5_DES_GSS,
 			      p,
@@ -125,24 +794,13 @@ gss_krb5_wrap (OM_uint32 * minor_status,
 	  return GSS_S_FAILURE;
 
 	/* seq_nr */
-	if (k5->acceptor)
-	  {
-	    seqno[0] = k5->acceptseqnr & 0xFF;
-	    seqno[1] = k5->acceptseqnr >> 8 & 0xFF;
-	    seqno[2] = k5->acceptseqnr >> 16 & 0xFF;
-	    seqno[3] = k5->acceptseqnr >> 24 & 0xFF;
-	    memset (seqno + 4, 0xFF, 4);
-	  }
-	else
-	  {
-	    seqno[0] = k5->initseqnr & 0xFF;
-	    seqno[1] = k5->initseqnr >> 8 & 0xFF;
-	    seqno[2] = k5->initseqnr >> 16 & 0xFF;
-	    seqno[3] = k5->initseqnr >> 24 & 0xFF;
-	    memset (seqno + 4, 0, 4);
-	  }
+	seqno[0] = seqnr & 0xFF;
+	seqno[1] = seqnr >> 8 & 0xFF;
+	seqno[2] = seqnr >> 16 & 0xFF;
+	seqno[3] = seqnr >> 24 & 0xFF;
+	memset (seqno + 4, k5->acceptor ? 0xFF : 0, 4);
 
-	rc = shishi_encrypt_iv_etype (k5->sh, k5->key, 0,
+	rc = shishi_encrypt_iv_etype (sh, k5->key, 0,
 				      SHISHI_DES_CBC_NONE, cksum, 8,
 				      seqno, 8, &eseqno, &tmplen);
 	if (rc != SHISHI_OK || tmplen != 8)
@@ -159,101 +817,66 @@ gss_krb5_wrap (OM_uint32 * minor_status,
 		input_message_buffer->length);
 	memset (p + 32 + input_message_buffer->length,
 		(int) padlength, padlength);
-
-	data.value = p;
-
-	rc = gss_encapsulate_token (&data, GSS_KRB5, output_message_buffer);
-	if (rc != GSS_S_COMPLETE)
-	  return GSS_S_FAILURE;
-	if (k5->acceptor)
-	  k5->acceptseqnr++;
-	else
-	  k5->initseqnr++;
       }
       break;
 
     case SHISHI_DES3_CBC_HMAC_SHA1_KD:
       {
+	_gss_krb5_hmac_sha1_ctx hmac = k5->send.mic;
+	size_t len = input_message_buffer->length;
+	size_t bodylen = 8 + len + padlength;
+	char *q = p + 8 + 8 + 20;
+	size_t i, n, a, b;
+	char iv[8];
 	char *tmp;
 
-	padlength = 8 - input_message_buffer->length % 8;
-	data.length = 8 + 8 + 20 + 8 + input_message_buffer->length
-	  + padlength;
-	p = malloc (data.length);
-	if (!p)
-	  {
-	    if (minor_status)
-	      *minor_status = ENOMEM;
-	    return GSS_S_FAILURE;
-	  }
-
-	/* XXX encrypt data iff confidential option chosen */
-
-	/* Compute checksum over header, confounder, input string, and pad */
-
+	sealed = conf_req_flag != 0;
 	memcpy (p, TOK_WRAP, 2);	/* TOK_ID: Wrap */
 	memcpy (p + 2, "\x04\x00", 2);	/* SGN_ALG: 3DES */
-	memcpy (p + 4, "\xFF\xFF", 2);	/* SEAL_ALG: none */
+	memcpy (p + 4, sealed ? "\x02\x00" : "\xFF\xFF", 2);	/* SEAL_ALG */
 	memcpy (p + 6, "\xFF\xFF", 2);	/* filler */
-	rc = shishi_randomize (k5->sh, 0, p + 8, 8);
+	rc = shishi_randomize (sh, 0, q, 8);
 	if (rc != SHISHI_OK)
 	  return GSS_S_FAILURE;
-	memcpy (p + 16, input_message_buffer->value,
-		input_message_buffer->length);
-	memset (p + 16 + input_message_buffer->length,
-		(int) padlength, padlength);
-
-	rc = shishi_checksum (k5->sh,
-			      k5->key,
-			      SHISHI_KEYUSAGE_GSS_R2,
-			      SHISHI_HMAC_SHA1_DES3_KD, p,
-			      16 + input_message_buffer->length + padlength,
-			      &tmp, &tmplen);
-	if (rc != SHISHI_OK || tmplen != 20)
-	  return GSS_S_FAILURE;
-
-	memcpy (p + 16, tmp, tmplen);
-	memcpy (p + 36, p + 8, 8);
-
-	/* seq_nr */
-	if (k5->acceptor)
-	  {
-	    (p + 8)[0] = k5->acceptseqnr & 0xFF;
-	    (p + 8)[1] = k5->acceptseqnr >> 8 & 0xFF;
-	    (p + 8)[2] = k5->acceptseqnr >> 16 & 0xFF;
-	    (p + 8)[3] = k5->acceptseqnr >> 24 & 0xFF;
-	    memset (p + 8 + 4, 0xFF, 4);
-	  }
-	else
+	memset (q + 8 + len, (int) padlength, padlength);
+
+	/* Checksum header + confounder + data + pad, and encrypt all
+	   but the header when sealing with a zero IV.  The data is
+	   copied in, checksummed and encrypted a slice at a time. */
+	_gss_krb5_hmac_sha1_update (&hmac, p, 8);
+	memset (iv, 0, sizeof (iv));
+	for (i = 0; i < bodylen; i += n)
 	  {
-	    (p + 8)[0] = k5->initseqnr & 0xFF;
-	    (p + 8)[1] = k5->initseqnr >> 8 & 0xFF;
-	    (p + 8)[2] = k5->initseqnr >> 16 & 0xFF;
-	    (p + 8)[3] = k5->initseqnr >> 24 & 0xFF;
-	    memset (p + 8 + 4, 0, 4);
+	    n = bodylen - i < CIPHER_SLICE ? bodylen - i : CIPHER_SLICE;
+	    if (slice_overlap (i, n, 8, len, &a, &b))
+	      memcpy (q + a,
+		      (const char *) input_message_buffer->value + a - 8,
+		      b - a);
+	    _gss_krb5_hmac_sha1_update (&hmac, q + i, n);
+	    if (sealed)
+	      {
+		rc = des3_cbc (sh, k5->key, 0, iv, q + i, q + i, n);
+		if (rc != SHISHI_OK)
+		  return GSS_S_FAILURE;
+	      }
 	  }
+	_gss_krb5_hmac_sha1_final (&hmac, p + 16);
+
+	/* seq_nr */
+	(p + 8)[0] = seqnr & 0xFF;
+	(p + 8)[1] = seqnr >> 8 & 0xFF;
+	(p + 8)[2] = seqnr >> 16 & 0xFF;
+	(p + 8)[3] = seqnr >> 24 & 0xFF;
+	memset (p + 8 + 4, k5->acceptor ? 0xFF : 0, 4);
 
-	rc = shishi_encrypt_iv_etype (k5->sh, k5->key, 0, SHISHI_DES3_CBC_NONE, p + 16, 8,	/* cksum */
+	rc = shishi_encrypt_iv_etype (sh, k5->key, 0, SHISHI_DES3_CBC_NONE, p + 16, 8,	/* cksum */
 				      p + 8, 8, &tmp, &tmplen);
 	if (rc != SHISHI_OK || tmplen != 8)
 	  return GSS_S_FAILURE;
 
 	memcpy (p + 8, tmp, tmplen);
 	free (tmp);
-	memcpy (p + 8 + 8 + 20 + 8, input_message_buffer->value,
-		input_message_buffer->length);
-	memset (p + 8 + 8 + 20 + 8 + input_message_buffer->length,
-		(int) padlength, padlength);
 
-	data.value = p;
-
-	rc = gss_encapsulate_token (&data, GSS_KRB5, output_message_buffer);
-	if (rc != GSS_S_COMPLETE)
-	  return GSS_S_FAILURE;
-	if (k5->acceptor)
-	  k5->acceptseqnr++;
-	else
-	  k5->initseqnr++;
 	break;
       }
 
@@ -261,62 +884,209 @@ gss_krb5_wrap (OM_uint32 * minor_status,
       return GSS_S_FAILURE;
     }
 
+  _gss_encapsulate_token_inplace (p, hdrlen, toklen,
+				  GSS_KRB5->elements, GSS_KRB5->length);
+
+  if (conf_state)
+    *conf_state = sealed;
+
   return GSS_S_COMPLETE;
 }
 
-OM_uint32
-gss_krb5_unwrap (OM_uint32 * minor_status,
-		 const gss_ctx_id_t context_handle,
-		 const gss_buffer_t input_message_buffer,
-		 gss_buffer_t output_message_buffer,
-		 int *conf_state, gss_qop_t * qop_state)
+/* Return the length of the Wrap token for LEN bytes of message on
+   context K5. */
+static size_t
+wrap_length (_gss_krb5_ctx_t k5, int conf_req_flag, size_t len)
 {
-  _gss_krb5_ctx_t k5 = context_handle->krb5;
-  gss_buffer_desc tok;
-  char *data;
-  OM_uint32 sgn_alg, seal_alg;
-  size_t tmplen;
-  int rc;
+  size_t hdrlen, trllen;
 
-  rc = gss_decapsulate_token (input_message_buffer, GSS_KRB5, &tok);
-  if (rc != GSS_S_COMPLETE)
-    return GSS_S_BAD_MIC;
+  if (!cfx_enctype_p (k5))
+    return rfc1964_wrap_length (k5, len);
 
-  if (tok.length < 8)
-    return GSS_S_BAD_MIC;
+  cfx_iov_sizes (k5, conf_req_flag, &hdrlen, &trllen);
+  return hdrlen + len + trllen;
+}
 
-  if (memcmp (tok.value, TOK_WRAP, TOK_LEN) != 0)
-    return GSS_S_BAD_MIC;
+/* Produce a Wrap token with sequence number SEQNR in BUF, which must
+   have room for wrap_length bytes.  SH is a Shishi handle, or NULL
+   if wrap_crypto_p says none is needed. */
+static OM_uint32
+wrap_token_seqnr (OM_uint32 * minor_status,
+		  _gss_krb5_ctx_t k5, Shishi * sh, uint64_t seqnr,
+		  int conf_req_flag,
+		  const gss_buffer_t input_message_buffer,
+		  int *conf_state, char *buf)
+{
+  if (cfx_enctype_p (k5))
+    return wrap_cfx (minor_status, k5, sh, seqnr, conf_req_flag,
+		     input_message_buffer, conf_state, buf);
 
-  data = tok.value;
+  return wrap_rfc1964 (minor_status, k5, sh, seqnr, conf_req_flag,
+		       input_message_buffer, conf_state, buf);
+}
 
-  sgn_alg = data[2] & 0xFF;
-  sgn_alg |= data[3] << 8 & 0xFF00;
+/* Return non-zero if producing Wrap tokens on context K5 needs a
+   Shishi handle.  Integrity-only RFC 4121 tokens only use the
+   precomputed HMAC keys. */
+static int
+wrap_crypto_p (_gss_krb5_ctx_t k5, int conf_req_flag)
+{
+  return conf_req_flag || !cfx_enctype_p (k5);
+}
 
-  seal_alg = data[4] & 0xFF;
-  seal_alg |= data[5] << 8 & 0xFF00;
+/* Produce a Wrap token in BUF, which must have room for wrap_length
+   bytes. */
+static OM_uint32
+wrap_token (OM_uint32 * minor_status,
+	    _gss_krb5_ctx_t k5,
+	    int conf_req_flag,
+	    const gss_buffer_t input_message_buffer,
+	    int *conf_state, char *buf)
+{
+  OM_uint32 maj_stat;
+  Shishi *sh = NULL;
 
-  if (conf_state != NULL)
-    *conf_state = seal_alg == 0xFFFF;
+  if (wrap_crypto_p (k5, conf_req_flag))
+    {
+      sh = _gss_krb5_crypto_get ();
+      if (!sh)
+	{
+	  if (minor_status)
+	    *minor_status = ENOMEM;
+	  return GSS_S_FAILURE;
+	}
+    }
 
-  if (memcmp (data + 6, "\xFF\xFF", 2) != 0)
-    return GSS_S_BAD_MIC;
+  maj_stat = wrap_token_seqnr (minor_status, k5, sh,
+			       _gss_krb5_send_seqnr (k5), conf_req_flag,
+			       input_message_buffer, conf_state, buf);
+  if (sh)
+    _gss_krb5_crypto_put (sh);
 
-  switch (sgn_alg)
-    {
-      /* XXX implement other checksums */
+  return maj_stat;
+}
 
-    case 0:			/* DES-MD5 */
-      {
-	size_t padlen;
-	char *pt;
-	char header[8];
-	char encseqno[8];
+OM_uint32
+gss_krb5_wrap (OM_uint32 * minor_status,
+	       const gss_ctx_id_t context_handle,
+	       int conf_req_flag,
+	       gss_qop_t qop_req,
+	       const gss_buffer_t input_message_buffer,
+	       int *conf_state, gss_buffer_t output_message_buffer)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  size_t toklen = wrap_length (k5, conf_req_flag,
+			       input_message_buffer->length);
+  OM_uint32 maj_stat;
+  char *p;
+
+  p = _gss_malloc (toklen);
+  if (!p)
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+
+  maj_stat = wrap_token (minor_status, k5, conf_req_flag,
+			 input_message_buffer, conf_state, p);
+  if (GSS_ERROR (maj_stat))
+    {
+      _gss_free (p);
+      return maj_stat;
+    }
+
+  output_message_buffer->value = p;
+  output_message_buffer->length = toklen;
+
+  return GSS_S_COMPLETE;
+}
+
+/* Like gss_krb5_wrap, but write the token into the caller supplied
+   OUTPUT_MESSAGE_BUFFER.  The size is checked before a sequence
+   number is used. */
+OM_uint32
+gss_krb5_wrap_into (OM_uint32 * minor_status,
+		    const gss_ctx_id_t context_handle,
+		    int conf_req_flag,
+		    gss_qop_t qop_req,
+		    const gss_buffer_t input_message_buffer,
+		    int *conf_state, gss_buffer_t output_message_buffer)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  size_t toklen = wrap_length (k5, conf_req_flag,
+			       input_message_buffer->length);
+  OM_uint32 maj_stat;
+
+  if (output_message_buffer->length < toklen)
+    return buffer_too_small (minor_status, output_message_buffer, toklen);
+
+  maj_stat = wrap_token (minor_status, k5, conf_req_flag,
+			 input_message_buffer, conf_state,
+			 output_message_buffer->value);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  output_message_buffer->length = toklen;
+
+  return GSS_S_COMPLETE;
+}
+
+/* Verify a RFC 1964 Wrap token, using the Shishi handle SH.  On
+   success, MESSAGE describes the message and SEQNR holds its sequence
+   number, which the caller must check with recv_seqnr.  The message
+   of an integrity-only token is inside the token.  A sealed token is
+   decrypted into memory stored in *PLAIN, which the caller must
+   release with _gss_free whether or not the call succeeds, or in
+   place inside the token if PLAIN is NULL. */
+static OM_uint32
+unwrap_rfc1964 (OM_uint32 * minor_status,
+		_gss_krb5_ctx_t k5, Shishi * sh,
+		const gss_buffer_t input_message_buffer,
+		gss_buffer_t message, uint32_t * seqnr, int *conf_state,
+		char **plain)
+{
+  gss_buffer_desc tok;
+  const char *data;
+  OM_uint32 sgn_alg, seal_alg;
+  int rc;
+
+  rc = gss_decapsulate_token_view (input_message_buffer, GSS_KRB5, &tok);
+  if (rc != GSS_S_COMPLETE)
+    return GSS_S_BAD_MIC;
+
+  if (tok.length < 8)
+    return GSS_S_BAD_MIC;
+
+  if (memcmp (tok.value, TOK_WRAP, TOK_LEN) != 0)
+    return GSS_S_BAD_MIC;
+
+  data = tok.value;
+
+  sgn_alg = data[2] & 0xFF;
+  sgn_alg |= data[3] << 8 & 0xFF00;
+
+  seal_alg = data[4] & 0xFF;
+  seal_alg |= data[5] << 8 & 0xFF00;
+
+  if (conf_state != NULL)
+    *conf_state = seal_alg != 0xFFFF;
+
+  if (memcmp (data + 6, "\xFF\xFF", 2) != 0)
+    return GSS_S_BAD_MIC;
+
+  switch (sgn_alg)
+    {
+      /* XXX implement other checksums */
+
+    case 0:			/* DES-MD5 */
+      {
+	_gss_krb5_md5_ctx md5;
+	char digest[_GSS_KRB5_MD5_LEN];
+	size_t padlen;
 	char seqno[8];
 	char cksum[8];
-	char confounder[8];
 	char *tmp;
-	uint32_t seqnr;
 	size_t outlen, i;
 
 	/* Typical data:
@@ -332,22 +1102,22 @@ gss_krb5_unwrap (OM_uint32 * minor_status,
 	if (tok.length < 5 * 8)
 	  return GSS_S_BAD_MIC;
 
-	memcpy (header, data, 8);
-	memcpy (encseqno, data + 8, 8);
-	memcpy (cksum, data + 16, 8);
-	memcpy (confounder, data + 24, 8);
-	pt = data + 32;
-
 	/* XXX decrypt data iff confidential option chosen */
+	if (seal_alg != 0xFFFF)
+	  return GSS_S_FAILURE;
 
-	rc = shishi_decrypt_iv_etype (k5->sh,
+	rc = shishi_decrypt_iv_etype (sh,
 				      k5->key,
 				      0, SHISHI_DES_CBC_NONE,
-				      cksum, 8, encseqno, 8, &tmp, &outlen);
+				      data + 16, 8, data + 8, 8,
+				      &tmp, &outlen);
 	if (rc != SHISHI_OK)
 	  return GSS_S_FAILURE;
 	if (outlen != 8)
-	  return GSS_S_BAD_MIC;
+	  {
+	    free (tmp);
+	    return GSS_S_BAD_MIC;
+	  }
 	memcpy (seqno, tmp, 8);
 	free (tmp);
 
@@ -355,14 +1125,7 @@ gss_krb5_unwrap (OM_uint32 * minor_status,
 		    "\xFF\xFF\xFF\xFF", 4) != 0)
 	  return GSS_S_BAD_MIC;
 
-	seqnr = C2I (seqno);
-	if (seqnr != (k5->acceptor ? k5->initseqnr : k5->acceptseqnr))
-	  return GSS_S_BAD_MIC;
-
-	if (k5->acceptor)
-	  k5->initseqnr++;
-	else
-	  k5->acceptseqnr++;
+	*seqnr = C2I (seqno);
 
 	/* Check pad */
 	padlen = data[tok.length - 1];
@@ -372,122 +1135,2265 @@ gss_krb5_unwrap (OM_uint32 * minor_status,
 	  if (data[tok.length - i] != (int) padlen)
 	    return GSS_S_BAD_MIC;
 
-	/* Write header and confounder next to data */
-	memcpy (data + 16, header, 8);
-	memcpy (data + 24, confounder, 8);
-
-	/* Checksum header + confounder + data + pad */
-	rc = shishi_checksum (k5->sh,
-			      k5->key,
-			      0, SHISHI_RSA_MD5_DES_GSS,
-			      data + 16, tok.length - 16, &tmp, &tmplen);
-	if (rc != SHISHI_OK || tmplen != 8)
+	/* Checksum header + confounder + data + pad.  The token is
+	   not modified, as it points into the caller's buffer. */
+	_gss_krb5_md5_init (&md5);
+	_gss_krb5_md5_update (&md5, data, 8);
+	_gss_krb5_md5_update (&md5, data + 24, tok.length - 24);
+	_gss_krb5_md5_final (&md5, digest);
+	if (des_md5_mac (sh, k5->key, digest, cksum) != SHISHI_OK)
 	  return GSS_S_FAILURE;
 
-	memcpy (data + 8, tmp, tmplen);
-
 	/* Compare checksum */
-	if (tmplen != 8 || memcmp (cksum, data + 8, 8) != 0)
+	if (memcmp (cksum, data + 16, 8) != 0)
 	  return GSS_S_BAD_MIC;
 
-	/* Copy output data */
-	output_message_buffer->length = tok.length - 8 - 8 - 8 - 8 - padlen;
-	output_message_buffer->value = malloc (output_message_buffer->length);
-	if (!output_message_buffer->value)
-	  {
-	    if (minor_status)
-	      *minor_status = ENOMEM;
-	    return GSS_S_FAILURE;
-	  }
-
-	memcpy (output_message_buffer->value, pt,
-		tok.length - 4 * 8 - padlen);
+	message->value = (char *) data + 32;
+	message->length = tok.length - 8 - 8 - 8 - 8 - padlen;
       }
       break;
 
     case 4:			/* 3DES */
       {
+	_gss_krb5_hmac_sha1_ctx hmac;
+	const char *body = data + 8 + 8 + 20;
+	size_t bodylen;
 	size_t padlen;
-	char *p;
+	char seqno[8];
 	char *t;
 	char cksum[20];
-	size_t outlen, i;
-	uint32_t seqnr;
+	char iv[8];
+	/* Where a sealed body was decrypted to, else NULL. */
+	char *out = NULL;
+	size_t outlen, i, n;
 
 	if (tok.length < 8 + 8 + 20 + 8 + 8)
 	  return GSS_S_BAD_MIC;
+	bodylen = tok.length - 8 - 8 - 20;
 
-	memcpy (cksum, data + 8 + 8, 20);
-
-	/* XXX decrypt data iff confidential option chosen */
+	/* SEAL_ALG is none or DES3. */
+	if (seal_alg != 0xFFFF && (seal_alg != 0x0002 || bodylen % 8 != 0))
+	  return GSS_S_BAD_MIC;
 
-	p = data + 8;
-	rc = shishi_decrypt_iv_etype (k5->sh,
+	rc = shishi_decrypt_iv_etype (sh,
 				      k5->key,
 				      0, SHISHI_DES3_CBC_NONE,
-				      cksum, 8, p, 8, &t, &outlen);
+				      data + 8 + 8, 8, data + 8, 8,
+				      &t, &outlen);
 	if (rc != SHISHI_OK || outlen != 8)
 	  return GSS_S_FAILURE;
 
-	memcpy (p, t, 8);
+	memcpy (seqno, t, 8);
 	free (t);
 
-	if (memcmp (p + 4, k5->acceptor ? "\x00\x00\x00\x00" :
+	if (memcmp (seqno + 4, k5->acceptor ? "\x00\x00\x00\x00" :
 		    "\xFF\xFF\xFF\xFF", 4) != 0)
 	  return GSS_S_BAD_MIC;
-	seqnr = C2I (p);
-	if (seqnr != (k5->acceptor ? k5->initseqnr : k5->acceptseqnr))
-	  return GSS_S_BAD_MIC;
+	*seqnr = C2I (seqno);
 
-	if (k5->acceptor)
-	  k5->initseqnr++;
+	/* Checksum header + confounder + data + pad.  A sealed body is
+	   decrypted and checksummed a slice at a time. */
+	hmac = k5->recv.mic;
+	_gss_krb5_hmac_sha1_update (&hmac, data, 8);
+	if (seal_alg == 0x0002)
+	  {
+	    out = (char *) body;
+	    if (plain)
+	      {
+		out = *plain = _gss_malloc (bodylen);
+		if (!out)
+		  {
+		    if (minor_status)
+		      *minor_status = ENOMEM;
+		    return GSS_S_FAILURE;
+		  }
+	      }
+
+	    memset (iv, 0, sizeof (iv));
+	    for (i = 0; i < bodylen; i += n)
+	      {
+		n = bodylen - i < CIPHER_SLICE ? bodylen - i : CIPHER_SLICE;
+		rc = des3_cbc (sh, k5->key, 1, iv, body + i, out + i, n);
+		if (rc != SHISHI_OK)
+		  {
+		    memset (out, 0, bodylen);
+		    return GSS_S_FAILURE;
+		  }
+		_gss_krb5_hmac_sha1_update (&hmac, out + i, n);
+	      }
+	    body = out;
+	  }
 	else
-	  k5->acceptseqnr++;
-
-	/* Check pad */
-	padlen = data[tok.length - 1];
-	if (padlen > 8)
-	  return GSS_S_BAD_MIC;
-	for (i = 1; i <= padlen; i++)
-	  if (data[tok.length - i] != (int) padlen)
+	  _gss_krb5_hmac_sha1_update (&hmac, body, bodylen);
+	_gss_krb5_hmac_sha1_final (&hmac, cksum);
+
+	/* Compare checksum and pad.  The decrypted body of a bad token
+	   is not left behind, in the token or in *PLAIN. */
+	padlen = body[bodylen - 1];
+	for (i = 1; padlen <= 8 && i <= padlen; i++)
+	  if (body[bodylen - i] != (int) padlen)
+	    break;
+	if (memcmp (cksum, data + 8 + 8, 20) != 0 || padlen > 8 || i <= padlen)
+	  {
+	    if (out)
+	      memset (out, 0, bodylen);
 	    return GSS_S_BAD_MIC;
+	  }
+
+	message->value = (char *) body + 8;
+	message->length = bodylen - 8 - padlen;
+      }
+      break;
 
-	/* Write header next to confounder */
-	memcpy (data + 8 + 20, data, 8);
+    default:
+      return GSS_S_FAILURE;
+    }
 
-	/* Checksum header + confounder + data + pad */
-	rc = shishi_checksum (k5->sh,
-			      k5->key,
-			      SHISHI_KEYUSAGE_GSS_R2,
-			      SHISHI_HMAC_SHA1_DES3_KD, data + 20 + 8,
-			      tok.length - 20 - 8, &t, &tmplen);
-	if (rc != SHISHI_OK || tmplen != 20)
+  return GSS_S_COMPLETE;
+}
+
+/* Verify the RFC 1964 Wrap token INPUT_MESSAGE_BUFFER, see
+   unwrap_rfc1964. */
+static OM_uint32
+unwrap_rfc1964_view (OM_uint32 * minor_status,
+		     _gss_krb5_ctx_t k5,
+		     const gss_buffer_t input_message_buffer,
+		     gss_buffer_t message, uint32_t * seqnr, int *conf_state,
+		     char **plain)
+{
+  OM_uint32 maj_stat;
+  Shishi *sh;
+
+  sh = _gss_krb5_crypto_get ();
+  if (!sh)
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+
+  maj_stat = unwrap_rfc1964 (minor_status, k5, sh, input_message_buffer,
+			     message, seqnr, conf_state, plain);
+  _gss_krb5_crypto_put (sh);
+
+  return maj_stat;
+}
+
+OM_uint32
+gss_krb5_unwrap (OM_uint32 * minor_status,
+		 const gss_ctx_id_t context_handle,
+		 const gss_buffer_t input_message_buffer,
+		 gss_buffer_t output_message_buffer,
+		 int *conf_state, gss_qop_t * qop_state)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  gss_buffer_desc message;
+  OM_uint32 maj_stat;
+  uint32_t seqnr;
+  char *plain = NULL;
+
+  /* RFC 4121 tokens are not wrapped in the RFC 2743 framing. */
+  if (input_message_buffer->length >= TOK_LEN
+      && memcmp (input_message_buffer->value, TOK_WRAP_CFX, TOK_LEN) == 0)
+    return unwrap_cfx (minor_status, k5, input_message_buffer,
+		       output_message_buffer, conf_state, qop_state, 0);
+
+  maj_stat = unwrap_rfc1964_view (minor_status, k5, input_message_buffer,
+				  &message, &seqnr, conf_state, &plain);
+  if (GSS_ERROR (maj_stat))
+    {
+      _gss_free (plain);
+      return maj_stat;
+    }
+
+  if (plain)
+    {
+      /* The message was decrypted into memory of our own. */
+      memmove (plain, message.value, message.length);
+      output_message_buffer->value = plain;
+    }
+  else
+    {
+      output_message_buffer->value =
+	_gss_malloc (message.length ? message.length : 1);
+      if (!output_message_buffer->value)
+	{
+	  if (minor_status)
+	    *minor_status = ENOMEM;
 	  return GSS_S_FAILURE;
+	}
+      memcpy (output_message_buffer->value, message.value, message.length);
+    }
+  output_message_buffer->length = message.length;
 
-	memcpy (data + 8 + 8, t, tmplen);
-	free (t);
+  return recv_seqnr (k5, seqnr, UINT32_MAX);
+}
 
-	/* Compare checksum */
-	if (tmplen != 20 || memcmp (cksum, data + 8 + 8, 20) != 0)
-	  return GSS_S_BAD_MIC;
+/* Like gss_krb5_unwrap, but write the message into the caller
+   supplied OUTPUT_MESSAGE_BUFFER.  The token is not consumed if the
+   buffer is too small. */
+OM_uint32
+gss_krb5_unwrap_into (OM_uint32 * minor_status,
+		      const gss_ctx_id_t context_handle,
+		      const gss_buffer_t input_message_buffer,
+		      gss_buffer_t output_message_buffer,
+		      int *conf_state, gss_qop_t * qop_state)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  gss_buffer_desc message;
+  OM_uint32 maj_stat;
+  uint32_t seqnr;
+  char *plain = NULL;
+
+  if (input_message_buffer->length >= TOK_LEN
+      && memcmp (input_message_buffer->value, TOK_WRAP_CFX, TOK_LEN) == 0)
+    return unwrap_cfx (minor_status, k5, input_message_buffer,
+		       output_message_buffer, conf_state, qop_state, 1);
+
+  maj_stat = unwrap_rfc1964_view (minor_status, k5, input_message_buffer,
+				  &message, &seqnr, conf_state, &plain);
+  if (GSS_ERROR (maj_stat))
+    {
+      _gss_free (plain);
+      return maj_stat;
+    }
 
-	/* Copy output data */
-	output_message_buffer->length = tok.length - 8 - 20 - 8 - 8 - padlen;
-	output_message_buffer->value = malloc (output_message_buffer->length);
-	if (!output_message_buffer->value)
-	  {
-	    if (minor_status)
-	      *minor_status = ENOMEM;
-	    return GSS_S_FAILURE;
-	  }
-	memcpy (output_message_buffer->value, data + 20 + 8 + 8 + 8,
-		tok.length - 20 - 8 - 8 - 8 - padlen);
-      }
-      break;
+  if (output_message_buffer->length < message.length)
+    {
+      _gss_free (plain);
+      return buffer_too_small (minor_status, output_message_buffer,
+			       message.length);
+    }
 
-    default:
+  memcpy (output_message_buffer->value, message.value, message.length);
+  output_message_buffer->length = message.length;
+  _gss_free (plain);
+
+  return recv_seqnr (k5, seqnr, UINT32_MAX);
+}
+
+/* Like gss_krb5_unwrap, but leave the message in MESSAGE_BUFFER and
+   store its position there in OFFSET and LENGTH. */
+OM_uint32
+gss_krb5_unwrap_inplace (OM_uint32 * minor_status,
+			 const gss_ctx_id_t context_handle,
+			 gss_buffer_t message_buffer,
+			 size_t * offset, size_t * length,
+			 int *conf_state, gss_qop_t * qop_state)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  gss_buffer_desc message;
+  OM_uint32 maj_stat;
+  uint32_t seqnr;
+
+  if (message_buffer->length >= TOK_LEN
+      && memcmp (message_buffer->value, TOK_WRAP_CFX, TOK_LEN) == 0)
+    return unwrap_cfx_inplace (minor_status, k5, message_buffer,
+			       offset, length, conf_state, qop_state);
+
+  /* RFC 1964 tokens carry the message in the clear, or are
+     decrypted where they are. */
+  maj_stat = unwrap_rfc1964_view (minor_status, k5, message_buffer,
+				  &message, &seqnr, conf_state, NULL);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  *offset = (char *) message.value - (char *) message_buffer->value;
+  *length = message.length;
+  if (qop_state)
+    *qop_state = GSS_C_QOP_DEFAULT;
+
+  return recv_seqnr (k5, seqnr, UINT32_MAX);
+}
+
+/* Wrap COUNT messages into tokens laid out back to back in one
+   buffer, OUTPUT_ARENA, which the caller releases.  The sequence
+   numbers are reserved together, and one Shishi handle serves all
+   tokens. */
+OM_uint32
+gss_krb5_wrap_batch (OM_uint32 * minor_status,
+		     const gss_ctx_id_t context_handle,
+		     int conf_req_flag,
+		     gss_qop_t qop_req,
+		     size_t count,
+		     gss_buffer_desc * input_message_buffers,
+		     int *conf_state,
+		     gss_buffer_desc * output_message_buffers,
+		     gss_buffer_t output_arena)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  OM_uint32 maj_stat = GSS_S_COMPLETE;
+  size_t total = 0, toklen, i;
+  Shishi *sh = NULL;
+  uint64_t seqnr;
+  char *arena, *p;
+
+  for (i = 0; i < count; i++)
+    {
+      toklen = wrap_length (k5, conf_req_flag,
+			    input_message_buffers[i].length);
+      if (total + toklen < total)
+	{
+	  if (minor_status)
+	    *minor_status = ERANGE;
+	  return GSS_S_FAILURE;
+	}
+      total += toklen;
+    }
+
+  arena = _gss_malloc (total ? total : 1);
+  if (!arena)
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+
+  if (wrap_crypto_p (k5, conf_req_flag))
+    {
+      sh = _gss_krb5_crypto_get ();
+      if (!sh)
+	{
+	  _gss_free (arena);
+	  if (minor_status)
+	    *minor_status = ENOMEM;
+	  return GSS_S_FAILURE;
+	}
+    }
+
+  seqnr = _gss_krb5_send_seqnrs (k5, count);
+  for (i = 0, p = arena; i < count; i++, p += toklen)
+    {
+      toklen = wrap_length (k5, conf_req_flag,
+			    input_message_buffers[i].length);
+      maj_stat = wrap_token_seqnr (minor_status, k5, sh, seqnr + i,
+				   conf_req_flag, &input_message_buffers[i],
+				   conf_state, p);
+      if (GSS_ERROR (maj_stat))
+	break;
+      output_message_buffers[i].value = p;
+      output_message_buffers[i].length = toklen;
+    }
+
+  if (sh)
+    _gss_krb5_crypto_put (sh);
+
+  if (GSS_ERROR (maj_stat))
+    {
+      _gss_free (arena);
+      return maj_stat;
+    }
+
+  output_arena->value = arena;
+  output_arena->length = total;
+
+  if (minor_status)
+    *minor_status = 0;
+  return GSS_S_COMPLETE;
+}
+
+/* Check the checksums of the integrity-only RFC 4121 Wrap tokens
+   among the COUNT tokens at IN all together, so that several
+   messages are hashed at once.  Returns an array that holds 1 for
+   each such token whose checksum is right, -1 for those whose
+   checksum is wrong, and 0 for the tokens that are left to the
+   usual path, or NULL if memory is short. */
+static signed char *
+cfx_batch_verify (_gss_krb5_ctx_t k5, size_t count,
+		  const gss_buffer_desc * in)
+{
+  int32_t etype = shishi_key_type (k5->key);
+  size_t cksumlen =
+    shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+  struct batch_job
+  {
+    _gss_krb5_hmac_sha1_job job;
+    size_t index;
+    char header[CFX_HEADER_LEN];
+  } *jobs;
+  signed char *verdict;
+  size_t ec, rrc, len, n = 0, i;
+  uint64_t seqnr;
+  int flags;
+  _gss_krb5_hmac_sha1_job *hmac;
+
+  verdict = _gss_malloc (count);
+  jobs = _gss_malloc (count * sizeof (*jobs));
+  hmac = _gss_malloc (count * sizeof (*hmac));
+  if (!verdict || !jobs || !hmac)
+    {
+      _gss_free (verdict);
+      _gss_free (jobs);
+      _gss_free (hmac);
+      return NULL;
+    }
+  memset (verdict, 0, count);
+
+  for (i = 0; i < count; i++)
+    {
+      const char *header = in[i].value;
+
+      /* Sealed and rotated tokens take the usual path.  The body of
+         an integrity-only token holds at least the checksum. */
+      if (cfx_wrap_parse (k5, header, in[i].length, &flags, &ec, &rrc,
+			  &seqnr, &len) != GSS_S_COMPLETE
+	  || (flags & CFX_FLAG_SEALED)
+	  || rrc % (in[i].length - CFX_HEADER_LEN) != 0)
+	continue;
+
+      /* See cfx_wrap_hmac. */
+      jobs[n].index = i;
+      memcpy (jobs[n].header, header, CFX_HEADER_LEN);
+      memset (jobs[n].header + 4, 0, 4);
+      hmac[n].key = &k5->recv.kc;
+      hmac[n].data = header + CFX_HEADER_LEN;
+      hmac[n].len = len;
+      hmac[n].tail = jobs[n].header;
+      hmac[n].taillen = CFX_HEADER_LEN;
+      n++;
+    }
+
+  _gss_krb5_hmac_sha1_multi (hmac, n);
+
+  for (i = 0; i < n; i++)
+    verdict[jobs[i].index] =
+      memcmp (hmac[i].digest, (char *) hmac[i].data + hmac[i].len,
+	      cksumlen) == 0 ? 1 : -1;
+
+  _gss_free (jobs);
+  _gss_free (hmac);
+
+  return verdict;
+}
+
+/* Unwrap COUNT tokens into messages laid out back to back in one
+   buffer, OUTPUT_ARENA, which the caller releases.  A message is
+   never longer than its token, so the buffer is sized from the token
+   lengths.  The outcome for each token is stored in
+   MESSAGE_STATUSES. */
+OM_uint32
+gss_krb5_unwrap_batch (OM_uint32 * minor_status,
+		       const gss_ctx_id_t context_handle,
+		       size_t count,
+		       gss_buffer_desc * input_message_buffers,
+		       gss_buffer_desc * output_message_buffers,
+		       OM_uint32 * message_statuses,
+		       int *conf_states, gss_buffer_t output_arena)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  size_t total = 0, used = 0, i;
+  signed char *verdict = NULL;
+  OM_uint32 tmp_min;
+  char *arena;
+
+  for (i = 0; i < count; i++)
+    total += input_message_buffers[i].length;
+
+  arena = _gss_malloc (total ? total : 1);
+  if (!arena)
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
       return GSS_S_FAILURE;
     }
 
+  /* Integrity-only tokens of the AES enctypes are checked together
+     first.  If that is not possible, every token takes the usual
+     path. */
+  if (count > 1 && cfx_enctype_p (k5))
+    verdict = cfx_batch_verify (k5, count, input_message_buffers);
+
+  for (i = 0; i < count; i++)
+    {
+      gss_buffer_t in = &input_message_buffers[i];
+      gss_buffer_t out = &output_message_buffers[i];
+
+      out->value = arena + used;
+      out->length = total - used;
+      if (verdict && verdict[i])
+	{
+	  /* The checksum is the last EC bytes of the token. */
+	  const char *header = in->value;
+	  size_t ec = (header[4] & 0xFF) << 8 | (header[5] & 0xFF);
+
+	  if (verdict[i] > 0)
+	    {
+	      out->length = in->length - CFX_HEADER_LEN - ec;
+	      memcpy (out->value, header + CFX_HEADER_LEN, out->length);
+	      if (conf_states)
+		conf_states[i] = 0;
+	      message_statuses[i] = recv_seqnr (k5, cfx_seqnr (header),
+						UINT64_MAX);
+	    }
+	  else
+	    message_statuses[i] = GSS_S_BAD_MIC;
+	}
+      else
+	message_statuses[i] =
+	  gss_krb5_unwrap_into (&tmp_min, context_handle, in, out,
+				conf_states ? &conf_states[i] : NULL, NULL);
+      if (GSS_ERROR (message_statuses[i]))
+	{
+	  out->value = NULL;
+	  out->length = 0;
+	}
+      used += out->length;
+    }
+  _gss_free (verdict);
+
+  output_arena->value = arena;
+  output_arena->length = used;
+
+  if (minor_status)
+    *minor_status = 0;
+
+  return GSS_S_COMPLETE;
+}
+
+/* Scatter/gather helpers for the IOV interface. */
+
+/* Find the HEADER, TRAILER and PADDING buffers in IOV.  There must be
+   exactly one header, and at most one trailer and one padding
+   buffer. */
+static OM_uint32
+iov_locate (gss_iov_buffer_desc * iov, int iov_count,
+	    gss_iov_buffer_t * header, gss_iov_buffer_t * trailer,
+	    gss_iov_buffer_t * padding)
+{
+  gss_iov_buffer_t *slot;
+  int i;
+
+  *header = *trailer = *padding = NULL;
+
+  for (i = 0; i < iov_count; i++)
+    {
+      switch (GSS_IOV_BUFFER_TYPE (iov[i].type))
+	{
+	case GSS_IOV_BUFFER_TYPE_HEADER:
+	  slot = header;
+	  break;
+
+	case GSS_IOV_BUFFER_TYPE_TRAILER:
+	  slot = trailer;
+	  break;
+
+	case GSS_IOV_BUFFER_TYPE_PADDING:
+	  slot = padding;
+	  break;
+
+	case GSS_IOV_BUFFER_TYPE_EMPTY:
+	case GSS_IOV_BUFFER_TYPE_DATA:
+	case GSS_IOV_BUFFER_TYPE_SIGN_ONLY:
+	  continue;
+
+	default:
+	  return GSS_S_FAILURE;
+	}
+
+      if (*slot)
+	return GSS_S_FAILURE;
+      *slot = &iov[i];
+    }
+
+  if (*header == NULL)
+    return GSS_S_FAILURE;
+
+  return GSS_S_COMPLETE;
+}
+
+/* Return the total length of the DATA buffers, plus the SIGN_ONLY
+   buffers if SIGN is non-zero. */
+static size_t
+iov_length (const gss_iov_buffer_desc * iov, int iov_count, int sign)
+{
+  size_t len = 0;
+  int i;
+
+  for (i = 0; i < iov_count; i++)
+    if (GSS_IOV_BUFFER_TYPE (iov[i].type) == GSS_IOV_BUFFER_TYPE_DATA
+	|| (sign && GSS_IOV_BUFFER_TYPE (iov[i].type)
+	    == GSS_IOV_BUFFER_TYPE_SIGN_ONLY))
+      len += iov[i].buffer.length;
+
+  return len;
+}
+
+/* Feed the DATA buffers, and the SIGN_ONLY buffers if SIGN is
+   non-zero, to HMAC in order. */
+static void
+iov_hmac (_gss_krb5_hmac_sha1_ctx * hmac, const gss_iov_buffer_desc * iov,
+	  int iov_count, int sign)
+{
+  int i;
+
+  for (i = 0; i < iov_count; i++)
+    if (GSS_IOV_BUFFER_TYPE (iov[i].type) == GSS_IOV_BUFFER_TYPE_DATA
+	|| (sign && GSS_IOV_BUFFER_TYPE (iov[i].type)
+	    == GSS_IOV_BUFFER_TYPE_SIGN_ONLY))
+      _gss_krb5_hmac_sha1_update (hmac, iov[i].buffer.value,
+				  iov[i].buffer.length);
+}
+
+/* Clear the DATA buffers, so that no unverified plaintext is left
+   in them. */
+static void
+iov_wipe (gss_iov_buffer_desc * iov, int iov_count)
+{
+  int i;
+
+  for (i = 0; i < iov_count; i++)
+    if (GSS_IOV_BUFFER_TYPE (iov[i].type) == GSS_IOV_BUFFER_TYPE_DATA)
+      memset (iov[i].buffer.value, 0, iov[i].buffer.length);
+}
+
+/* State for encrypting or decrypting the confounder, data and header
+   copy of a RFC 4121 Wrap token where they lie in the IOV buffers,
+   with AES-CBC with ciphertext stealing.  The pieces need not be
+   block aligned: whole blocks are processed in place, and a block
+   that straddles two pieces, as well as the final two blocks, is
+   gathered into BLOCK and written back through AT. */
+struct iov_cts
+{
+  Shishi *sh;
+  const _gss_krb5_aes_key *ke;
+  int decryptp;
+  int rc;
+  size_t cbclen;
+  size_t pos;
+  size_t n;
+  char iv[16];
+  char block[32];
+  char *at[32];
+};
+
+/* Start processing LEN bytes of plaintext or ciphertext. */
+static void
+iov_cts_init (struct iov_cts *c, Shishi * sh, const _gss_krb5_aes_key * ke,
+	      int decryptp, size_t len)
+{
+  memset (c, 0, sizeof (*c));
+  c->sh = sh;
+  c->ke = ke;
+  c->decryptp = decryptp;
+  c->rc = SHISHI_OK;
+
+  /* The last two blocks, the final one possibly partial, are left for
+     the ciphertext stealing. */
+  c->cbclen = len > 32 ? (len - 17) / 16 * 16 : 0;
+}
+
+/* Write the gathered bytes back to where they came from. */
+static void
+iov_cts_flush (struct iov_cts *c)
+{
+  size_t i;
+
+  for (i = 0; i < c->n; i++)
+    *c->at[i] = c->block[i];
+  c->n = 0;
+}
+
+/* Process the LEN bytes at P, which follow those processed so far. */
+static void
+iov_cts_update (struct iov_cts *c, char *p, size_t len)
+{
+  size_t n;
+
+  while (len > 0 && c->rc == SHISHI_OK)
+    {
+      if (c->n == 0 && c->pos < c->cbclen)
+	{
+	  n = len < c->cbclen - c->pos ? len : c->cbclen - c->pos;
+	  n -= n % 16;
+	  if (n > 0)
+	    {
+	      c->rc = _gss_krb5_aes_cbc (c->sh, c->ke, c->decryptp, c->iv,
+					 p, p, n);
+	      p += n;
+	      len -= n;
+	      c->pos += n;
+	      continue;
+	    }
+	}
+
+      c->block[c->n] = *p;
+      c->at[c->n++] = p++;
+      len--;
+      c->pos++;
+
+      if (c->pos <= c->cbclen && c->n == 16)
+	{
+	  c->rc = _gss_krb5_aes_cbc (c->sh, c->ke, c->decryptp, c->iv,
+				     c->block, c->block, 16);
+	  if (c->rc == SHISHI_OK)
+	    iov_cts_flush (c);
+	}
+    }
+}
+
+/* Process the final two blocks, and return a Shishi error code. */
+static int
+iov_cts_final (struct iov_cts *c)
+{
+  if (c->rc == SHISHI_OK)
+    c->rc = _gss_krb5_aes_cts (c->sh, c->ke, c->decryptp, c->iv,
+			       c->block, c->block, c->n);
+  if (c->rc == SHISHI_OK)
+    iov_cts_flush (c);
+  memset (c->block, 0, sizeof (c->block));
+
+  return c->rc;
+}
+
+/* Make BUF hold exactly LEN bytes, allocating storage for it if the
+   caller asked for that. */
+static OM_uint32
+iov_reserve (OM_uint32 * minor_status, gss_iov_buffer_t buf, size_t len)
+{
+  if (buf->type & GSS_IOV_BUFFER_FLAG_ALLOCATE)
+    {
+      gss_release_iov_buffer (NULL, buf, 1);
+      buf->buffer.value = NULL;
+      if (len > 0)
+	{
+	  buf->buffer.value = _gss_malloc (len);
+	  if (!buf->buffer.value)
+	    {
+	      if (minor_status)
+		*minor_status = ENOMEM;
+	      return GSS_S_FAILURE;
+	    }
+	  buf->type |= GSS_IOV_BUFFER_FLAG_ALLOCATED;
+	}
+    }
+  else if (buf->buffer.length < len)
+    {
+      if (minor_status)
+	*minor_status = GSS_KRB5_S_G_WRONG_SIZE;
+      return GSS_S_FAILURE;
+    }
+
+  buf->buffer.length = len;
+
+  return GSS_S_COMPLETE;
+}
+
+/* Protect IOV in place as a RFC 4121 Wrap token.  Encryption uses the
+   RFC 3961 simplified profile directly rather than shishi_encrypt,
+   because the HMAC has to cover the SIGN_ONLY buffers that are not
+   encrypted.  The buffers are checksummed and encrypted where they
+   are, without copying the message. */
+static OM_uint32
+wrap_iov_cfx (OM_uint32 * minor_status,
+	      _gss_krb5_ctx_t k5,
+	      int conf_req_flag, int *conf_state,
+	      gss_iov_buffer_desc * iov, int iov_count)
+{
+  int32_t etype = shishi_key_type (k5->key);
+  size_t confsize = shishi_cipher_confoundersize (etype);
+  gss_iov_buffer_t header, trailer, padding;
+  _gss_krb5_hmac_sha1_ctx hmac;
+  char digest[_GSS_KRB5_SHA1_LEN];
+  char tmp[CFX_HEADER_LEN];
+  size_t datalen, hdrlen, trllen, rrc;
+  struct iov_cts cts;
+  char *tok, *trl, *conf;
+  uint64_t seqnr;
+  OM_uint32 maj_stat;
+  Shishi *sh;
+  int rc, i;
+
+  maj_stat = iov_locate (iov, iov_count, &header, &trailer, &padding);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  datalen = iov_length (iov, iov_count, 0);
+  cfx_iov_sizes (k5, conf_req_flag, &hdrlen, &trllen);
+
+  /* Without a trailer buffer, the trailer is rotated into the
+     header, see RFC 4121 section 4.2.5. */
+  rrc = trailer ? 0 : trllen;
+
+  maj_stat = iov_reserve (minor_status, header, hdrlen + rrc);
+  if (!GSS_ERROR (maj_stat) && trailer)
+    maj_stat = iov_reserve (minor_status, trailer, trllen);
+  if (!GSS_ERROR (maj_stat) && padding)
+    maj_stat = iov_reserve (minor_status, padding, 0);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  tok = header->buffer.value;
+  trl = trailer ? trailer->buffer.value : tok + CFX_HEADER_LEN;
+
+  if (conf_req_flag)
+    {
+      conf = tok + CFX_HEADER_LEN + rrc;
+
+      sh = _gss_krb5_crypto_get ();
+      if (!sh)
+	{
+	  if (minor_status)
+	    *minor_status = ENOMEM;
+	  return GSS_S_FAILURE;
+	}
+
+      rc = shishi_randomize (sh, 0, conf, confsize);
+      if (rc != SHISHI_OK)
+	{
+	  _gss_krb5_crypto_put (sh);
+	  return GSS_S_FAILURE;
+	}
+      seqnr = _gss_krb5_send_seqnr (k5);
+      cfx_header (k5, TOK_WRAP_CFX, CFX_FLAG_SEALED, 0, 0, seqnr, trl);
+
+      /* HMAC confounder | data and sign-only buffers | header, and
+         encrypt confounder | data | header, in one pass.  Each buffer
+         is checksummed before any of it is encrypted. */
+      hmac = k5->send.ki;
+      iov_cts_init (&cts, sh, &k5->send.ke, 0,
+		    confsize + datalen + CFX_HEADER_LEN);
+      _gss_krb5_hmac_sha1_update (&hmac, conf, confsize);
+      iov_cts_update (&cts, conf, confsize);
+      for (i = 0; i < iov_count; i++)
+	switch (GSS_IOV_BUFFER_TYPE (iov[i].type))
+	  {
+	  case GSS_IOV_BUFFER_TYPE_DATA:
+	    _gss_krb5_hmac_sha1_update (&hmac, iov[i].buffer.value,
+					iov[i].buffer.length);
+	    iov_cts_update (&cts, iov[i].buffer.value, iov[i].buffer.length);
+	    break;
+
+	  case GSS_IOV_BUFFER_TYPE_SIGN_ONLY:
+	    _gss_krb5_hmac_sha1_update (&hmac, iov[i].buffer.value,
+					iov[i].buffer.length);
+	    break;
+	  }
+      _gss_krb5_hmac_sha1_update (&hmac, trl, CFX_HEADER_LEN);
+      _gss_krb5_hmac_sha1_final (&hmac, digest);
+      memcpy (trl + CFX_HEADER_LEN, digest, trllen - CFX_HEADER_LEN);
+      iov_cts_update (&cts, trl, CFX_HEADER_LEN);
+      rc = iov_cts_final (&cts);
+      _gss_krb5_crypto_put (sh);
+      if (rc != SHISHI_OK)
+	return GSS_S_FAILURE;
+
+      cfx_header (k5, TOK_WRAP_CFX, CFX_FLAG_SEALED, 0, rrc, seqnr, tok);
+    }
+  else
+    {
+      /* Checksum data and sign-only buffers | header, with EC and RRC
+         both zero. */
+      seqnr = _gss_krb5_send_seqnr (k5);
+      cfx_header (k5, TOK_WRAP_CFX, 0, 0, 0, seqnr, tmp);
+      hmac = k5->send.kc;
+      iov_hmac (&hmac, iov, iov_count, 1);
+      _gss_krb5_hmac_sha1_update (&hmac, tmp, CFX_HEADER_LEN);
+      _gss_krb5_hmac_sha1_final (&hmac, digest);
+      memcpy (trl, digest, trllen);
+
+      cfx_header (k5, TOK_WRAP_CFX, 0, trllen, rrc, seqnr, tok);
+    }
+
+  if (conf_state)
+    *conf_state = conf_req_flag;
+
+  return GSS_S_COMPLETE;
+}
+
+/* Verify (and decrypt) a RFC 4121 Wrap token split into IOV buffers,
+   in place.  If the token is bad, the DATA buffers are cleared
+   rather than left holding unverified plaintext. */
+static OM_uint32
+unwrap_iov_cfx (OM_uint32 * minor_status,
+		_gss_krb5_ctx_t k5,
+		int *conf_state, gss_qop_t * qop_state,
+		gss_iov_buffer_desc * iov, int iov_count)
+{
+  int32_t etype = shishi_key_type (k5->key);
+  size_t confsize = shishi_cipher_confoundersize (etype);
+  gss_iov_buffer_t header, trailer, padding;
+  size_t datalen, hdrlen, trllen, ec, rrc;
+  _gss_krb5_hmac_sha1_ctx hmac;
+  char digest[_GSS_KRB5_SHA1_LEN];
+  char tmp[CFX_HEADER_LEN];
+  struct iov_cts cts;
+  char *tok, *trl, *conf, *copy;
+  Shishi *sh;
+  uint64_t seqnr;
+  OM_uint32 maj_stat;
+  int flags, rc, i;
+
+  maj_stat = iov_locate (iov, iov_count, &header, &trailer, &padding);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  tok = header->buffer.value;
+  if (header->buffer.length < CFX_HEADER_LEN
+      || memcmp (tok, TOK_WRAP_CFX, TOK_LEN) != 0
+      || (tok[3] & 0xFF) != 0xFF)
+    return GSS_S_DEFECTIVE_TOKEN;
+
+  flags = tok[2] & 0xFF;
+  maj_stat = cfx_check_flags (k5, flags);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  ec = (tok[4] & 0xFF) << 8 | (tok[5] & 0xFF);
+  rrc = (tok[6] & 0xFF) << 8 | (tok[7] & 0xFF);
+  seqnr = cfx_seqnr (tok);
+
+  datalen = iov_length (iov, iov_count, 0);
+  cfx_iov_sizes (k5, flags & CFX_FLAG_SEALED, &hdrlen, &trllen);
+
+  /* In a sealed token, EC bytes of filler are encrypted along with
+     the header copy, at the start of the trailer.  Tokens from
+     gss_wrap_iov never carry filler, but other implementations may
+     add some. */
+  if (flags & CFX_FLAG_SEALED)
+    trllen += ec;
+  else if (ec != trllen)
+    return GSS_S_DEFECTIVE_TOKEN;
+
+  /* The trailer is either in its own buffer, or rotated into the
+     header by exactly its length.  Any other rotation moves part of
+     the data into the header, so such tokens can only be unwrapped
+     with gss_unwrap. */
+  if (trailer ? rrc != 0 || header->buffer.length != hdrlen
+      || trailer->buffer.length != trllen
+      : rrc != trllen || header->buffer.length != hdrlen + trllen)
+    {
+      if (minor_status)
+	*minor_status = GSS_KRB5_S_KG_BAD_LENGTH;
+      return GSS_S_DEFECTIVE_TOKEN;
+    }
+  trl = trailer ? trailer->buffer.value : tok + CFX_HEADER_LEN;
+
+  if (flags & CFX_FLAG_SEALED)
+    {
+      conf = tok + CFX_HEADER_LEN + rrc;
+      copy = trl + ec;
+
+      sh = _gss_krb5_crypto_get ();
+      if (!sh)
+	{
+	  if (minor_status)
+	    *minor_status = ENOMEM;
+	  return GSS_S_FAILURE;
+	}
+
+      /* Decrypt confounder | data | filler | header where they are.  The HMAC
+         covers the sign-only buffers too, so it needs a second pass
+         over the plaintext. */
+      iov_cts_init (&cts, sh, &k5->recv.ke, 1,
+		    confsize + datalen + ec + CFX_HEADER_LEN);
+      iov_cts_update (&cts, conf, confsize);
+      for (i = 0; i < iov_count; i++)
+	if (GSS_IOV_BUFFER_TYPE (iov[i].type) == GSS_IOV_BUFFER_TYPE_DATA)
+	  iov_cts_update (&cts, iov[i].buffer.value, iov[i].buffer.length);
+      iov_cts_update (&cts, trl, ec + CFX_HEADER_LEN);
+      rc = iov_cts_final (&cts);
+      _gss_krb5_crypto_put (sh);
+
+      hmac = k5->recv.ki;
+      _gss_krb5_hmac_sha1_update (&hmac, conf, confsize);
+      iov_hmac (&hmac, iov, iov_count, 1);
+      _gss_krb5_hmac_sha1_update (&hmac, trl, ec + CFX_HEADER_LEN);
+      _gss_krb5_hmac_sha1_final (&hmac, digest);
+
+      /* The encrypted header copy must match, except for RRC. */
+      if (rc != SHISHI_OK
+	  || memcmp (digest, copy + CFX_HEADER_LEN,
+		     trllen - ec - CFX_HEADER_LEN) != 0
+	  || memcmp (copy, tok, 6) != 0 || memcmp (copy + 8, tok + 8, 8) != 0)
+	{
+	  iov_wipe (iov, iov_count);
+	  return GSS_S_BAD_MIC;
+	}
+    }
+  else
+    {
+      /* Checksum data and sign-only buffers | header, with EC and RRC
+         both zero. */
+      memcpy (tmp, tok, CFX_HEADER_LEN);
+      memset (tmp + 4, 0, 4);
+      hmac = k5->recv.kc;
+      iov_hmac (&hmac, iov, iov_count, 1);
+      _gss_krb5_hmac_sha1_update (&hmac, tmp, CFX_HEADER_LEN);
+      _gss_krb5_hmac_sha1_final (&hmac, digest);
+
+      if (memcmp (digest, trl, trllen) != 0)
+	return GSS_S_BAD_MIC;
+    }
+
+  if (conf_state)
+    *conf_state = (flags & CFX_FLAG_SEALED) != 0;
+  if (qop_state)
+    *qop_state = GSS_C_QOP_DEFAULT;
+
+  return recv_seqnr (k5, seqnr, UINT64_MAX);
+}
+
+OM_uint32
+gss_krb5_wrap_iov (OM_uint32 * minor_status,
+		   const gss_ctx_id_t context_handle,
+		   int conf_req_flag,
+		   gss_qop_t qop_req,
+		   int *conf_state, gss_iov_buffer_desc * iov, int iov_count)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+
+  if (minor_status)
+    *minor_status = 0;
+
+  /* The RFC 1964 tokens used by older enctypes cannot be split. */
+  if (!cfx_enctype_p (k5))
+    return GSS_S_UNAVAILABLE;
+
+  if (qop_req != GSS_C_QOP_DEFAULT)
+    return GSS_S_BAD_QOP;
+
+  return wrap_iov_cfx (minor_status, k5, conf_req_flag, conf_state,
+		       iov, iov_count);
+}
+
+OM_uint32
+gss_krb5_unwrap_iov (OM_uint32 * minor_status,
+		     const gss_ctx_id_t context_handle,
+		     int *conf_state,
+		     gss_qop_t * qop_state,
+		     gss_iov_buffer_desc * iov, int iov_count)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+
+  if (minor_status)
+    *minor_status = 0;
+
+  if (!cfx_enctype_p (k5))
+    return GSS_S_UNAVAILABLE;
+
+  return unwrap_iov_cfx (minor_status, k5, conf_state, qop_state,
+			 iov, iov_count);
+}
+
+OM_uint32
+gss_krb5_wrap_iov_length (OM_uint32 * minor_status,
+			  const gss_ctx_id_t context_handle,
+			  int conf_req_flag,
+			  gss_qop_t qop_req,
+			  int *conf_state,
+			  gss_iov_buffer_desc * iov, int iov_count)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  gss_iov_buffer_t header, trailer, padding;
+  size_t hdrlen, trllen;
+  OM_uint32 maj_stat;
+
+  if (minor_status)
+    *minor_status = 0;
+
+  if (!cfx_enctype_p (k5))
+    return GSS_S_UNAVAILABLE;
+
+  if (qop_req != GSS_C_QOP_DEFAULT)
+    return GSS_S_BAD_QOP;
+
+  maj_stat = iov_locate (iov, iov_count, &header, &trailer, &padding);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  cfx_iov_sizes (k5, conf_req_flag, &hdrlen, &trllen);
+
+  if (trailer)
+    {
+      header->buffer.length = hdrlen;
+      trailer->buffer.length = trllen;
+    }
+  else
+    header->buffer.length = hdrlen + trllen;
+  if (padding)
+    padding->buffer.length = 0;
+
+  if (conf_state)
+    *conf_state = conf_req_flag;
+
+  return GSS_S_COMPLETE;
+}
+
+/* Return the largest LEN for which a RFC 2743 framed token holding
+   LEN bytes is at most OUTLEN bytes long, or 0. */
+static size_t
+rfc2743_room (size_t outlen)
+{
+  size_t framing, len;
+
+  framing = _gss_encapsulate_token_length (0, outlen, GSS_KRB5->length)
+    - outlen;
+  if (outlen <= framing)
+    return 0;
+
+  /* The length fields may be shorter for the smaller token. */
+  len = outlen - framing;
+  while (_gss_encapsulate_token_length (0, len + 1, GSS_KRB5->length)
+	 <= outlen)
+    len++;
+
+  return len;
+}
+
+OM_uint32
+gss_krb5_wrap_size_limit (OM_uint32 * minor_status,
+			  const gss_ctx_id_t context_handle,
+			  int conf_req_flag,
+			  gss_qop_t qop_req,
+			  OM_uint32 req_output_size,
+			  OM_uint32 * max_input_size)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  size_t hdrlen, trllen, room;
+
+  switch (shishi_key_type (k5->key))
+    {
+    case SHISHI_DES_CBC_MD5:
+    case SHISHI_DES3_CBC_HMAC_SHA1_KD:
+      hdrlen = rfc1964_wrap_hdrlen (k5);
+      room = rfc2743_room (req_output_size);
+      if (room < hdrlen + 8)
+	*max_input_size = 0;
+      else
+	*max_input_size = (room - hdrlen) / 8 * 8 - 1;
+      break;
+
+    case SHISHI_AES128_CTS_HMAC_SHA1_96:
+    case SHISHI_AES256_CTS_HMAC_SHA1_96:
+      /* RFC 4121 tokens have a fixed overhead and are not framed. */
+      cfx_iov_sizes (k5, conf_req_flag, &hdrlen, &trllen);
+      if (req_output_size <= hdrlen + trllen)
+	*max_input_size = 0;
+      else
+	*max_input_size = req_output_size - hdrlen - trllen;
+      break;
+
+    default:
+      return GSS_S_FAILURE;
+    }
+
+  if (minor_status)
+    *minor_status = 0;
+  return GSS_S_COMPLETE;
+}
+
+/* MIC tokens, see RFC 1964 section 1.2.1 and RFC 4121 section
+   4.2.6.1.  The checksum is computed incrementally, so that the
+   streaming interface does not have to buffer the message. */
+
+/* Return the RFC 1964 MIC token header for the context key, or NULL
+   if the key uses RFC 4121 tokens. */
+static const char *
+rfc1964_mic_header (_gss_krb5_ctx_t k5)
+{
+  switch (shishi_key_type (k5->key))
+    {
+    case SHISHI_DES_CBC_MD5:
+      /* TOK_ID, SGN_ALG DES-MAC-MD5, filler. */
+      return TOK_MIC "\x00\x00" "\xFF\xFF\xFF\xFF";
+
+    case SHISHI_DES3_CBC_HMAC_SHA1_KD:
+      /* TOK_ID, SGN_ALG HMAC SHA1 DES3-KD, filler. */
+      return TOK_MIC "\x04\x00" "\xFF\xFF\xFF\xFF";
+
+    default:
+      return NULL;
+    }
+}
+
+/* Encrypt or decrypt the RFC 1964 SND_SEQ field in place, using the
+   first 8 bytes of the checksum CKSUM as IV. */
+static int
+rfc1964_seqno (_gss_krb5_ctx_t k5, int decryptp, const char *cksum,
+	       char *seqno)
+{
+  int32_t etype = shishi_key_type (k5->key) == SHISHI_DES3_CBC_HMAC_SHA1_KD
+    ? SHISHI_DES3_CBC_NONE : SHISHI_DES_CBC_NONE;
+  char *tmp;
+  size_t tmplen;
+  Shishi *sh;
+  int rc;
+
+  sh = _gss_krb5_crypto_get ();
+  if (!sh)
+    return SHISHI_MALLOC_ERROR;
+  if (decryptp)
+    rc = shishi_decrypt_iv_etype (sh, k5->key, 0, etype, cksum, 8,
+				  seqno, 8, &tmp, &tmplen);
+  else
+    rc = shishi_encrypt_iv_etype (sh, k5->key, 0, etype, cksum, 8,
+				  seqno, 8, &tmp, &tmplen);
+  _gss_krb5_crypto_put (sh);
+  if (rc != SHISHI_OK)
+    return rc;
+  if (tmplen != 8)
+    {
+      free (tmp);
+      return SHISHI_CRYPTO_ERROR;
+    }
+
+  memcpy (seqno, tmp, 8);
+  free (tmp);
+
+  return SHISHI_OK;
+}
+
+/* Start the checksum of a MIC token that is created (VERIFY zero) or
+   verified on context K5. */
+static OM_uint32
+mic_init (OM_uint32 * minor_status, _gss_krb5_ctx_t k5, int verify,
+	  _gss_krb5_mic_t mic)
+{
+  const char *header = rfc1964_mic_header (k5);
+
+  mic->k5 = k5;
+  mic->verify = verify;
+
+  switch (shishi_key_type (k5->key))
+    {
+    case SHISHI_DES_CBC_MD5:
+      _gss_krb5_md5_init (&mic->u.md5);
+      _gss_krb5_md5_update (&mic->u.md5, header, 8);
+      return GSS_S_COMPLETE;
+
+    case SHISHI_DES3_CBC_HMAC_SHA1_KD:
+    case SHISHI_AES128_CTS_HMAC_SHA1_96:
+    case SHISHI_AES256_CTS_HMAC_SHA1_96:
+      mic->u.hmac = verify ? k5->recv.mic : k5->send.mic;
+      break;
+
+    default:
+      return GSS_S_FAILURE;
+    }
+
+  /* RFC 1964 checksums the header before the message, RFC 4121
+     after it. */
+  if (header)
+    _gss_krb5_hmac_sha1_update (&mic->u.hmac, header, 8);
+
+  return GSS_S_COMPLETE;
+}
+
+static void
+mic_update (_gss_krb5_mic_t mic, const void *data, size_t len)
+{
+  if (shishi_key_type (mic->k5->key) == SHISHI_DES_CBC_MD5)
+    _gss_krb5_md5_update (&mic->u.md5, data, len);
+  else
+    _gss_krb5_hmac_sha1_update (&mic->u.hmac, data, len);
+}
+
+/* Finish the checksum of MIC and store it in CKSUM, which must hold
+   _GSS_KRB5_SHA1_LEN bytes.  For RFC 4121, the token header HEADER is
+   checksummed last. */
+static OM_uint32
+mic_checksum (_gss_krb5_mic_t mic, const char *header,
+	      char *cksum, size_t * cksumlen)
+{
+  _gss_krb5_ctx_t k5 = mic->k5;
+  int32_t etype = shishi_key_type (k5->key);
+  char digest[_GSS_KRB5_SHA1_LEN];
+  Shishi *sh;
+  int rc;
+
+  switch (etype)
+    {
+    case SHISHI_DES_CBC_MD5:
+      /* DES-CBC MAC over the MD5 hash, using the context key and a
+         zero IV. */
+      _gss_krb5_md5_final (&mic->u.md5, digest);
+      sh = _gss_krb5_crypto_get ();
+      if (!sh)
+	return GSS_S_FAILURE;
+      rc = des_md5_mac (sh, k5->key, digest, cksum);
+      _gss_krb5_crypto_put (sh);
+      if (rc != SHISHI_OK)
+	return GSS_S_FAILURE;
+      *cksumlen = 8;
+      break;
+
+    case SHISHI_DES3_CBC_HMAC_SHA1_KD:
+      _gss_krb5_hmac_sha1_final (&mic->u.hmac, cksum);
+      *cksumlen = _GSS_KRB5_SHA1_LEN;
+      break;
+
+    default:
+      _gss_krb5_hmac_sha1_update (&mic->u.hmac, header, CFX_HEADER_LEN);
+      _gss_krb5_hmac_sha1_final (&mic->u.hmac, digest);
+      *cksumlen =
+	shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+      memcpy (cksum, digest, *cksumlen);
+      break;
+    }
+
+  return GSS_S_COMPLETE;
+}
+
+/* Return the length of a MIC token on context K5. */
+static size_t
+mic_length (_gss_krb5_ctx_t k5)
+{
+  int32_t etype = shishi_key_type (k5->key);
+
+  switch (etype)
+    {
+    case SHISHI_DES_CBC_MD5:
+      return _gss_encapsulate_token_length (0, 16 + 8, GSS_KRB5->length);
+
+    case SHISHI_DES3_CBC_HMAC_SHA1_KD:
+      return _gss_encapsulate_token_length (0, 16 + _GSS_KRB5_SHA1_LEN,
+					    GSS_KRB5->length);
+
+    default:
+      return CFX_HEADER_LEN
+	+ shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+    }
+}
+
+/* Finish MIC and store the token in MESSAGE_TOKEN.  If INTO is
+   non-zero, the token is written to the buffer it describes, which
+   must have room for mic_length bytes; otherwise it is allocated. */
+static OM_uint32
+mic_get_final (OM_uint32 * minor_status, _gss_krb5_mic_t mic,
+	       gss_buffer_t message_token, int into)
+{
+  _gss_krb5_ctx_t k5 = mic->k5;
+  const char *header = rfc1964_mic_header (k5);
+  uint64_t seqnr = _gss_krb5_send_seqnr (k5);
+  char tok[CFX_HEADER_LEN + _GSS_KRB5_SHA1_LEN];
+  size_t cksumlen, toklen, hdrlen = 0;
+  OM_uint32 maj_stat;
+  char *p;
+
+  if (header)
+    {
+      maj_stat = mic_checksum (mic, NULL, tok + 16, &cksumlen);
+      if (GSS_ERROR (maj_stat))
+	return maj_stat;
+
+      memcpy (tok, header, 8);
+      tok[8] = seqnr & 0xFF;
+      tok[9] = seqnr >> 8 & 0xFF;
+      tok[10] = seqnr >> 16 & 0xFF;
+      tok[11] = seqnr >> 24 & 0xFF;
+      memset (tok + 12, k5->acceptor ? 0xFF : 0, 4);
+      if (rfc1964_seqno (k5, 0, tok + 16, tok + 8) != SHISHI_OK)
+	return GSS_S_FAILURE;
+
+      toklen = 16 + cksumlen;
+      hdrlen = _gss_encapsulate_token_headroom (toklen, GSS_KRB5->length);
+    }
+  else
+    {
+      cfx_header (k5, TOK_MIC_CFX, 0, 0xFFFF, 0xFFFF, seqnr, tok);
+      maj_stat = mic_checksum (mic, tok, tok + CFX_HEADER_LEN, &cksumlen);
+      if (GSS_ERROR (maj_stat))
+	return maj_stat;
+
+      toklen = CFX_HEADER_LEN + cksumlen;
+    }
+
+  if (into)
+    p = message_token->value;
+  else
+    {
+      p = _gss_malloc (hdrlen + toklen);
+      if (!p)
+	{
+	  if (minor_status)
+	    *minor_status = ENOMEM;
+	  return GSS_S_FAILURE;
+	}
+    }
+
+  /* The RFC 1964 framing is written in front of the token. */
+  memcpy (p + hdrlen, tok, toklen);
+  if (header)
+    _gss_encapsulate_token_inplace (p + hdrlen, hdrlen, toklen,
+				    GSS_KRB5->elements, GSS_KRB5->length);
+
+  message_token->value = p;
+  message_token->length = hdrlen + toklen;
+
+  return GSS_S_COMPLETE;
+}
+
+static OM_uint32
+mic_verify_final (OM_uint32 * minor_status, _gss_krb5_mic_t mic,
+		  const gss_buffer_t token_buffer, gss_qop_t * qop_state)
+{
+  _gss_krb5_ctx_t k5 = mic->k5;
+  const char *header = rfc1964_mic_header (k5);
+  char cksum[_GSS_KRB5_SHA1_LEN];
+  size_t cksumlen;
+  uint64_t seqnr, mask;
+  OM_uint32 maj_stat;
+
+  if (header)
+    {
+      gss_buffer_desc tok;
+      char seqno[8];
+
+      maj_stat = gss_decapsulate_token_view (token_buffer, GSS_KRB5, &tok);
+      if (GSS_ERROR (maj_stat))
+	return GSS_S_DEFECTIVE_TOKEN;
+
+      maj_stat = mic_checksum (mic, NULL, cksum, &cksumlen);
+      if (GSS_ERROR (maj_stat))
+	return maj_stat;
+
+      if (tok.length != 16 + cksumlen || memcmp (tok.value, header, 8) != 0)
+	return GSS_S_DEFECTIVE_TOKEN;
+
+      if (memcmp ((char *) tok.value + 16, cksum, cksumlen) != 0)
+	return GSS_S_BAD_MIC;
+
+      memcpy (seqno, (char *) tok.value + 8, 8);
+      if (rfc1964_seqno (k5, 1, cksum, seqno) != SHISHI_OK)
+	return GSS_S_FAILURE;
+
+      if (memcmp (seqno + 4, k5->acceptor ? "\x00\x00\x00\x00" :
+		  "\xFF\xFF\xFF\xFF", 4) != 0)
+	return GSS_S_BAD_MIC;
+
+      seqnr = C2I (seqno);
+      mask = UINT32_MAX;
+    }
+  else
+    {
+      const char *tok = token_buffer->value;
+
+      if (token_buffer->length < CFX_HEADER_LEN
+	  || memcmp (tok, TOK_MIC_CFX, TOK_LEN) != 0
+	  || memcmp (tok + 3, "\xFF\xFF\xFF\xFF\xFF", 5) != 0)
+	return GSS_S_DEFECTIVE_TOKEN;
+
+      maj_stat = cfx_check_flags (k5, tok[2] & 0xFF);
+      if (GSS_ERROR (maj_stat))
+	return maj_stat;
+
+      maj_stat = mic_checksum (mic, tok, cksum, &cksumlen);
+      if (GSS_ERROR (maj_stat))
+	return maj_stat;
+
+      if (token_buffer->length != CFX_HEADER_LEN + cksumlen)
+	return GSS_S_DEFECTIVE_TOKEN;
+      if (memcmp (tok + CFX_HEADER_LEN, cksum, cksumlen) != 0)
+	return GSS_S_BAD_MIC;
+
+      seqnr = cfx_seqnr (tok);
+      mask = UINT64_MAX;
+    }
+
+  if (qop_state)
+    *qop_state = GSS_C_QOP_DEFAULT;
+
+  return recv_seqnr (k5, seqnr, mask);
+}
+
+OM_uint32
+gss_krb5_get_mic (OM_uint32 * minor_status,
+		  const gss_ctx_id_t context_handle,
+		  gss_qop_t qop_req,
+		  const gss_buffer_t message_buffer,
+		  gss_buffer_t message_token)
+{
+  _gss_krb5_mic_desc mic;
+  OM_uint32 maj_stat;
+
+  maj_stat = mic_init (minor_status, context_handle->krb5, 0, &mic);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  mic_update (&mic, message_buffer->value, message_buffer->length);
+  maj_stat = mic_get_final (minor_status, &mic, message_token, 0);
+  memset (&mic, 0, sizeof (mic));
+
+  return maj_stat;
+}
+
+/* Like gss_krb5_get_mic, but write the token into the caller supplied
+   MESSAGE_TOKEN.  MIC tokens have a fixed size, so it is checked
+   before the message is processed. */
+OM_uint32
+gss_krb5_get_mic_into (OM_uint32 * minor_status,
+		       const gss_ctx_id_t context_handle,
+		       gss_qop_t qop_req,
+		       const gss_buffer_t message_buffer,
+		       gss_buffer_t message_token)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  size_t toklen = mic_length (k5);
+  _gss_krb5_mic_desc mic;
+  OM_uint32 maj_stat;
+
+  if (message_token->length < toklen)
+    return buffer_too_small (minor_status, message_token, toklen);
+
+  maj_stat = mic_init (minor_status, k5, 0, &mic);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  mic_update (&mic, message_buffer->value, message_buffer->length);
+  maj_stat = mic_get_final (minor_status, &mic, message_token, 1);
+  memset (&mic, 0, sizeof (mic));
+
+  return maj_stat;
+}
+
+OM_uint32
+gss_krb5_verify_mic (OM_uint32 * minor_status,
+		     const gss_ctx_id_t context_handle,
+		     const gss_buffer_t message_buffer,
+		     const gss_buffer_t token_buffer, gss_qop_t * qop_state)
+{
+  _gss_krb5_mic_desc mic;
+  OM_uint32 maj_stat;
+
+  maj_stat = mic_init (minor_status, context_handle->krb5, 1, &mic);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  mic_update (&mic, message_buffer->value, message_buffer->length);
+  maj_stat = mic_verify_final (minor_status, &mic, token_buffer, qop_state);
+  memset (&mic, 0, sizeof (mic));
+
+  return maj_stat;
+}
+
+OM_uint32
+gss_krb5_mic_init (OM_uint32 * minor_status,
+		   const gss_ctx_id_t context_handle,
+		   int verify, gss_qop_t qop_req, gss_mic_stream_t mic_stream)
+{
+  _gss_krb5_mic_t mic;
+  OM_uint32 maj_stat;
+
+  mic = _gss_malloc (sizeof (*mic));
+  if (!mic)
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+
+  maj_stat = mic_init (minor_status, context_handle->krb5, verify, mic);
+  if (GSS_ERROR (maj_stat))
+    {
+      _gss_free (mic);
+      return maj_stat;
+    }
+
+  mic_stream->krb5 = mic;
+
+  return GSS_S_COMPLETE;
+}
+
+OM_uint32
+gss_krb5_mic_update (OM_uint32 * minor_status,
+		     gss_mic_stream_t mic_stream,
+		     const gss_buffer_t message_buffer)
+{
+  mic_update (mic_stream->krb5, message_buffer->value,
+	      message_buffer->length);
+
+  return GSS_S_COMPLETE;
+}
+
+OM_uint32
+gss_krb5_mic_final (OM_uint32 * minor_status,
+		    gss_mic_stream_t mic_stream,
+		    gss_buffer_t token_buffer, gss_qop_t * qop_state)
+{
+  if (mic_stream->krb5->verify)
+    return mic_verify_final (minor_status, mic_stream->krb5, token_buffer,
+			     qop_state);
+
+  return mic_get_final (minor_status, mic_stream->krb5, token_buffer, 0);
+}
+
+void
+gss_krb5_mic_release (gss_mic_stream_t mic_stream)
+{
+  if (mic_stream->krb5)
+    {
+      /* Do not leave the keyed hash state around. */
+      memset (mic_stream->krb5, 0, sizeof (*mic_stream->krb5));
+      _gss_free (mic_stream->krb5);
+      mic_stream->krb5 = NULL;
+    }
+}
+
+/* Wrap tokens produced or verified in pieces are processed in slices
+   of at most this many bytes, which bounds the memory a stream
+   uses. */
+#define STREAM_SLICE 65536
+
+/* Allocate OUT with room for SIZE bytes, and make it empty. */
+static OM_uint32
+stream_output (OM_uint32 * minor_status, gss_buffer_t out, size_t size)
+{
+  out->length = 0;
+  out->value = _gss_malloc (size ? size : 1);
+  if (!out->value)
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+
+  return GSS_S_COMPLETE;
+}
+
+/* Append the LEN bytes at DATA to OUT, which has room for them. */
+static void
+stream_emit (gss_buffer_t out, const char *data, size_t len)
+{
+  memcpy ((char *) out->value + out->length, data, len);
+  out->length += len;
+}
+
+static void
+stream_discard (gss_buffer_t out)
+{
+  _gss_free (out->value);
+  out->value = NULL;
+  out->length = 0;
+}
+
+/* Start producing a RFC 4121 Wrap token.  The header is fixed here,
+   so the sequence number is reserved now. */
+static OM_uint32
+wrap_stream_init (OM_uint32 * minor_status, _gss_krb5_wrap_t w,
+		  int conf_req_flag)
+{
+  _gss_krb5_ctx_t k5 = w->k5;
+  int32_t etype = shishi_key_type (k5->key);
+  size_t confsize = shishi_cipher_confoundersize (etype);
+  size_t cksumlen =
+    shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+  Shishi *sh;
+  int rc;
+
+  w->sealed = conf_req_flag != 0;
+  if (!w->sealed)
+    {
+      w->hmac = k5->send.kc;
+      w->seqnr = _gss_krb5_send_seqnr (k5);
+      cfx_header (k5, TOK_WRAP_CFX, 0, cksumlen, 0, w->seqnr, w->header);
+      return GSS_S_COMPLETE;
+    }
+
+  /* Up to a block of plaintext is held back, and the header copy is
+     added at the end. */
+  w->pending = _gss_malloc (STREAM_SLICE + 2 * CFX_HEADER_LEN);
+  sh = _gss_krb5_crypto_get ();
+  if (!w->pending || !sh)
+    {
+      if (sh)
+	_gss_krb5_crypto_put (sh);
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+  rc = shishi_randomize (sh, 0, w->pending, confsize);
+  _gss_krb5_crypto_put (sh);
+  if (rc != SHISHI_OK)
+    return GSS_S_FAILURE;
+
+  w->pendinglen = confsize;
+  w->hmac = k5->send.ki;
+  _gss_krb5_hmac_sha1_update (&w->hmac, w->pending, confsize);
+
+  w->seqnr = _gss_krb5_send_seqnr (k5);
+  cfx_header (k5, TOK_WRAP_CFX, CFX_FLAG_SEALED, 0, 0, w->seqnr,
+	      w->header);
+
+  return GSS_S_COMPLETE;
+}
+
+static OM_uint32
+wrap_stream_update (OM_uint32 * minor_status, _gss_krb5_wrap_t w,
+		    const char *data, size_t len, gss_buffer_t output)
+{
+  OM_uint32 maj_stat;
+  Shishi *sh;
+  int rc = SHISHI_OK;
+
+  maj_stat = stream_output (minor_status, output,
+			    CFX_HEADER_LEN + w->pendinglen + len);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  if (w->headerlen == 0)
+    {
+      stream_emit (output, w->header, CFX_HEADER_LEN);
+      w->headerlen = CFX_HEADER_LEN;
+    }
+
+  if (!w->sealed)
+    {
+      _gss_krb5_hmac_sha1_update (&w->hmac, data, len);
+      stream_emit (output, data, len);
+      return GSS_S_COMPLETE;
+    }
+
+  sh = _gss_krb5_crypto_get ();
+  if (!sh)
+    {
+      stream_discard (output);
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+
+  while (len > 0 && rc == SHISHI_OK)
+    {
+      size_t n = len < STREAM_SLICE ? len : STREAM_SLICE;
+      size_t done;
+
+      _gss_krb5_hmac_sha1_update (&w->hmac, data, n);
+      memcpy (w->pending + w->pendinglen, data, n);
+      w->pendinglen += n;
+      data += n;
+      len -= n;
+
+      /* Keep at least one byte, so that the last two blocks of the
+         token are left for the ciphertext stealing at the end. */
+      done = (w->pendinglen - 1) / 16 * 16;
+      if (done == 0)
+	continue;
+
+      rc = _gss_krb5_aes_cbc (sh, &w->k5->send.ke, 0, w->iv,
+			      w->pending, w->pending, done);
+      if (rc == SHISHI_OK)
+	{
+	  stream_emit (output, w->pending, done);
+	  w->pendinglen -= done;
+	  memmove (w->pending, w->pending + done, w->pendinglen);
+	}
+    }
+  _gss_krb5_crypto_put (sh);
+
+  if (rc != SHISHI_OK)
+    {
+      stream_discard (output);
+      return GSS_S_FAILURE;
+    }
+
+  return GSS_S_COMPLETE;
+}
+
+static OM_uint32
+wrap_stream_final (OM_uint32 * minor_status, _gss_krb5_wrap_t w,
+		   gss_buffer_t output)
+{
+  _gss_krb5_ctx_t k5 = w->k5;
+  int32_t etype = shishi_key_type (k5->key);
+  size_t cksumlen =
+    shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+  char digest[_GSS_KRB5_SHA1_LEN];
+  char tmp[CFX_HEADER_LEN];
+  OM_uint32 maj_stat;
+  Shishi *sh;
+  int rc;
+
+  maj_stat = stream_output (minor_status, output,
+			    2 * CFX_HEADER_LEN + w->pendinglen + cksumlen);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  if (w->headerlen == 0)
+    stream_emit (output, w->header, CFX_HEADER_LEN);
+
+  if (!w->sealed)
+    {
+      /* The checksum covers the header with EC and RRC zero. */
+      memcpy (tmp, w->header, CFX_HEADER_LEN);
+      memset (tmp + 4, 0, 4);
+      _gss_krb5_hmac_sha1_update (&w->hmac, tmp, CFX_HEADER_LEN);
+      _gss_krb5_hmac_sha1_final (&w->hmac, digest);
+      stream_emit (output, digest, cksumlen);
+      return GSS_S_COMPLETE;
+    }
+
+  memcpy (w->pending + w->pendinglen, w->header, CFX_HEADER_LEN);
+  w->pendinglen += CFX_HEADER_LEN;
+  _gss_krb5_hmac_sha1_update (&w->hmac, w->header, CFX_HEADER_LEN);
+  _gss_krb5_hmac_sha1_final (&w->hmac, digest);
+
+  sh = _gss_krb5_crypto_get ();
+  if (!sh)
+    {
+      stream_discard (output);
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+  rc = _gss_krb5_aes_cts (sh, &k5->send.ke, 0, w->iv,
+			  w->pending, w->pending, w->pendinglen);
+  _gss_krb5_crypto_put (sh);
+  if (rc != SHISHI_OK)
+    {
+      stream_discard (output);
+      return GSS_S_FAILURE;
+    }
+
+  stream_emit (output, w->pending, w->pendinglen);
+  stream_emit (output, digest, cksumlen);
+
+  return GSS_S_COMPLETE;
+}
+
+/* Check the header of a RFC 4121 Wrap token that is unwrapped in
+   pieces, once all of it has been received. */
+static OM_uint32
+unwrap_stream_header (OM_uint32 * minor_status, _gss_krb5_wrap_t w)
+{
+  _gss_krb5_ctx_t k5 = w->k5;
+  int32_t etype = shishi_key_type (k5->key);
+  size_t cksumlen =
+    shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+  const char *header = w->header;
+  OM_uint32 maj_stat;
+  int flags;
+
+  if (memcmp (header, TOK_WRAP_CFX, TOK_LEN) != 0
+      || (header[3] & 0xFF) != 0xFF)
+    return GSS_S_DEFECTIVE_TOKEN;
+
+  flags = header[2] & 0xFF;
+  maj_stat = cfx_check_flags (k5, flags);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  w->sealed = (flags & CFX_FLAG_SEALED) != 0;
+  w->ec = (header[4] & 0xFF) << 8 | (header[5] & 0xFF);
+  w->rrc = (header[6] & 0xFF) << 8 | (header[7] & 0xFF);
+  w->seqnr = cfx_seqnr (header);
+
+  if (!w->sealed && w->ec != cksumlen)
+    return GSS_S_DEFECTIVE_TOKEN;
+
+  /* The checksum and the last two blocks are held back. */
+  w->pending = _gss_malloc (STREAM_SLICE + cksumlen + 32);
+  if (w->rrc)
+    w->rotated = _gss_malloc (w->rrc);
+  if (w->sealed)
+    {
+      w->plain = _gss_malloc (STREAM_SLICE + w->ec + CFX_HEADER_LEN + 32);
+      w->skip = shishi_cipher_confoundersize (etype);
+      w->hmac = k5->recv.ki;
+    }
+  else
+    w->hmac = k5->recv.kc;
+
+  if (!w->pending || (w->rrc && !w->rotated) || (w->sealed && !w->plain))
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+
+  return GSS_S_COMPLETE;
+}
+
+/* Take LEN bytes of decrypted confounder | message | filler | header
+   at P.  The message is added to OUTPUT, except for the bytes that
+   may still turn out to be filler or the header copy. */
+static void
+unwrap_stream_plain (_gss_krb5_wrap_t w, const char *p, size_t len,
+		     gss_buffer_t output)
+{
+  size_t hold = w->ec + CFX_HEADER_LEN;
+  size_t n;
+
+  _gss_krb5_hmac_sha1_update (&w->hmac, p, len);
+
+  n = len < w->skip ? len : w->skip;
+  p += n;
+  len -= n;
+  w->skip -= n;
+
+  memcpy (w->plain + w->plainlen, p, len);
+  w->plainlen += len;
+
+  if (w->plainlen > hold)
+    {
+      n = w->plainlen - hold;
+      stream_emit (output, w->plain, n);
+      memmove (w->plain, w->plain + n, hold);
+      w->plainlen = hold;
+    }
+}
+
+/* Take LEN bytes of the token body at DATA, in the order before any
+   rotation, and add what can be verified or decrypted to OUTPUT. */
+static OM_uint32
+unwrap_stream_body (OM_uint32 * minor_status, _gss_krb5_wrap_t w,
+		    const char *data, size_t len, gss_buffer_t output)
+{
+  int32_t etype = shishi_key_type (w->k5->key);
+  size_t cksumlen =
+    shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+  Shishi *sh = NULL;
+  int rc = SHISHI_OK;
+
+  while (len > 0 && rc == SHISHI_OK)
+    {
+      size_t n = len < STREAM_SLICE ? len : STREAM_SLICE;
+      size_t done;
+
+      memcpy (w->pending + w->pendinglen, data, n);
+      w->pendinglen += n;
+      data += n;
+      len -= n;
+
+      if (!w->sealed)
+	{
+	  /* The checksum follows the message. */
+	  if (w->pendinglen <= cksumlen)
+	    continue;
+	  done = w->pendinglen - cksumlen;
+	  _gss_krb5_hmac_sha1_update (&w->hmac, w->pending, done);
+	  stream_emit (output, w->pending, done);
+	}
+      else
+	{
+	  /* Keep the checksum and the last two, possibly partial,
+	     blocks for the ciphertext stealing at the end. */
+	  if (w->pendinglen < cksumlen + 17 + 16)
+	    continue;
+	  done = (w->pendinglen - cksumlen - 17) / 16 * 16;
+
+	  if (!sh)
+	    sh = _gss_krb5_crypto_get ();
+	  if (!sh)
+	    {
+	      if (minor_status)
+		*minor_status = ENOMEM;
+	      return GSS_S_FAILURE;
+	    }
+	  rc = _gss_krb5_aes_cbc (sh, &w->k5->recv.ke, 1, w->iv,
+				  w->pending, w->pending, done);
+	  if (rc != SHISHI_OK)
+	    break;
+	  unwrap_stream_plain (w, w->pending, done, output);
+	}
+
+      w->pendinglen -= done;
+      memmove (w->pending, w->pending + done, w->pendinglen);
+    }
+
+  if (sh)
+    _gss_krb5_crypto_put (sh);
+
+  if (rc != SHISHI_OK)
+    return GSS_S_FAILURE;
+
+  return GSS_S_COMPLETE;
+}
+
+static OM_uint32
+unwrap_stream_update (OM_uint32 * minor_status, _gss_krb5_wrap_t w,
+		      const char *data, size_t len, gss_buffer_t output)
+{
+  OM_uint32 maj_stat;
+  size_t n;
+
+  maj_stat = stream_output (minor_status, output,
+			    w->plainlen + w->pendinglen + len);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  if (w->headerlen < CFX_HEADER_LEN)
+    {
+      n = CFX_HEADER_LEN - w->headerlen;
+      if (n > len)
+	n = len;
+      memcpy (w->header + w->headerlen, data, n);
+      w->headerlen += n;
+      data += n;
+      len -= n;
+
+      if (w->headerlen < CFX_HEADER_LEN)
+	return GSS_S_COMPLETE;
+
+      maj_stat = unwrap_stream_header (minor_status, w);
+      if (GSS_ERROR (maj_stat))
+	{
+	  stream_discard (output);
+	  return maj_stat;
+	}
+    }
+
+  if (w->rotatedlen < w->rrc)
+    {
+      n = w->rrc - w->rotatedlen;
+      if (n > len)
+	n = len;
+      memcpy (w->rotated + w->rotatedlen, data, n);
+      w->rotatedlen += n;
+      data += n;
+      len -= n;
+    }
+
+  maj_stat = unwrap_stream_body (minor_status, w, data, len, output);
+  if (GSS_ERROR (maj_stat))
+    stream_discard (output);
+
+  return maj_stat;
+}
+
+static OM_uint32
+unwrap_stream_final (OM_uint32 * minor_status, _gss_krb5_wrap_t w,
+		     gss_buffer_t output, int *conf_state,
+		     gss_qop_t * qop_state)
+{
+  _gss_krb5_ctx_t k5 = w->k5;
+  int32_t etype = shishi_key_type (k5->key);
+  size_t cksumlen =
+    shishi_checksum_cksumlen (shishi_cipher_defaultcksumtype (etype));
+  char digest[_GSS_KRB5_SHA1_LEN];
+  char tmp[CFX_HEADER_LEN];
+  OM_uint32 maj_stat;
+  const char *copy;
+  size_t len, r;
+  Shishi *sh;
+  int rc;
+
+  if (w->headerlen < CFX_HEADER_LEN)
+    return GSS_S_DEFECTIVE_TOKEN;
+
+  maj_stat = stream_output (minor_status, output,
+			    w->plainlen + w->pendinglen + w->rotatedlen);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  /* The first RRC bytes of the body belong at its end.  If the body
+     is shorter than that, all of it is in ROTATED. */
+  if (w->rotatedlen < w->rrc)
+    {
+      if (w->rotatedlen == 0)
+	{
+	  maj_stat = GSS_S_DEFECTIVE_TOKEN;
+	  goto fail;
+	}
+      r = w->rrc % w->rotatedlen;
+      reverse_bytes (w->rotated, r);
+      reverse_bytes (w->rotated + r, w->rotatedlen - r);
+      reverse_bytes (w->rotated, w->rotatedlen);
+    }
+
+  maj_stat = unwrap_stream_body (minor_status, w, w->rotated,
+				 w->rotatedlen, output);
+  if (GSS_ERROR (maj_stat))
+    goto fail;
+
+  if (!w->sealed)
+    {
+      if (w->pendinglen != cksumlen)
+	{
+	  maj_stat = GSS_S_DEFECTIVE_TOKEN;
+	  goto fail;
+	}
+
+      memcpy (tmp, w->header, CFX_HEADER_LEN);
+      memset (tmp + 4, 0, 4);
+      _gss_krb5_hmac_sha1_update (&w->hmac, tmp, CFX_HEADER_LEN);
+      _gss_krb5_hmac_sha1_final (&w->hmac, digest);
+      if (memcmp (digest, w->pending, cksumlen) != 0)
+	{
+	  maj_stat = GSS_S_BAD_MIC;
+	  goto fail;
+	}
+    }
+  else
+    {
+      if (w->pendinglen < cksumlen + 16)
+	{
+	  maj_stat = GSS_S_DEFECTIVE_TOKEN;
+	  goto fail;
+	}
+      len = w->pendinglen - cksumlen;
+
+      sh = _gss_krb5_crypto_get ();
+      if (!sh)
+	{
+	  if (minor_status)
+	    *minor_status = ENOMEM;
+	  maj_stat = GSS_S_FAILURE;
+	  goto fail;
+	}
+      rc = _gss_krb5_aes_cts (sh, &k5->recv.ke, 1, w->iv,
+			      w->pending, w->pending, len);
+      _gss_krb5_crypto_put (sh);
+      if (rc != SHISHI_OK)
+	{
+	  maj_stat = GSS_S_BAD_MIC;
+	  goto fail;
+	}
+      unwrap_stream_plain (w, w->pending, len, output);
+
+      _gss_krb5_hmac_sha1_final (&w->hmac, digest);
+      if (memcmp (digest, w->pending + len, cksumlen) != 0)
+	{
+	  maj_stat = GSS_S_BAD_MIC;
+	  goto fail;
+	}
+
+      if (w->skip || w->plainlen != w->ec + CFX_HEADER_LEN)
+	{
+	  maj_stat = GSS_S_DEFECTIVE_TOKEN;
+	  goto fail;
+	}
+
+      /* The encrypted header copy must match, except for RRC. */
+      copy = w->plain + w->ec;
+      if (memcmp (copy, w->header, 6) != 0
+	  || memcmp (copy + 8, w->header + 8, 8) != 0)
+	{
+	  maj_stat = GSS_S_BAD_MIC;
+	  goto fail;
+	}
+    }
+
+  if (conf_state)
+    *conf_state = w->sealed;
+  if (qop_state)
+    *qop_state = GSS_C_QOP_DEFAULT;
+
+  return recv_seqnr (k5, w->seqnr, UINT64_MAX);
+
+fail:
+  stream_discard (output);
+  return maj_stat;
+}
+
+OM_uint32
+gss_krb5_wrap_stream_init (OM_uint32 * minor_status,
+			   const gss_ctx_id_t context_handle,
+			   int unwrap, int conf_req_flag, gss_qop_t qop_req,
+			   int *conf_state, gss_wrap_stream_t wrap_stream)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  _gss_krb5_wrap_t w;
+  OM_uint32 maj_stat;
+
+  /* RFC 1964 tokens start with their length and checksum, so they
+     cannot be produced before the whole message is known. */
+  if (!cfx_enctype_p (k5))
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  w = _gss_calloc (1, sizeof (*w));
+  if (!w)
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+  w->k5 = k5;
+  w->unwrap = unwrap;
+  wrap_stream->krb5 = w;
+
+  if (unwrap)
+    return GSS_S_COMPLETE;
+
+  maj_stat = wrap_stream_init (minor_status, w, conf_req_flag);
+  if (GSS_ERROR (maj_stat))
+    {
+      gss_krb5_wrap_stream_release (wrap_stream);
+      return maj_stat;
+    }
+
+  if (conf_state)
+    *conf_state = w->sealed;
+
+  return GSS_S_COMPLETE;
+}
+
+OM_uint32
+gss_krb5_wrap_stream_update (OM_uint32 * minor_status,
+			     gss_wrap_stream_t wrap_stream,
+			     const gss_buffer_t input_buffer,
+			     gss_buffer_t output_buffer)
+{
+  _gss_krb5_wrap_t w = wrap_stream->krb5;
+
+  if (w->unwrap)
+    return unwrap_stream_update (minor_status, w, input_buffer->value,
+				 input_buffer->length, output_buffer);
+
+  return wrap_stream_update (minor_status, w, input_buffer->value,
+			     input_buffer->length, output_buffer);
+}
+
+OM_uint32
+gss_krb5_wrap_stream_final (OM_uint32 * minor_status,
+			    gss_wrap_stream_t wrap_stream,
+			    gss_buffer_t output_buffer,
+			    int *conf_state, gss_qop_t * qop_state)
+{
+  _gss_krb5_wrap_t w = wrap_stream->krb5;
+
+  if (w->unwrap)
+    return unwrap_stream_final (minor_status, w, output_buffer,
+				conf_state, qop_state);
+
+  return wrap_stream_final (minor_status, w, output_buffer);
+}
+
+void
+gss_krb5_wrap_stream_release (gss_wrap_stream_t wrap_stream)
+{
+  _gss_krb5_wrap_t w = wrap_stream->krb5;
+
+  if (w)
+    {
+      _gss_free (w->pending);
+      _gss_free (w->rotated);
+      _gss_free (w->plain);
+      /* Do not leave the keyed hash state around. */
+      memset (w, 0, sizeof (*w));
+      _gss_free (w);
+      wrap_stream->krb5 = NULL;
+    }
+}
+
+OM_uint32
+gss_krb5_set_replay_window (OM_uint32 * minor_status,
+			    const gss_ctx_id_t context_handle,
+			    OM_uint32 window)
+{
+  _gss_krb5_ctx_t k5 = context_handle->krb5;
+  OM_uint32 width = _GSS_KRB5_REPLAY_WINDOW;
+
+  if (window > _GSS_KRB5_REPLAY_WINDOW_MAX)
+    {
+      if (minor_status)
+	*minor_status = GSS_KRB5_S_G_WRONG_SIZE;
+      return GSS_S_FAILURE;
+    }
+
+  /* The window is indexed by the low bits of the sequence number. */
+  while (width < window)
+    width *= 2;
+
+  _gss_krb5_lock (k5);
+  memset (&k5->replay, 0, sizeof (k5->replay));
+  k5->replay.width = width;
+  _gss_krb5_unlock (k5);
+
+  if (minor_status)
+    *minor_status = 0;
   return GSS_S_COMPLETE;
 }
@@ -40,7 +40,7 @@ gss_krb5_canonicalize_name (OM_uint32 * minor_status,
     {
       if (input_name->length > 15)
 	{
-	  *output_name = malloc (sizeof (**output_name));
+	  *output_name = _gss_malloc (sizeof (**output_name));
 	  if (!*output_name)
 	    {
 	      if (minor_status)
@@ -49,10 +49,10 @@ gss_krb5_canonicalize_name (OM_uint32 * minor_status,
 	    }
 	  (*output_name)->type = GSS_KRB5_NT_PRINCIPAL_NAME;
 	  (*output_name)->length = input_name->length - 15;
-	  (*output_name)->value = malloc ((*output_name)->length + 1);
+	  (*output_name)->value = _gss_malloc ((*output_name)->length + 1);
 	  if (!(*output_name)->value)
 	    {
-	      free (*output_name);
+	      _gss_free (*output_name);
 	      if (minor_status)
 		*minor_status = ENOMEM;
 	      return GSS_S_FAILURE;
@@ -123,7 +123,7 @@ gss_krb5_export_name (OM_uint32 * minor_status,
   char *p;
 
   exported_name->length = len;
-  p = exported_name->value = malloc (len);
+  p = exported_name->value = _gss_malloc (len);
   if (!p)
     {
       if (minor_status)
@@ -116,6 +116,125 @@ gss_krb5_wrap (OM_uint32 * minor_status,
 	       gss_qop_t qop_req,
 	       const gss_buffer_t input_message_buffer,
 	       int *conf_state, gss_buffer_t output_message_buffer);
+extern OM_uint32
+gss_krb5_wrap_iov (OM_uint32 * minor_status,
+		   const gss_ctx_id_t context_handle,
+		   int conf_req_flag,
+		   gss_qop_t qop_req,
+		   int *conf_state, gss_iov_buffer_desc * iov, int iov_count);
+extern OM_uint32
+gss_krb5_unwrap_iov (OM_uint32 * minor_status,
+		     const gss_ctx_id_t context_handle,
+		     int *conf_state,
+		     gss_qop_t * qop_state,
+		     gss_iov_buffer_desc * iov, int iov_count);
+extern OM_uint32
+gss_krb5_wrap_iov_length (OM_uint32 * minor_status,
+			  const gss_ctx_id_t context_handle,
+			  int conf_req_flag,
+			  gss_qop_t qop_req,
+			  int *conf_state,
+			  gss_iov_buffer_desc * iov, int iov_count);
+extern OM_uint32
+gss_krb5_mic_init (OM_uint32 * minor_status,
+		   const gss_ctx_id_t context_handle,
+		   int verify, gss_qop_t qop_req, gss_mic_stream_t mic_stream);
+extern OM_uint32
+gss_krb5_mic_update (OM_uint32 * minor_status,
+		     gss_mic_stream_t mic_stream,
+		     const gss_buffer_t message_buffer);
+extern OM_uint32
+gss_krb5_mic_final (OM_uint32 * minor_status,
+		    gss_mic_stream_t mic_stream,
+		    gss_buffer_t token_buffer, gss_qop_t * qop_state);
+extern void gss_krb5_mic_release (gss_mic_stream_t mic_stream);
+extern OM_uint32
+gss_krb5_wrap_stream_init (OM_uint32 * minor_status,
+			   const gss_ctx_id_t context_handle,
+			   int unwrap, int conf_req_flag, gss_qop_t qop_req,
+			   int *conf_state, gss_wrap_stream_t wrap_stream);
+extern OM_uint32
+gss_krb5_wrap_stream_update (OM_uint32 * minor_status,
+			     gss_wrap_stream_t wrap_stream,
+			     const gss_buffer_t input_buffer,
+			     gss_buffer_t output_buffer);
+extern OM_uint32
+gss_krb5_wrap_stream_final (OM_uint32 * minor_status,
+			    gss_wrap_stream_t wrap_stream,
+			    gss_buffer_t output_buffer,
+			    int *conf_state, gss_qop_t * qop_state);
+extern void gss_krb5_wrap_stream_release (gss_wrap_stream_t wrap_stream);
+extern OM_uint32
+gss_krb5_wrap_batch (OM_uint32 * minor_status,
+		     const gss_ctx_id_t context_handle,
+		     int conf_req_flag,
+		     gss_qop_t qop_req,
+		     size_t count,
+		     gss_buffer_desc * input_message_buffers,
+		     int *conf_state,
+		     gss_buffer_desc * output_message_buffers,
+		     gss_buffer_t output_arena);
+extern OM_uint32
+gss_krb5_unwrap_batch (OM_uint32 * minor_status,
+		       const gss_ctx_id_t context_handle,
+		       size_t count,
+		       gss_buffer_desc * input_message_buffers,
+		       gss_buffer_desc * output_message_buffers,
+		       OM_uint32 * message_statuses,
+		       int *conf_states, gss_buffer_t output_arena);
+extern OM_uint32
+gss_krb5_init_sec_context_async (OM_uint32 * minor_status,
+				 const gss_cred_id_t initiator_cred_handle,
+				 gss_ctx_id_t * context_handle,
+				 const gss_name_t target_name,
+				 const gss_OID mech_type,
+				 OM_uint32 req_flags,
+				 OM_uint32 time_req,
+				 const gss_channel_bindings_t
+				 input_chan_bindings,
+				 const gss_buffer_t input_token,
+				 gss_OID * actual_mech_type,
+				 gss_buffer_t output_token,
+				 OM_uint32 * ret_flags,
+				 OM_uint32 * time_rec, int *wait_fd);
+extern OM_uint32
+gss_krb5_set_cred_refresh (OM_uint32 * minor_status, OM_uint32 percent);
+extern OM_uint32
+gss_krb5_set_replay_window (OM_uint32 * minor_status,
+			    const gss_ctx_id_t context_handle,
+			    OM_uint32 window);
+extern OM_uint32
+gss_krb5_wrap_size_limit (OM_uint32 * minor_status,
+			  const gss_ctx_id_t context_handle,
+			  int conf_req_flag,
+			  gss_qop_t qop_req,
+			  OM_uint32 req_output_size,
+			  OM_uint32 * max_input_size);
+extern OM_uint32
+gss_krb5_wrap_into (OM_uint32 * minor_status,
+		    const gss_ctx_id_t context_handle,
+		    int conf_req_flag,
+		    gss_qop_t qop_req,
+		    const gss_buffer_t input_message_buffer,
+		    int *conf_state, gss_buffer_t output_message_buffer);
+extern OM_uint32
+gss_krb5_unwrap_into (OM_uint32 * minor_status,
+		      const gss_ctx_id_t context_handle,
+		      const gss_buffer_t input_message_buffer,
+		      gss_buffer_t output_message_buffer,
+		      int *conf_state, gss_qop_t * qop_state);
+extern OM_uint32
+gss_krb5_get_mic_into (OM_uint32 * minor_status,
+		       const gss_ctx_id_t context_handle,
+		       gss_qop_t qop_req,
+		       const gss_buffer_t message_buffer,
+		       gss_buffer_t message_token);
+extern OM_uint32
+gss_krb5_unwrap_inplace (OM_uint32 * minor_status,
+			 const gss_ctx_id_t context_handle,
+			 gss_buffer_t message_buffer,
+			 size_t * offset, size_t * length,
+			 int *conf_state, gss_qop_t * qop_state);
 
 /* See name.c. */
 extern OM_uint32
@@ -0,0 +1,189 @@
+/* krb5/thread.c --- Concurrent use of Krb5 GSS contexts.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "k5internal.h"
+
+/* Per-message tokens may be created and verified on an established
+   context from several threads at once.  The sequence numbers and
+   the replay window are protected by a mutex in the context, which
+   is only held while they are read and updated.  The cryptography
+   runs outside of it: the derived keys are not modified once the
+   context is established, and Shishi calls use a handle borrowed
+   from the pool below, since Shishi records errors in its handle and
+   the context handle may be shared with the credential. */
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+# define POOL_LOCK() pthread_mutex_lock (&pool_lock)
+# define POOL_UNLOCK() pthread_mutex_unlock (&pool_lock)
+#else
+# define POOL_LOCK()
+# define POOL_UNLOCK()
+#endif
+
+/* Idle Shishi handles.  The pool only grows to the number of threads
+   that have been doing per-message operations at the same time.  It
+   outlives the objects handed to the application, so it is allocated
+   with realloc rather than _gss_realloc, see alloc.c. */
+static Shishi **pool;
+static size_t pool_len;
+static size_t pool_size;
+
+/* Set up the mutex of context K5.  Returns 0 on success, or an errno
+   value. */
+int
+_gss_krb5_lock_init (_gss_krb5_ctx_t k5)
+{
+#ifdef HAVE_PTHREAD_H
+  return pthread_mutex_init (&k5->lock, NULL);
+#else
+  return 0;
+#endif
+}
+
+void
+_gss_krb5_lock_done (_gss_krb5_ctx_t k5)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy (&k5->lock);
+#endif
+}
+
+void
+_gss_krb5_lock (_gss_krb5_ctx_t k5)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock (&k5->lock);
+#endif
+}
+
+void
+_gss_krb5_unlock (_gss_krb5_ctx_t k5)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock (&k5->lock);
+#endif
+}
+
+/* Reserve the next sequence number for a token sent on context K5.
+   A number is never handed out twice, even if the token using it is
+   not completed. */
+uint64_t
+_gss_krb5_send_seqnr (_gss_krb5_ctx_t k5)
+{
+  return _gss_krb5_send_seqnrs (k5, 1);
+}
+
+/* Like _gss_krb5_send_seqnr, but reserve COUNT consecutive numbers
+   and return the first. */
+uint64_t
+_gss_krb5_send_seqnrs (_gss_krb5_ctx_t k5, size_t count)
+{
+  uint64_t seqnr;
+
+  _gss_krb5_lock (k5);
+  if (k5->acceptor)
+    {
+      seqnr = k5->acceptseqnr;
+      k5->acceptseqnr += count;
+    }
+  else
+    {
+      seqnr = k5->initseqnr;
+      k5->initseqnr += count;
+    }
+  _gss_krb5_unlock (k5);
+
+  return seqnr;
+}
+
+/* Borrow a Shishi handle for cryptographic operations, which must be
+   given back with _gss_krb5_crypto_put.  Returns NULL if no handle
+   could be created. */
+Shishi *
+_gss_krb5_crypto_get (void)
+{
+  Shishi *sh = NULL;
+
+  POOL_LOCK ();
+  if (pool_len > 0)
+    sh = pool[--pool_len];
+  POOL_UNLOCK ();
+
+  if (sh)
+    return sh;
+
+  /* Unlike shishi_init, this does not read any configuration or
+     ticket files.  Failures are reported through return codes. */
+  sh = shishi ();
+  if (sh)
+    shishi_error_set_outputtype (sh, SHISHI_OUTPUTTYPE_NULL);
+
+  return sh;
+}
+
+void
+_gss_krb5_crypto_put (Shishi * sh)
+{
+  POOL_LOCK ();
+  if (pool_len == pool_size)
+    {
+      size_t n = pool_size ? 2 * pool_size : 8;
+      Shishi **tmp = realloc (pool, n * sizeof (*pool));
+
+      if (tmp)
+	{
+	  pool = tmp;
+	  pool_size = n;
+	}
+    }
+  if (pool_len < pool_size)
+    {
+      pool[pool_len++] = sh;
+      sh = NULL;
+    }
+  POOL_UNLOCK ();
+
+  if (sh)
+    shishi_done (sh);
+}
+
+#ifdef __GNUC__
+
+/* Release the pooled handles when the library is unloaded or the
+   process exits, so that they do not show up as leaks in memory
+   checkers.  No thread may be using the library by then. */
+static void crypto_pool_done (void) __attribute__ ((destructor));
+
+static void
+crypto_pool_done (void)
+{
+  POOL_LOCK ();
+  while (pool_len > 0)
+    shishi_done (pool[--pool_len]);
+  free (pool);
+  pool = NULL;
+  pool_size = 0;
+  POOL_UNLOCK ();
+}
+
+#endif
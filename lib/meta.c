@@ -23,6 +23,13 @@
 #include "internal.h"
 #include "meta.h"
 
+#ifdef ENABLE_MECH_MODULES
+# include <dlfcn.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+
 #ifdef USE_KERBEROS5
 # include <gss/krb5.h>
 # include "krb5/protos.h"
@@ -31,78 +38,342 @@
 static _gss_mech_api_desc _gss_mech_apis[] = {
 #ifdef USE_KERBEROS5
   {
-   &GSS_KRB5_static,
-   "GS2-KRB5",
-   "Kerberos V5",
-   N_("Kerberos V5 GSS-API mechanism"),
-   {
-    /* Mandatory name-types. */
-    &GSS_KRB5_NT_PRINCIPAL_NAME_static,
-    &GSS_C_NT_HOSTBASED_SERVICE_static,
-    &GSS_C_NT_EXPORT_NAME_static},
-   gss_krb5_init_sec_context,
-   gss_krb5_canonicalize_name,
-   gss_krb5_export_name,
-   gss_krb5_wrap,
-   gss_krb5_unwrap,
-   gss_krb5_get_mic,
-   gss_krb5_verify_mic,
-   gss_krb5_display_status,
-   gss_krb5_acquire_cred,
-   gss_krb5_release_cred,
-   gss_krb5_accept_sec_context,
-   gss_krb5_delete_sec_context,
-   gss_krb5_context_time,
-   gss_krb5_inquire_cred,
-   gss_krb5_inquire_cred_by_mech},
+   .mech = &GSS_KRB5_static,
+   .sasl_name = "GS2-KRB5",
+   .mech_name = "Kerberos V5",
+   .mech_description = N_("Kerberos V5 GSS-API mechanism"),
+   .name_types = {
+		  /* Mandatory name-types. */
+		  &GSS_KRB5_NT_PRINCIPAL_NAME_static,
+		  &GSS_C_NT_HOSTBASED_SERVICE_static,
+		  &GSS_C_NT_EXPORT_NAME_static},
+   .init_sec_context = gss_krb5_init_sec_context,
+   .canonicalize_name = gss_krb5_canonicalize_name,
+   .export_name = gss_krb5_export_name,
+   .wrap = gss_krb5_wrap,
+   .unwrap = gss_krb5_unwrap,
+   .get_mic = gss_krb5_get_mic,
+   .verify_mic = gss_krb5_verify_mic,
+   .display_status = gss_krb5_display_status,
+   .acquire_cred = gss_krb5_acquire_cred,
+   .release_cred = gss_krb5_release_cred,
+   .accept_sec_context = gss_krb5_accept_sec_context,
+   .delete_sec_context = gss_krb5_delete_sec_context,
+   .context_time = gss_krb5_context_time,
+   .inquire_cred = gss_krb5_inquire_cred,
+   .inquire_cred_by_mech = gss_krb5_inquire_cred_by_mech,
+   .wrap_iov = gss_krb5_wrap_iov,
+   .unwrap_iov = gss_krb5_unwrap_iov,
+   .wrap_iov_length = gss_krb5_wrap_iov_length,
+   .mic_init = gss_krb5_mic_init,
+   .mic_update = gss_krb5_mic_update,
+   .mic_final = gss_krb5_mic_final,
+   .mic_release = gss_krb5_mic_release,
+   .set_replay_window = gss_krb5_set_replay_window,
+   .wrap_size_limit = gss_krb5_wrap_size_limit,
+   .wrap_into = gss_krb5_wrap_into,
+   .unwrap_into = gss_krb5_unwrap_into,
+   .get_mic_into = gss_krb5_get_mic_into,
+   .unwrap_inplace = gss_krb5_unwrap_inplace,
+   .wrap_stream_init = gss_krb5_wrap_stream_init,
+   .wrap_stream_update = gss_krb5_wrap_stream_update,
+   .wrap_stream_final = gss_krb5_wrap_stream_final,
+   .wrap_stream_release = gss_krb5_wrap_stream_release,
+   .wrap_batch = gss_krb5_wrap_batch,
+   .unwrap_batch = gss_krb5_unwrap_batch,
+   .set_cred_refresh = gss_krb5_set_cred_refresh,
+   .init_sec_context_async = gss_krb5_init_sec_context_async},
 #endif
-  {
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   {
-    NULL,
-    NULL,
-    NULL},
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL,
-   NULL}
+  /* Terminator. */
+  {.mech = NULL}
 };
 
-_gss_mech_api_t
-_gss_find_mech_no_default (const gss_OID oid)
+/* Mechanisms are looked up in a registry that is set up the first
+   time it is needed.  It holds the mechanisms built into the library,
+   followed by those loaded from the modules listed in the
+   configuration file, in hash tables indexed by OID and by SASL name.
+   The registry lives until the process exits, so it is allocated
+   with the C library allocator rather than the one set by
+   gss_set_allocator.
+
+   The configuration file is GSS_MECH_CONFIG, unless the environment
+   variable of the same name says otherwise.  Each line holds a
+   keyword and a value, and lines starting with '#' are ignored:
+
+     module NAME   Load the mechanism module NAME.  Names without a
+                   '/' are looked up in GSS_MECH_MODULEDIR.
+     default NAME  Use the mechanism with SASL name NAME when the
+                   application does not ask for a mechanism.
+
+   Modules that cannot be loaded, or that implement a mechanism with
+   the OID or SASL name of one already registered, are skipped.
+   Without a "default" line, the first mechanism is the default. */
+
+static struct
 {
+  /* Mechanisms in the order they were registered. */
+  _gss_mech_api_t *mechs;
+  size_t count;
+  /* Open addressing hash tables of SIZE slots, a power of two at
+     least twice COUNT. */
+  _gss_mech_api_t *by_oid;
+  _gss_mech_api_t *by_saslname;
+  size_t size;
+  _gss_mech_api_t dflt;
+} registry;
+
+/* Return the FNV-1a hash of the LEN bytes at DATA. */
+static size_t
+hash_bytes (const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  size_t h = 2166136261U;
+
+  while (len-- > 0)
+    h = (h ^ *p++) * 16777619U;
+
+  return h;
+}
+
+static _gss_mech_api_t
+lookup_oid (const gss_OID oid)
+{
+  size_t mask = registry.size - 1;
   size_t i;
 
-  for (i = 0; _gss_mech_apis[i].mech; i++)
-    if (gss_oid_equal (oid, _gss_mech_apis[i].mech))
-      return &_gss_mech_apis[i];
+  if (registry.size == 0 || oid == GSS_C_NO_OID)
+    return NULL;
+
+  for (i = hash_bytes (oid->elements, oid->length) & mask;
+       registry.by_oid[i]; i = (i + 1) & mask)
+    if (gss_oid_equal (oid, registry.by_oid[i]->mech))
+      return registry.by_oid[i];
+
+  return NULL;
+}
+
+static _gss_mech_api_t
+lookup_saslname (const char *name, size_t len)
+{
+  size_t mask = registry.size - 1;
+  size_t i;
+
+  if (registry.size == 0)
+    return NULL;
+
+  for (i = hash_bytes (name, len) & mask;
+       registry.by_saslname[i]; i = (i + 1) & mask)
+    if (strlen (registry.by_saslname[i]->sasl_name) == len
+	&& memcmp (registry.by_saslname[i]->sasl_name, name, len) == 0)
+      return registry.by_saslname[i];
 
   return NULL;
 }
 
+/* Put MECH in the hash tables, which have a free slot. */
+static void
+registry_index (_gss_mech_api_t mech)
+{
+  size_t mask = registry.size - 1;
+  size_t i;
+
+  for (i = hash_bytes (mech->mech->elements, mech->mech->length) & mask;
+       registry.by_oid[i]; i = (i + 1) & mask)
+    ;
+  registry.by_oid[i] = mech;
+
+  for (i = hash_bytes (mech->sasl_name, strlen (mech->sasl_name)) & mask;
+       registry.by_saslname[i]; i = (i + 1) & mask)
+    ;
+  registry.by_saslname[i] = mech;
+}
+
+/* Double the size of the registry.  Returns 0 on success, or -1 if
+   memory is short, leaving the registry unchanged. */
+static int
+registry_grow (void)
+{
+  size_t size = registry.size ? 2 * registry.size : 8;
+  _gss_mech_api_t *mechs, *by_oid, *by_saslname;
+  size_t i;
+
+  mechs = realloc (registry.mechs, size / 2 * sizeof (*mechs));
+  if (!mechs)
+    return -1;
+  registry.mechs = mechs;
+
+  by_oid = calloc (size, sizeof (*by_oid));
+  by_saslname = calloc (size, sizeof (*by_saslname));
+  if (!by_oid || !by_saslname)
+    {
+      free (by_oid);
+      free (by_saslname);
+      return -1;
+    }
+
+  free (registry.by_oid);
+  free (registry.by_saslname);
+  registry.by_oid = by_oid;
+  registry.by_saslname = by_saslname;
+  registry.size = size;
+
+  for (i = 0; i < registry.count; i++)
+    registry_index (registry.mechs[i]);
+
+  return 0;
+}
+
+/* Add MECH to the registry.  Returns 0 on success, or -1 if a
+   mechanism with the same OID or SASL name is already registered or
+   memory is short. */
+static int
+registry_add (_gss_mech_api_t mech)
+{
+  if (lookup_oid (mech->mech)
+      || lookup_saslname (mech->sasl_name, strlen (mech->sasl_name)))
+    return -1;
+
+  if (2 * (registry.count + 1) > registry.size && registry_grow () != 0)
+    return -1;
+
+  registry.mechs[registry.count++] = mech;
+  registry_index (mech);
+
+  return 0;
+}
+
+#ifdef ENABLE_MECH_MODULES
+/* Return non-zero if the table entry MECH from a module has what the
+   library needs to use it.  The extensions are optional. */
+static int
+module_mech_valid (_gss_mech_api_t mech)
+{
+  return mech->mech && mech->sasl_name && mech->mech_name
+    && mech->mech_description
+    && mech->init_sec_context && mech->canonicalize_name
+    && mech->export_name && mech->wrap && mech->unwrap
+    && mech->get_mic && mech->verify_mic && mech->display_status
+    && mech->acquire_cred && mech->release_cred
+    && mech->accept_sec_context && mech->delete_sec_context
+    && mech->context_time && mech->inquire_cred
+    && mech->inquire_cred_by_mech;
+}
+
+/* Load the mechanism module NAME and register its mechanism. */
+static void
+load_module (const char *name)
+{
+  _gss_mech_module_func func;
+  _gss_mech_api_t mech;
+  char *path = NULL;
+  void *handle;
+
+  if (!strchr (name, '/'))
+    {
+      path = malloc (strlen (GSS_MECH_MODULEDIR) + strlen (name) + 2);
+      if (!path)
+	return;
+      sprintf (path, "%s/%s", GSS_MECH_MODULEDIR, name);
+    }
+
+  handle = dlopen (path ? path : name, RTLD_NOW | RTLD_LOCAL);
+  free (path);
+  if (!handle)
+    return;
+
+  *(void **) &func = dlsym (handle, "gss_mech_module");
+  mech = func ? func (_GSS_MECH_MODULE_VERSION) : NULL;
+  if (!mech || !module_mech_valid (mech) || registry_add (mech) != 0)
+    dlclose (handle);
+}
+#endif
+
+/* Read the configuration file FILE, if there is one. */
+static void
+read_config (const char *file)
+{
+  char line[1024], dflt[sizeof (line)] = "";
+  FILE *fh;
+
+  fh = fopen (file, "r");
+  if (!fh)
+    return;
+
+  while (fgets (line, sizeof (line), fh))
+    {
+      char *key = line + strspn (line, " \t");
+      char *value = key + strcspn (key, " \t\r\n");
+      char *end;
+
+      if (*key == '#' || value == key)
+	continue;
+      if (*value)
+	*value++ = '\0';
+      value += strspn (value, " \t");
+      end = value + strcspn (value, "\r\n");
+      while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+	end--;
+      *end = '\0';
+      if (!*value)
+	continue;
+
+#ifdef ENABLE_MECH_MODULES
+      if (strcmp (key, "module") == 0)
+	load_module (value);
+#endif
+      if (strcmp (key, "default") == 0)
+	strcpy (dflt, value);
+    }
+
+  fclose (fh);
+
+  /* The default may be implemented by a module listed after it. */
+  if (*dflt)
+    registry.dflt = lookup_saslname (dflt, strlen (dflt));
+}
+
+static void
+registry_init (void)
+{
+  const char *file = NULL;
+  size_t i;
+
+  for (i = 0; _gss_mech_apis[i].mech; i++)
+    registry_add (&_gss_mech_apis[i]);
+
+#ifdef HAVE_SECURE_GETENV
+  file = secure_getenv ("GSS_MECH_CONFIG");
+#endif
+  read_config (file ? file : GSS_MECH_CONFIG);
+
+  if (!registry.dflt && registry.count > 0)
+    registry.dflt = registry.mechs[0];
+}
+
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+# define REGISTRY_INIT() pthread_once (&registry_once, registry_init)
+#else
+static int registry_done;
+# define REGISTRY_INIT() \
+  (registry_done ? (void) 0 : (registry_done = 1, registry_init ()))
+#endif
+
+_gss_mech_api_t
+_gss_find_mech_no_default (const gss_OID oid)
+{
+  REGISTRY_INIT ();
+
+  return lookup_oid (oid);
+}
+
 _gss_mech_api_t
 _gss_find_mech (const gss_OID oid)
 {
   _gss_mech_api_t p = _gss_find_mech_no_default (oid);
 
-  if (!p && _gss_mech_apis[0].mech)
-    /* FIXME.  When we support more than one mechanism, make it possible
-       to configure the default mechanism. */
-    return &_gss_mech_apis[0];
+  if (!p)
+    return registry.dflt;
 
   return p;
 }
@@ -110,31 +381,27 @@ _gss_find_mech (const gss_OID oid)
 _gss_mech_api_t
 _gss_find_mech_by_saslname (const gss_buffer_t sasl_mech_name)
 {
-  size_t i;
-
   if (sasl_mech_name == NULL
       || sasl_mech_name->value == NULL || sasl_mech_name->length == 0)
     return NULL;
 
-  for (i = 0; _gss_mech_apis[i].mech; i++)
-    if (strlen (_gss_mech_apis[i].sasl_name) == sasl_mech_name->length &&
-	memcmp (_gss_mech_apis[i].sasl_name, sasl_mech_name->value,
-		sasl_mech_name->length) == 0)
-      return &_gss_mech_apis[i];
+  REGISTRY_INIT ();
 
-  return NULL;
+  return lookup_saslname (sasl_mech_name->value, sasl_mech_name->length);
 }
 
 OM_uint32
 _gss_indicate_mechs1 (OM_uint32 * minor_status, gss_OID_set * mech_set)
 {
   OM_uint32 maj_stat;
-  int i;
+  size_t i;
 
-  for (i = 0; _gss_mech_apis[i].mech; i++)
+  REGISTRY_INIT ();
+
+  for (i = 0; i < registry.count; i++)
     {
       maj_stat = gss_add_oid_set_member (minor_status,
-					 _gss_mech_apis[i].mech, mech_set);
+					 registry.mechs[i]->mech, mech_set);
       if (GSS_ERROR (maj_stat))
 	return maj_stat;
     }
@@ -24,9 +24,22 @@
 #define META_H
 
 #include <gss/api.h>
+#include <gss/ext.h>
 
 #define MAX_NT 5
 
+/* Call the function FN of mechanism MECH.  When the library is
+   configured with --with-single-mech=krb5, Kerberos V5 is the only
+   mechanism and is called directly instead of through its table
+   entry, so that the compiler may inline it. */
+#ifdef USE_SINGLE_MECH_KERBEROS5
+# include <gss/krb5.h>
+# include "krb5/protos.h"
+# define _GSS_MECH_CALL(mech, fn) ((void) (mech), gss_krb5_ ## fn)
+#else
+# define _GSS_MECH_CALL(mech, fn) ((mech)->fn)
+#endif
+
 typedef struct _gss_mech_api_struct
 {
   gss_OID mech;
@@ -119,8 +132,122 @@ typedef struct _gss_mech_api_struct
      gss_name_t * name,
      OM_uint32 * initiator_lifetime,
      OM_uint32 * acceptor_lifetime, gss_cred_usage_t * cred_usage);
+    OM_uint32 (*wrap_iov)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle, int conf_req_flag,
+     gss_qop_t qop_req, int *conf_state,
+     gss_iov_buffer_desc * iov, int iov_count);
+    OM_uint32 (*unwrap_iov)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle,
+     int *conf_state, gss_qop_t * qop_state,
+     gss_iov_buffer_desc * iov, int iov_count);
+    OM_uint32 (*wrap_iov_length)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle, int conf_req_flag,
+     gss_qop_t qop_req, int *conf_state,
+     gss_iov_buffer_desc * iov, int iov_count);
+    OM_uint32 (*mic_init)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle, int verify,
+     gss_qop_t qop_req, gss_mic_stream_t mic_stream);
+    OM_uint32 (*mic_update)
+    (OM_uint32 * minor_status,
+     gss_mic_stream_t mic_stream, const gss_buffer_t message_buffer);
+    OM_uint32 (*mic_final)
+    (OM_uint32 * minor_status,
+     gss_mic_stream_t mic_stream,
+     gss_buffer_t token_buffer, gss_qop_t * qop_state);
+  void (*mic_release) (gss_mic_stream_t mic_stream);
+    OM_uint32 (*set_replay_window)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle, OM_uint32 window);
+    OM_uint32 (*wrap_size_limit)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle, int conf_req_flag,
+     gss_qop_t qop_req, OM_uint32 req_output_size,
+     OM_uint32 * max_input_size);
+    OM_uint32 (*wrap_into)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle,
+     int conf_req_flag,
+     gss_qop_t qop_req,
+     const gss_buffer_t input_message_buffer,
+     int *conf_state, gss_buffer_t output_message_buffer);
+    OM_uint32 (*unwrap_into)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle,
+     const gss_buffer_t input_message_buffer,
+     gss_buffer_t output_message_buffer,
+     int *conf_state, gss_qop_t * qop_state);
+    OM_uint32 (*get_mic_into)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle,
+     gss_qop_t qop_req,
+     const gss_buffer_t message_buffer, gss_buffer_t message_token);
+    OM_uint32 (*unwrap_inplace)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle,
+     gss_buffer_t message_buffer,
+     size_t * offset, size_t * length,
+     int *conf_state, gss_qop_t * qop_state);
+    OM_uint32 (*wrap_stream_init)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle,
+     int unwrap, int conf_req_flag, gss_qop_t qop_req,
+     int *conf_state, gss_wrap_stream_t wrap_stream);
+    OM_uint32 (*wrap_stream_update)
+    (OM_uint32 * minor_status,
+     gss_wrap_stream_t wrap_stream,
+     const gss_buffer_t input_buffer, gss_buffer_t output_buffer);
+    OM_uint32 (*wrap_stream_final)
+    (OM_uint32 * minor_status,
+     gss_wrap_stream_t wrap_stream,
+     gss_buffer_t output_buffer, int *conf_state, gss_qop_t * qop_state);
+    void (*wrap_stream_release) (gss_wrap_stream_t wrap_stream);
+    OM_uint32 (*wrap_batch)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle,
+     int conf_req_flag, gss_qop_t qop_req,
+     size_t count, gss_buffer_desc * input_message_buffers,
+     int *conf_state,
+     gss_buffer_desc * output_message_buffers, gss_buffer_t output_arena);
+    OM_uint32 (*unwrap_batch)
+    (OM_uint32 * minor_status,
+     const gss_ctx_id_t context_handle,
+     size_t count, gss_buffer_desc * input_message_buffers,
+     gss_buffer_desc * output_message_buffers,
+     OM_uint32 * message_statuses, int *conf_states,
+     gss_buffer_t output_arena);
+    OM_uint32 (*set_cred_refresh)
+    (OM_uint32 * minor_status, OM_uint32 percent);
+    OM_uint32 (*init_sec_context_async)
+    (OM_uint32 * minor_status,
+     const gss_cred_id_t initiator_cred_handle,
+     gss_ctx_id_t * context_handle,
+     const gss_name_t target_name,
+     const gss_OID mech_type,
+     OM_uint32 req_flags,
+     OM_uint32 time_req,
+     const gss_channel_bindings_t input_chan_bindings,
+     const gss_buffer_t input_token,
+     gss_OID * actual_mech_type,
+     gss_buffer_t output_token,
+     OM_uint32 * ret_flags, OM_uint32 * time_rec, int *wait_fd);
 } _gss_mech_api_desc, *_gss_mech_api_t;
 
+/* A mechanism module is a shared object, listed in the configuration
+   file, that exports a function called "gss_mech_module" of the type
+   below.  It is passed _GSS_MECH_MODULE_VERSION, and returns the
+   table entry of the mechanism it implements, or NULL if it was
+   built for another version of the table.  The version changes
+   whenever the layout of _gss_mech_api_desc or of the handles in
+   internal.h does, so modules must be built against the same GSS
+   source tree as the library. */
+#define _GSS_MECH_MODULE_VERSION 3
+
+typedef _gss_mech_api_t (*_gss_mech_module_func) (unsigned int version);
+
 _gss_mech_api_t _gss_find_mech (const gss_OID oid);
 _gss_mech_api_t _gss_find_mech_no_default (const gss_OID oid);
 _gss_mech_api_t _gss_find_mech_by_saslname (const gss_buffer_t
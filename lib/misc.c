@@ -49,7 +49,7 @@ gss_create_empty_oid_set (OM_uint32 * minor_status, gss_OID_set * oid_set)
   if (minor_status)
     *minor_status = 0;
 
-  *oid_set = malloc (sizeof (**oid_set));
+  *oid_set = _gss_malloc (sizeof (**oid_set));
   if (!*oid_set)
     {
       if (minor_status)
@@ -95,7 +95,7 @@ _gss_copy_oid (OM_uint32 * minor_status,
     return GSS_S_FAILURE | GSS_S_CALL_BAD_STRUCTURE;
 
   dest_oid->length = src_oid->length;
-  dest_oid->elements = malloc (src_oid->length);
+  dest_oid->elements = _gss_malloc (src_oid->length);
   if (!dest_oid->elements)
     {
       if (minor_status)
@@ -169,7 +169,7 @@ gss_add_oid_set_member (OM_uint32 * minor_status,
   {
     gss_OID tmp;
 
-    tmp = realloc ((*oid_set)->elements, (*oid_set)->count *
+    tmp = _gss_realloc ((*oid_set)->elements, (*oid_set)->count *
 		   sizeof (*(*oid_set)->elements));
     if (!tmp)
       {
@@ -269,9 +269,9 @@ gss_release_oid_set (OM_uint32 * minor_status, gss_OID_set * set)
     return GSS_S_COMPLETE;
 
   for (i = 0, cur = (*set)->elements; i < (*set)->count; i++, cur++)
-    free (cur->elements);
-  free ((*set)->elements);
-  free (*set);
+    _gss_free (cur->elements);
+  _gss_free ((*set)->elements);
+  _gss_free (*set);
   *set = GSS_C_NO_OID_SET;
 
   return GSS_S_COMPLETE;
@@ -342,10 +342,131 @@ gss_release_buffer (OM_uint32 * minor_status, gss_buffer_t buffer)
 
   if (buffer != GSS_C_NO_BUFFER)
     {
-      free (buffer->value);
+      _gss_free (buffer->value);
       buffer->value = NULL;
       buffer->length = 0;
     }
 
   return GSS_S_COMPLETE;
 }
+
+/**
+ * gss_release_iov_buffer:
+ * @minor_status: (integer, modify) Mechanism specific status code.
+ * @iov: (gss_iov_buffer_desc array, modify) Buffers to release.
+ * @iov_count: (integer, read) Number of elements in @iov.
+ *
+ * Free storage that gss_wrap_iov() allocated for buffers marked with
+ * the `GSS_IOV_BUFFER_FLAG_ALLOCATE` flag.  Only buffers with the
+ * `GSS_IOV_BUFFER_FLAG_ALLOCATED` flag set are released; the flag is
+ * cleared and the length field zeroed.  Other buffers are left
+ * untouched.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ **/
+OM_uint32
+gss_release_iov_buffer (OM_uint32 * minor_status,
+			gss_iov_buffer_desc * iov, int iov_count)
+{
+  int i;
+
+  if (minor_status)
+    *minor_status = 0;
+
+  if (iov == GSS_C_NO_IOV_BUFFER)
+    return GSS_S_COMPLETE;
+
+  for (i = 0; i < iov_count; i++)
+    if (iov[i].type & GSS_IOV_BUFFER_FLAG_ALLOCATED)
+      {
+	gss_release_buffer (NULL, &iov[i].buffer);
+	iov[i].type &= ~GSS_IOV_BUFFER_FLAG_ALLOCATED;
+      }
+
+  return GSS_S_COMPLETE;
+}
+
+/**
+ * gss_release_mic_stream:
+ * @minor_status: (integer, modify) Mechanism specific status code.
+ * @mic_stream: (gss_mic_stream_t, modify) MIC computation or
+ *   verification to abandon.  Set to GSS_C_NO_MIC_STREAM on return.
+ *
+ * Release a MIC stream started by gss_get_mic_init() or
+ * gss_verify_mic_init() without producing or checking a token.
+ * Streams passed to gss_get_mic_final() or gss_verify_mic_final()
+ * are already released and must not be passed to this function.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ **/
+OM_uint32
+gss_release_mic_stream (OM_uint32 * minor_status,
+			gss_mic_stream_t * mic_stream)
+{
+  _gss_mech_api_t mech;
+
+  if (minor_status)
+    *minor_status = 0;
+
+  if (!mic_stream || *mic_stream == GSS_C_NO_MIC_STREAM)
+    return GSS_S_COMPLETE;
+
+  mech = (*mic_stream)->api;
+  if (mech && mech->mic_release)
+    _GSS_MECH_CALL (mech, mic_release) (*mic_stream);
+
+  _gss_free (*mic_stream);
+  *mic_stream = GSS_C_NO_MIC_STREAM;
+
+  return GSS_S_COMPLETE;
+}
+
+/**
+ * gss_release_wrap_stream:
+ * @minor_status: (integer, modify) Mechanism specific status code.
+ * @wrap_stream: (gss_wrap_stream_t, modify) Token being produced or
+ *   unwrapped, to abandon.  Set to GSS_C_NO_WRAP_STREAM on return.
+ *
+ * Release a stream started by gss_wrap_init() or gss_unwrap_init()
+ * without finishing the token.  Streams passed to gss_wrap_final()
+ * or gss_unwrap_final() are already released and must not be passed
+ * to this function.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ **/
+OM_uint32
+gss_release_wrap_stream (OM_uint32 * minor_status,
+			 gss_wrap_stream_t * wrap_stream)
+{
+  _gss_mech_api_t mech;
+
+  if (minor_status)
+    *minor_status = 0;
+
+  if (!wrap_stream || *wrap_stream == GSS_C_NO_WRAP_STREAM)
+    return GSS_S_COMPLETE;
+
+  mech = (*wrap_stream)->api;
+  if (mech && mech->wrap_stream_release)
+    _GSS_MECH_CALL (mech, wrap_stream_release) (*wrap_stream);
+
+  _gss_free (*wrap_stream);
+  *wrap_stream = GSS_C_NO_WRAP_STREAM;
+
+  return GSS_S_COMPLETE;
+}
@@ -22,7 +22,7 @@
 
 #include "internal.h"
 
-/* _gss_find_mech */
+/* _gss_mech_api_t */
 #include "meta.h"
 
 /**
@@ -78,7 +78,7 @@ gss_get_mic (OM_uint32 * minor_status,
       return GSS_S_NO_CONTEXT;
     }
 
-  mech = _gss_find_mech (context_handle->mech);
+  mech = context_handle->api;
   if (mech == NULL)
     {
       if (minor_status)
@@ -86,8 +86,8 @@ gss_get_mic (OM_uint32 * minor_status,
       return GSS_S_BAD_MECH;
     }
 
-  return mech->get_mic (minor_status, context_handle, qop_req,
-			message_buffer, message_token);
+  return _GSS_MECH_CALL (mech, get_mic) (minor_status, context_handle, qop_req,
+					 message_buffer, message_token);
 }
 
 /**
@@ -153,7 +153,7 @@ gss_verify_mic (OM_uint32 * minor_status,
       return GSS_S_NO_CONTEXT;
     }
 
-  mech = _gss_find_mech (context_handle->mech);
+  mech = context_handle->api;
   if (mech == NULL)
     {
       if (minor_status)
@@ -161,8 +161,9 @@ gss_verify_mic (OM_uint32 * minor_status,
       return GSS_S_BAD_MECH;
     }
 
-  return mech->verify_mic (minor_status, context_handle,
-			   message_buffer, token_buffer, qop_state);
+  return _GSS_MECH_CALL (mech, verify_mic) (minor_status, context_handle,
+					    message_buffer, token_buffer,
+					    qop_state);
 }
 
 /**
@@ -227,7 +228,7 @@ gss_wrap (OM_uint32 * minor_status,
       return GSS_S_NO_CONTEXT;
     }
 
-  mech = _gss_find_mech (context_handle->mech);
+  mech = context_handle->api;
   if (mech == NULL)
     {
       if (minor_status)
@@ -235,8 +236,10 @@ gss_wrap (OM_uint32 * minor_status,
       return GSS_S_BAD_MECH;
     }
 
-  return mech->wrap (minor_status, context_handle, conf_req_flag, qop_req,
-		     input_message_buffer, conf_state, output_message_buffer);
+  return _GSS_MECH_CALL (mech, wrap) (minor_status, context_handle,
+				      conf_req_flag, qop_req,
+				      input_message_buffer, conf_state,
+				      output_message_buffer);
 }
 
 /**
@@ -308,7 +311,7 @@ gss_unwrap (OM_uint32 * minor_status,
       return GSS_S_NO_CONTEXT;
     }
 
-  mech = _gss_find_mech (context_handle->mech);
+  mech = context_handle->api;
   if (mech == NULL)
     {
       if (minor_status)
@@ -316,6 +319,1449 @@ gss_unwrap (OM_uint32 * minor_status,
       return GSS_S_BAD_MECH;
     }
 
-  return mech->unwrap (minor_status, context_handle, input_message_buffer,
-		       output_message_buffer, conf_state, qop_state);
+  return _GSS_MECH_CALL (mech, unwrap) (minor_status, context_handle,
+					input_message_buffer,
+					output_message_buffer, conf_state,
+					qop_state);
+}
+
+/**
+ * gss_wrap_iov:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message will be sent.
+ * @conf_req_flag: (boolean, read) Non-zero - Both confidentiality and
+ *   integrity services are requested. Zero - Only integrity service is
+ *   requested.
+ * @qop_req: (gss_qop_t, read, optional) Specifies required quality of
+ *   protection.  A mechanism-specific default may be requested by
+ *   setting qop_req to GSS_C_QOP_DEFAULT.
+ * @conf_state: (boolean, modify, optional) Non-zero -
+ *   Confidentiality, data origin authentication and integrity
+ *   services have been applied. Zero - Integrity and data origin
+ *   services only has been applied.  Specify NULL if not required.
+ * @iov: (gss_iov_buffer_desc array, modify) Message buffers.
+ * @iov_count: (integer, read) Number of elements in @iov.
+ *
+ * Like gss_wrap(), but the message is described by an array of
+ * buffers and is protected in place.  Buffers of type
+ * `GSS_IOV_BUFFER_TYPE_DATA` hold the message and are encrypted in
+ * place when confidentiality is requested.  Buffers of type
+ * `GSS_IOV_BUFFER_TYPE_SIGN_ONLY` are integrity protected but
+ * neither encrypted nor part of the token.  The token header is
+ * written to the single `GSS_IOV_BUFFER_TYPE_HEADER` buffer, and the
+ * token trailer to the optional `GSS_IOV_BUFFER_TYPE_TRAILER`
+ * buffer; without a trailer buffer, the mechanism may place the
+ * trailer in the header buffer.  An optional
+ * `GSS_IOV_BUFFER_TYPE_PADDING` buffer receives any padding.
+ *
+ * The header, trailer and padding buffers must be large enough, see
+ * gss_wrap_iov_length().  Alternatively, set the
+ * `GSS_IOV_BUFFER_FLAG_ALLOCATE` flag on them and they will be
+ * allocated by the library; use gss_release_iov_buffer() to release
+ * them.
+ *
+ * The Kerberos V5 mechanism only implements this function for
+ * contexts with aes128-cts or aes256-cts session keys.  The RFC 1964
+ * tokens used with des-cbc-md5 and des3-cbc-sha1-kd keys cannot be
+ * split into buffers, so for them `GSS_S_UNAVAILABLE` is returned
+ * and gss_wrap() has to be used instead.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_CONTEXT_EXPIRED`: The context has already expired.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ *  valid context.
+ *
+ * `GSS_S_BAD_QOP`: The specified QOP is not supported by the
+ * mechanism.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_wrap_iov (OM_uint32 * minor_status,
+	      gss_ctx_id_t context_handle,
+	      int conf_req_flag,
+	      gss_qop_t qop_req,
+	      int *conf_state, gss_iov_buffer_desc * iov, int iov_count)
+{
+  _gss_mech_api_t mech;
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->wrap_iov == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, wrap_iov) (minor_status, context_handle,
+					  conf_req_flag, qop_req, conf_state,
+					  iov, iov_count);
+}
+
+/**
+ * gss_unwrap_iov:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message arrived.
+ * @conf_state: (boolean, modify, optional) Non-zero - Confidentiality
+ *   and integrity protection were used. Zero - Integrity service only
+ *   was used.  Specify NULL if not required.
+ * @qop_state: (gss_qop_t, modify, optional) Quality of protection
+ *   provided.  Specify NULL if not required.
+ * @iov: (gss_iov_buffer_desc array, modify) Message buffers.
+ * @iov_count: (integer, read) Number of elements in @iov.
+ *
+ * Like gss_unwrap(), but for a token described by an array of
+ * buffers laid out as by gss_wrap_iov().  The message is decrypted in
+ * place in the `GSS_IOV_BUFFER_TYPE_DATA` buffers, and the
+ * `GSS_IOV_BUFFER_TYPE_SIGN_ONLY` buffers must hold the same
+ * associated data as when the token was created.  If the token does
+ * not verify, the contents of the data buffers are undefined.  As
+ * with gss_wrap_iov(), the Kerberos V5 mechanism only implements this
+ * function for AES enctypes.  It accepts tokens with filler, but a
+ * token whose trailer was rotated into the header by anything but
+ * the trailer length cannot be split into buffers; it is rejected
+ * with `GSS_S_DEFECTIVE_TOKEN` and minor status
+ * `GSS_KRB5_S_KG_BAD_LENGTH`, and has to be passed to gss_unwrap()
+ * instead.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_DEFECTIVE_TOKEN`: The token failed consistency checks.
+ *
+ * `GSS_S_BAD_SIG`: The MIC was incorrect.
+ *
+ * `GSS_S_CONTEXT_EXPIRED`: The context has already expired.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_unwrap_iov (OM_uint32 * minor_status,
+		gss_ctx_id_t context_handle,
+		int *conf_state,
+		gss_qop_t * qop_state, gss_iov_buffer_desc * iov, int iov_count)
+{
+  _gss_mech_api_t mech;
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->unwrap_iov == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, unwrap_iov) (minor_status, context_handle,
+					    conf_state, qop_state, iov,
+					    iov_count);
+}
+
+/**
+ * gss_wrap_iov_length:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message will be sent.
+ * @conf_req_flag: (boolean, read) Whether confidentiality will be
+ *   requested from gss_wrap_iov().
+ * @qop_req: (gss_qop_t, read, optional) Quality of protection that
+ *   will be requested from gss_wrap_iov().
+ * @conf_state: (boolean, modify, optional) Whether confidentiality
+ *   would be applied.  Specify NULL if not required.
+ * @iov: (gss_iov_buffer_desc array, modify) Message buffers.
+ * @iov_count: (integer, read) Number of elements in @iov.
+ *
+ * Compute the sizes of the header, trailer and padding buffers that
+ * gss_wrap_iov() needs for the given data buffers.  The length field
+ * of each `GSS_IOV_BUFFER_TYPE_HEADER`, `GSS_IOV_BUFFER_TYPE_TRAILER`
+ * and `GSS_IOV_BUFFER_TYPE_PADDING` buffer is set, and no data is
+ * read or written.  Like gss_wrap_iov(), the Kerberos V5 mechanism
+ * only implements this function for AES enctypes.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ *  valid context.
+ *
+ * `GSS_S_BAD_QOP`: The specified QOP is not supported by the
+ * mechanism.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_wrap_iov_length (OM_uint32 * minor_status,
+		     gss_ctx_id_t context_handle,
+		     int conf_req_flag,
+		     gss_qop_t qop_req,
+		     int *conf_state, gss_iov_buffer_desc * iov, int iov_count)
+{
+  _gss_mech_api_t mech;
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->wrap_iov_length == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, wrap_iov_length) (minor_status, context_handle,
+						 conf_req_flag, qop_req,
+						 conf_state, iov, iov_count);
+}
+
+static OM_uint32
+mic_stream_init (OM_uint32 * minor_status,
+		 const gss_ctx_id_t context_handle,
+		 int verify, gss_qop_t qop_req, gss_mic_stream_t * mic_stream)
+{
+  _gss_mech_api_t mech;
+  gss_mic_stream_t stream;
+  OM_uint32 maj_stat;
+
+  if (!mic_stream)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_WRITE;
+    }
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->mic_init == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  stream = _gss_calloc (1, sizeof (*stream));
+  if (!stream)
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+  stream->mech = context_handle->mech;
+  stream->api = context_handle->api;
+  stream->verify = verify;
+
+  maj_stat = _GSS_MECH_CALL (mech, mic_init) (minor_status, context_handle,
+					      verify, qop_req, stream);
+  if (GSS_ERROR (maj_stat))
+    {
+      _gss_free (stream);
+      return maj_stat;
+    }
+
+  *mic_stream = stream;
+
+  return GSS_S_COMPLETE;
+}
+
+/**
+ * gss_get_mic_init:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message will be sent.
+ * @qop_req: (gss_qop_t, read, optional) Specifies requested quality
+ *   of protection.  Callers are encouraged, on portability grounds,
+ *   to accept the default quality of protection offered by the chosen
+ *   mechanism, which may be requested by specifying GSS_C_QOP_DEFAULT
+ *   for this parameter.
+ * @mic_stream: (gss_mic_stream_t, modify) Receives a handle for the
+ *   new MIC computation.
+ *
+ * Start computing a MIC token incrementally.  Feed the message to
+ * gss_mic_update(), in as many pieces as convenient, and retrieve
+ * the token with gss_get_mic_final().  The resulting token is
+ * identical to the one gss_get_mic() would have produced for the
+ * concatenation of the pieces, and may be verified with
+ * gss_verify_mic().  This avoids having to hold a large message in
+ * memory.
+ *
+ * The message sequence number is assigned when the token is
+ * produced, so other per-message calls on the context may be made
+ * while the stream is open.  The context must remain valid until the
+ * stream is finished or released.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_BAD_QOP`: The specified QOP is not supported by the
+ * mechanism.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_get_mic_init (OM_uint32 * minor_status,
+		  const gss_ctx_id_t context_handle,
+		  gss_qop_t qop_req, gss_mic_stream_t * mic_stream)
+{
+  return mic_stream_init (minor_status, context_handle, 0, qop_req,
+			  mic_stream);
+}
+
+/**
+ * gss_verify_mic_init:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message arrived.
+ * @mic_stream: (gss_mic_stream_t, modify) Receives a handle for the
+ *   new MIC verification.
+ *
+ * Start verifying a MIC token incrementally.  Feed the message to
+ * gss_mic_update(), in as many pieces as convenient, and check the
+ * token with gss_verify_mic_final().  Any token created by
+ * gss_get_mic() or gss_get_mic_final() can be verified this way.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_verify_mic_init (OM_uint32 * minor_status,
+		     const gss_ctx_id_t context_handle,
+		     gss_mic_stream_t * mic_stream)
+{
+  return mic_stream_init (minor_status, context_handle, 1,
+			  GSS_C_QOP_DEFAULT, mic_stream);
+}
+
+/**
+ * gss_mic_update:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @mic_stream: (gss_mic_stream_t, modify) MIC computation or
+ *   verification started by gss_get_mic_init() or
+ *   gss_verify_mic_init().
+ * @message_buffer: (buffer, opaque, read) Next piece of the message.
+ *
+ * Add the next piece of the message to a MIC computation or
+ * verification.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_CALL_INACCESSIBLE_READ`: The mic_stream or message_buffer
+ * parameter was not valid.
+ **/
+OM_uint32
+gss_mic_update (OM_uint32 * minor_status,
+		gss_mic_stream_t mic_stream, const gss_buffer_t message_buffer)
+{
+  _gss_mech_api_t mech;
+
+  if (!mic_stream || !message_buffer)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_READ;
+    }
+
+  mech = mic_stream->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  return _GSS_MECH_CALL (mech, mic_update) (minor_status, mic_stream,
+					    message_buffer);
+}
+
+static OM_uint32
+mic_stream_final (OM_uint32 * minor_status,
+		  gss_mic_stream_t * mic_stream, int verify,
+		  gss_buffer_t token_buffer, gss_qop_t * qop_state)
+{
+  _gss_mech_api_t mech;
+  OM_uint32 maj_stat;
+
+  if (!mic_stream || !*mic_stream)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_READ;
+    }
+
+  mech = (*mic_stream)->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if ((*mic_stream)->verify != verify)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      maj_stat = GSS_S_FAILURE;
+    }
+  else
+    maj_stat = _GSS_MECH_CALL (mech, mic_final) (minor_status, *mic_stream,
+						 token_buffer, qop_state);
+
+  _GSS_MECH_CALL (mech, mic_release) (*mic_stream);
+  _gss_free (*mic_stream);
+  *mic_stream = GSS_C_NO_MIC_STREAM;
+
+  return maj_stat;
+}
+
+/**
+ * gss_get_mic_final:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @mic_stream: (gss_mic_stream_t, modify) MIC computation started by
+ *   gss_get_mic_init().  Released and set to GSS_C_NO_MIC_STREAM on
+ *   return.
+ * @message_token: (buffer, opaque, modify) Buffer to receive token.
+ *   The application must free storage associated with this buffer
+ *   after use with a call to gss_release_buffer().
+ *
+ * Finish an incremental MIC computation and produce the MIC token
+ * for the message given to gss_mic_update().  The stream is released
+ * whether or not the call succeeds.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_CONTEXT_EXPIRED`: The context has already expired.
+ *
+ * `GSS_S_FAILURE`: The stream was not started by gss_get_mic_init().
+ *
+ * `GSS_S_CALL_INACCESSIBLE_READ`: The mic_stream parameter was not
+ * valid.
+ **/
+OM_uint32
+gss_get_mic_final (OM_uint32 * minor_status,
+		   gss_mic_stream_t * mic_stream, gss_buffer_t message_token)
+{
+  return mic_stream_final (minor_status, mic_stream, 0, message_token,
+			   NULL);
+}
+
+/**
+ * gss_verify_mic_final:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @mic_stream: (gss_mic_stream_t, modify) MIC verification started
+ *   by gss_verify_mic_init().  Released and set to
+ *   GSS_C_NO_MIC_STREAM on return.
+ * @token_buffer: (buffer, opaque, read) Token associated with
+ *   message.
+ * @qop_state: (gss_qop_t, modify, optional) Quality of protection
+ *   gained from MIC Specify NULL if not required.
+ *
+ * Finish an incremental MIC verification, checking that
+ * @token_buffer is a valid MIC for the message given to
+ * gss_mic_update().  Supplementary status and error codes are as for
+ * gss_verify_mic().  The stream is released whether or not the call
+ * succeeds.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Message was successfully verified.
+ *
+ * `GSS_S_DEFECTIVE_TOKEN`: The token failed consistency checks.
+ *
+ * `GSS_S_BAD_SIG`: The MIC was incorrect.
+ *
+ * `GSS_S_CONTEXT_EXPIRED`: The context has already expired.
+ *
+ * `GSS_S_FAILURE`: The stream was not started by
+ * gss_verify_mic_init().
+ *
+ * `GSS_S_CALL_INACCESSIBLE_READ`: The mic_stream parameter was not
+ * valid.
+ **/
+OM_uint32
+gss_verify_mic_final (OM_uint32 * minor_status,
+		      gss_mic_stream_t * mic_stream,
+		      const gss_buffer_t token_buffer, gss_qop_t * qop_state)
+{
+  return mic_stream_final (minor_status, mic_stream, 1, token_buffer,
+			   qop_state);
+}
+
+/**
+ * gss_wrap_into:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message will be sent.
+ * @conf_req_flag: (boolean, read) Non-zero - Both confidentiality and
+ *   integrity services are requested. Zero - Only integrity service is
+ *   requested.
+ * @qop_req: (gss_qop_t, read, optional) Specifies required quality of
+ *   protection.  A mechanism-specific default may be requested by
+ *   setting qop_req to GSS_C_QOP_DEFAULT.
+ * @input_message_buffer: (buffer, opaque, read) Message to be
+ *   protected.
+ * @conf_state: (boolean, modify, optional) Non-zero -
+ *   Confidentiality, data origin authentication and integrity
+ *   services have been applied. Zero - Integrity and data origin
+ *   services only has been applied.  Specify NULL if not required.
+ * @output_message_buffer: (buffer, opaque, modify) Buffer owned by
+ *   the caller to receive the protected message.  On input, the
+ *   length field holds the size of the buffer.
+ *
+ * Like gss_wrap(), but the token is written to memory provided by the
+ * caller instead of being allocated by the library.  On success, the
+ * length field of @output_message_buffer is set to the length of the
+ * token.  If the buffer is too small, nothing is written, the call
+ * fails with a minor status of `ERANGE`, and the length field is set
+ * to the size needed; no sequence number is used up in that case.
+ * The input and output buffers must not overlap.
+ *
+ * The size needed for a message can also be found with
+ * gss_wrap_iov_length(), and gss_wrap_size_limit() gives the largest
+ * message that fits a given buffer.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_CONTEXT_EXPIRED`: The context has already expired.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ *  valid context.
+ *
+ * `GSS_S_BAD_QOP`: The specified QOP is not supported by the
+ * mechanism.
+ *
+ * `GSS_S_FAILURE`: The output buffer is too small, or another failure
+ * occurred.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_wrap_into (OM_uint32 * minor_status,
+	       const gss_ctx_id_t context_handle,
+	       int conf_req_flag,
+	       gss_qop_t qop_req,
+	       const gss_buffer_t input_message_buffer,
+	       int *conf_state, gss_buffer_t output_message_buffer)
+{
+  _gss_mech_api_t mech;
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->wrap_into == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, wrap_into) (minor_status, context_handle,
+					   conf_req_flag, qop_req,
+					   input_message_buffer, conf_state,
+					   output_message_buffer);
+}
+
+/**
+ * gss_unwrap_into:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message arrived.
+ * @input_message_buffer: (buffer, opaque, read) Protected message.
+ * @output_message_buffer: (buffer, opaque, modify) Buffer owned by
+ *   the caller to receive the unwrapped message.  On input, the
+ *   length field holds the size of the buffer.
+ * @conf_state: (boolean, modify, optional) Non-zero - Confidentiality
+ *   and integrity protection were used. Zero - Integrity service only
+ *   was used.  Specify NULL if not required.
+ * @qop_state: (gss_qop_t, modify, optional) Quality of protection
+ *   provided.  Specify NULL if not required.
+ *
+ * Like gss_unwrap(), but the message is written to memory provided by
+ * the caller instead of being allocated by the library.  On success,
+ * the length field of @output_message_buffer is set to the length of
+ * the message.  If the buffer is too small, the token is not
+ * processed, the call fails with a minor status of `ERANGE`, and the
+ * length field is set to the size needed.  A buffer as large as the
+ * token is always sufficient.  The input and output buffers must not
+ * overlap.
+ *
+ * Supplementary status codes are as for gss_unwrap().
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_DEFECTIVE_TOKEN`: The token failed consistency checks.
+ *
+ * `GSS_S_BAD_SIG`: The MIC was incorrect.
+ *
+ * `GSS_S_CONTEXT_EXPIRED`: The context has already expired.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_FAILURE`: The output buffer is too small, or another failure
+ * occurred.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_unwrap_into (OM_uint32 * minor_status,
+		 const gss_ctx_id_t context_handle,
+		 const gss_buffer_t input_message_buffer,
+		 gss_buffer_t output_message_buffer,
+		 int *conf_state, gss_qop_t * qop_state)
+{
+  _gss_mech_api_t mech;
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->unwrap_into == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, unwrap_into) (minor_status, context_handle,
+					     input_message_buffer,
+					     output_message_buffer, conf_state,
+					     qop_state);
+}
+
+/**
+ * gss_get_mic_into:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message will be sent.
+ * @qop_req: (gss_qop_t, read, optional) Specifies requested quality
+ *   of protection.  Specify GSS_C_QOP_DEFAULT for the default.
+ * @message_buffer: (buffer, opaque, read) Message to be protected.
+ * @message_token: (buffer, opaque, modify) Buffer owned by the caller
+ *   to receive the token.  On input, the length field holds the size
+ *   of the buffer.
+ *
+ * Like gss_get_mic(), but the token is written to memory provided by
+ * the caller instead of being allocated by the library.  On success,
+ * the length field of @message_token is set to the length of the
+ * token.  If the buffer is too small, the call fails with a minor
+ * status of `ERANGE`, and the length field is set to the size
+ * needed.  MIC tokens of a context all have the same size.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_CONTEXT_EXPIRED`: The context has already expired.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_BAD_QOP`: The specified QOP is not supported by the
+ * mechanism.
+ *
+ * `GSS_S_FAILURE`: The output buffer is too small, or another failure
+ * occurred.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_get_mic_into (OM_uint32 * minor_status,
+		  const gss_ctx_id_t context_handle,
+		  gss_qop_t qop_req,
+		  const gss_buffer_t message_buffer,
+		  gss_buffer_t message_token)
+{
+  _gss_mech_api_t mech;
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->get_mic_into == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, get_mic_into) (minor_status, context_handle,
+					      qop_req, message_buffer,
+					      message_token);
+}
+
+/**
+ * gss_unwrap_inplace:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message arrived.
+ * @message_buffer: (buffer, opaque, modify) Protected message, which
+ *   is overwritten.
+ * @offset: (size_t, modify) Position of the unwrapped message in
+ *   @message_buffer.
+ * @length: (size_t, modify) Length of the unwrapped message.
+ * @conf_state: (boolean, modify, optional) Non-zero - Confidentiality
+ *   and integrity protection were used. Zero - Integrity service only
+ *   was used.  Specify NULL if not required.
+ * @qop_state: (gss_qop_t, modify, optional) Quality of protection
+ *   provided.  Specify NULL if not required.
+ *
+ * Like gss_unwrap(), but the message is decrypted and verified inside
+ * @message_buffer instead of being copied to a new buffer.  On
+ * success, the message is the @length bytes at @offset bytes into
+ * the value of @message_buffer.  The rest of the buffer is left in an
+ * unspecified state, and the contents of the buffer are unspecified
+ * if the call fails.
+ *
+ * Supplementary status codes are as for gss_unwrap().
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_DEFECTIVE_TOKEN`: The token failed consistency checks.
+ *
+ * `GSS_S_BAD_SIG`: The MIC was incorrect.
+ *
+ * `GSS_S_CONTEXT_EXPIRED`: The context has already expired.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_FAILURE`: Failure, see @minor_status for more information.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_unwrap_inplace (OM_uint32 * minor_status,
+		    const gss_ctx_id_t context_handle,
+		    gss_buffer_t message_buffer,
+		    size_t * offset, size_t * length,
+		    int *conf_state, gss_qop_t * qop_state)
+{
+  _gss_mech_api_t mech;
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->unwrap_inplace == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, unwrap_inplace) (minor_status, context_handle,
+						message_buffer, offset, length,
+						conf_state, qop_state);
+}
+
+static OM_uint32
+wrap_stream_init (OM_uint32 * minor_status,
+		  const gss_ctx_id_t context_handle, int unwrap,
+		  int conf_req_flag, gss_qop_t qop_req, int *conf_state,
+		  gss_wrap_stream_t * wrap_stream)
+{
+  _gss_mech_api_t mech;
+  gss_wrap_stream_t stream;
+  OM_uint32 maj_stat;
+
+  if (!wrap_stream)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_WRITE;
+    }
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->wrap_stream_init == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  stream = _gss_calloc (1, sizeof (*stream));
+  if (!stream)
+    {
+      if (minor_status)
+	*minor_status = ENOMEM;
+      return GSS_S_FAILURE;
+    }
+  stream->mech = context_handle->mech;
+  stream->api = context_handle->api;
+  stream->unwrap = unwrap;
+
+  maj_stat = _GSS_MECH_CALL (mech, wrap_stream_init) (minor_status,
+						      context_handle, unwrap,
+						      conf_req_flag, qop_req,
+						      conf_state, stream);
+  if (GSS_ERROR (maj_stat))
+    {
+      _gss_free (stream);
+      return maj_stat;
+    }
+
+  *wrap_stream = stream;
+
+  return GSS_S_COMPLETE;
+}
+
+/**
+ * gss_wrap_init:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message will be sent.
+ * @conf_req_flag: (boolean, read) Whether confidentiality is
+ *   requested.
+ * @qop_req: (gss_qop_t, read, optional) Specifies required quality of
+ *   protection.  A mechanism-specific default may be requested by
+ *   setting qop_req to GSS_C_QOP_DEFAULT.
+ * @conf_state: (boolean, modify, optional) Non-zero if
+ *   confidentiality services will be applied.  Specify NULL if not
+ *   required.
+ * @wrap_stream: (gss_wrap_stream_t, modify) Receives a handle for the
+ *   new token.
+ *
+ * Start producing a wrap token for a message that is not available
+ * all at once.  Give the message to gss_wrap_update(), in as many
+ * pieces as convenient, and send each output piece in turn; the
+ * remainder of the token comes from gss_wrap_final().  The
+ * concatenated output is a single token, which may be processed with
+ * gss_unwrap() or gss_unwrap_init().  Only a bounded amount of the
+ * message is held by the stream, whatever its size.
+ *
+ * The message sequence number is assigned by this call, so other
+ * per-message calls on the context may be made while the stream is
+ * open.  The context must remain valid until the stream is finished
+ * or released.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_BAD_QOP`: The specified QOP is not supported by the
+ * mechanism.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function
+ * for the context.
+ **/
+OM_uint32
+gss_wrap_init (OM_uint32 * minor_status,
+	       const gss_ctx_id_t context_handle,
+	       int conf_req_flag, gss_qop_t qop_req, int *conf_state,
+	       gss_wrap_stream_t * wrap_stream)
+{
+  return wrap_stream_init (minor_status, context_handle, 0, conf_req_flag,
+			   qop_req, conf_state, wrap_stream);
+}
+
+/**
+ * gss_unwrap_init:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the message arrived.
+ * @wrap_stream: (gss_wrap_stream_t, modify) Receives a handle for the
+ *   new token.
+ *
+ * Start processing a wrap token that is not available all at once.
+ * Give the token to gss_wrap_update(), in as many pieces as
+ * convenient, and finish with gss_unwrap_final().  Tokens created by
+ * gss_wrap() or gss_wrap_init() can be unwrapped this way.
+ *
+ * The message pieces returned by gss_wrap_update() have not been
+ * verified yet, and must not be acted upon until gss_unwrap_final()
+ * has returned successfully.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function
+ * for the context.
+ **/
+OM_uint32
+gss_unwrap_init (OM_uint32 * minor_status,
+		 const gss_ctx_id_t context_handle,
+		 gss_wrap_stream_t * wrap_stream)
+{
+  return wrap_stream_init (minor_status, context_handle, 1, 0,
+			   GSS_C_QOP_DEFAULT, NULL, wrap_stream);
+}
+
+/**
+ * gss_wrap_update:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @wrap_stream: (gss_wrap_stream_t, modify) Token started by
+ *   gss_wrap_init() or gss_unwrap_init().
+ * @input_buffer: (buffer, opaque, read) Next piece of the message
+ *   or token.
+ * @output_buffer: (buffer, opaque, modify) Buffer to receive the
+ *   next piece of the token or message, which may be empty.  The
+ *   application must free storage associated with this buffer after
+ *   use with a call to gss_release_buffer().
+ *
+ * Add the next piece of the message to a token being produced, or
+ * the next piece of a token to a message being unwrapped.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_DEFECTIVE_TOKEN`: The token header failed consistency
+ * checks.
+ *
+ * `GSS_S_CALL_INACCESSIBLE_READ`: The wrap_stream or input_buffer
+ * parameter was not valid.
+ **/
+OM_uint32
+gss_wrap_update (OM_uint32 * minor_status,
+		 gss_wrap_stream_t wrap_stream,
+		 const gss_buffer_t input_buffer, gss_buffer_t output_buffer)
+{
+  _gss_mech_api_t mech;
+
+  if (!wrap_stream || !input_buffer)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_READ;
+    }
+
+  if (!output_buffer)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_WRITE;
+    }
+
+  mech = wrap_stream->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  return _GSS_MECH_CALL (mech, wrap_stream_update) (minor_status, wrap_stream,
+						    input_buffer,
+						    output_buffer);
+}
+
+static OM_uint32
+wrap_stream_final (OM_uint32 * minor_status,
+		   gss_wrap_stream_t * wrap_stream, int unwrap,
+		   gss_buffer_t output_buffer, int *conf_state,
+		   gss_qop_t * qop_state)
+{
+  _gss_mech_api_t mech;
+  OM_uint32 maj_stat;
+
+  if (!wrap_stream || !*wrap_stream)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_READ;
+    }
+
+  if (!output_buffer)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_WRITE;
+    }
+
+  mech = (*wrap_stream)->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if ((*wrap_stream)->unwrap != unwrap)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      maj_stat = GSS_S_FAILURE;
+    }
+  else
+    maj_stat = _GSS_MECH_CALL (mech, wrap_stream_final) (minor_status,
+							 *wrap_stream,
+							 output_buffer,
+							 conf_state,
+							 qop_state);
+
+  _GSS_MECH_CALL (mech, wrap_stream_release) (*wrap_stream);
+  _gss_free (*wrap_stream);
+  *wrap_stream = GSS_C_NO_WRAP_STREAM;
+
+  return maj_stat;
+}
+
+/**
+ * gss_wrap_final:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @wrap_stream: (gss_wrap_stream_t, modify) Token started by
+ *   gss_wrap_init().  Released and set to GSS_C_NO_WRAP_STREAM on
+ *   return.
+ * @output_buffer: (buffer, opaque, modify) Buffer to receive the end
+ *   of the token.  The application must free storage associated with
+ *   this buffer after use with a call to gss_release_buffer().
+ *
+ * Finish a token started by gss_wrap_init(), once the whole message
+ * has been given to gss_wrap_update().  The stream is released
+ * whether or not the call succeeds.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_FAILURE`: The stream was not started by gss_wrap_init().
+ *
+ * `GSS_S_CALL_INACCESSIBLE_READ`: The wrap_stream parameter was not
+ * valid.
+ **/
+OM_uint32
+gss_wrap_final (OM_uint32 * minor_status,
+		gss_wrap_stream_t * wrap_stream, gss_buffer_t output_buffer)
+{
+  return wrap_stream_final (minor_status, wrap_stream, 0, output_buffer,
+			    NULL, NULL);
+}
+
+/**
+ * gss_unwrap_final:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @wrap_stream: (gss_wrap_stream_t, modify) Token started by
+ *   gss_unwrap_init().  Released and set to GSS_C_NO_WRAP_STREAM on
+ *   return.
+ * @output_buffer: (buffer, opaque, modify) Buffer to receive the end
+ *   of the message.  The application must free storage associated
+ *   with this buffer after use with a call to gss_release_buffer().
+ * @conf_state: (boolean, modify, optional) Non-zero - Confidentiality
+ *   and integrity protection were used. Zero - Integrity service only
+ *   was used.  Specify NULL if not required.
+ * @qop_state: (gss_qop_t, modify, optional) Quality of protection
+ *   provided.  Specify NULL if not required.
+ *
+ * Finish unwrapping a token, once all of it has been given to
+ * gss_wrap_update(), and verify it.  Only when this call succeeds may
+ * the message pieces returned for the token be trusted.
+ * Supplementary status and error codes are as for gss_unwrap().  The
+ * stream is released whether or not the call succeeds.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_DEFECTIVE_TOKEN`: The token failed consistency checks.
+ *
+ * `GSS_S_BAD_SIG`: The MIC was incorrect.
+ *
+ * `GSS_S_FAILURE`: The stream was not started by gss_unwrap_init().
+ *
+ * `GSS_S_CALL_INACCESSIBLE_READ`: The wrap_stream parameter was not
+ * valid.
+ **/
+OM_uint32
+gss_unwrap_final (OM_uint32 * minor_status,
+		  gss_wrap_stream_t * wrap_stream,
+		  gss_buffer_t output_buffer,
+		  int *conf_state, gss_qop_t * qop_state)
+{
+  return wrap_stream_final (minor_status, wrap_stream, 1, output_buffer,
+			    conf_state, qop_state);
+}
+
+/**
+ * gss_wrap_batch:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the messages will be sent.
+ * @conf_req_flag: (boolean, read) Whether confidentiality is
+ *   requested.
+ * @qop_req: (gss_qop_t, read, optional) Specifies required quality of
+ *   protection.  A mechanism-specific default may be requested by
+ *   setting qop_req to GSS_C_QOP_DEFAULT.
+ * @count: (size_t, read) Number of messages.
+ * @input_message_buffers: (buffer array, opaque, read) The @count
+ *   messages to be protected.
+ * @conf_state: (boolean, modify, optional) Non-zero if
+ *   confidentiality services were applied.  Specify NULL if not
+ *   required.
+ * @output_message_buffers: (buffer array, opaque, modify) Array of
+ *   @count buffers to receive the tokens, in the order of the
+ *   messages.  They point into @output_arena and must not be
+ *   released on their own.
+ * @output_arena: (buffer, opaque, modify) Buffer to receive the
+ *   storage holding all tokens.  The application must free it after
+ *   use with a call to gss_release_buffer().
+ *
+ * Like calling gss_wrap() for each of @count messages in turn, but
+ * the mechanism is looked up once and all tokens share one
+ * allocation.  The tokens use consecutive sequence numbers.  On
+ * failure no token is produced.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: Successful completion.
+ *
+ * `GSS_S_CONTEXT_EXPIRED`: The context has already expired.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_BAD_QOP`: The specified QOP is not supported by the
+ * mechanism.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_wrap_batch (OM_uint32 * minor_status,
+		const gss_ctx_id_t context_handle,
+		int conf_req_flag,
+		gss_qop_t qop_req,
+		size_t count,
+		gss_buffer_desc * input_message_buffers,
+		int *conf_state,
+		gss_buffer_desc * output_message_buffers,
+		gss_buffer_t output_arena)
+{
+  _gss_mech_api_t mech;
+
+  if (count && !input_message_buffers)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_READ;
+    }
+
+  if ((count && !output_message_buffers) || !output_arena)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_WRITE;
+    }
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->wrap_batch == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, wrap_batch) (minor_status, context_handle,
+					    conf_req_flag, qop_req, count,
+					    input_message_buffers, conf_state,
+					    output_message_buffers,
+					    output_arena);
+}
+
+/**
+ * gss_unwrap_batch:
+ * @minor_status: (Integer, modify) Mechanism specific status code.
+ * @context_handle: (gss_ctx_id_t, read) Identifies the context on
+ *   which the messages arrived.
+ * @count: (size_t, read) Number of tokens.
+ * @input_message_buffers: (buffer array, opaque, read) The @count
+ *   protected messages.
+ * @output_message_buffers: (buffer array, opaque, modify) Array of
+ *   @count buffers to receive the unwrapped messages.  They point
+ *   into @output_arena and must not be released on their own.
+ * @message_statuses: (Integer array, modify) Array of @count major
+ *   status codes, receiving the outcome for each token as
+ *   gss_unwrap() would have returned it.
+ * @conf_states: (boolean array, modify, optional) Array of @count
+ *   flags, each non-zero if confidentiality protection was used for
+ *   the message.  Specify NULL if not required.
+ * @output_arena: (buffer, opaque, modify) Buffer to receive the
+ *   storage holding all messages.  The application must free it
+ *   after use with a call to gss_release_buffer().
+ *
+ * Like calling gss_unwrap() for each of @count tokens in turn, but
+ * the mechanism is looked up once and all messages share one
+ * allocation.  A token that fails to unwrap does not affect the
+ * others; its entry in @message_statuses holds the error and its
+ * output buffer is empty.
+ *
+ * WARNING: This function is a GNU GSS specific extension, and is not
+ * part of the official GSS API.
+ *
+ * Return value:
+ *
+ * `GSS_S_COMPLETE`: The tokens were processed, see
+ * @message_statuses for the result of each.
+ *
+ * `GSS_S_NO_CONTEXT`: The context_handle parameter did not identify a
+ * valid context.
+ *
+ * `GSS_S_UNAVAILABLE`: The mechanism does not support this function.
+ **/
+OM_uint32
+gss_unwrap_batch (OM_uint32 * minor_status,
+		  const gss_ctx_id_t context_handle,
+		  size_t count,
+		  gss_buffer_desc * input_message_buffers,
+		  gss_buffer_desc * output_message_buffers,
+		  OM_uint32 * message_statuses,
+		  int *conf_states, gss_buffer_t output_arena)
+{
+  _gss_mech_api_t mech;
+
+  if (count && !input_message_buffers)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_READ;
+    }
+
+  if ((count && (!output_message_buffers || !message_statuses))
+      || !output_arena)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_CALL_INACCESSIBLE_WRITE;
+    }
+
+  if (!context_handle)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_NO_CONTEXT;
+    }
+
+  mech = context_handle->api;
+  if (mech == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_BAD_MECH;
+    }
+
+  if (mech->unwrap_batch == NULL)
+    {
+      if (minor_status)
+	*minor_status = 0;
+      return GSS_S_UNAVAILABLE;
+    }
+
+  return _GSS_MECH_CALL (mech, unwrap_batch) (minor_status, context_handle,
+					      count, input_message_buffers,
+					      output_message_buffers,
+					      message_statuses, conf_states,
+					      output_arena);
 }
@@ -71,7 +71,7 @@ gss_import_name (OM_uint32 * minor_status,
       return GSS_S_BAD_NAME | GSS_S_CALL_INACCESSIBLE_WRITE;
     }
 
-  *output_name = malloc (sizeof (**output_name));
+  *output_name = _gss_malloc (sizeof (**output_name));
   if (!*output_name)
     {
       if (minor_status)
@@ -79,10 +79,10 @@ gss_import_name (OM_uint32 * minor_status,
       return GSS_S_FAILURE;
     }
   (*output_name)->length = input_name_buffer->length;
-  (*output_name)->value = malloc (input_name_buffer->length);
+  (*output_name)->value = _gss_malloc (input_name_buffer->length);
   if (!(*output_name)->value)
     {
-      free (*output_name);
+      _gss_free (*output_name);
       if (minor_status)
 	*minor_status = ENOMEM;
       return GSS_S_FAILURE;
@@ -144,7 +144,7 @@ gss_display_name (OM_uint32 * minor_status,
     }
 
   output_name_buffer->length = input_name->length;
-  output_name_buffer->value = malloc (input_name->length + 1);
+  output_name_buffer->value = _gss_malloc (input_name->length + 1);
   if (!output_name_buffer->value)
     {
       if (minor_status)
@@ -234,9 +234,9 @@ gss_release_name (OM_uint32 * minor_status, gss_name_t * name)
   if (*name != GSS_C_NO_NAME)
     {
       if ((*name)->value)
-	free ((*name)->value);
+	_gss_free ((*name)->value);
 
-      free (*name);
+      _gss_free (*name);
       *name = GSS_C_NO_NAME;
     }
 
@@ -496,7 +496,8 @@ gss_export_name (OM_uint32 * minor_status,
       return GSS_S_BAD_MECH;
     }
 
-  return mech->export_name (minor_status, input_name, exported_name);
+  return _GSS_MECH_CALL (mech, export_name) (minor_status, input_name,
+					     exported_name);
 }
 
 /**
@@ -538,8 +539,8 @@ gss_canonicalize_name (OM_uint32 * minor_status,
       return GSS_S_BAD_MECH;
     }
 
-  return mech->canonicalize_name (minor_status, input_name,
-				  mech_type, output_name);
+  return _GSS_MECH_CALL (mech, canonicalize_name) (minor_status, input_name,
+						   mech_type, output_name);
 }
 
 /**
@@ -579,7 +580,7 @@ gss_duplicate_name (OM_uint32 * minor_status,
       return GSS_S_FAILURE | GSS_S_CALL_INACCESSIBLE_WRITE;
     }
 
-  *dest_name = malloc (sizeof (**dest_name));
+  *dest_name = _gss_malloc (sizeof (**dest_name));
   if (!*dest_name)
     {
       if (minor_status)
@@ -588,10 +589,10 @@ gss_duplicate_name (OM_uint32 * minor_status,
     }
   (*dest_name)->type = src_name->type;
   (*dest_name)->length = src_name->length;
-  (*dest_name)->value = malloc (src_name->length + 1);
+  (*dest_name)->value = _gss_malloc (src_name->length + 1);
   if (!(*dest_name)->value)
     {
-      free (*dest_name);
+      _gss_free (*dest_name);
       if (minor_status)
 	*minor_status = ENOMEM;
       return GSS_S_FAILURE;
@@ -33,9 +33,9 @@ dup_data (OM_uint32 * minor_status,
     return GSS_S_COMPLETE;
 
   if (translate)
-    out->value = strdup (_(str));
+    out->value = _gss_strdup (_(str));
   else
-    out->value = strdup (str);
+    out->value = _gss_strdup (str);
   if (!out->value)
     {
       if (minor_status)
@@ -106,16 +106,16 @@ gss_inquire_saslname_for_mech (OM_uint32 * minor_status,
   if (dup_data (minor_status, mech_name, m->mech_name, 0) != GSS_S_COMPLETE)
     {
       if (sasl_mech_name)
-	free (sasl_mech_name->value);
+	_gss_free (sasl_mech_name->value);
       return GSS_S_FAILURE;
     }
   if (dup_data (minor_status, mech_description,
 		m->mech_description, 1) != GSS_S_COMPLETE)
     {
       if (sasl_mech_name)
-	free (sasl_mech_name->value);
+	_gss_free (sasl_mech_name->value);
       if (mech_name)
-	free (mech_name->value);
+	_gss_free (mech_name->value);
       return GSS_S_FAILURE;
     }
 
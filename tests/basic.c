@@ -33,11 +33,40 @@
 
 #include "utils.c"
 
+/* Allocator that keeps track of the number of live objects. */
+static long live_allocations;
+
+static void *
+test_malloc (size_t size)
+{
+  void *p = malloc (size);
+  if (p)
+    live_allocations++;
+  return p;
+}
+
+static void *
+test_realloc (void *ptr, size_t size)
+{
+  void *p = realloc (ptr, size);
+  if (p && !ptr)
+    live_allocations++;
+  return p;
+}
+
+static void
+test_free (void *ptr)
+{
+  if (ptr)
+    live_allocations--;
+  free (ptr);
+}
+
 int
 main (int argc, char *argv[])
 {
   gss_uint32 maj_stat, min_stat, msgctx;
-  gss_buffer_desc bufdesc, bufdesc2;
+  gss_buffer_desc bufdesc, bufdesc2, view;
   gss_name_t service;
   gss_OID_set oids;
   int n;
@@ -59,6 +88,13 @@ main (int argc, char *argv[])
       }
   while (argc-- > 1);
 
+  maj_stat = gss_set_allocator (&min_stat, test_malloc, test_realloc,
+				test_free);
+  if (maj_stat == GSS_S_COMPLETE)
+    success ("gss_set_allocator() OK\n");
+  else
+    fail ("gss_set_allocator() failed (%d,%d)\n", maj_stat, min_stat);
+
   /* OID set tests */
   oids = GSS_C_NO_OID_SET;
   maj_stat = gss_create_empty_oid_set (&min_stat, &oids);
@@ -391,6 +427,23 @@ main (int argc, char *argv[])
   else
     fail ("gss_decapsulate_token() failed (%d)\n", maj_stat);
 
+  maj_stat = gss_decapsulate_token_view (&bufdesc2, GSS_C_NT_USER_NAME,
+					 &view);
+  if (maj_stat == GSS_S_COMPLETE && view.length == bufdesc.length
+      && (char *) view.value + view.length
+      == (char *) bufdesc2.value + bufdesc2.length
+      && memcmp (view.value, bufdesc.value, view.length) == 0)
+    success ("gss_decapsulate_token_view() OK\n");
+  else
+    fail ("gss_decapsulate_token_view() failed (%d)\n", maj_stat);
+
+  maj_stat = gss_decapsulate_token_view (&bufdesc2, GSS_C_NT_ANONYMOUS,
+					 &view);
+  if (maj_stat == GSS_S_DEFECTIVE_TOKEN)
+    success ("gss_decapsulate_token_view(bad oid) OK\n");
+  else
+    fail ("gss_decapsulate_token_view() failed (%d)\n", maj_stat);
+
   maj_stat = gss_release_buffer (&min_stat, &bufdesc);
   if (maj_stat == GSS_S_COMPLETE)
     success ("gss_release_buffer() OK\n");
@@ -403,6 +456,19 @@ main (int argc, char *argv[])
   else
     fail ("gss_release_buffer() failed (%d,%d)\n", maj_stat, min_stat);
 
+  /* Everything allocated through the hooks has been released. */
+  if (live_allocations == 0)
+    success ("gss_set_allocator() OK\n");
+  else
+    fail ("gss_set_allocator() failed (%ld objects live)\n",
+	  live_allocations);
+
+  maj_stat = gss_set_allocator (&min_stat, NULL, NULL, NULL);
+  if (maj_stat == GSS_S_COMPLETE)
+    success ("gss_set_allocator() OK\n");
+  else
+    fail ("gss_set_allocator() failed (%d,%d)\n", maj_stat, min_stat);
+
   if (debug)
     printf ("Basic self tests done with %d errors\n", error_count);
 
@@ -0,0 +1,622 @@
+/* krb5async.c --- Test of asynchronous Kerberos 5 context initiation.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+
+/* Get GSS prototypes. */
+#include <gss.h>
+
+/* Get Shishi prototypes. */
+#include <shishi.h>
+
+#include "utils.c"
+
+#if defined HAVE_PTHREAD_H && defined HAVE_PIPE
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define CONFIG "krb5async.conf"
+#define REALM "JOSEFSSON.ORG"
+
+/* Stand-in KDCs.  Shishi is pointed at the second one to tell new
+   Shishi handles from pooled ones. */
+#define KDCS 2
+
+static void
+display_status_1 (const char *m, OM_uint32 code, int type)
+{
+  OM_uint32 maj_stat, min_stat;
+  gss_buffer_desc msg;
+  OM_uint32 msg_ctx;
+
+  msg_ctx = 0;
+  do
+    {
+      maj_stat = gss_display_status (&min_stat, code,
+				     type, GSS_C_NO_OID, &msg_ctx, &msg);
+      if (GSS_ERROR (maj_stat))
+	printf ("GSS-API display_status failed on code %d type %d\n",
+		code, type);
+      else
+	{
+	  printf ("GSS-API error %s (%s): %.*s\n",
+		  m, type == GSS_C_GSS_CODE ? "major" : "minor",
+		  (int) msg.length, (char *) msg.value);
+
+	  gss_release_buffer (&min_stat, &msg);
+	}
+    }
+  while (!GSS_ERROR (maj_stat) && msg_ctx);
+}
+
+static void
+display_status (const char *msg, OM_uint32 maj_stat, OM_uint32 min_stat)
+{
+  display_status_1 (msg, maj_stat, GSS_C_GSS_CODE);
+  display_status_1 (msg, min_stat, GSS_C_MECH_CODE);
+}
+
+/* The stand-in KDC answers every request with a KRB-ERROR saying
+   that the principal is unknown.  It is served from the main thread,
+   between calls to gss_init_sec_context_async, so the library must
+   not wait for it inside the call. */
+static int
+kdc_reply (Shishi * handle, int kdc)
+{
+  const char *sname[] = { "krbtgt", REALM, NULL };
+  struct sockaddr_in from;
+  socklen_t fromlen = sizeof (from);
+  Shishi_asn1 krberror;
+  char buf[4096];
+  char *der;
+  size_t derlen;
+  ssize_t len;
+  int rc;
+
+  len = recvfrom (kdc, buf, sizeof (buf), 0,
+		  (struct sockaddr *) &from, &fromlen);
+  if (len <= 0)
+    return -1;
+
+  krberror = shishi_krberror (handle);
+  if (!krberror)
+    return -1;
+  rc = shishi_krberror_set_realm (handle, krberror, REALM);
+  if (rc == SHISHI_OK)
+    rc = shishi_krberror_set_sname (handle, krberror, SHISHI_NT_SRV_INST,
+				    sname);
+  if (rc == SHISHI_OK)
+    rc = shishi_krberror_errorcode_set (handle, krberror,
+					SHISHI_KDC_ERR_S_PRINCIPAL_UNKNOWN);
+  if (rc == SHISHI_OK)
+    rc = shishi_krberror_der (handle, krberror, &der, &derlen);
+  shishi_asn1_done (handle, krberror);
+  if (rc != SHISHI_OK)
+    return -1;
+
+  len = sendto (kdc, der, derlen, 0, (struct sockaddr *) &from, fromlen);
+  free (der);
+
+  return len == (ssize_t) derlen ? 0 : -1;
+}
+
+/* Point Shishi at the stand-in KDC listening on PORT.  Returns 0 on
+   success. */
+static int
+write_config (int port)
+{
+  FILE *fh;
+
+  fh = fopen (CONFIG, "w");
+  if (!fh)
+    return -1;
+  fprintf (fh, "default-realm=%s\n"
+	   "realm-kdc=%s,127.0.0.1:%d\n", REALM, REALM, port);
+  return fclose (fh);
+}
+
+/* Start or continue initiating *CTX to SERVERNAME. */
+static OM_uint32
+init_async (OM_uint32 * minor_status, gss_name_t servername,
+	    gss_ctx_id_t * ctx, int *wait_fd)
+{
+  gss_buffer_desc bufdesc;
+  OM_uint32 maj_stat, min_stat;
+
+  maj_stat = gss_init_sec_context_async (minor_status,
+					 GSS_C_NO_CREDENTIAL,
+					 ctx,
+					 servername,
+					 GSS_KRB5,
+					 GSS_C_MUTUAL_FLAG,
+					 0,
+					 GSS_C_NO_CHANNEL_BINDINGS,
+					 GSS_C_NO_BUFFER, NULL,
+					 &bufdesc, NULL, NULL, wait_fd);
+  if (!GSS_ERROR (maj_stat) && bufdesc.length != 0)
+    {
+      fail ("gss_init_sec_context_async() returned a token\n");
+      gss_release_buffer (&min_stat, &bufdesc);
+    }
+
+  return maj_stat;
+}
+
+/* Answer the stand-in KDCs until each of the NWAIT descriptors in
+   WAIT_FD is readable, and count the requests that each KDC received
+   meanwhile in REQUESTS.  Returns 0 if all became readable. */
+static int
+serve (Shishi * handle, const int *kdc, int *requests,
+       const int *wait_fd, size_t nwait)
+{
+  struct pollfd pfd[KDCS + 2];
+  size_t i, ready;
+
+  for (i = 0; i < KDCS; i++)
+    {
+      pfd[i].fd = kdc[i];
+      pfd[i].events = POLLIN;
+      requests[i] = 0;
+    }
+  for (i = 0; i < nwait; i++)
+    {
+      pfd[KDCS + i].fd = wait_fd[i];
+      pfd[KDCS + i].events = POLLIN;
+    }
+
+  ready = 0;
+  while (ready < nwait && poll (pfd, KDCS + nwait, 30000) > 0)
+    for (i = 0; i < KDCS + nwait; i++)
+      if (!(pfd[i].revents & POLLIN))
+	continue;
+      else if (i < KDCS)
+	{
+	  if (kdc_reply (handle, kdc[i]) != 0)
+	    fail ("stand-in KDC failed to reply\n");
+	  requests[i]++;
+	}
+      else
+	{
+	  /* It stays readable, so stop watching it. */
+	  pfd[i].fd = -1;
+	  ready++;
+	}
+
+  return ready == nwait ? 0 : -1;
+}
+
+/* Answer the stand-in KDCs until none received a request for QUIET
+   milliseconds, and return how many requests they received. */
+static int
+serve_quiet (Shishi * handle, const int *kdc, int quiet)
+{
+  struct pollfd pfd[KDCS];
+  int i, requests = 0;
+
+  for (i = 0; i < KDCS; i++)
+    {
+      pfd[i].fd = kdc[i];
+      pfd[i].events = POLLIN;
+    }
+
+  while (poll (pfd, KDCS, quiet) > 0)
+    for (i = 0; i < KDCS; i++)
+      if (pfd[i].revents & POLLIN)
+	{
+	  if (kdc_reply (handle, kdc[i]) != 0)
+	    fail ("stand-in KDC failed to reply\n");
+	  requests++;
+	}
+
+  return requests;
+}
+
+/* Establish a context to SERVERNAME with a ticket that is at hand,
+   and delete it again.  Returns 0 on success. */
+static int
+init_sync (gss_name_t servername)
+{
+  gss_ctx_id_t ctx = GSS_C_NO_CONTEXT;
+  gss_buffer_desc bufdesc;
+  OM_uint32 maj_stat, min_stat;
+
+  maj_stat = gss_init_sec_context (&min_stat,
+				   GSS_C_NO_CREDENTIAL,
+				   &ctx,
+				   servername,
+				   GSS_KRB5,
+				   GSS_C_MUTUAL_FLAG,
+				   0,
+				   GSS_C_NO_CHANNEL_BINDINGS,
+				   GSS_C_NO_BUFFER, NULL, &bufdesc, NULL, NULL);
+  if (maj_stat != GSS_S_CONTINUE_NEEDED)
+    {
+      fail ("gss_init_sec_context() failure (%d,%d)\n", maj_stat, min_stat);
+      display_status ("init_sec_context", maj_stat, min_stat);
+      return -1;
+    }
+  gss_release_buffer (&min_stat, &bufdesc);
+
+  maj_stat = gss_delete_sec_context (&min_stat, &ctx, GSS_C_NO_BUFFER);
+  if (GSS_ERROR (maj_stat))
+    {
+      fail ("gss_delete_sec_context failure\n");
+      display_status ("delete_sec_context", maj_stat, min_stat);
+    }
+
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const char *services[] = {
+    "imap@async.josefsson.org",
+    "pop@async.josefsson.org",
+    "smtp@async.josefsson.org",
+    "ftp@async.josefsson.org",
+    /* This one has a ticket, see krb5context.tkt. */
+    "host@latte.josefsson.org"
+  };
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc bufdesc;
+  gss_name_t servername[5];
+  gss_ctx_id_t cctx = GSS_C_NO_CONTEXT;
+  gss_ctx_id_t cctxs[2];
+  struct sockaddr_in addr;
+  socklen_t addrlen;
+  Shishi *handle;
+  int kdc[KDCS], port[KDCS], requests[KDCS];
+  int wait_fd, wait_fds[2], rc, baseline;
+  size_t i;
+
+  do
+    if (strcmp (argv[argc - 1], "-v") == 0 ||
+	strcmp (argv[argc - 1], "--verbose") == 0)
+      debug = 1;
+    else if (strcmp (argv[argc - 1], "-b") == 0 ||
+	     strcmp (argv[argc - 1], "--break-on-error") == 0)
+      break_on_error = 1;
+    else if (strcmp (argv[argc - 1], "-h") == 0 ||
+	     strcmp (argv[argc - 1], "-?") == 0 ||
+	     strcmp (argv[argc - 1], "--help") == 0)
+      {
+	printf ("Usage: %s [-vbh?] [--verbose] [--break-on-error] [--help]\n",
+		argv[0]);
+	return 1;
+      }
+  while (argc-- > 1);
+
+  handle = shishi ();
+
+  /* Start the stand-in KDCs on local ports, and point Shishi at the
+     first. */
+
+  for (i = 0; i < KDCS; i++)
+    {
+      kdc[i] = socket (AF_INET, SOCK_DGRAM, 0);
+      memset (&addr, 0, sizeof (addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+      addrlen = sizeof (addr);
+      if (kdc[i] < 0
+	  || bind (kdc[i], (struct sockaddr *) &addr, sizeof (addr)) != 0
+	  || getsockname (kdc[i], (struct sockaddr *) &addr, &addrlen) != 0)
+	{
+	  fail ("cannot start stand-in KDC\n");
+	  return 1;
+	}
+      port[i] = ntohs (addr.sin_port);
+    }
+
+  if (write_config (port[0]) != 0)
+    {
+      fail ("cannot write " CONFIG "\n");
+      return 1;
+    }
+  setenv ("SHISHI_CONFIG", CONFIG, 1);
+
+  /* Names of services we have no ticket for, but the last. */
+
+  for (i = 0; i < 5; i++)
+    {
+      bufdesc.value = (char *) services[i];
+      bufdesc.length = strlen (bufdesc.value);
+
+      maj_stat = gss_import_name (&min_stat, &bufdesc,
+				  GSS_C_NT_HOSTBASED_SERVICE,
+				  &servername[i]);
+      if (GSS_ERROR (maj_stat))
+	{
+	  fail ("gss_import_name (%s)\n", services[i]);
+	  return 1;
+	}
+    }
+
+  /* The ticket has to be requested, so the call returns at once. */
+
+  maj_stat = init_async (&min_stat, servername[0], &cctx, &wait_fd);
+  if (maj_stat == GSS_S_CONTINUE_NEEDED && wait_fd >= 0)
+    success ("gss_init_sec_context_async() pending OK\n");
+  else
+    {
+      fail ("gss_init_sec_context_async() not pending (%d,%d,%d)\n",
+	    maj_stat, min_stat, wait_fd);
+      display_status ("init_sec_context_async", maj_stat, min_stat);
+      return 1;
+    }
+
+  /* Serve the KDC until the descriptor says the request is done. */
+
+  rc = serve (handle, kdc, requests, &wait_fd, 1);
+
+  if (requests[0] > 0)
+    success ("stand-in KDC answered %d requests\n", requests[0]);
+  else
+    fail ("no request reached the stand-in KDC\n");
+  if (rc == 0)
+    success ("descriptor became readable\n");
+  else
+    fail ("descriptor did not become readable\n");
+
+  /* Continue, which reports that no ticket could be had. */
+
+  maj_stat = init_async (&min_stat, servername[0], &cctx, &wait_fd);
+  if (maj_stat == GSS_S_NO_CRED && wait_fd == -1)
+    success ("gss_init_sec_context_async() resumed OK\n");
+  else
+    {
+      fail ("gss_init_sec_context_async() resumed badly (%d,%d,%d)\n",
+	    maj_stat, min_stat, wait_fd);
+      display_status ("init_sec_context_async", maj_stat, min_stat);
+    }
+
+  maj_stat = gss_delete_sec_context (&min_stat, &cctx, GSS_C_NO_BUFFER);
+  if (GSS_ERROR (maj_stat))
+    {
+      fail ("gss_delete_sec_context failure\n");
+      display_status ("delete_sec_context", maj_stat, min_stat);
+    }
+
+  /* The failure is remembered for a few seconds, so another context
+     for the service gets it without asking the KDC again.  Its
+     request may be done before the call returns. */
+
+  requests[0] = requests[1] = 0;
+  maj_stat = init_async (&min_stat, servername[0], &cctx, &wait_fd);
+  if (maj_stat == GSS_S_CONTINUE_NEEDED)
+    {
+      if (serve (handle, kdc, requests, &wait_fd, 1) != 0)
+	fail ("descriptor did not become readable\n");
+      maj_stat = init_async (&min_stat, servername[0], &cctx, &wait_fd);
+    }
+  if (maj_stat == GSS_S_NO_CRED && requests[0] + requests[1] == 0)
+    success ("failed request remembered OK\n");
+  else
+    fail ("failed request not remembered (%d,%d,%d)\n",
+	  maj_stat, requests[0], requests[1]);
+
+  if (cctx != GSS_C_NO_CONTEXT)
+    {
+      maj_stat = gss_delete_sec_context (&min_stat, &cctx, GSS_C_NO_BUFFER);
+      if (GSS_ERROR (maj_stat))
+	{
+	  fail ("gss_delete_sec_context failure\n");
+	  display_status ("delete_sec_context", maj_stat, min_stat);
+	}
+    }
+
+  /* The context gave its Shishi handle back, and the next context
+     borrows it.  A handle reads the configuration only when it is
+     created, so a new handle would ask the second KDC instead. */
+
+  if (write_config (port[1]) != 0)
+    fail ("cannot write " CONFIG "\n");
+
+  maj_stat = init_async (&min_stat, servername[1], &cctx, &wait_fd);
+  if (maj_stat == GSS_S_CONTINUE_NEEDED)
+    {
+      rc = serve (handle, kdc, requests, &wait_fd, 1);
+      if (rc == 0 && requests[0] > 0 && requests[1] == 0)
+	success ("pooled Shishi handle reused OK\n");
+      else
+	fail ("pooled Shishi handle not reused (%d,%d,%d)\n",
+	      rc, requests[0], requests[1]);
+
+      maj_stat = init_async (&min_stat, servername[1], &cctx, &wait_fd);
+      if (maj_stat != GSS_S_NO_CRED)
+	fail ("gss_init_sec_context_async() resumed badly (%d,%d)\n",
+	      maj_stat, min_stat);
+    }
+  else
+    fail ("gss_init_sec_context_async() not pending (%d,%d)\n",
+	  maj_stat, min_stat);
+
+  if (cctx != GSS_C_NO_CONTEXT)
+    {
+      maj_stat = gss_delete_sec_context (&min_stat, &cctx, GSS_C_NO_BUFFER);
+      if (GSS_ERROR (maj_stat))
+	{
+	  fail ("gss_delete_sec_context failure\n");
+	  display_status ("delete_sec_context", maj_stat, min_stat);
+	}
+    }
+
+  /* Count the requests for a ticket of one context alone.  How many
+     there are depends on whether the ticket granting ticket is still
+     valid, so the two contexts below are compared with this. */
+
+  baseline = -1;
+  maj_stat = init_async (&min_stat, servername[2], &cctx, &wait_fd);
+  if (maj_stat == GSS_S_CONTINUE_NEEDED)
+    {
+      if (serve (handle, kdc, requests, &wait_fd, 1) == 0)
+	baseline = requests[0] + requests[1];
+      else
+	fail ("descriptor did not become readable\n");
+      maj_stat = init_async (&min_stat, servername[2], &cctx, &wait_fd);
+      if (maj_stat != GSS_S_NO_CRED)
+	fail ("gss_init_sec_context_async() resumed badly (%d,%d)\n",
+	      maj_stat, min_stat);
+    }
+  else
+    fail ("gss_init_sec_context_async() not pending (%d,%d)\n",
+	  maj_stat, min_stat);
+
+  if (cctx != GSS_C_NO_CONTEXT)
+    {
+      maj_stat = gss_delete_sec_context (&min_stat, &cctx, GSS_C_NO_BUFFER);
+      if (GSS_ERROR (maj_stat))
+	{
+	  fail ("gss_delete_sec_context failure\n");
+	  display_status ("delete_sec_context", maj_stat, min_stat);
+	}
+    }
+
+  /* Two contexts that miss the same ticket at once share one
+     request.  One borrows the pooled handle and the other gets a new
+     one, so the request reaches a single KDC, and as many requests
+     reach it as for one context. */
+
+  for (i = 0; i < 2; i++)
+    {
+      cctxs[i] = GSS_C_NO_CONTEXT;
+      maj_stat = init_async (&min_stat, servername[3], &cctxs[i],
+			     &wait_fds[i]);
+      if (maj_stat != GSS_S_CONTINUE_NEEDED)
+	fail ("gss_init_sec_context_async() not pending (%d,%d)\n",
+	      maj_stat, min_stat);
+    }
+
+  if (cctxs[0] != GSS_C_NO_CONTEXT && cctxs[1] != GSS_C_NO_CONTEXT)
+    {
+      rc = serve (handle, kdc, requests, wait_fds, 2);
+      if (rc == 0 && baseline > 0
+	  && requests[0] + requests[1] == baseline
+	  && (requests[0] == 0 || requests[1] == 0))
+	success ("concurrent requests shared OK (%d)\n", baseline);
+      else
+	fail ("concurrent requests not shared (%d,%d,%d,%d)\n",
+	      rc, baseline, requests[0], requests[1]);
+    }
+
+  for (i = 0; i < 2; i++)
+    if (cctxs[i] != GSS_C_NO_CONTEXT)
+      {
+	maj_stat = init_async (&min_stat, servername[3], &cctxs[i],
+			       &wait_fds[i]);
+	if (maj_stat != GSS_S_NO_CRED)
+	  fail ("gss_init_sec_context_async() resumed badly (%d,%d)\n",
+		maj_stat, min_stat);
+
+	maj_stat = gss_delete_sec_context (&min_stat, &cctxs[i],
+					   GSS_C_NO_BUFFER);
+	if (GSS_ERROR (maj_stat))
+	  {
+	    fail ("gss_delete_sec_context failure\n");
+	    display_status ("delete_sec_context", maj_stat, min_stat);
+	  }
+      }
+
+  /* Tickets are not renewed unless asked for. */
+
+  if (init_sync (servername[4]) == 0)
+    {
+      rc = serve_quiet (handle, kdc, 1000);
+      if (rc == 0)
+	success ("ticket not renewed by default OK\n");
+      else
+	fail ("ticket renewed by default (%d)\n", rc);
+    }
+
+  for (i = 100; i <= 101; i++)
+    {
+      maj_stat = gss_set_cred_refresh (&min_stat, GSS_C_NO_OID, i);
+      if (maj_stat != GSS_S_FAILURE)
+	fail ("gss_set_cred_refresh (%d) status %d\n", (int) i, maj_stat);
+    }
+
+  /* The ticket is valid from 2024 to 2037, so more than one percent
+     of its lifetime has passed, and using it makes it due at once.
+     The renewal asks the KDC for a new ticket, which it refuses. */
+
+  maj_stat = gss_set_cred_refresh (&min_stat, GSS_C_NO_OID, 1);
+  if (maj_stat != GSS_S_COMPLETE)
+    fail ("gss_set_cred_refresh (1) failure (%d,%d)\n", maj_stat, min_stat);
+  else if (init_sync (servername[4]) == 0)
+    {
+      rc = serve_quiet (handle, kdc, 5000);
+      if (rc > 0)
+	success ("ticket renewal answered %d requests OK\n", rc);
+      else
+	fail ("ticket renewal did not reach the stand-in KDC\n");
+    }
+
+  maj_stat = gss_set_cred_refresh (&min_stat, GSS_C_NO_OID, 0);
+  if (maj_stat != GSS_S_COMPLETE)
+    fail ("gss_set_cred_refresh (0) failure (%d,%d)\n", maj_stat, min_stat);
+
+  /* Clean up. */
+
+  for (i = 0; i < 5; i++)
+    {
+      maj_stat = gss_release_name (&min_stat, &servername[i]);
+      if (GSS_ERROR (maj_stat))
+	{
+	  fail ("gss_release_name failure\n");
+	  display_status ("gss_release_name", maj_stat, min_stat);
+	}
+    }
+
+  for (i = 0; i < KDCS; i++)
+    close (kdc[i]);
+  remove (CONFIG);
+  shishi_done (handle);
+
+  if (debug)
+    printf ("Kerberos 5 asynchronous context self tests done with %d errors\n",
+	    error_count);
+
+  return error_count ? 1 : 0;
+}
+
+#else
+
+int
+main (int argc, char *argv[])
+{
+  /* Without threads, the request blocks; skip the test. */
+  return 77;
+}
+
+#endif
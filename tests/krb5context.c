@@ -27,6 +27,10 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <string.h>
+#include <errno.h>
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
 
 /* Get GSS prototypes. */
 #include <gss.h>
@@ -70,8 +74,1398 @@ display_status (const char *msg, OM_uint32 maj_stat, OM_uint32 min_stat)
   display_status_1 (msg, min_stat, GSS_C_MECH_CODE);
 }
 
-int
-main (int argc, char *argv[])
+/* Fill LEN bytes at P with a pattern that differs for each SEED. */
+static void
+fill (char *p, size_t len, int seed)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    p[i] = (char) (i * 7 + seed);
+}
+
+/* MIC tokens from CCTX must verify on SCTX, whether the checksum is
+   computed in one go or in pieces, and must not verify once
+   tampered with.  The tokens carry sequence numbers, so streaming and
+   one-shot tokens are compared by verifying each with the other
+   interface rather than byte for byte. */
+static void
+test_mic (gss_ctx_id_t cctx, gss_ctx_id_t sctx)
+{
+  static const size_t pieces[] = { 1, 7, 56, 64, 65, 200, 1 };
+  const size_t npieces = sizeof (pieces) / sizeof (pieces[0]);
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc msg, part, tok;
+  gss_mic_stream_t stream;
+  gss_qop_t qop_state;
+  char data[1000];
+  size_t i, off;
+
+  fill (data, sizeof (data), 1);
+  msg.value = data;
+  msg.length = sizeof (data);
+
+  maj_stat = gss_get_mic (&min_stat, cctx, 0, &msg, &tok);
+  if (GSS_ERROR (maj_stat))
+    {
+      fail ("gss_get_mic failure\n");
+      display_status ("get_mic", maj_stat, min_stat);
+      return;
+    }
+
+  maj_stat = gss_verify_mic (&min_stat, sctx, &msg, &tok, &qop_state);
+  if (GSS_ERROR (maj_stat) || qop_state != GSS_C_QOP_DEFAULT)
+    {
+      fail ("gss_verify_mic failure\n");
+      display_status ("verify_mic", maj_stat, min_stat);
+    }
+  gss_release_buffer (&min_stat, &tok);
+
+  /* A changed checksum must be rejected. */
+  maj_stat = gss_get_mic (&min_stat, cctx, 0, &msg, &tok);
+  if (GSS_ERROR (maj_stat))
+    fail ("gss_get_mic failure (2)\n");
+  else
+    {
+      ((char *) tok.value)[tok.length - 1] ^= 1;
+      maj_stat = gss_verify_mic (&min_stat, sctx, &msg, &tok, NULL);
+      if (GSS_ROUTINE_ERROR (maj_stat) != GSS_S_BAD_MIC)
+	fail ("tampered MIC token not rejected (%d)\n", maj_stat);
+      gss_release_buffer (&min_stat, &tok);
+    }
+
+  /* Created in pieces, verified in one go. */
+  maj_stat = gss_get_mic_init (&min_stat, cctx, 0, &stream);
+  if (GSS_ERROR (maj_stat))
+    {
+      fail ("gss_get_mic_init failure\n");
+      return;
+    }
+  for (i = 0, off = 0; off < msg.length; i++)
+    {
+      part.value = data + off;
+      part.length = pieces[i % npieces];
+      if (part.length > msg.length - off)
+	part.length = msg.length - off;
+      off += part.length;
+      maj_stat = gss_mic_update (&min_stat, stream, &part);
+      if (GSS_ERROR (maj_stat))
+	fail ("gss_mic_update failure\n");
+    }
+  maj_stat = gss_get_mic_final (&min_stat, &stream, &tok);
+  if (GSS_ERROR (maj_stat))
+    fail ("gss_get_mic_final failure\n");
+  else
+    {
+      maj_stat = gss_verify_mic (&min_stat, sctx, &msg, &tok, NULL);
+      if (GSS_ERROR (maj_stat))
+	{
+	  fail ("streaming MIC does not verify\n");
+	  display_status ("verify_mic", maj_stat, min_stat);
+	}
+      gss_release_buffer (&min_stat, &tok);
+    }
+
+  /* Created in one go, verified in pieces. */
+  maj_stat = gss_get_mic (&min_stat, cctx, 0, &msg, &tok);
+  if (GSS_ERROR (maj_stat))
+    {
+      fail ("gss_get_mic failure (3)\n");
+      return;
+    }
+  maj_stat = gss_verify_mic_init (&min_stat, sctx, &stream);
+  if (GSS_ERROR (maj_stat))
+    fail ("gss_verify_mic_init failure\n");
+  else
+    {
+      for (i = 0, off = 0; off < msg.length; i++)
+	{
+	  part.value = data + off;
+	  part.length = pieces[(i + 3) % npieces];
+	  if (part.length > msg.length - off)
+	    part.length = msg.length - off;
+	  off += part.length;
+	  gss_mic_update (&min_stat, stream, &part);
+	}
+      maj_stat = gss_verify_mic_final (&min_stat, &stream, &tok, NULL);
+      if (GSS_ERROR (maj_stat))
+	{
+	  fail ("MIC does not verify in pieces\n");
+	  display_status ("verify_mic_final", maj_stat, min_stat);
+	}
+    }
+  gss_release_buffer (&min_stat, &tok);
+}
+
+/* Return whether the LEN bytes at P occur in TOK. */
+static int
+contains (const gss_buffer_t tok, const char *p, size_t len)
+{
+  const char *t = tok->value;
+  size_t i;
+
+  for (i = 0; i + len <= tok->length; i++)
+    if (memcmp (t + i, p, len) == 0)
+      return 1;
+
+  return 0;
+}
+
+/* Return whether TOK is an RFC 1964 wrap token checksummed with
+   DES-MAC-MD5, which this implementation never seals. */
+static int
+des_token_p (const gss_buffer_t tok)
+{
+  gss_uint32 min_stat;
+  gss_buffer_desc inner;
+  int des;
+
+  if (GSS_ERROR (gss_decapsulate_token (tok, GSS_KRB5, &inner)))
+    return 0;
+  des = inner.length >= 4
+    && memcmp (inner.value, "\x02\x01\x00\x00", 4) == 0;
+  gss_release_buffer (&min_stat, &inner);
+
+  return des;
+}
+
+/* Wrap tokens from CCTX must unwrap on SCTX with and without
+   confidentiality, for lengths around the cipher block and checksum
+   sizes, and must not unwrap once tampered with.  Both ends must
+   report whether the message was encrypted, which it is if and only
+   if confidentiality was asked for, except with DES. */
+static void
+test_wrap (gss_ctx_id_t cctx, gss_ctx_id_t sctx)
+{
+  static const size_t lens[] = { 0, 1, 15, 16, 17, 100, 4096 };
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc msg, tok, out;
+  char data[4096];
+  int conf, conf_state, conf_state2;
+  size_t i;
+
+  for (conf = 0; conf < 2; conf++)
+    for (i = 0; i < sizeof (lens) / sizeof (lens[0]); i++)
+      {
+	fill (data, lens[i], (int) i);
+	msg.value = data;
+	msg.length = lens[i];
+
+	maj_stat = gss_wrap (&min_stat, cctx, conf, 0, &msg, &conf_state,
+			     &tok);
+	if (GSS_ERROR (maj_stat))
+	  {
+	    fail ("gss_wrap failure (%d, %d)\n", conf, (int) lens[i]);
+	    display_status ("wrap", maj_stat, min_stat);
+	    continue;
+	  }
+
+	if (conf_state != (conf && !des_token_p (&tok)))
+	  fail ("gss_wrap conf_state %d (%d, %d)\n",
+		conf_state, conf, (int) lens[i]);
+	/* Too short a message could turn up by chance. */
+	if (msg.length >= 16 && contains (&tok, data, msg.length) == conf_state)
+	  fail ("gss_wrap %s the message (%d, %d)\n",
+		conf_state ? "did not encrypt" : "encrypted",
+		conf, (int) lens[i]);
+
+	conf_state2 = -1;
+	maj_stat = gss_unwrap (&min_stat, sctx, &tok, &out, &conf_state2,
+			       NULL);
+	if (GSS_ERROR (maj_stat))
+	  {
+	    fail ("gss_unwrap failure (%d, %d)\n", conf, (int) lens[i]);
+	    display_status ("unwrap", maj_stat, min_stat);
+	  }
+	else
+	  {
+	    if (out.length != msg.length
+		|| memcmp (out.value, msg.value, msg.length) != 0)
+	      fail ("wrap+unwrap mismatch (%d, %d)\n", conf, (int) lens[i]);
+	    if (conf_state2 != conf_state)
+	      fail ("gss_unwrap conf_state %d (%d, %d)\n",
+		    conf_state2, conf, (int) lens[i]);
+	    gss_release_buffer (&min_stat, &out);
+	  }
+	gss_release_buffer (&min_stat, &tok);
+
+	/* A changed token must be rejected, without its sequence number
+	   being taken as seen. */
+	maj_stat = gss_wrap (&min_stat, cctx, conf, 0, &msg, NULL, &tok);
+	if (GSS_ERROR (maj_stat))
+	  continue;
+	((char *) tok.value)[tok.length - 1] ^= 1;
+	maj_stat = gss_unwrap (&min_stat, sctx, &tok, &out, NULL, NULL);
+	if (!GSS_ERROR (maj_stat))
+	  {
+	    fail ("tampered wrap token not rejected (%d, %d)\n",
+		  conf, (int) lens[i]);
+	    gss_release_buffer (&min_stat, &out);
+	  }
+	((char *) tok.value)[tok.length - 1] ^= 1;
+	maj_stat = gss_unwrap (&min_stat, sctx, &tok, &out, NULL, NULL);
+	if (maj_stat != GSS_S_COMPLETE)
+	  fail ("restored wrap token failure (%d, %d, %d)\n",
+		conf, (int) lens[i], maj_stat);
+	else
+	  gss_release_buffer (&min_stat, &out);
+	gss_release_buffer (&min_stat, &tok);
+      }
+}
+
+/* Changing any byte of the header of a wrap or MIC token from CCTX,
+   or its first byte after the header, or its last, must make SCTX
+   reject the token.  The headers of RFC 1964 and RFC 4121 tokens are
+   16 bytes after the framing, which only the former have; contexts
+   with CFX set must send the latter. */
+static void
+test_tamper (gss_ctx_id_t cctx, gss_ctx_id_t sctx, int cfx)
+{
+  static const size_t offsets[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 15, 16 };
+  const size_t noffsets = sizeof (offsets) / sizeof (offsets[0]);
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc msg, tok, inner, out;
+  char data[100];
+  size_t i, start, off;
+  int mic, conf;
+
+  fill (data, sizeof (data), 13);
+  msg.value = data;
+  msg.length = sizeof (data);
+
+  for (mic = 0; mic < 2; mic++)
+    for (conf = 0; conf < 2 - mic; conf++)
+      {
+	if (mic)
+	  maj_stat = gss_get_mic (&min_stat, cctx, 0, &msg, &tok);
+	else
+	  maj_stat = gss_wrap (&min_stat, cctx, conf, 0, &msg, NULL, &tok);
+	if (GSS_ERROR (maj_stat))
+	  {
+	    fail ("%s failure (tamper %d)\n",
+		  mic ? "gss_get_mic" : "gss_wrap", conf);
+	    continue;
+	  }
+
+	start = 0;
+	if (((unsigned char *) tok.value)[0] == 0x60
+	    && !GSS_ERROR (gss_decapsulate_token (&tok, GSS_KRB5, &inner)))
+	  {
+	    start = tok.length - inner.length;
+	    gss_release_buffer (&min_stat, &inner);
+	  }
+	if ((start == 0) != cfx || tok.length < start + 17)
+	  {
+	    fail ("%s token %s RFC 4121 (%d)\n", mic ? "MIC" : "wrap",
+		  cfx ? "not" : "unexpectedly", conf);
+	    gss_release_buffer (&min_stat, &tok);
+	    continue;
+	  }
+
+	for (i = 0; i <= noffsets; i++)
+	  {
+	    off = i < noffsets ? start + offsets[i] : tok.length - 1;
+	    ((char *) tok.value)[off] ^= 1;
+	    if (mic)
+	      maj_stat = gss_verify_mic (&min_stat, sctx, &msg, &tok, NULL);
+	    else
+	      maj_stat = gss_unwrap (&min_stat, sctx, &tok, &out, NULL, NULL);
+	    if (!GSS_ERROR (maj_stat))
+	      {
+		fail ("%s token changed at %d not rejected (%d)\n",
+		      mic ? "MIC" : "wrap", (int) (off - start), conf);
+		if (!mic)
+		  gss_release_buffer (&min_stat, &out);
+	      }
+	    ((char *) tok.value)[off] ^= 1;
+	  }
+
+	if (mic)
+	  maj_stat = gss_verify_mic (&min_stat, sctx, &msg, &tok, NULL);
+	else
+	  maj_stat = gss_unwrap (&min_stat, sctx, &tok, &out, NULL, NULL);
+	if (maj_stat != GSS_S_COMPLETE)
+	  fail ("restored %s token failure (%d, %x)\n",
+		mic ? "MIC" : "wrap", conf, maj_stat);
+	else if (!mic)
+	  gss_release_buffer (&min_stat, &out);
+	gss_release_buffer (&min_stat, &tok);
+      }
+}
+
+/* Tokens from CCTX that arrive at SCTX out of order, twice, or too
+   late must be reported as such.  The window is set to 100, which
+   the mechanism rounds up to 128. */
+static void
+test_replay (gss_ctx_id_t cctx, gss_ctx_id_t sctx)
+{
+  static const struct
+  {
+    size_t n;
+    gss_uint32 status;
+  } steps[] =
+  {
+    {0, GSS_S_COMPLETE},
+    {2, GSS_S_GAP_TOKEN},
+    {1, GSS_S_UNSEQ_TOKEN},
+    {1, GSS_S_DUPLICATE_TOKEN},
+    {3, GSS_S_COMPLETE},
+    {150, GSS_S_GAP_TOKEN},
+    /* 128 behind the newest token, so inside the rounded window. */
+    {23, GSS_S_UNSEQ_TOKEN},
+    {22, GSS_S_OLD_TOKEN},
+    {23, GSS_S_DUPLICATE_TOKEN},
+    {150, GSS_S_DUPLICATE_TOKEN},
+    {151, GSS_S_COMPLETE},
+    {0, GSS_S_OLD_TOKEN}
+  };
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc msg, tok[200], out;
+  size_t i, n;
+
+  maj_stat = gss_set_replay_window (&min_stat, sctx, 1025);
+  if (maj_stat != GSS_S_FAILURE)
+    fail ("gss_set_replay_window accepted 1025 (%d)\n", maj_stat);
+  maj_stat = gss_set_replay_window (&min_stat, sctx, 100);
+  if (GSS_ERROR (maj_stat))
+    {
+      fail ("gss_set_replay_window failure\n");
+      return;
+    }
+
+  msg.value = (char *) "abc";
+  msg.length = 3;
+  for (n = 0; n < sizeof (tok) / sizeof (tok[0]); n++)
+    {
+      maj_stat = gss_wrap (&min_stat, cctx, 0, 0, &msg, NULL, &tok[n]);
+      if (GSS_ERROR (maj_stat))
+	{
+	  fail ("gss_wrap failure (%d)\n", (int) n);
+	  break;
+	}
+    }
+  if (n < sizeof (tok) / sizeof (tok[0]))
+    goto done;
+
+  for (i = 0; i < sizeof (steps) / sizeof (steps[0]); i++)
+    {
+      maj_stat = gss_unwrap (&min_stat, sctx, &tok[steps[i].n], &out,
+			     NULL, NULL);
+      if (maj_stat != steps[i].status)
+	fail ("replay step %d: token %d gave %x, expected %x\n", (int) i,
+	      (int) steps[i].n, maj_stat, steps[i].status);
+      if (GSS_ERROR (maj_stat))
+	continue;
+      if (out.length != msg.length
+	  || memcmp (out.value, msg.value, msg.length) != 0)
+	fail ("replay step %d: wrong message\n", (int) i);
+      gss_release_buffer (&min_stat, &out);
+    }
+
+  /* Catch up, so that later tokens arrive in order. */
+  for (i = 152; i < n; i++)
+    {
+      maj_stat = gss_unwrap (&min_stat, sctx, &tok[i], &out, NULL, NULL);
+      if (maj_stat != GSS_S_COMPLETE)
+	fail ("gss_unwrap failure (%d)\n", (int) i);
+      if (!GSS_ERROR (maj_stat))
+	gss_release_buffer (&min_stat, &out);
+    }
+
+done:
+  for (i = 0; i < n; i++)
+    gss_release_buffer (&min_stat, &tok[i]);
+
+  maj_stat = gss_set_replay_window (&min_stat, sctx, 0);
+  if (GSS_ERROR (maj_stat))
+    fail ("gss_set_replay_window failure (2)\n");
+}
+
+/* Return the length of the token that wraps the first LEN bytes of
+   DATA on CCTX, after checking that it unwraps on SCTX, or 0 on
+   failure. */
+static size_t
+wrap_length (gss_ctx_id_t cctx, gss_ctx_id_t sctx, int conf,
+	     char *data, size_t len)
+{
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc msg, tok, out;
+  size_t toklen;
+
+  msg.value = data;
+  msg.length = len;
+  maj_stat = gss_wrap (&min_stat, cctx, conf, 0, &msg, NULL, &tok);
+  if (GSS_ERROR (maj_stat))
+    {
+      fail ("gss_wrap failure (%d, %d)\n", conf, (int) len);
+      return 0;
+    }
+  toklen = tok.length;
+
+  maj_stat = gss_unwrap (&min_stat, sctx, &tok, &out, NULL, NULL);
+  if (GSS_ERROR (maj_stat))
+    fail ("gss_unwrap failure (%d, %d)\n", conf, (int) len);
+  else
+    gss_release_buffer (&min_stat, &out);
+  gss_release_buffer (&min_stat, &tok);
+
+  return toklen;
+}
+
+/* The size gss_wrap_size_limit returns for a token size must be the
+   largest message whose token is no larger, including where the
+   padding or the length of the ASN.1 framing changes. */
+static void
+test_wrap_size (gss_ctx_id_t cctx, gss_ctx_id_t sctx)
+{
+  static const OM_uint32 reqs[] = {
+    0, 1, 28, 29, 60, 61, 100, 127, 128, 129, 130,
+    255, 256, 257, 258, 1000, 1500, 65535, 65536, 65537, 70000
+  };
+  gss_uint32 maj_stat, min_stat;
+  OM_uint32 max;
+  size_t i;
+  char *data;
+  int conf;
+
+  data = malloc (70001);
+  if (!data)
+    {
+      fail ("malloc failure\n");
+      return;
+    }
+  fill (data, 70001, 3);
+
+  for (conf = 0; conf < 2; conf++)
+    for (i = 0; i < sizeof (reqs) / sizeof (reqs[0]); i++)
+      {
+	maj_stat = gss_wrap_size_limit (&min_stat, cctx, conf, 0, reqs[i],
+					&max);
+	if (GSS_ERROR (maj_stat))
+	  {
+	    fail ("gss_wrap_size_limit failure (%d, %d)\n",
+		  conf, (int) reqs[i]);
+	    display_status ("wrap_size_limit", maj_stat, min_stat);
+	    continue;
+	  }
+	if (max > 0 && wrap_length (cctx, sctx, conf, data, max) > reqs[i])
+	  fail ("gss_wrap_size_limit too large (%d, %d, %d)\n",
+		conf, (int) reqs[i], (int) max);
+	if (wrap_length (cctx, sctx, conf, data, max + 1) <= reqs[i])
+	  fail ("gss_wrap_size_limit too small (%d, %d, %d)\n",
+		conf, (int) reqs[i], (int) max);
+      }
+
+  free (data);
+}
+
+/* The calls that write into the caller's memory must report the size
+   needed when it is too small, without using up a sequence number or
+   consuming the token, and must then succeed with a buffer of that
+   size. */
+static void
+test_into (gss_ctx_id_t cctx, gss_ctx_id_t sctx)
+{
+  static const size_t lens[] = { 0, 1, 16, 100, 4096 };
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc msg, tok, out;
+  char data[4096], copy[4096];
+  char *buf;
+  size_t i, need;
+  int conf;
+
+  for (conf = 0; conf < 2; conf++)
+    for (i = 0; i < sizeof (lens) / sizeof (lens[0]); i++)
+      {
+	fill (data, lens[i], (int) i);
+	msg.value = data;
+	msg.length = lens[i];
+
+	need = wrap_length (cctx, sctx, conf, data, lens[i]);
+	buf = malloc (need);
+	if (!need || !buf)
+	  {
+	    free (buf);
+	    continue;
+	  }
+
+	tok.value = buf;
+	tok.length = need - 1;
+	maj_stat = gss_wrap_into (&min_stat, cctx, conf, 0, &msg, NULL, &tok);
+	if (maj_stat != GSS_S_FAILURE || min_stat != ERANGE
+	    || tok.length != need)
+	  fail ("gss_wrap_into short buffer (%d, %d): %x %d %d\n", conf,
+		(int) lens[i], maj_stat, (int) min_stat, (int) tok.length);
+
+	tok.length = need;
+	maj_stat = gss_wrap_into (&min_stat, cctx, conf, 0, &msg, NULL, &tok);
+	if (GSS_ERROR (maj_stat) || tok.length != need)
+	  {
+	    fail ("gss_wrap_into failure (%d, %d)\n", conf, (int) lens[i]);
+	    free (buf);
+	    continue;
+	  }
+
+	if (lens[i] > 0)
+	  {
+	    out.value = copy;
+	    out.length = lens[i] - 1;
+	    maj_stat = gss_unwrap_into (&min_stat, sctx, &tok, &out,
+					NULL, NULL);
+	    if (maj_stat != GSS_S_FAILURE || min_stat != ERANGE
+		|| out.length != lens[i])
+	      fail ("gss_unwrap_into short buffer (%d, %d): %x %d %d\n",
+		    conf, (int) lens[i], maj_stat, (int) min_stat,
+		    (int) out.length);
+	  }
+
+	/* Anything but GSS_S_COMPLETE means that the short calls used up
+	   a sequence number. */
+	out.value = copy;
+	out.length = lens[i];
+	maj_stat = gss_unwrap_into (&min_stat, sctx, &tok, &out, NULL, NULL);
+	if (maj_stat != GSS_S_COMPLETE || out.length != lens[i]
+	    || memcmp (copy, data, lens[i]) != 0)
+	  fail ("gss_unwrap_into failure (%d, %d): %x\n",
+		conf, (int) lens[i], maj_stat);
+
+	free (buf);
+      }
+
+  fill (data, 100, 4);
+  msg.value = data;
+  msg.length = 100;
+  maj_stat = gss_get_mic (&min_stat, cctx, 0, &msg, &tok);
+  if (GSS_ERROR (maj_stat))
+    {
+      fail ("gss_get_mic failure (into)\n");
+      return;
+    }
+  need = tok.length;
+  maj_stat = gss_verify_mic (&min_stat, sctx, &msg, &tok, NULL);
+  if (GSS_ERROR (maj_stat))
+    fail ("gss_verify_mic failure (into)\n");
+  gss_release_buffer (&min_stat, &tok);
+
+  tok.value = copy;
+  tok.length = need - 1;
+  maj_stat = gss_get_mic_into (&min_stat, cctx, 0, &msg, &tok);
+  if (maj_stat != GSS_S_FAILURE || min_stat != ERANGE || tok.length != need)
+    fail ("gss_get_mic_into short buffer: %x %d %d\n",
+	  maj_stat, (int) min_stat, (int) tok.length);
+
+  tok.length = need;
+  maj_stat = gss_get_mic_into (&min_stat, cctx, 0, &msg, &tok);
+  if (GSS_ERROR (maj_stat) || tok.length != need)
+    fail ("gss_get_mic_into failure\n");
+  else
+    {
+      maj_stat = gss_verify_mic (&min_stat, sctx, &msg, &tok, NULL);
+      if (maj_stat != GSS_S_COMPLETE)
+	fail ("gss_get_mic_into token failure: %x\n", maj_stat);
+    }
+}
+
+/* RFC 1964 wrap tokens get their ASN.1 framing written in front of
+   the token where it was built.  It must be the same framing that
+   gss_encapsulate_token adds, also where the length of the token
+   needs one more byte to encode.  RFC 4121 tokens are not framed. */
+static void
+test_framing (gss_ctx_id_t cctx, gss_ctx_id_t sctx)
+{
+  static const struct
+  {
+    size_t from;
+    size_t to;
+  } ranges[] =
+  {
+    {0, 300},
+    {65480, 65560}
+  };
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc msg, tok, inner, outer, out;
+  size_t i, len;
+  char *data;
+  int conf;
+
+  data = malloc (65560);
+  if (!data)
+    {
+      fail ("malloc failure\n");
+      return;
+    }
+  fill (data, 65560, 5);
+  msg.value = data;
+
+  for (conf = 0; conf < 2; conf++)
+    for (i = 0; i < sizeof (ranges) / sizeof (ranges[0]); i++)
+      for (len = ranges[i].from; len < ranges[i].to; len++)
+	{
+	  msg.length = len;
+	  maj_stat = gss_wrap (&min_stat, cctx, conf, 0, &msg, NULL, &tok);
+	  if (GSS_ERROR (maj_stat))
+	    {
+	      fail ("gss_wrap failure (%d, %d)\n", conf, (int) len);
+	      continue;
+	    }
+
+	  if (((unsigned char *) tok.value)[0] == 0x60)
+	    {
+	      maj_stat = gss_decapsulate_token (&tok, GSS_KRB5, &inner);
+	      if (GSS_ERROR (maj_stat))
+		fail ("gss_decapsulate_token failure (%d, %d)\n",
+		      conf, (int) len);
+	      else
+		{
+		  maj_stat = gss_encapsulate_token (&inner, GSS_KRB5, &outer);
+		  if (GSS_ERROR (maj_stat) || outer.length != tok.length
+		      || memcmp (outer.value, tok.value, tok.length) != 0)
+		    fail ("wrap token framing differs (%d, %d)\n",
+			  conf, (int) len);
+		  if (!GSS_ERROR (maj_stat))
+		    gss_release_buffer (&min_stat, &outer);
+		  gss_release_buffer (&min_stat, &inner);
+		}
+	    }
+
+	  maj_stat = gss_unwrap (&min_stat, sctx, &tok, &out, NULL, NULL);
+	  if (GSS_ERROR (maj_stat))
+	    fail ("gss_unwrap failure (%d, %d)\n", conf, (int) len);
+	  else
+	    gss_release_buffer (&min_stat, &out);
+	  gss_release_buffer (&min_stat, &tok);
+	}
+
+  free (data);
+}
+
+/* Tokens from CCTX unwrapped in place at SCTX must give back the
+   message inside the token buffer, be recognized when replayed, and
+   be rejected when changed.  A rejected token is unwrapped again
+   from a copy, so the sequence is left in order. */
+static void
+test_inplace (gss_ctx_id_t cctx, gss_ctx_id_t sctx)
+{
+  static const size_t lens[] = { 0, 1, 16, 100, 4096 };
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc msg, tok;
+  char data[4096];
+  char *copy;
+  int conf, conf_state, conf_state2;
+  size_t i, offset, length;
+
+  for (conf = 0; conf < 2; conf++)
+    for (i = 0; i < sizeof (lens) / sizeof (lens[0]); i++)
+      {
+	fill (data, lens[i], (int) i + 7);
+	msg.value = data;
+	msg.length = lens[i];
+
+	maj_stat = gss_wrap (&min_stat, cctx, conf, 0, &msg, &conf_state,
+			     &tok);
+	if (GSS_ERROR (maj_stat))
+	  {
+	    fail ("gss_wrap failure (%d, %d)\n", conf, (int) lens[i]);
+	    display_status ("wrap", maj_stat, min_stat);
+	    continue;
+	  }
+	copy = malloc (tok.length);
+	if (!copy)
+	  {
+	    fail ("malloc failure\n");
+	    gss_release_buffer (&min_stat, &tok);
+	    return;
+	  }
+	memcpy (copy, tok.value, tok.length);
+
+	conf_state2 = -1;
+	maj_stat = gss_unwrap_inplace (&min_stat, sctx, &tok, &offset,
+				       &length, &conf_state2, NULL);
+	if (maj_stat != GSS_S_COMPLETE)
+	  {
+	    fail ("gss_unwrap_inplace failure (%d, %d)\n",
+		  conf, (int) lens[i]);
+	    display_status ("unwrap_inplace", maj_stat, min_stat);
+	  }
+	else
+	  {
+	    if (length != msg.length || offset + length > tok.length
+		|| memcmp ((char *) tok.value + offset, data, length) != 0)
+	      fail ("wrap+unwrap_inplace mismatch (%d, %d)\n",
+		    conf, (int) lens[i]);
+	    if (conf_state2 != conf_state)
+	      fail ("gss_unwrap_inplace conf_state %d (%d, %d)\n",
+		    conf_state2, conf, (int) lens[i]);
+	  }
+
+	memcpy (tok.value, copy, tok.length);
+	maj_stat = gss_unwrap_inplace (&min_stat, sctx, &tok, &offset,
+				       &length, NULL, NULL);
+	if (GSS_ERROR (maj_stat) || !(maj_stat & GSS_S_DUPLICATE_TOKEN))
+	  fail ("replayed unwrap_inplace token %x (%d, %d)\n",
+		maj_stat, conf, (int) lens[i]);
+	gss_release_buffer (&min_stat, &tok);
+	free (copy);
+
+	maj_stat = gss_wrap (&min_stat, cctx, conf, 0, &msg, &conf_state,
+			     &tok);
+	if (GSS_ERROR (maj_stat))
+	  continue;
+	copy = malloc (tok.length);
+	if (!copy)
+	  {
+	    fail ("malloc failure\n");
+	    gss_release_buffer (&min_stat, &tok);
+	    return;
+	  }
+	memcpy (copy, tok.value, tok.length);
+	((char *) tok.value)[tok.length - 1] ^= 1;
+	maj_stat = gss_unwrap_inplace (&min_stat, sctx, &tok, &offset,
+				       &length, NULL, NULL);
+	if (!GSS_ERROR (maj_stat))
+	  fail ("tampered unwrap_inplace token not rejected (%d, %d)\n",
+		conf, (int) lens[i]);
+	/* Nor may it leave the decrypted message behind. */
+	else if (conf_state && msg.length >= 16
+		 && contains (&tok, data, msg.length))
+	  fail ("tampered unwrap_inplace token left the message (%d, %d)\n",
+		conf, (int) lens[i]);
+	memcpy (tok.value, copy, tok.length);
+	maj_stat = gss_unwrap_inplace (&min_stat, sctx, &tok, &offset,
+				       &length, NULL, NULL);
+	if (maj_stat != GSS_S_COMPLETE)
+	  fail ("restored unwrap_inplace token failure (%d, %d, %x)\n",
+		conf, (int) lens[i], maj_stat);
+	gss_release_buffer (&min_stat, &tok);
+	free (copy);
+      }
+}
+
+/* Messages wrapped in place with gss_wrap_iov at CCTX must unwrap in
+   place with gss_unwrap_iov at SCTX, both with the trailer in a
+   buffer of its own and with it rotated into the header as in RFC
+   4121 section 4.2.5; the latter kind also with gss_unwrap.  A change
+   to the data or to a SIGN_ONLY buffer must be rejected without
+   leaving the decrypted data behind.  Only contexts with CFX set,
+   which use RFC 4121 tokens, support the IOV functions. */
+static void
+test_iov (gss_ctx_id_t cctx, gss_ctx_id_t sctx, int cfx)
+{
+  static const size_t lens[] = { 0, 1, 16, 17, 100, 4096 };
+  static const char assoc[] = "associated data";
+  gss_uint32 maj_stat, min_stat;
+  gss_iov_buffer_desc iov[6];
+  gss_buffer_desc tok, out;
+  char data[4096], plain[4096], wrapped[4096];
+  char hdr[64], hdrcopy[64], trlcopy[64], sign[sizeof (assoc)];
+  char *p;
+  int conf, conf_state, conf_state2, rrc, n;
+  gss_qop_t qop_state;
+  size_t i, split;
+
+  memset (iov, 0, sizeof (iov));
+  iov[0].type = GSS_IOV_BUFFER_TYPE_HEADER;
+  iov[1].type = GSS_IOV_BUFFER_TYPE_DATA;
+  if (!cfx)
+    {
+      maj_stat = gss_wrap_iov (&min_stat, cctx, 0, 0, NULL, iov, 2);
+      if (maj_stat != GSS_S_UNAVAILABLE)
+	fail ("gss_wrap_iov status %x\n", maj_stat);
+      return;
+    }
+  maj_stat = gss_wrap_iov_length (&min_stat, cctx, 0, 1, NULL, iov, 2);
+  if (maj_stat != GSS_S_BAD_QOP)
+    fail ("gss_wrap_iov_length qop status %x\n", maj_stat);
+
+  for (conf = 0; conf < 2; conf++)
+    for (rrc = 0; rrc < 2; rrc++)
+      for (i = 0; i < sizeof (lens) / sizeof (lens[0]); i++)
+	{
+	  fill (plain, lens[i], (int) i + 11);
+	  memcpy (data, plain, lens[i]);
+	  memcpy (sign, assoc, sizeof (sign));
+	  /* Split the data where a cipher block straddles the two. */
+	  split = lens[i] / 3;
+
+	  /* HEADER | SIGN_ONLY | DATA | DATA | PADDING | TRAILER, with
+	     the library allocating the buffers of the token, or HEADER
+	     | DATA | DATA in buffers sized by gss_wrap_iov_length. */
+	  memset (iov, 0, sizeof (iov));
+	  n = 0;
+	  iov[n].type = GSS_IOV_BUFFER_TYPE_HEADER;
+	  if (!rrc)
+	    {
+	      iov[n++].type |= GSS_IOV_BUFFER_FLAG_ALLOCATE;
+	      iov[n].type = GSS_IOV_BUFFER_TYPE_SIGN_ONLY;
+	      iov[n].buffer.value = sign;
+	      iov[n].buffer.length = sizeof (sign);
+	    }
+	  n++;
+	  iov[n].type = GSS_IOV_BUFFER_TYPE_DATA;
+	  iov[n].buffer.value = data;
+	  iov[n++].buffer.length = split;
+	  iov[n].type = GSS_IOV_BUFFER_TYPE_DATA;
+	  iov[n].buffer.value = data + split;
+	  iov[n++].buffer.length = lens[i] - split;
+	  if (!rrc)
+	    {
+	      iov[n++].type = GSS_IOV_BUFFER_TYPE_PADDING
+		| GSS_IOV_BUFFER_FLAG_ALLOCATE;
+	      iov[n++].type = GSS_IOV_BUFFER_TYPE_TRAILER
+		| GSS_IOV_BUFFER_FLAG_ALLOCATE;
+	    }
+	  else
+	    {
+	      maj_stat = gss_wrap_iov_length (&min_stat, cctx, conf, 0,
+					      NULL, iov, n);
+	      if (maj_stat != GSS_S_COMPLETE
+		  || iov[0].buffer.length > sizeof (hdr))
+		{
+		  fail ("gss_wrap_iov_length failure (%d)\n", conf);
+		  continue;
+		}
+	      iov[0].buffer.value = hdr;
+	    }
+
+	  maj_stat = gss_wrap_iov (&min_stat, cctx, conf, 0, &conf_state,
+				   iov, n);
+	  if (GSS_ERROR (maj_stat))
+	    {
+	      fail ("gss_wrap_iov failure (%d, %d, %d)\n",
+		    conf, rrc, (int) lens[i]);
+	      display_status ("wrap_iov", maj_stat, min_stat);
+	      gss_release_iov_buffer (&min_stat, iov, n);
+	      continue;
+	    }
+	  if (conf_state != conf)
+	    fail ("gss_wrap_iov conf_state %d (%d, %d)\n",
+		  conf_state, conf, rrc);
+	  if (lens[i] >= 16 && (memcmp (data, plain, lens[i]) != 0) != conf)
+	    fail ("gss_wrap_iov %s the message (%d, %d, %d)\n",
+		  conf ? "did not encrypt" : "changed", conf, rrc,
+		  (int) lens[i]);
+
+	  /* Keep the token, and check that a changed one is refused. */
+	  memcpy (wrapped, data, lens[i]);
+	  memcpy (hdrcopy, iov[0].buffer.value, iov[0].buffer.length);
+	  if (!rrc)
+	    memcpy (trlcopy, iov[n - 1].buffer.value,
+		    iov[n - 1].buffer.length);
+	  p = lens[i] > 0 ? data + lens[i] - 1 : rrc ? hdr + 20 : sign;
+	  *p ^= 1;
+	  maj_stat = gss_unwrap_iov (&min_stat, sctx, NULL, NULL, iov, n);
+	  if (!GSS_ERROR (maj_stat))
+	    fail ("tampered wrap_iov token not rejected (%d, %d, %d)\n",
+		  conf, rrc, (int) lens[i]);
+	  else if (conf && lens[i] >= 16
+		   && memcmp (data, plain, lens[i] - 1) == 0)
+	    fail ("tampered wrap_iov token left the message (%d, %d)\n",
+		  rrc, (int) lens[i]);
+
+	  memcpy (data, wrapped, lens[i]);
+	  memcpy (iov[0].buffer.value, hdrcopy, iov[0].buffer.length);
+	  if (!rrc)
+	    memcpy (iov[n - 1].buffer.value, trlcopy,
+		    iov[n - 1].buffer.length);
+	  memcpy (sign, assoc, sizeof (sign));
+	  conf_state2 = -1;
+	  qop_state = 1;
+	  maj_stat = gss_unwrap_iov (&min_stat, sctx, &conf_state2,
+				     &qop_state, iov, n);
+	  if (maj_stat != GSS_S_COMPLETE)
+	    {
+	      fail ("gss_unwrap_iov failure (%d, %d, %d)\n",
+		    conf, rrc, (int) lens[i]);
+	      display_status ("unwrap_iov", maj_stat, min_stat);
+	    }
+	  else if (memcmp (data, plain, lens[i]) != 0
+		   || conf_state2 != conf || qop_state != 0)
+	    fail ("wrap_iov+unwrap_iov mismatch (%d, %d, %d)\n",
+		  conf, rrc, (int) lens[i]);
+	  gss_release_iov_buffer (&min_stat, iov, n);
+	  if (!rrc)
+	    continue;
+
+	  /* The header with the rotated trailer, followed by the data,
+	     is an ordinary token. */
+	  maj_stat = gss_wrap_iov (&min_stat, cctx, conf, 0, NULL, iov, n);
+	  if (GSS_ERROR (maj_stat))
+	    continue;
+	  tok.length = iov[0].buffer.length + lens[i];
+	  tok.value = malloc (tok.length);
+	  if (!tok.value)
+	    {
+	      fail ("malloc failure\n");
+	      return;
+	    }
+	  memcpy (tok.value, hdr, iov[0].buffer.length);
+	  memcpy ((char *) tok.value + iov[0].buffer.length, data, lens[i]);
+	  maj_stat = gss_unwrap (&min_stat, sctx, &tok, &out, &conf_state2,
+				 NULL);
+	  if (maj_stat != GSS_S_COMPLETE)
+	    fail ("gss_unwrap of wrap_iov token failure (%d, %d)\n",
+		  conf, (int) lens[i]);
+	  else
+	    {
+	      if (out.length != lens[i]
+		  || memcmp (out.value, plain, lens[i]) != 0
+		  || conf_state2 != conf)
+		fail ("wrap_iov+unwrap mismatch (%d, %d)\n",
+		      conf, (int) lens[i]);
+	      gss_release_buffer (&min_stat, &out);
+	    }
+	  free (tok.value);
+	}
+}
+
+/* As in lib/krb5/msg.c, which bounds the memory of a stream by
+   processing its message in slices of this size. */
+#define STREAM_SLICE 65536
+
+/* Move PIECE to the end of ACC, which is kept with malloc. */
+static void
+append (gss_buffer_t acc, gss_buffer_t piece)
+{
+  gss_uint32 min_stat;
+  char *p;
+
+  p = realloc (acc->value, acc->length + piece->length + 1);
+  if (!p)
+    fail ("realloc failure\n");
+  else
+    {
+      memcpy (p + acc->length, piece->value, piece->length);
+      acc->value = p;
+      acc->length += piece->length;
+    }
+  gss_release_buffer (&min_stat, piece);
+}
+
+/* Unwrap TOK at SCTX through a stream, CHUNK bytes at a time, into
+   OUT, which must be freed by the caller whatever the outcome. */
+static gss_uint32
+stream_unwrap (gss_ctx_id_t sctx, gss_buffer_t tok, size_t chunk,
+	       gss_buffer_t out, int *conf_state)
+{
+  gss_uint32 maj_stat, min_stat;
+  gss_wrap_stream_t stream;
+  gss_buffer_desc in, piece;
+  size_t pos;
+
+  out->value = NULL;
+  out->length = 0;
+
+  maj_stat = gss_unwrap_init (&min_stat, sctx, &stream);
+  if (GSS_ERROR (maj_stat))
+    return maj_stat;
+
+  for (pos = 0; pos < tok->length; pos += in.length)
+    {
+      in.value = (char *) tok->value + pos;
+      in.length = tok->length - pos < chunk ? tok->length - pos : chunk;
+      maj_stat = gss_wrap_update (&min_stat, stream, &in, &piece);
+      if (GSS_ERROR (maj_stat))
+	{
+	  gss_release_wrap_stream (&min_stat, &stream);
+	  return maj_stat;
+	}
+      append (out, &piece);
+    }
+
+  maj_stat = gss_unwrap_final (&min_stat, &stream, &piece, conf_state,
+			       NULL);
+  if (stream != GSS_C_NO_WRAP_STREAM)
+    fail ("gss_unwrap_final did not release the stream\n");
+  if (!GSS_ERROR (maj_stat))
+    append (out, &piece);
+
+  return maj_stat;
+}
+
+/* Messages produced or verified in pieces must round-trip with
+   gss_wrap and gss_unwrap, also across several slices of the
+   stream.  A token whose last piece was changed must fail only when
+   the stream is finished, and be accepted again once restored.
+   Contexts that do not support streams must refuse to start one;
+   those with CFX set, which use RFC 4121 tokens, must support them. */
+static void
+test_stream (gss_ctx_id_t cctx, gss_ctx_id_t sctx, int cfx)
+{
+  static const size_t lens[] = {
+    0, 1, STREAM_SLICE - 1, STREAM_SLICE, STREAM_SLICE + 1,
+    3 * STREAM_SLICE + 100
+  };
+  static const size_t chunks[] = { 4093, STREAM_SLICE + 1 };
+  gss_uint32 maj_stat, min_stat;
+  gss_wrap_stream_t stream = GSS_C_NO_WRAP_STREAM;
+  gss_buffer_desc msg, in, piece, tok, out;
+  int conf, conf_state, conf_state2;
+  size_t i, j, pos;
+  char *data;
+
+  /* Unlike gss_wrap_init, this does not take a sequence number. */
+  maj_stat = gss_unwrap_init (&min_stat, sctx, &stream);
+  if (maj_stat == GSS_S_UNAVAILABLE)
+    {
+      if (cfx)
+	fail ("gss_unwrap_init unavailable on an RFC 4121 context\n");
+      if (stream != GSS_C_NO_WRAP_STREAM)
+	fail ("gss_unwrap_init returned a stream\n");
+      maj_stat = gss_wrap_init (&min_stat, cctx, 0, 0, NULL, &stream);
+      if (maj_stat != GSS_S_UNAVAILABLE || stream != GSS_C_NO_WRAP_STREAM)
+	fail ("gss_wrap_init status %x\n", maj_stat);
+      return;
+    }
+  if (GSS_ERROR (maj_stat))
+    {
+      fail ("gss_unwrap_init failure\n");
+      display_status ("unwrap_init", maj_stat, min_stat);
+      return;
+    }
+  gss_release_wrap_stream (&min_stat, &stream);
+
+  data = malloc (3 * STREAM_SLICE + 100);
+  if (!data)
+    {
+      fail ("malloc failure\n");
+      return;
+    }
+  fill (data, 3 * STREAM_SLICE + 100, 9);
+  msg.value = data;
+
+  for (conf = 0; conf < 2; conf++)
+    for (i = 0; i < sizeof (lens) / sizeof (lens[0]); i++)
+      for (j = 0; j < sizeof (chunks) / sizeof (chunks[0]); j++)
+	{
+	  msg.length = lens[i];
+
+	  maj_stat = gss_wrap_init (&min_stat, cctx, conf, 0, &conf_state,
+				    &stream);
+	  if (GSS_ERROR (maj_stat))
+	    {
+	      fail ("gss_wrap_init failure (%d, %d)\n", conf, (int) lens[i]);
+	      continue;
+	    }
+	  tok.value = NULL;
+	  tok.length = 0;
+	  for (pos = 0; pos < msg.length; pos += in.length)
+	    {
+	      in.value = data + pos;
+	      in.length = msg.length - pos < chunks[j]
+		? msg.length - pos : chunks[j];
+	      maj_stat = gss_wrap_update (&min_stat, stream, &in, &piece);
+	      if (GSS_ERROR (maj_stat))
+		break;
+	      append (&tok, &piece);
+	    }
+	  if (GSS_ERROR (maj_stat))
+	    {
+	      fail ("gss_wrap_update failure (%d, %d, %d)\n",
+		    conf, (int) lens[i], (int) chunks[j]);
+	      gss_release_wrap_stream (&min_stat, &stream);
+	      free (tok.value);
+	      continue;
+	    }
+	  maj_stat = gss_wrap_final (&min_stat, &stream, &piece);
+	  if (GSS_ERROR (maj_stat))
+	    {
+	      fail ("gss_wrap_final failure (%d, %d, %d)\n",
+		    conf, (int) lens[i], (int) chunks[j]);
+	      free (tok.value);
+	      continue;
+	    }
+	  append (&tok, &piece);
+
+	  conf_state2 = -1;
+	  maj_stat = gss_unwrap (&min_stat, sctx, &tok, &out, &conf_state2,
+				 NULL);
+	  if (maj_stat != GSS_S_COMPLETE)
+	    {
+	      fail ("gss_unwrap of stream failure (%d, %d, %d)\n",
+		    conf, (int) lens[i], (int) chunks[j]);
+	      display_status ("unwrap", maj_stat, min_stat);
+	    }
+	  if (!GSS_ERROR (maj_stat))
+	    {
+	      if (out.length != msg.length
+		  || memcmp (out.value, data, msg.length) != 0)
+		fail ("wrap stream+unwrap mismatch (%d, %d, %d)\n",
+		      conf, (int) lens[i], (int) chunks[j]);
+	      if (conf_state2 != conf_state)
+		fail ("gss_unwrap of stream conf_state %d (%d, %d, %d)\n",
+		      conf_state2, conf, (int) lens[i], (int) chunks[j]);
+	      gss_release_buffer (&min_stat, &out);
+	    }
+	  free (tok.value);
+
+	  maj_stat = gss_wrap (&min_stat, cctx, conf, 0, &msg, &conf_state,
+			       &tok);
+	  if (GSS_ERROR (maj_stat))
+	    {
+	      fail ("gss_wrap failure (%d, %d)\n", conf, (int) lens[i]);
+	      continue;
+	    }
+	  conf_state2 = -1;
+	  maj_stat = stream_unwrap (sctx, &tok, chunks[j], &out,
+				    &conf_state2);
+	  if (maj_stat != GSS_S_COMPLETE)
+	    fail ("stream unwrap failure (%d, %d, %d, %x)\n",
+		  conf, (int) lens[i], (int) chunks[j], maj_stat);
+	  else if (out.length != msg.length
+		   || (msg.length
+		       && memcmp (out.value, data, msg.length) != 0)
+		   || conf_state2 != conf_state)
+	    fail ("wrap+stream unwrap mismatch (%d, %d, %d)\n",
+		  conf, (int) lens[i], (int) chunks[j]);
+	  free (out.value);
+	  gss_release_buffer (&min_stat, &tok);
+
+	  maj_stat = gss_wrap (&min_stat, cctx, conf, 0, &msg, NULL, &tok);
+	  if (GSS_ERROR (maj_stat))
+	    continue;
+	  ((char *) tok.value)[tok.length - 1] ^= 1;
+	  maj_stat = stream_unwrap (sctx, &tok, chunks[j], &out, NULL);
+	  if (!GSS_ERROR (maj_stat))
+	    fail ("tampered stream token not rejected (%d, %d, %d)\n",
+		  conf, (int) lens[i], (int) chunks[j]);
+	  free (out.value);
+	  ((char *) tok.value)[tok.length - 1] ^= 1;
+	  maj_stat = stream_unwrap (sctx, &tok, chunks[j], &out, NULL);
+	  if (maj_stat != GSS_S_COMPLETE)
+	    fail ("restored stream token failure (%d, %d, %d, %x)\n",
+		  conf, (int) lens[i], (int) chunks[j], maj_stat);
+	  free (out.value);
+	  gss_release_buffer (&min_stat, &tok);
+	}
+
+  free (data);
+}
+
+/* More than the eight lanes of _gss_krb5_hmac_sha1_multi, so that
+   integrity-only AES tokens are checked in a full pass and in a
+   shorter one for the rest. */
+#define BATCH_SIZE 11
+
+/* A batch of tokens from CCTX unwrapped at SCTX in one call must
+   give each message back, sharing the arena, with one changed token
+   rejected on its own status and the others unaffected.  The changed
+   token is first among the full eight, then among the rest.  It is
+   restored and unwrapped, so the sequence is left in order. */
+static void
+test_batch (gss_ctx_id_t cctx, gss_ctx_id_t sctx)
+{
+  /* With the 16 byte header, some of these end around a SHA-1
+     block. */
+  static const size_t lens[BATCH_SIZE] = {
+    0, 1, 16, 17, 39, 40, 47, 48, 49, 100, 333
+  };
+  static const size_t bads[] = { 3, 9 };
+  gss_uint32 maj_stat, min_stat;
+  gss_uint32 statuses[BATCH_SIZE];
+  gss_buffer_desc msgs[BATCH_SIZE], toks[BATCH_SIZE], outs[BATCH_SIZE];
+  gss_buffer_desc arena, arena2, out;
+  int conf_states[BATCH_SIZE];
+  char data[BATCH_SIZE][333];
+  int conf, conf_state;
+  size_t i, sum, bad, k;
+
+  for (k = 0; k < 4; k++)
+    {
+      conf = k / 2;
+      bad = bads[k % 2];
+      for (i = 0; i < BATCH_SIZE; i++)
+	{
+	  fill (data[i], lens[i], (int) i + 11);
+	  msgs[i].value = data[i];
+	  msgs[i].length = lens[i];
+	}
+
+      maj_stat = gss_wrap_batch (&min_stat, cctx, conf, 0, BATCH_SIZE, msgs,
+				 &conf_state, toks, &arena);
+      if (maj_stat != GSS_S_COMPLETE)
+	{
+	  fail ("gss_wrap_batch failure (%d)\n", conf);
+	  display_status ("wrap_batch", maj_stat, min_stat);
+	  continue;
+	}
+      for (i = 0, sum = 0; i < BATCH_SIZE; i++)
+	{
+	  if ((char *) toks[i].value != (char *) arena.value + sum)
+	    fail ("gss_wrap_batch token %d outside arena (%d)\n",
+		  (int) i, conf);
+	  sum += toks[i].length;
+	}
+      if (sum != arena.length)
+	fail ("gss_wrap_batch arena length (%d)\n", conf);
+
+      ((char *) toks[bad].value)[toks[bad].length - 1] ^= 1;
+      maj_stat = gss_unwrap_batch (&min_stat, sctx, BATCH_SIZE, toks, outs,
+				   statuses, conf_states, &arena2);
+      if (maj_stat != GSS_S_COMPLETE)
+	{
+	  fail ("gss_unwrap_batch failure (%d)\n", conf);
+	  display_status ("unwrap_batch", maj_stat, min_stat);
+	  gss_release_buffer (&min_stat, &arena);
+	  continue;
+	}
+      for (i = 0; i < BATCH_SIZE; i++)
+	{
+	  if (i == bad)
+	    {
+	      if (!GSS_ERROR (statuses[i]) || outs[i].length != 0)
+		fail ("tampered batch token not rejected (%d, %x)\n",
+		      conf, statuses[i]);
+	      continue;
+	    }
+	  /* Tokens after the rejected one arrive early. */
+	  if (i < bad ? statuses[i] != GSS_S_COMPLETE
+	      : (statuses[i] & ~(GSS_S_GAP_TOKEN | GSS_S_UNSEQ_TOKEN)) != 0)
+	    fail ("gss_unwrap_batch token %d status %x (%d)\n",
+		  (int) i, statuses[i], conf);
+	  else if (outs[i].length != lens[i]
+		   || (lens[i]
+		       && memcmp (outs[i].value, data[i], lens[i]) != 0))
+	    fail ("wrap+unwrap_batch token %d mismatch (%d)\n",
+		  (int) i, conf);
+	  else if (conf_states[i] != conf_state)
+	    fail ("gss_unwrap_batch token %d conf_state %d (%d)\n",
+		  (int) i, conf_states[i], conf);
+	}
+      gss_release_buffer (&min_stat, &arena2);
+
+      ((char *) toks[bad].value)[toks[bad].length - 1] ^= 1;
+      maj_stat = gss_unwrap (&min_stat, sctx, &toks[bad], &out, NULL,
+			     NULL);
+      if (GSS_ERROR (maj_stat) || (maj_stat & GSS_S_DUPLICATE_TOKEN))
+	fail ("restored batch token failure (%d, %x)\n", conf, maj_stat);
+      else
+	{
+	  if (out.length != lens[bad]
+	      || memcmp (out.value, data[bad], out.length) != 0)
+	    fail ("restored batch token mismatch (%d)\n", conf);
+	  gss_release_buffer (&min_stat, &out);
+	}
+      gss_release_buffer (&min_stat, &arena);
+    }
+
+  maj_stat = gss_wrap_batch (&min_stat, cctx, 0, 0, 0, NULL, NULL, NULL,
+			     &arena);
+  if (maj_stat != GSS_S_COMPLETE || arena.length != 0)
+    fail ("gss_wrap_batch of no messages (%x)\n", maj_stat);
+  if (!GSS_ERROR (maj_stat))
+    gss_release_buffer (&min_stat, &arena);
+}
+
+#ifdef HAVE_PTHREAD_H
+
+#define WRAP_THREADS 4
+#define WRAP_TOKENS 64
+
+struct wrap_thread
+{
+  gss_ctx_id_t ctx;
+  int id;
+  int errors;
+  gss_buffer_desc tok[WRAP_TOKENS];
+};
+
+static void *
+wrap_thread (void *arg)
+{
+  struct wrap_thread *t = arg;
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc msg;
+  char data[2];
+  size_t i;
+
+  for (i = 0; i < WRAP_TOKENS; i++)
+    {
+      data[0] = (char) t->id;
+      data[1] = (char) i;
+      msg.value = data;
+      msg.length = sizeof (data);
+      maj_stat = gss_wrap (&min_stat, t->ctx, 1, 0, &msg, NULL, &t->tok[i]);
+      if (GSS_ERROR (maj_stat))
+	{
+	  t->tok[i].length = 0;
+	  t->tok[i].value = NULL;
+	  t->errors++;
+	}
+    }
+
+  return NULL;
+}
+
+/* Threads wrapping on CCTX at the same time must each get their own
+   sequence numbers, so that SCTX sees every token once, if not in
+   order.  The window is widened to hold all the tokens. */
+static void
+test_threads (gss_ctx_id_t cctx, gss_ctx_id_t sctx)
+{
+  struct wrap_thread t[WRAP_THREADS];
+  pthread_t thread[WRAP_THREADS];
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc out;
+  int n, started;
+  size_t i;
+
+  maj_stat = gss_set_replay_window (&min_stat, sctx, 1024);
+  if (GSS_ERROR (maj_stat))
+    {
+      fail ("gss_set_replay_window failure (threads)\n");
+      return;
+    }
+
+  memset (t, 0, sizeof (t));
+  for (started = 0; started < WRAP_THREADS; started++)
+    {
+      t[started].ctx = cctx;
+      t[started].id = started;
+      if (pthread_create (&thread[started], NULL, wrap_thread,
+			  &t[started]) != 0)
+	{
+	  fail ("pthread_create failure\n");
+	  break;
+	}
+    }
+  for (n = 0; n < started; n++)
+    pthread_join (thread[n], NULL);
+
+  for (n = 0; n < started; n++)
+    {
+      if (t[n].errors)
+	fail ("gss_wrap failed %d times in thread %d\n", t[n].errors, n);
+      for (i = 0; i < WRAP_TOKENS; i++)
+	{
+	  if (!t[n].tok[i].value)
+	    continue;
+	  maj_stat = gss_unwrap (&min_stat, sctx, &t[n].tok[i], &out,
+				 NULL, NULL);
+	  if (maj_stat & ~(GSS_S_GAP_TOKEN | GSS_S_UNSEQ_TOKEN))
+	    fail ("thread %d token %d gave %x\n", n, (int) i, maj_stat);
+	  if (GSS_ERROR (maj_stat))
+	    continue;
+	  if (out.length != 2 || ((char *) out.value)[0] != (char) n
+	      || ((char *) out.value)[1] != (char) i)
+	    fail ("thread %d token %d: wrong message\n", n, (int) i);
+	  gss_release_buffer (&min_stat, &out);
+	}
+      for (i = 0; i < WRAP_TOKENS; i++)
+	gss_release_buffer (&min_stat, &t[n].tok[i]);
+    }
+
+  maj_stat = gss_set_replay_window (&min_stat, sctx, 0);
+  if (GSS_ERROR (maj_stat))
+    fail ("gss_set_replay_window failure (threads 2)\n");
+}
+
+#endif
+
+/* Establish contexts to SERVICE three ways, and run the tests on
+   each.  CFX says whether the session key of its ticket has an RFC
+   4121 enctype. */
+static void
+test_service (Shishi * handle, const char *service, int cfx)
 {
   gss_uint32 maj_stat, min_stat, ret_flags, time_rec;
   gss_buffer_desc bufdesc, bufdesc2;
@@ -79,7 +1473,6 @@ main (int argc, char *argv[])
   gss_ctx_id_t cctx = GSS_C_NO_CONTEXT;
   gss_ctx_id_t sctx = GSS_C_NO_CONTEXT;
   gss_cred_id_t server_creds;
-  Shishi *handle;
   size_t i;
   struct gss_channel_bindings_struct cb;
 
@@ -87,28 +1480,9 @@ main (int argc, char *argv[])
   cb.application_data.length = 3;
   cb.application_data.value = (char *) "hej";
 
-  do
-    if (strcmp (argv[argc - 1], "-v") == 0 ||
-	strcmp (argv[argc - 1], "--verbose") == 0)
-      debug = 1;
-    else if (strcmp (argv[argc - 1], "-b") == 0 ||
-	     strcmp (argv[argc - 1], "--break-on-error") == 0)
-      break_on_error = 1;
-    else if (strcmp (argv[argc - 1], "-h") == 0 ||
-	     strcmp (argv[argc - 1], "-?") == 0 ||
-	     strcmp (argv[argc - 1], "--help") == 0)
-      {
-	printf ("Usage: %s [-vbh?] [--verbose] [--break-on-error] [--help]\n",
-		argv[0]);
-	return 1;
-      }
-  while (argc-- > 1);
-
-  handle = shishi ();
-
   /* Name of service. */
 
-  bufdesc.value = (char *) "host@latte.josefsson.org";
+  bufdesc.value = (char *) service;
   bufdesc.length = strlen (bufdesc.value);
 
   maj_stat = gss_import_name (&min_stat, &bufdesc,
@@ -353,6 +1727,21 @@ main (int argc, char *argv[])
 	gss_release_buffer (&min_stat, &pt2);
       }
 
+      test_mic (cctx, sctx);
+      test_wrap (cctx, sctx);
+      test_replay (cctx, sctx);
+#ifdef HAVE_PTHREAD_H
+      test_threads (cctx, sctx);
+#endif
+      test_wrap_size (cctx, sctx);
+      test_into (cctx, sctx);
+      test_framing (cctx, sctx);
+      test_inplace (cctx, sctx);
+      test_iov (cctx, sctx, cfx);
+      test_stream (cctx, sctx, cfx);
+      test_batch (cctx, sctx);
+      test_tamper (cctx, sctx, cfx);
+
       maj_stat = gss_delete_sec_context (&min_stat, &cctx, GSS_C_NO_BUFFER);
       if (GSS_ERROR (maj_stat))
 	{
@@ -367,7 +1756,7 @@ main (int argc, char *argv[])
 	  display_status ("server delete_sec_context", maj_stat, min_stat);
 	}
 
-      success ("loop %d ok\n", (int) i);
+      success ("%s loop %d ok\n", service, (int) i);
     }
 
   /* Clean up. */
@@ -385,6 +1774,48 @@ main (int argc, char *argv[])
       fail ("gss_release_name failure\n");
       display_status ("gss_release_name", maj_stat, min_stat);
     }
+}
+
+int
+main (int argc, char *argv[])
+{
+  /* There is a ticket and a host key for each, see krb5context.tkt
+     and krb5context.key. */
+  static const struct
+  {
+    const char *name;
+    int cfx;
+  } services[] =
+  {
+    {"host@latte.josefsson.org", 0},	/* des-cbc-md5 */
+    {"host@des3.josefsson.org", 0},	/* des3-cbc-sha1-kd */
+    {"host@aes128.josefsson.org", 1},	/* aes128-cts-hmac-sha1-96 */
+    {"host@aes256.josefsson.org", 1}	/* aes256-cts-hmac-sha1-96 */
+  };
+  Shishi *handle;
+  size_t i;
+
+  do
+    if (strcmp (argv[argc - 1], "-v") == 0 ||
+	strcmp (argv[argc - 1], "--verbose") == 0)
+      debug = 1;
+    else if (strcmp (argv[argc - 1], "-b") == 0 ||
+	     strcmp (argv[argc - 1], "--break-on-error") == 0)
+      break_on_error = 1;
+    else if (strcmp (argv[argc - 1], "-h") == 0 ||
+	     strcmp (argv[argc - 1], "-?") == 0 ||
+	     strcmp (argv[argc - 1], "--help") == 0)
+      {
+	printf ("Usage: %s [-vbh?] [--verbose] [--break-on-error] [--help]\n",
+		argv[0]);
+	return 1;
+      }
+  while (argc-- > 1);
+
+  handle = shishi ();
+
+  for (i = 0; i < sizeof (services) / sizeof (services[0]); i++)
+    test_service (handle, services[i].name, services[i].cfx);
 
   shishi_done (handle);
 
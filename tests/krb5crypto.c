@@ -0,0 +1,432 @@
+/* krb5crypto.c --- Known answer tests for the Krb5 GSS crypto code.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+
+/* Get Shishi prototypes. */
+#include <shishi.h>
+
+/* The per-message crypto of the Kerberos V5 mechanism. */
+#include "cipher.h"
+#include "digest.h"
+#include "hmac.h"
+
+#include "utils.c"
+
+/* RFC 3962 appendix B. */
+static const char cts_key[] = "chicken teriyaki";
+static const char cts_msg[] =
+  "I would like the General Gau's Chicken, please, and wonton soup.";
+static const struct
+{
+  size_t len;
+  const char *out;
+} cts_tv[] = {
+  {17, "c6353568f2bf8cb4d8a580362da7ff7f97"},
+  {31, "fc00783e0efdb2c1d445d4c8eff7ed2297687268d6ecccc0c07b25e25ecfe5"},
+  {32, "39312523a78662d5be7fcbcc98ebf5a897687268d6ecccc0c07b25e25ecfe584"},
+  {47, "97687268d6ecccc0c07b25e25ecfe584b3fffd940c16a18c1b5549d2f838029e"
+   "39312523a78662d5be7fcbcc98ebf5"},
+  {48, "97687268d6ecccc0c07b25e25ecfe5849dad8bbb96c4cdc03bc103e1a194bbd8"
+   "39312523a78662d5be7fcbcc98ebf5a8"},
+  {64, "97687268d6ecccc0c07b25e25ecfe58439312523a78662d5be7fcbcc98ebf5a8"
+   "4807efe836ee89a526730dbc2f7bc8409dad8bbb96c4cdc03bc103e1a194bbd8"}
+};
+
+/* RFC 2202 section 3, test cases 1, 2, 3 and 6. */
+static const struct
+{
+  int keybyte;
+  size_t keylen;
+  const char *key;
+  int databyte;
+  size_t datalen;
+  const char *data;
+  const char *digest;
+} hmac_tv[] = {
+  {0x0b, 20, NULL, 0, 8, "Hi There",
+   "b617318655057264e28bc0b6fb378c8ef146be00"},
+  {0, 4, "Jefe", 0, 28, "what do ya want for nothing?",
+   "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79"},
+  {0xaa, 20, NULL, 0xdd, 50, NULL,
+   "125d7342b9ac11cd91a39af48aa17b4f63f175d3"},
+  {0xaa, 80, NULL, 0, 54,
+   "Test Using Larger Than Block-Size Key - Hash Key First",
+   "aa4ae5e15272d00e95705637ce8a3b55ed402112"}
+};
+
+static void
+unhex (const char *hex, char *out)
+{
+  unsigned int c;
+
+  for (; *hex; hex += 2)
+    {
+      sscanf (hex, "%2x", &c);
+      *out++ = c;
+    }
+}
+
+static void
+fill (char *buf, size_t len, int seed)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    buf[i] = (i * 31 + seed * 7 + (i >> 8)) & 0xFF;
+}
+
+static void
+test_vectors (Shishi * sh)
+{
+  _gss_krb5_aes_key aes;
+  Shishi_key *key;
+  char iv[16], expect[64], out[64];
+  size_t i;
+  int rc;
+
+  rc = shishi_key_from_value (sh, SHISHI_AES128_CTS_HMAC_SHA1_96,
+			      cts_key, &key);
+  if (rc != SHISHI_OK)
+    {
+      fail ("shishi_key_from_value() failed (%d)\n", rc);
+      return;
+    }
+  _gss_krb5_aes_init (&aes, key);
+
+  memset (iv, 0, sizeof (iv));
+  for (i = 0; i < sizeof (cts_tv) / sizeof (cts_tv[0]); i++)
+    {
+      unhex (cts_tv[i].out, expect);
+
+      rc = _gss_krb5_aes_cts (sh, &aes, 0, iv, cts_msg, out, cts_tv[i].len);
+      if (rc == SHISHI_OK && memcmp (out, expect, cts_tv[i].len) == 0)
+	success ("AES-CTS encrypt %lu OK\n", (unsigned long) cts_tv[i].len);
+      else
+	fail ("AES-CTS encrypt %lu failed (%d)\n",
+	      (unsigned long) cts_tv[i].len, rc);
+
+      rc = _gss_krb5_aes_cts (sh, &aes, 1, iv, out, out, cts_tv[i].len);
+      if (rc == SHISHI_OK && memcmp (out, cts_msg, cts_tv[i].len) == 0)
+	success ("AES-CTS decrypt %lu OK\n", (unsigned long) cts_tv[i].len);
+      else
+	fail ("AES-CTS decrypt %lu failed (%d)\n",
+	      (unsigned long) cts_tv[i].len, rc);
+    }
+
+  _gss_krb5_aes_done (&aes);
+
+  for (i = 0; i < sizeof (hmac_tv) / sizeof (hmac_tv[0]); i++)
+    {
+      _gss_krb5_hmac_sha1_ctx hmac;
+      char k[80], data[64], digest[_GSS_KRB5_SHA1_LEN];
+
+      if (hmac_tv[i].key)
+	memcpy (k, hmac_tv[i].key, hmac_tv[i].keylen);
+      else
+	memset (k, hmac_tv[i].keybyte, hmac_tv[i].keylen);
+      if (hmac_tv[i].data)
+	memcpy (data, hmac_tv[i].data, hmac_tv[i].datalen);
+      else
+	memset (data, hmac_tv[i].databyte, hmac_tv[i].datalen);
+      unhex (hmac_tv[i].digest, expect);
+
+      _gss_krb5_hmac_sha1_init (&hmac, k, hmac_tv[i].keylen);
+      _gss_krb5_hmac_sha1_update (&hmac, data, hmac_tv[i].datalen);
+      _gss_krb5_hmac_sha1_final (&hmac, digest);
+      if (memcmp (digest, expect, sizeof (digest)) == 0)
+	success ("HMAC-SHA1 %lu OK\n", (unsigned long) i);
+      else
+	fail ("HMAC-SHA1 %lu failed\n", (unsigned long) i);
+    }
+}
+
+/* Compare the encryption of LEN bytes with KEYLEN bytes of key
+   against Shishi, with and without a chaining value. */
+static void
+test_cts (Shishi * sh, size_t keylen, size_t len)
+{
+  _gss_krb5_aes_key aes;
+  Shishi_key *key;
+  char k[32], iv[16], *in, *out, *ref;
+  int rc, withiv;
+
+  fill (k, keylen, 1);
+  rc = shishi_key_from_value (sh, keylen == 16
+			      ? SHISHI_AES128_CTS_HMAC_SHA1_96
+			      : SHISHI_AES256_CTS_HMAC_SHA1_96, k, &key);
+  if (rc != SHISHI_OK)
+    {
+      fail ("shishi_key_from_value() failed (%d)\n", rc);
+      return;
+    }
+  _gss_krb5_aes_init (&aes, key);
+
+  in = malloc (len);
+  out = malloc (len);
+  if (!in || !out)
+    {
+      fail ("malloc() failed\n");
+      free (in);
+      free (out);
+      _gss_krb5_aes_done (&aes);
+      return;
+    }
+  fill (in, len, (int) len);
+
+  for (withiv = 0; withiv < 2; withiv++)
+    {
+      memset (iv, 0, sizeof (iv));
+      if (withiv)
+	fill (iv, sizeof (iv), 3);
+
+      rc = shishi_aes_cts (sh, 0, k, keylen, iv, NULL, in, len, &ref);
+      if (rc != SHISHI_OK)
+	{
+	  fail ("shishi_aes_cts() failed (%d)\n", rc);
+	  continue;
+	}
+      rc = _gss_krb5_aes_cts (sh, &aes, 0, iv, in, out, len);
+      if (rc != SHISHI_OK || memcmp (out, ref, len) != 0)
+	fail ("AES-CTS encrypt %lu/%lu/%d differs from Shishi\n",
+	      (unsigned long) keylen, (unsigned long) len, withiv);
+      free (ref);
+
+      rc = _gss_krb5_aes_cts (sh, &aes, 1, iv, out, out, len);
+      if (rc != SHISHI_OK || memcmp (out, in, len) != 0)
+	fail ("AES-CTS decrypt %lu/%lu/%d failed\n",
+	      (unsigned long) keylen, (unsigned long) len, withiv);
+    }
+
+  /* CBC over whole blocks is CTS with the last two blocks swapped,
+     and continues where the previous call stopped. */
+  if (len % 16 == 0 && len >= 32)
+    {
+      size_t half = len / 32 * 16;
+
+      rc = shishi_aes_cts (sh, 0, k, keylen, NULL, NULL, in, len, &ref);
+      if (rc != SHISHI_OK)
+	fail ("shishi_aes_cts() failed (%d)\n", rc);
+      else
+	{
+	  memset (iv, 0, sizeof (iv));
+	  rc = _gss_krb5_aes_cbc (sh, &aes, 0, iv, in, out, half);
+	  if (rc == SHISHI_OK)
+	    rc = _gss_krb5_aes_cbc (sh, &aes, 0, iv, in + half, out + half,
+				    len - half);
+	  if (rc != SHISHI_OK
+	      || memcmp (out, ref, len - 32) != 0
+	      || memcmp (out + len - 32, ref + len - 16, 16) != 0
+	      || memcmp (out + len - 16, ref + len - 32, 16) != 0
+	      || memcmp (iv, out + len - 16, 16) != 0)
+	    fail ("AES-CBC encrypt %lu/%lu differs from Shishi\n",
+		  (unsigned long) keylen, (unsigned long) len);
+	  free (ref);
+
+	  memset (iv, 0, sizeof (iv));
+	  rc = _gss_krb5_aes_cbc (sh, &aes, 1, iv, out, out, len);
+	  if (rc != SHISHI_OK || memcmp (out, in, len) != 0)
+	    fail ("AES-CBC decrypt %lu/%lu failed\n",
+		  (unsigned long) keylen, (unsigned long) len);
+	}
+    }
+
+  free (in);
+  free (out);
+  _gss_krb5_aes_done (&aes);
+}
+
+/* Compare HMAC-SHA1 of LEN bytes, fed in pieces of CHUNK bytes,
+   against Shishi and the one-shot gnulib function. */
+static void
+test_hmac (Shishi * sh, size_t keylen, size_t len, size_t chunk)
+{
+  _gss_krb5_hmac_sha1_ctx hmac;
+  char k[100], *in, digest[_GSS_KRB5_SHA1_LEN], *ref;
+  char ref1[_GSS_KRB5_SHA1_LEN];
+  size_t i;
+  int rc;
+
+  in = malloc (len + 1);
+  if (!in)
+    {
+      fail ("malloc() failed\n");
+      return;
+    }
+  fill (k, keylen, 5);
+  fill (in, len, 7);
+
+  _gss_krb5_hmac_sha1_init (&hmac, k, keylen);
+  for (i = 0; i < len; i += chunk)
+    _gss_krb5_hmac_sha1_update (&hmac, in + i,
+				len - i < chunk ? len - i : chunk);
+  _gss_krb5_hmac_sha1_final (&hmac, digest);
+
+  hmac_sha1 (k, keylen, in, len, ref1);
+  if (memcmp (digest, ref1, sizeof (digest)) != 0)
+    fail ("HMAC-SHA1 %lu/%lu/%lu differs from gnulib\n",
+	  (unsigned long) keylen, (unsigned long) len, (unsigned long) chunk);
+
+  rc = shishi_hmac_sha1 (sh, k, keylen, in, len, &ref);
+  if (rc != SHISHI_OK)
+    fail ("shishi_hmac_sha1() failed (%d)\n", rc);
+  else
+    {
+      if (memcmp (digest, ref, sizeof (digest)) != 0)
+	fail ("HMAC-SHA1 %lu/%lu/%lu differs from Shishi\n",
+	      (unsigned long) keylen, (unsigned long) len,
+	      (unsigned long) chunk);
+      free (ref);
+    }
+
+  free (in);
+}
+
+/* Compare COUNT HMAC-SHA1 computations done together, over messages
+   of different lengths, with doing them one by one. */
+static void
+test_multi (size_t count, size_t maxlen)
+{
+  _gss_krb5_hmac_sha1_ctx keys[3], hmac;
+  _gss_krb5_hmac_sha1_job jobs[20];
+  char k[3][32], *in, tail[16], digest[_GSS_KRB5_SHA1_LEN];
+  size_t i;
+
+  in = malloc (maxlen + 1);
+  if (!in)
+    {
+      fail ("malloc() failed\n");
+      return;
+    }
+  fill (in, maxlen, 9);
+  fill (tail, sizeof (tail), 11);
+
+  for (i = 0; i < 3; i++)
+    {
+      fill (k[i], sizeof (k[i]), (int) i);
+      _gss_krb5_hmac_sha1_init (&keys[i], k[i], 16 + 8 * i);
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      jobs[i].key = &keys[i % 3];
+      jobs[i].data = in + i;
+      jobs[i].len = (i * 37 + count) % (maxlen - i);
+      jobs[i].tail = tail;
+      jobs[i].taillen = i % 2 ? 0 : (i * 5) % 17;
+    }
+
+  _gss_krb5_hmac_sha1_multi (jobs, count);
+
+  for (i = 0; i < count; i++)
+    {
+      hmac = *jobs[i].key;
+      _gss_krb5_hmac_sha1_update (&hmac, jobs[i].data, jobs[i].len);
+      _gss_krb5_hmac_sha1_update (&hmac, jobs[i].tail, jobs[i].taillen);
+      _gss_krb5_hmac_sha1_final (&hmac, digest);
+      if (memcmp (digest, jobs[i].digest, sizeof (digest)) != 0)
+	fail ("HMAC-SHA1 job %lu of %lu differs\n", (unsigned long) i,
+	      (unsigned long) count);
+    }
+
+  free (in);
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const size_t lens[] = {
+    16, 17, 31, 32, 33, 47, 48, 63, 64, 65, 80, 96, 127, 128, 129,
+    1024, 4096 + 17, 65536
+  };
+  Shishi *sh;
+  size_t i, k;
+  int features;
+
+  do
+    if (strcmp (argv[argc - 1], "-v") == 0 ||
+	strcmp (argv[argc - 1], "--verbose") == 0)
+      debug = 1;
+    else if (strcmp (argv[argc - 1], "-b") == 0 ||
+	     strcmp (argv[argc - 1], "--break-on-error") == 0)
+      break_on_error = 1;
+    else if (strcmp (argv[argc - 1], "-h") == 0 ||
+	     strcmp (argv[argc - 1], "-?") == 0 ||
+	     strcmp (argv[argc - 1], "--help") == 0)
+      {
+	printf ("Usage: %s [-vbh?] [--verbose] [--break-on-error] [--help]\n",
+		argv[0]);
+	return 1;
+      }
+  while (argc-- > 1);
+
+  sh = shishi ();
+  if (!sh)
+    {
+      fail ("shishi() failed\n");
+      return 1;
+    }
+
+  features = _gss_krb5_cpu_features ();
+  success ("AES provider %s, SHA-1 %s, multi-buffer HMAC %s\n",
+	   _gss_krb5_cipher_provider (),
+	   features & _GSS_KRB5_CPU_SHA ? "sha-ni" : "generic",
+	   features & _GSS_KRB5_CPU_AVX2 ? "avx2" : "serial");
+
+  test_vectors (sh);
+
+  for (k = 16; k <= 32; k += 16)
+    for (i = 0; i < sizeof (lens) / sizeof (lens[0]); i++)
+      test_cts (sh, k, lens[i]);
+  success ("AES-CTS and AES-CBC match Shishi\n");
+
+  for (k = 0; k <= 100; k += 25)
+    for (i = 0; i < 300; i += 7)
+      {
+	test_hmac (sh, k, i, 1);
+	test_hmac (sh, k, i, 64);
+	test_hmac (sh, k, i, 100);
+      }
+  test_hmac (sh, 20, 65536 + 3, 4096);
+  success ("HMAC-SHA1 matches Shishi\n");
+
+  for (i = 1; i <= 20; i++)
+    {
+      test_multi (i, 200);
+      test_multi (i, 1100);
+    }
+  success ("Multi-buffer HMAC-SHA1 OK\n");
+
+  shishi_done (sh);
+
+  if (debug)
+    printf ("Kerberos V5 crypto self tests done with %d errors\n",
+	    error_count);
+
+  return error_count ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+/* mechconf.c --- Test of mechanisms loaded from modules.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+
+/* Get GSS prototypes. */
+#include <gss.h>
+
+#include "utils.c"
+
+#define CONFIG "mechconf.conf"
+
+/* The mechanism of mechmodule.c. */
+static gss_OID_desc test_oid = {
+  9, (void *) "\x2b\x06\x01\x04\x01\xda\x47\xa4\x67"
+};
+
+int
+main (int argc, char *argv[])
+{
+  gss_uint32 maj_stat, min_stat;
+  gss_buffer_desc bufdesc;
+  gss_OID_set mechs;
+  gss_cred_id_t cred;
+  gss_OID oid;
+  size_t i, n;
+  FILE *fh;
+
+  do
+    if (strcmp (argv[argc - 1], "-v") == 0 ||
+	strcmp (argv[argc - 1], "--verbose") == 0)
+      debug = 1;
+    else if (strcmp (argv[argc - 1], "-b") == 0 ||
+	     strcmp (argv[argc - 1], "--break-on-error") == 0)
+      break_on_error = 1;
+    else if (strcmp (argv[argc - 1], "-h") == 0 ||
+	     strcmp (argv[argc - 1], "-?") == 0 ||
+	     strcmp (argv[argc - 1], "--help") == 0)
+      {
+	printf ("Usage: %s [-vbh?] [--verbose] [--break-on-error] [--help]\n",
+		argv[0]);
+	return 1;
+      }
+  while (argc-- > 1);
+
+  /* Modules that cannot be loaded, and a second module for the same
+     mechanism, are skipped.  The default names the module, which is
+     only loaded after it. */
+  fh = fopen (CONFIG, "w");
+  if (!fh)
+    {
+      fail ("cannot write " CONFIG "\n");
+      return 1;
+    }
+  fprintf (fh, "# Test configuration.\n"
+	   "default GSS-TEST\n"
+	   "\n"
+	   "module /nonexistent/mechmodule.so\n"
+	   "  module\t%s  \n" "module %s\n", MECHMODULE, MECHMODULE);
+  fclose (fh);
+  setenv ("GSS_MECH_CONFIG", CONFIG, 1);
+
+  maj_stat = gss_indicate_mechs (&min_stat, &mechs);
+  if (maj_stat == GSS_S_COMPLETE)
+    success ("gss_indicate_mechs() OK\n");
+  else
+    fail ("gss_indicate_mechs() failed (%d,%d)\n", maj_stat, min_stat);
+
+  for (i = 0, n = 0; maj_stat == GSS_S_COMPLETE && i < mechs->count; i++)
+    if (gss_oid_equal (&mechs->elements[i], &test_oid))
+      n++;
+  if (n == 1)
+    success ("module mechanism listed once\n");
+  else
+    fail ("module mechanism listed %lu times\n", (unsigned long) n);
+  if (maj_stat == GSS_S_COMPLETE)
+    gss_release_oid_set (&min_stat, &mechs);
+
+  bufdesc.value = (void *) "GSS-TEST";
+  bufdesc.length = 8;
+  maj_stat = gss_inquire_mech_for_saslname (&min_stat, &bufdesc, &oid);
+  if (maj_stat == GSS_S_COMPLETE && gss_oid_equal (oid, &test_oid))
+    success ("gss_inquire_mech_for_saslname (GSS-TEST) OK\n");
+  else
+    fail ("gss_inquire_mech_for_saslname (GSS-TEST) failed (%d,%d)\n",
+	  maj_stat, min_stat);
+
+  maj_stat = gss_inquire_saslname_for_mech (&min_stat, &test_oid,
+					    &bufdesc, NULL, NULL);
+  if (maj_stat == GSS_S_COMPLETE && bufdesc.length == 8
+      && memcmp (bufdesc.value, "GSS-TEST", 8) == 0)
+    success ("gss_inquire_saslname_for_mech (test) OK\n");
+  else
+    fail ("gss_inquire_saslname_for_mech (test) failed (%d,%d)\n",
+	  maj_stat, min_stat);
+  if (maj_stat == GSS_S_COMPLETE)
+    gss_release_buffer (&min_stat, &bufdesc);
+
+  /* The module's gss_acquire_cred fails with minor status 4711. */
+  maj_stat = gss_acquire_cred (&min_stat, GSS_C_NO_NAME, GSS_C_INDEFINITE,
+			       GSS_C_NO_OID_SET, GSS_C_INITIATE, &cred,
+			       NULL, NULL);
+  if (maj_stat == GSS_S_UNAVAILABLE && min_stat == 4711)
+    success ("default mechanism OK\n");
+  else
+    fail ("default mechanism not used (%d,%d)\n", maj_stat, min_stat);
+
+  remove (CONFIG);
+
+  if (debug)
+    printf ("Mechanism module self tests done with %d errors\n",
+	    error_count);
+
+  return error_count ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+/* mechmodule.c --- Mechanism module used by the mechconf self test.
+ * Copyright (C) 2026 Simon Josefsson
+ *
+ * This file is part of the Generic Security Service (GSS).
+ *
+ * GSS is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GSS is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GSS; if not, see http://www.gnu.org/licenses or write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth
+ * Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stddef.h>
+
+#include "meta.h"
+
+/* A mechanism that does nothing, except that acquiring a credential
+   fails with minor status 4711 so that the test can tell it was
+   used.  Its OID is 1.3.6.1.4.1.11591.4711. */
+
+static gss_OID_desc mechmodule_oid = {
+  9, (void *) "\x2b\x06\x01\x04\x01\xda\x47\xa4\x67"
+};
+
+static OM_uint32
+mm_init_sec_context (OM_uint32 * minor_status,
+		     const gss_cred_id_t initiator_cred_handle,
+		     gss_ctx_id_t * context_handle,
+		     const gss_name_t target_name,
+		     const gss_OID mech_type,
+		     OM_uint32 req_flags,
+		     OM_uint32 time_req,
+		     const gss_channel_bindings_t input_chan_bindings,
+		     const gss_buffer_t input_token,
+		     gss_OID * actual_mech_type,
+		     gss_buffer_t output_token,
+		     OM_uint32 * ret_flags, OM_uint32 * time_rec)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_canonicalize_name (OM_uint32 * minor_status,
+		      const gss_name_t input_name,
+		      const gss_OID mech_type, gss_name_t * output_name)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_export_name (OM_uint32 * minor_status,
+		const gss_name_t input_name, gss_buffer_t exported_name)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_wrap (OM_uint32 * minor_status,
+	 const gss_ctx_id_t context_handle,
+	 int conf_req_flag,
+	 gss_qop_t qop_req,
+	 const gss_buffer_t input_message_buffer,
+	 int *conf_state, gss_buffer_t output_message_buffer)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_unwrap (OM_uint32 * minor_status,
+	   const gss_ctx_id_t context_handle,
+	   const gss_buffer_t input_message_buffer,
+	   gss_buffer_t output_message_buffer,
+	   int *conf_state, gss_qop_t * qop_state)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_get_mic (OM_uint32 * minor_status,
+	    const gss_ctx_id_t context_handle,
+	    gss_qop_t qop_req,
+	    const gss_buffer_t message_buffer, gss_buffer_t message_token)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_verify_mic (OM_uint32 * minor_status,
+	       const gss_ctx_id_t context_handle,
+	       const gss_buffer_t message_buffer,
+	       const gss_buffer_t token_buffer, gss_qop_t * qop_state)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_display_status (OM_uint32 * minor_status,
+		   OM_uint32 status_value,
+		   int status_type,
+		   const gss_OID mech_type,
+		   OM_uint32 * message_context, gss_buffer_t status_string)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_acquire_cred (OM_uint32 * minor_status,
+		 const gss_name_t desired_name,
+		 OM_uint32 time_req,
+		 const gss_OID_set desired_mechs,
+		 gss_cred_usage_t cred_usage,
+		 gss_cred_id_t * output_cred_handle,
+		 gss_OID_set * actual_mechs, OM_uint32 * time_rec)
+{
+  if (minor_status)
+    *minor_status = 4711;
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_release_cred (OM_uint32 * minor_status, gss_cred_id_t * cred_handle)
+{
+  return GSS_S_COMPLETE;
+}
+
+static OM_uint32
+mm_accept_sec_context (OM_uint32 * minor_status,
+		       gss_ctx_id_t * context_handle,
+		       const gss_cred_id_t acceptor_cred_handle,
+		       const gss_buffer_t input_token_buffer,
+		       const gss_channel_bindings_t input_chan_bindings,
+		       gss_name_t * src_name,
+		       gss_OID * mech_type,
+		       gss_buffer_t output_token,
+		       OM_uint32 * ret_flags,
+		       OM_uint32 * time_rec,
+		       gss_cred_id_t * delegated_cred_handle)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_delete_sec_context (OM_uint32 * minor_status,
+		       gss_ctx_id_t * context_handle,
+		       gss_buffer_t output_token)
+{
+  return GSS_S_COMPLETE;
+}
+
+static OM_uint32
+mm_context_time (OM_uint32 * minor_status,
+		 const gss_ctx_id_t context_handle, OM_uint32 * time_rec)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_inquire_cred (OM_uint32 * minor_status,
+		 const gss_cred_id_t cred_handle,
+		 gss_name_t * name,
+		 OM_uint32 * lifetime,
+		 gss_cred_usage_t * cred_usage, gss_OID_set * mechanisms)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+static OM_uint32
+mm_inquire_cred_by_mech (OM_uint32 * minor_status,
+			 const gss_cred_id_t cred_handle,
+			 const gss_OID mech_type,
+			 gss_name_t * name,
+			 OM_uint32 * initiator_lifetime,
+			 OM_uint32 * acceptor_lifetime,
+			 gss_cred_usage_t * cred_usage)
+{
+  return GSS_S_UNAVAILABLE;
+}
+
+/* The extensions are left NULL. */
+static _gss_mech_api_desc mechmodule = {
+  .mech = &mechmodule_oid,
+  .sasl_name = "GSS-TEST",
+  .mech_name = "Test",
+  .mech_description = "Mechanism module for self tests",
+  .init_sec_context = mm_init_sec_context,
+  .canonicalize_name = mm_canonicalize_name,
+  .export_name = mm_export_name,
+  .wrap = mm_wrap,
+  .unwrap = mm_unwrap,
+  .get_mic = mm_get_mic,
+  .verify_mic = mm_verify_mic,
+  .display_status = mm_display_status,
+  .acquire_cred = mm_acquire_cred,
+  .release_cred = mm_release_cred,
+  .accept_sec_context = mm_accept_sec_context,
+  .delete_sec_context = mm_delete_sec_context,
+  .context_time = mm_context_time,
+  .inquire_cred = mm_inquire_cred,
+  .inquire_cred_by_mech = mm_inquire_cred_by_mech
+};
+
+extern _gss_mech_api_t gss_mech_module (unsigned int version);
+
+_gss_mech_api_t
+gss_mech_module (unsigned int version)
+{
+  if (version != _GSS_MECH_MODULE_VERSION)
+    return NULL;
+
+  return &mechmodule;
+}